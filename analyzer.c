@@ -0,0 +1,453 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <glib.h>
+
+#include "trace.h"
+#include "analyzer.h"
+
+// Concurrency is tracked at no finer than one second, and in no more than this many intervals
+#define MAX_INTERVALS 3600
+
+// Number of rows printed for the concurrency over time and top paths
+#define PRINTED_INTERVALS 60
+#define PRINTED_PATHS 20
+
+/* Per-thread partial aggregates
+ * The path table maps each tracked path to its position in the min-heap of path counts
+ */
+struct analyzer_worker {
+    pthread_t thread;
+    struct trace_stats * stats;
+    GHashTable * path_index;
+    GHashTable * last_opcodes;
+};
+
+static struct trace_reader * analyzer_reader = NULL;
+static pthread_mutex_t next_segment_lock = PTHREAD_MUTEX_INITIALIZER;
+static int next_segment = 0;
+
+static int latencyBucket(uint64_t ns) {
+    if(ns < LATENCY_SUB_BUCKETS) return ns;
+    int msb = 63 - __builtin_clzll(ns);
+    int sub = (ns >> (msb - 2)) & (LATENCY_SUB_BUCKETS - 1);
+    return (msb - 1) * LATENCY_SUB_BUCKETS + sub;
+}
+
+// Smallest latency which falls in a bucket
+uint64_t latencyBucketValue(int bucket) {
+    if(bucket < LATENCY_SUB_BUCKETS) return bucket;
+    int msb = bucket / LATENCY_SUB_BUCKETS + 1;
+    int sub = bucket % LATENCY_SUB_BUCKETS;
+    return (uint64_t) (LATENCY_SUB_BUCKETS + sub) << (msb - 2);
+}
+
+static int sizeBucket(uint64_t bytes) {
+    if(bytes == 0) return 0;
+    return 64 - __builtin_clzll(bytes);
+}
+
+// Upper bound of the bucket containing the given percentile
+uint64_t latencyPercentile(const uint64_t * latency, uint64_t count, double percentile) {
+    if(count == 0) return 0;
+    uint64_t target = (uint64_t) (percentile * count);
+    if(target >= count) target = count - 1;
+    uint64_t seen = 0;
+    for(int b = 0; b < LATENCY_BUCKETS; b++) {
+        seen += latency[b];
+        if(seen > target) {
+            return b + 1 < LATENCY_BUCKETS ? latencyBucketValue(b + 1) : UINT64_MAX;
+        }
+    }
+    return UINT64_MAX;
+}
+
+static struct trace_stats * createTraceStats(int64_t concurrency_start, int64_t concurrency_interval, int num_intervals) {
+    struct trace_stats * stats = calloc(1, sizeof(*stats));
+    stats->min_timestamp = INT64_MAX;
+    stats->max_timestamp = INT64_MIN;
+    stats->concurrency_start = concurrency_start;
+    stats->concurrency_interval = concurrency_interval;
+    stats->num_intervals = num_intervals;
+    stats->busy = calloc(num_intervals, sizeof(*stats->busy));
+    return stats;
+}
+
+void freeTraceStats(struct trace_stats * stats) {
+    if(stats == NULL) return;
+    for(int i = 0; i < stats->num_paths; i++) {
+        free(stats->paths[i].path);
+    }
+    free(stats->busy);
+    free(stats);
+}
+
+static void swapPaths(struct analyzer_worker * worker, int a, int b) {
+    struct path_count * paths = worker->stats->paths;
+    struct path_count tmp = paths[a];
+    paths[a] = paths[b];
+    paths[b] = tmp;
+    g_hash_table_insert(worker->path_index, paths[a].path, GINT_TO_POINTER(a + 1));
+    g_hash_table_insert(worker->path_index, paths[b].path, GINT_TO_POINTER(b + 1));
+}
+
+// Restore the min-heap after the count at position i has grown
+static void siftDownPath(struct analyzer_worker * worker, int i) {
+    struct path_count * paths = worker->stats->paths;
+    int n = worker->stats->num_paths;
+    while(TRUE) {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = 2 * i + 2;
+        if(left < n && paths[left].count < paths[smallest].count) smallest = left;
+        if(right < n && paths[right].count < paths[smallest].count) smallest = right;
+        if(smallest == i) break;
+        swapPaths(worker, i, smallest);
+        i = smallest;
+    }
+}
+
+static void siftUpPath(struct analyzer_worker * worker, int i) {
+    struct path_count * paths = worker->stats->paths;
+    while(i > 0 && paths[(i - 1) / 2].count > paths[i].count) {
+        swapPaths(worker, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+// Space-saving: an untracked path replaces the least common one, inheriting its count as the error
+static void countPath(struct analyzer_worker * worker, const char * path) {
+    struct trace_stats * stats = worker->stats;
+    int idx = GPOINTER_TO_INT(g_hash_table_lookup(worker->path_index, path)) - 1;
+    if(idx < 0) {
+        if(stats->num_paths < TOP_PATHS_CAPACITY) {
+            idx = stats->num_paths++;
+            stats->paths[idx].count = 0;
+            stats->paths[idx].error = 0;
+        } else {
+            idx = 0;
+            g_hash_table_remove(worker->path_index, stats->paths[idx].path);
+            free(stats->paths[idx].path);
+            stats->paths[idx].error = stats->paths[idx].count;
+        }
+        stats->paths[idx].path = malloc(strlen(path) + 1);
+        strcpy(stats->paths[idx].path, path);
+        g_hash_table_insert(worker->path_index, stats->paths[idx].path, GINT_TO_POINTER(idx + 1));
+        siftUpPath(worker, idx);
+        idx = GPOINTER_TO_INT(g_hash_table_lookup(worker->path_index, path)) - 1;
+    }
+    stats->paths[idx].count++;
+    siftDownPath(worker, idx);
+}
+
+// Spread the time a call spent in the filesystem over the intervals it overlaps
+static void addBusyTime(struct trace_stats * stats, int64_t start, int64_t end) {
+    if(stats->num_intervals == 0) return;
+    int64_t first = (start - stats->concurrency_start) / stats->concurrency_interval;
+    int64_t last = (end - stats->concurrency_start) / stats->concurrency_interval;
+    if(first < 0) first = 0;
+    if(last >= stats->num_intervals) last = stats->num_intervals - 1;
+    for(int64_t i = first; i <= last; i++) {
+        int64_t interval_start = stats->concurrency_start + i * stats->concurrency_interval;
+        int64_t interval_end = interval_start + stats->concurrency_interval;
+        int64_t overlap_start = start > interval_start ? start : interval_start;
+        int64_t overlap_end = end < interval_end ? end : interval_end;
+        if(overlap_end > overlap_start) {
+            stats->busy[i] += overlap_end - overlap_start;
+        }
+    }
+}
+
+static bool isTransferOp(int opcode) {
+    const char * name = traceOpName(opcode);
+    return strcmp(name, "read") == 0 || strcmp(name, "write") == 0
+        || strcmp(name, "read_buf") == 0 || strcmp(name, "write_buf") == 0;
+}
+
+static void analyzeRecord(struct analyzer_worker * worker, const struct trace_record * rec) {
+    struct trace_stats * stats = worker->stats;
+    struct op_stats * op = &stats->ops[rec->opcode];
+    stats->records++;
+    if(rec->timestamp < stats->min_timestamp) stats->min_timestamp = rec->timestamp;
+    if(rec->timestamp > stats->max_timestamp) stats->max_timestamp = rec->timestamp;
+
+    if(rec->type == TRACE_TYPE_INVOKE) {
+        op->invokes++;
+
+        // Calls with no client pid are attributed to the worker thread instead
+        gpointer client = GINT_TO_POINTER(rec->pid != 0 ? rec->pid : -rec->tid);
+        int last_opcode = GPOINTER_TO_INT(g_hash_table_lookup(worker->last_opcodes, client)) - 1;
+        if(last_opcode >= 0) {
+            stats->patterns[last_opcode][rec->opcode]++;
+        }
+        g_hash_table_insert(worker->last_opcodes, client, GINT_TO_POINTER(rec->opcode + 1));
+
+        const char * path = traceRecordPath(rec);
+        if(path != NULL) {
+            countPath(worker, path);
+        }
+        return;
+    }
+
+    op->returns++;
+    if(rec->elapsed >= 0) {
+        uint64_t elapsed = rec->elapsed;
+        op->latency[latencyBucket(elapsed)]++;
+        op->latency_total += elapsed;
+        if(elapsed > op->latency_max) op->latency_max = elapsed;
+        addBusyTime(stats, rec->timestamp - rec->elapsed / 1000, rec->timestamp);
+    }
+    if(rec->has_retval && rec->retval < 0) {
+        op->errors++;
+        int err = -rec->retval;
+        stats->errors[rec->opcode][err < MAX_ERRNO ? err : MAX_ERRNO - 1]++;
+    } else if(rec->has_retval && isTransferOp(rec->opcode)) {
+        // Reads and writes return the number of bytes transferred
+        op->sizes[sizeBucket(rec->retval)]++;
+        op->bytes += rec->retval;
+    }
+}
+
+// Each worker takes whole segments until there are none left
+static void * analyzerWorker(void * arg) {
+    struct analyzer_worker * worker = arg;
+    while(TRUE) {
+        pthread_mutex_lock(&next_segment_lock);
+        int segment = next_segment++;
+        pthread_mutex_unlock(&next_segment_lock);
+        if(segment >= traceNumSegments(analyzer_reader)) break;
+
+        struct trace_cursor cursor;
+        traceSegmentStart(analyzer_reader, segment, &cursor);
+        const struct trace_record * rec;
+        while((rec = traceNextInSegment(&cursor)) != NULL) {
+            analyzeRecord(worker, rec);
+        }
+    }
+    return NULL;
+}
+
+static int comparePathCounts(const void * a, const void * b) {
+    const struct path_count * pa = a;
+    const struct path_count * pb = b;
+    if(pa->count == pb->count) return 0;
+    return pa->count < pb->count ? 1 : -1;
+}
+
+/* Merge path counts from every worker
+ * A path missing from a full worker's table may have occurred up to that table's minimum count there
+ */
+static void mergePaths(struct trace_stats * merged, struct analyzer_worker * workers, int num_workers) {
+    GHashTable * totals = g_hash_table_new(g_str_hash, g_str_equal);
+    GArray * all = g_array_new(FALSE, FALSE, sizeof(struct path_count));
+    for(int w = 0; w < num_workers; w++) {
+        struct trace_stats * stats = workers[w].stats;
+        for(int i = 0; i < stats->num_paths; i++) {
+            gpointer idx_ptr;
+            if(g_hash_table_lookup_extended(totals, stats->paths[i].path, NULL, &idx_ptr)) {
+                struct path_count * total = &g_array_index(all, struct path_count, GPOINTER_TO_INT(idx_ptr));
+                total->count += stats->paths[i].count;
+                total->error += stats->paths[i].error;
+            } else {
+                g_array_append_val(all, stats->paths[i]);
+                g_hash_table_insert(totals, stats->paths[i].path, GINT_TO_POINTER(all->len - 1));
+            }
+        }
+    }
+    for(int w = 0; w < num_workers; w++) {
+        struct trace_stats * stats = workers[w].stats;
+        if(stats->num_paths < TOP_PATHS_CAPACITY) continue;
+        for(guint i = 0; i < all->len; i++) {
+            struct path_count * total = &g_array_index(all, struct path_count, i);
+            if(!g_hash_table_contains(workers[w].path_index, total->path)) {
+                total->count += stats->paths[0].count;
+                total->error += stats->paths[0].count;
+            }
+        }
+    }
+
+    qsort(all->data, all->len, sizeof(struct path_count), comparePathCounts);
+    merged->num_paths = all->len < TOP_PATHS_CAPACITY ? all->len : TOP_PATHS_CAPACITY;
+    for(int i = 0; i < merged->num_paths; i++) {
+        merged->paths[i] = g_array_index(all, struct path_count, i);
+        merged->paths[i].path = malloc(strlen(merged->paths[i].path) + 1);
+        strcpy(merged->paths[i].path, g_array_index(all, struct path_count, i).path);
+    }
+    g_array_free(all, TRUE);
+    g_hash_table_destroy(totals);
+}
+
+static void mergeStats(struct trace_stats * merged, struct trace_stats * stats) {
+    if(stats->min_timestamp < merged->min_timestamp) merged->min_timestamp = stats->min_timestamp;
+    if(stats->max_timestamp > merged->max_timestamp) merged->max_timestamp = stats->max_timestamp;
+    merged->records += stats->records;
+    for(int o = 0; o < NUM_OPCODES; o++) {
+        struct op_stats * to = &merged->ops[o];
+        struct op_stats * from = &stats->ops[o];
+        to->invokes += from->invokes;
+        to->returns += from->returns;
+        to->errors += from->errors;
+        to->latency_total += from->latency_total;
+        to->bytes += from->bytes;
+        if(from->latency_max > to->latency_max) to->latency_max = from->latency_max;
+        for(int b = 0; b < LATENCY_BUCKETS; b++) to->latency[b] += from->latency[b];
+        for(int b = 0; b < SIZE_BUCKETS; b++) to->sizes[b] += from->sizes[b];
+        for(int e = 0; e < MAX_ERRNO; e++) merged->errors[o][e] += stats->errors[o][e];
+        for(int p = 0; p < NUM_OPCODES; p++) merged->patterns[o][p] += stats->patterns[o][p];
+    }
+    for(int i = 0; i < merged->num_intervals; i++) {
+        merged->busy[i] += stats->busy[i];
+    }
+}
+
+/* Analyze every segment of a trace in a single pass, using num_threads threads (or one per core if 0)
+ * Memory use depends only on the number of threads, not on the size of the trace
+ */
+struct trace_stats * analyzeTrace(struct trace_reader * reader, int num_threads) {
+    if(num_threads <= 0) {
+        num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+        if(num_threads <= 0) num_threads = 1;
+    }
+    if(num_threads > traceNumSegments(reader) && traceNumSegments(reader) > 0) {
+        num_threads = traceNumSegments(reader);
+    }
+
+    // Size the concurrency intervals from the segment summaries so every worker uses the same ones
+    int64_t start = INT64_MAX;
+    int64_t end = INT64_MIN;
+    for(int s = 0; s < traceNumSegments(reader); s++) {
+        const struct trace_index_footer * summary = traceSegmentSummary(reader, s);
+        if(summary->num_records == 0) continue;
+        if(summary->min_timestamp < start) start = summary->min_timestamp;
+        if(summary->max_timestamp > end) end = summary->max_timestamp;
+    }
+    int64_t interval = 1000000;
+    int num_intervals = 0;
+    if(end >= start) {
+        int64_t duration = end - start + 1;
+        if(duration / interval >= MAX_INTERVALS) {
+            interval = (duration + MAX_INTERVALS - 1) / MAX_INTERVALS;
+        }
+        num_intervals = (duration + interval - 1) / interval;
+    }
+
+    analyzer_reader = reader;
+    next_segment = 0;
+    struct analyzer_worker workers[num_threads];
+    for(int i = 0; i < num_threads; i++) {
+        workers[i].stats = createTraceStats(start, interval, num_intervals);
+        workers[i].path_index = g_hash_table_new(g_str_hash, g_str_equal);
+        workers[i].last_opcodes = g_hash_table_new(g_direct_hash, g_direct_equal);
+        if(pthread_create(&workers[i].thread, NULL, analyzerWorker, &workers[i]) != 0) {
+            perror("pthread_create");
+            analyzerWorker(&workers[i]);
+            workers[i].thread = pthread_self();
+        }
+    }
+
+    struct trace_stats * merged = createTraceStats(start, interval, num_intervals);
+    for(int i = 0; i < num_threads; i++) {
+        if(!pthread_equal(workers[i].thread, pthread_self())) {
+            pthread_join(workers[i].thread, NULL);
+        }
+        mergeStats(merged, workers[i].stats);
+    }
+    mergePaths(merged, workers, num_threads);
+    for(int i = 0; i < num_threads; i++) {
+        g_hash_table_destroy(workers[i].path_index);
+        g_hash_table_destroy(workers[i].last_opcodes);
+        freeTraceStats(workers[i].stats);
+    }
+    return merged;
+}
+
+static void printDuration(uint64_t ns) {
+    if(ns == UINT64_MAX) printf("%10s", "-");
+    else if(ns < 1000) printf("%8lluns", (unsigned long long) ns);
+    else if(ns < 1000000) printf("%8.1fus", ns / 1000.0);
+    else if(ns < 1000000000) printf("%8.1fms", ns / 1000000.0);
+    else printf("%9.2fs", ns / 1000000000.0);
+}
+
+void printTraceStats(struct trace_stats * stats) {
+    if(stats->records == 0) {
+        printf("Trace contains no records\n");
+        return;
+    }
+    double span = (stats->max_timestamp - stats->min_timestamp) / 1000000.0;
+    printf("%llu records over %.1f seconds\n\n", (unsigned long long) stats->records, span);
+
+    printf("Operations:\n");
+    printf("%-12s %10s %10s %10s %10s %10s %10s %10s %10s %10s\n",
+            "name", "calls", "calls/s", "errors", "mean", "p50", "p90", "p99", "p99.9", "max");
+    for(int o = 0; o < NUM_OPCODES; o++) {
+        struct op_stats * op = &stats->ops[o];
+        if(op->invokes == 0 && op->returns == 0) continue;
+        uint64_t timed = 0;
+        for(int b = 0; b < LATENCY_BUCKETS; b++) timed += op->latency[b];
+        printf("%-12s %10llu %10.1f %10llu ", traceOpName(o), (unsigned long long) op->returns,
+                span > 0 ? op->returns / span : 0.0, (unsigned long long) op->errors);
+        printDuration(timed > 0 ? op->latency_total / timed : 0);
+        printf(" ");
+        printDuration(MIN(latencyPercentile(op->latency, timed, 0.5), op->latency_max));
+        printf(" ");
+        printDuration(MIN(latencyPercentile(op->latency, timed, 0.9), op->latency_max));
+        printf(" ");
+        printDuration(MIN(latencyPercentile(op->latency, timed, 0.99), op->latency_max));
+        printf(" ");
+        printDuration(MIN(latencyPercentile(op->latency, timed, 0.999), op->latency_max));
+        printf(" ");
+        printDuration(op->latency_max);
+        printf("\n");
+    }
+
+    printf("\nErrors:\n");
+    bool any_errors = FALSE;
+    for(int o = 0; o < NUM_OPCODES; o++) {
+        for(int e = 0; e < MAX_ERRNO; e++) {
+            if(stats->errors[o][e] == 0) continue;
+            printf("%-12s %-20s %10llu\n", traceOpName(o), strerror(e), (unsigned long long) stats->errors[o][e]);
+            any_errors = TRUE;
+        }
+    }
+    if(!any_errors) printf("None\n");
+
+    printf("\nTransfer sizes:\n");
+    for(int o = 0; o < NUM_OPCODES; o++) {
+        struct op_stats * op = &stats->ops[o];
+        if(op->bytes == 0) continue;
+        printf("%s (%llu bytes total)\n", traceOpName(o), (unsigned long long) op->bytes);
+        for(int b = 0; b < SIZE_BUCKETS; b++) {
+            if(op->sizes[b] == 0) continue;
+            if(b == 0) printf("  %20s %10llu\n", "0", (unsigned long long) op->sizes[b]);
+            else printf("  %9llu-%-10llu %10llu\n", 1ULL << (b - 1), (1ULL << b) - 1, (unsigned long long) op->sizes[b]);
+        }
+    }
+
+    printf("\nTop paths:\n");
+    for(int i = 0; i < stats->num_paths && i < PRINTED_PATHS; i++) {
+        printf("%10llu  %s", (unsigned long long) stats->paths[i].count, stats->paths[i].path);
+        if(stats->paths[i].error > 0) printf("  (may be over by %llu)", (unsigned long long) stats->paths[i].error);
+        printf("\n");
+    }
+
+    // Group intervals together so the output stays readable
+    printf("\nConcurrency (average and peak calls in flight):\n");
+    int group = (stats->num_intervals + PRINTED_INTERVALS - 1) / PRINTED_INTERVALS;
+    if(group < 1) group = 1;
+    for(int i = 0; i < stats->num_intervals; i += group) {
+        double total = 0;
+        double peak = 0;
+        int n = 0;
+        for(int j = i; j < i + group && j < stats->num_intervals; j++, n++) {
+            double avg = stats->busy[j] / stats->concurrency_interval;
+            total += avg;
+            if(avg > peak) peak = avg;
+        }
+        printf("+%9.1fs %8.2f %8.2f\n", (double) i * stats->concurrency_interval / 1000000.0, total / n, peak);
+    }
+}
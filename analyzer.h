@@ -0,0 +1,66 @@
+#pragma once
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "trace.h"
+
+// Latency histograms have this many sub-buckets per power of two nanoseconds
+#define LATENCY_SUB_BUCKETS 4
+#define LATENCY_BUCKETS (64 * LATENCY_SUB_BUCKETS)
+
+// Size histograms have one bucket per power of two bytes
+#define SIZE_BUCKETS 64
+
+// Errno values above this are counted together
+#define MAX_ERRNO 256
+
+// Number of distinct paths tracked when looking for the most common ones
+#define TOP_PATHS_CAPACITY 1024
+
+#define NUM_OPCODES 64
+
+struct op_stats {
+    uint64_t invokes;
+    uint64_t returns;
+    uint64_t errors;
+    uint64_t latency_total;         // Nanoseconds
+    uint64_t latency_max;
+    uint64_t latency[LATENCY_BUCKETS];
+    uint64_t sizes[SIZE_BUCKETS];   // Bytes transferred by successful reads and writes
+    uint64_t bytes;
+};
+
+// Approximate path counts, kept with the space-saving algorithm so memory doesn't grow with the trace
+struct path_count {
+    char * path;
+    uint64_t count;
+    uint64_t error;     // Upper bound on how much count overestimates by
+};
+
+struct trace_stats {
+    int64_t min_timestamp;
+    int64_t max_timestamp;
+    uint64_t records;
+
+    struct op_stats ops[NUM_OPCODES];
+    uint64_t errors[NUM_OPCODES][MAX_ERRNO];
+
+    // Pairs of consecutive calls made by the same client, e.g. patterns[open][getattr]
+    uint64_t patterns[NUM_OPCODES][NUM_OPCODES];
+
+    struct path_count paths[TOP_PATHS_CAPACITY];
+    int num_paths;
+
+    // Sum of time spent in the filesystem per interval, giving the average number of calls in flight
+    int64_t concurrency_start;
+    int64_t concurrency_interval;   // Microseconds
+    int num_intervals;
+    double * busy;                  // Microseconds of calls in flight during each interval
+};
+
+struct trace_stats * analyzeTrace(struct trace_reader * reader, int num_threads);
+void freeTraceStats(struct trace_stats * stats);
+uint64_t latencyPercentile(const uint64_t * latency, uint64_t count, double percentile);
+uint64_t latencyBucketValue(int bucket);
+void printTraceStats(struct trace_stats * stats);
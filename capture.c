@@ -0,0 +1,231 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <glib.h>
+
+#include "cJSON.h"
+#include "capture.h"
+
+// First character of a file other than whitespace, or EOF
+static int firstSignificantChar(FILE * file) {
+    int c;
+    while((c = fgetc(file)) != EOF && isspace(c));
+    return c;
+}
+
+/* Open a capture file for appending, creating it if needed
+ * Returns -1 if it can't be appended to, such as when it holds grouped JSON
+ */
+int captureOpen(const char * path) {
+    FILE * existing = fopen(path, "r");
+    if(existing != NULL) {
+        int c = firstSignificantChar(existing);
+        fclose(existing);
+        if(c == '[') {
+            fprintf(stderr, "'%s' holds grouped JSON, which can't be appended to\n", path);
+            fprintf(stderr, "Convert it with fdt --convert first, or choose another file\n");
+            return -1;
+        }
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if(fd < 0) {
+        fprintf(stderr, "Unable to open '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    // A line cut short by a crash is finished off, so that it doesn't swallow the next sequence
+    off_t size = lseek(fd, 0, SEEK_END);
+    char last;
+    if(size > 0 && pread(fd, &last, 1, size - 1) == 1 && last != '\n') {
+        write(fd, "\n", 1);
+    }
+    return fd;
+}
+
+// Identify the sequences captured by one run of the logger
+void captureGroupId(char * buf, size_t len) {
+    snprintf(buf, len, "%ld-%d", (long) time(NULL), (int) getpid());
+}
+
+static bool writeLine(int fd, const char * line) {
+    size_t len = strlen(line);
+    char * buf = malloc(len + 1);
+    memcpy(buf, line, len);
+    buf[len] = '\n';
+
+    // The line goes out in a single append where possible, so a crash can at worst truncate the last line
+    size_t written = 0;
+    while(written < len + 1) {
+        ssize_t n = write(fd, buf + written, len + 1 - written);
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            free(buf);
+            return FALSE;
+        }
+        written += n;
+    }
+    free(buf);
+    return TRUE;
+}
+
+bool captureAppendSequence(int fd, cJSON * sequence) {
+    char * line = cJSON_PrintUnformatted(sequence);
+    bool ok = writeLine(fd, line);
+    free(line);
+    if(!ok) {
+        perror("Unable to write sequence");
+    }
+    return ok;
+}
+
+struct capture_group {
+    char * id;
+    GArray * offsets;   // Start of each of the group's lines in the capture file
+};
+
+/* Rebuild grouped JSON from a capture file
+ * Only the offset of each line is kept while scanning, and sequences are read back one at a time
+ * to be written out, so memory use doesn't depend on the size of the capture
+ */
+static bool captureToGrouped(FILE * in, FILE * out) {
+    GHashTable * index = g_hash_table_new(g_str_hash, g_str_equal);
+    GPtrArray * groups = g_ptr_array_new();
+
+    char * line = NULL;
+    size_t line_capacity = 0;
+    long line_num = 0;
+    off_t offset = ftello(in);
+    ssize_t len;
+    while((len = getline(&line, &line_capacity, in)) != -1) {
+        line_num++;
+        off_t line_offset = offset;
+        offset += len;
+
+        cJSON * sequence = cJSON_Parse(line);
+        if(sequence == NULL) {
+            bool blank = TRUE;
+            for(ssize_t i = 0; i < len; i++) {
+                if(!isspace((unsigned char) line[i])) blank = FALSE;
+            }
+            if(!blank) fprintf(stderr, "Skipping line %ld, which is not valid JSON\n", line_num);
+            continue;
+        }
+
+        cJSON * group_obj = cJSON_GetObjectItem(sequence, "group");
+        const char * group_id = group_obj != NULL && group_obj->type == cJSON_String ? group_obj->valuestring : "";
+        struct capture_group * group = g_hash_table_lookup(index, group_id);
+        if(group == NULL) {
+            group = malloc(sizeof(*group));
+            group->id = malloc(strlen(group_id) + 1);
+            strcpy(group->id, group_id);
+            group->offsets = g_array_new(FALSE, FALSE, sizeof(off_t));
+            g_hash_table_insert(index, group->id, group);
+            g_ptr_array_add(groups, group);
+        }
+        g_array_append_val(group->offsets, line_offset);
+        cJSON_Delete(sequence);
+    }
+
+    // Groups keep the order they were first captured in
+    fputs("[", out);
+    for(guint g = 0; g < groups->len; g++) {
+        struct capture_group * group = g_ptr_array_index(groups, g);
+        fputs(g > 0 ? ", [" : "[", out);
+        for(guint s = 0; s < group->offsets->len; s++) {
+            fseeko(in, g_array_index(group->offsets, off_t, s), SEEK_SET);
+            getline(&line, &line_capacity, in);
+            cJSON * sequence = cJSON_Parse(line);
+            cJSON_DeleteItemFromObject(sequence, "group");
+            char * json = cJSON_Print(sequence);
+            fprintf(out, "%s%s", s > 0 ? ", " : "", json);
+            free(json);
+            cJSON_Delete(sequence);
+        }
+        fputs("]", out);
+        g_array_free(group->offsets, TRUE);
+        free(group->id);
+        free(group);
+    }
+    fputs("]\n", out);
+    printf("Converted %ld lines into %u groups\n", line_num, groups->len);
+
+    free(line);
+    g_ptr_array_free(groups, TRUE);
+    g_hash_table_destroy(index);
+    return TRUE;
+}
+
+// Split grouped JSON into a capture file, so that more sequences can be appended to it
+static bool groupedToCapture(FILE * in, int out_fd) {
+    fseeko(in, 0, SEEK_END);
+    off_t size = ftello(in);
+    rewind(in);
+    char * data = malloc(size + 1);
+    size_t read = fread(data, 1, size, in);
+    data[read] = '\0';
+    cJSON * groups = cJSON_Parse(data);
+    free(data);
+    if(groups == NULL || groups->type != cJSON_Array) {
+        fprintf(stderr, "Input is not grouped JSON\n");
+        cJSON_Delete(groups);
+        return FALSE;
+    }
+
+    char base_id[64];
+    captureGroupId(base_id, sizeof(base_id));
+    bool ok = TRUE;
+    int num_sequences = 0;
+    for(int g = 0; g < cJSON_GetArraySize(groups) && ok; g++) {
+        cJSON * group = cJSON_GetArrayItem(groups, g);
+        char group_id[96];
+        snprintf(group_id, sizeof(group_id), "%s.%d", base_id, g);
+        for(int s = 0; s < cJSON_GetArraySize(group) && ok; s++) {
+            cJSON * sequence = cJSON_GetArrayItem(group, s);
+            cJSON_AddStringToObject(sequence, "group", group_id);
+            ok = captureAppendSequence(out_fd, sequence);
+            num_sequences++;
+        }
+    }
+    printf("Converted %d groups into %d lines\n", cJSON_GetArraySize(groups), num_sequences);
+    cJSON_Delete(groups);
+    return ok;
+}
+
+/* Convert between a capture file and grouped JSON, in whichever direction the input needs
+ * Grouped JSON is appended to an existing capture file, but a grouped JSON output is replaced
+ */
+bool convertCapture(const char * in_path, const char * out_path) {
+    FILE * in = fopen(in_path, "r");
+    if(in == NULL) {
+        fprintf(stderr, "Unable to open '%s': %s\n", in_path, strerror(errno));
+        return FALSE;
+    }
+    bool grouped = firstSignificantChar(in) == '[';
+    rewind(in);
+
+    bool ok;
+    if(grouped) {
+        int out_fd = captureOpen(out_path);
+        ok = out_fd >= 0 && groupedToCapture(in, out_fd);
+        if(out_fd >= 0) close(out_fd);
+    } else {
+        FILE * out = fopen(out_path, "w");
+        if(out == NULL) {
+            fprintf(stderr, "Unable to open '%s': %s\n", out_path, strerror(errno));
+            ok = FALSE;
+        } else {
+            ok = captureToGrouped(in, out);
+            if(fclose(out) != 0) ok = FALSE;
+        }
+    }
+    fclose(in);
+    return ok;
+}
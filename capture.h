@@ -0,0 +1,17 @@
+#pragma once
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cJSON.h"
+
+/* Captured call sequences are appended to a file one line of JSON at a time, so that writing a
+ * sequence costs the same however much has been captured before it. Each line is a sequence object
+ * with an extra "group" key naming the logger run it came from, which is how the grouped JSON
+ * format the test suite reads is rebuilt.
+ */
+
+int captureOpen(const char * path);
+void captureGroupId(char * buf, size_t len);
+bool captureAppendSequence(int fd, cJSON * sequence);
+bool convertCapture(const char * in_path, const char * out_path);
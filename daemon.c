@@ -0,0 +1,551 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <sys/queue.h>
+#include <glib.h>
+
+#include "cJSON.h"
+#include "fdt.h"
+#include "daemon.h"
+#include "trace.h"
+#include "hotpaths.h"
+
+// Maximum number of undelivered events per subscriber before we start dropping
+#define SUBSCRIBER_QUEUE_LEN 4096
+
+#define EVENT_TYPE_INVOKE 1
+#define EVENT_TYPE_RETURN 2
+
+static bool closing = FALSE;
+static bool fifoOpen = FALSE;
+
+static char debugFifoName[PATH_MAX];
+static int debugFifo = -1;
+
+static char stepSemName[PATH_MAX];
+static sem_t *stepSem = NULL;
+
+static char *socketPath = NULL;
+static int listenSocket = -1;
+
+// Hottest paths by calls and by bytes, which subscribers can ask for with the "hot" command
+static struct hot_paths * hotPaths = NULL;
+
+// Events are also recorded to disk if a trace directory was given
+static char *traceDir = NULL;
+static struct trace_writer * traceWriter = NULL;
+
+// Paths of calls which have been invoked but not yet returned, so return events can be filtered by path too
+static GHashTable * inflight_paths = NULL;
+
+/* A serialised event, shared between the queues of every subscriber it is sent to */
+struct daemon_msg {
+    int refs;
+    size_t len;
+    char data[];
+};
+
+struct subscriber {
+    int fd;
+
+    // Partial command line received from the subscriber
+    char inbuf[1024];
+    size_t inlen;
+
+    // Filter set by the subscriber (everything is sent until a filter is set)
+    char ** names;
+    int num_names;
+    int types;
+    char * path_prefix;
+
+    // Ring of events waiting to be written to the socket
+    struct daemon_msg * queue[SUBSCRIBER_QUEUE_LEN];
+    size_t queue_head;
+    size_t queue_count;
+    size_t head_sent;
+    unsigned long dropped;
+
+    LIST_ENTRY(subscriber) entries;
+};
+
+static LIST_HEAD(, subscriber) subscribers;
+static int num_subscribers = 0;
+
+void setDaemonSocketPath(const char * path) {
+    free(socketPath);
+    socketPath = malloc(strlen(path) + 1);
+    strcpy(socketPath, path);
+}
+
+void setDaemonTraceDir(const char * dir) {
+    free(traceDir);
+    traceDir = malloc(strlen(dir) + 1);
+    strcpy(traceDir, dir);
+}
+
+static struct daemon_msg * createMessage(const char * str) {
+    size_t len = strlen(str);
+    struct daemon_msg * msg = malloc(sizeof(*msg) + len + 1);
+    msg->refs = 1;
+    msg->len = len + 1;
+    memcpy(msg->data, str, len);
+    msg->data[len] = '\n';
+    return msg;
+}
+
+static void unrefMessage(struct daemon_msg * msg) {
+    if(--msg->refs == 0) {
+        free(msg);
+    }
+}
+
+static void clearFilter(struct subscriber * sub) {
+    for(int i = 0; i < sub->num_names; i++) {
+        free(sub->names[i]);
+    }
+    free(sub->names);
+    free(sub->path_prefix);
+    sub->names = NULL;
+    sub->num_names = 0;
+    sub->types = EVENT_TYPE_INVOKE | EVENT_TYPE_RETURN;
+    sub->path_prefix = NULL;
+}
+
+static void removeSubscriber(struct subscriber * sub) {
+    LIST_REMOVE(sub, entries);
+    num_subscribers--;
+    close(sub->fd);
+    while(sub->queue_count > 0) {
+        unrefMessage(sub->queue[sub->queue_head]);
+        sub->queue_head = (sub->queue_head + 1) % SUBSCRIBER_QUEUE_LEN;
+        sub->queue_count--;
+    }
+    clearFilter(sub);
+    free(sub);
+    printf("Subscriber detached (%d remaining)\n", num_subscribers);
+}
+
+// Queue a message for a subscriber, dropping it if the subscriber has fallen too far behind
+static void enqueueMessage(struct subscriber * sub, struct daemon_msg * msg) {
+    if(sub->dropped > 0 && sub->queue_count < SUBSCRIBER_QUEUE_LEN - 1) {
+        // Tell the subscriber how many events it missed before it gets any newer ones
+        char notice[64];
+        snprintf(notice, sizeof notice, "{\"type\":\"dropped\",\"count\":%lu}", sub->dropped);
+        sub->queue[(sub->queue_head + sub->queue_count) % SUBSCRIBER_QUEUE_LEN] = createMessage(notice);
+        sub->queue_count++;
+        sub->dropped = 0;
+    }
+    if(sub->queue_count < SUBSCRIBER_QUEUE_LEN) {
+        msg->refs++;
+        sub->queue[(sub->queue_head + sub->queue_count) % SUBSCRIBER_QUEUE_LEN] = msg;
+        sub->queue_count++;
+    } else {
+        sub->dropped++;
+    }
+}
+
+// Write as much of the queue as the socket will take without blocking
+// Returns false if the subscriber has gone away
+static bool flushSubscriber(struct subscriber * sub) {
+    while(sub->queue_count > 0) {
+        struct daemon_msg * msg = sub->queue[sub->queue_head];
+        ssize_t n = write(sub->fd, msg->data + sub->head_sent, msg->len - sub->head_sent);
+        if(n < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            if(errno == EINTR) continue;
+            return false;
+        }
+        sub->head_sent += n;
+        if(sub->head_sent == msg->len) {
+            unrefMessage(msg);
+            sub->queue_head = (sub->queue_head + 1) % SUBSCRIBER_QUEUE_LEN;
+            sub->queue_count--;
+            sub->head_sent = 0;
+        }
+    }
+    return true;
+}
+
+static void replyToSubscriber(struct subscriber * sub, const char * status, const char * message) {
+    cJSON * reply = cJSON_CreateObject();
+    cJSON_AddStringToObject(reply, "type", "reply");
+    cJSON_AddStringToObject(reply, "status", status);
+    if(message != NULL) {
+        cJSON_AddStringToObject(reply, "message", message);
+    }
+    char * reply_str = cJSON_PrintUnformatted(reply);
+    cJSON_Delete(reply);
+    struct daemon_msg * msg = createMessage(reply_str);
+    free(reply_str);
+    enqueueMessage(sub, msg);
+    unrefMessage(msg);
+}
+
+/* Parse a command sent by a subscriber, for example:
+ *   filter name=read,write type=return path=/var/log
+ * A bare "filter" clears any existing filter, and "hot" replies with the hottest paths
+ */
+static void handleSubscriberCommand(struct subscriber * sub, char * line) {
+    char * stringp = line;
+    char * cmd = strsep(&stringp, " ");
+    if(strcmp(cmd, "filter") == 0) {
+        clearFilter(sub);
+        char * token;
+        while((token = strsep(&stringp, " ")) != NULL) {
+            if(strlen(token) == 0) continue;
+            if(strncmp(token, "name=", 5) == 0) {
+                char * names = token + 5;
+                char * name;
+                while((name = strsep(&names, ",")) != NULL) {
+                    sub->names = realloc(sub->names, (sub->num_names + 1) * sizeof(*sub->names));
+                    sub->names[sub->num_names] = malloc(strlen(name) + 1);
+                    strcpy(sub->names[sub->num_names], name);
+                    sub->num_names++;
+                }
+            } else if(strncmp(token, "type=", 5) == 0) {
+                sub->types = 0;
+                if(strstr(token + 5, "invoke") != NULL) sub->types |= EVENT_TYPE_INVOKE;
+                if(strstr(token + 5, "return") != NULL) sub->types |= EVENT_TYPE_RETURN;
+            } else if(strncmp(token, "path=", 5) == 0) {
+                sub->path_prefix = malloc(strlen(token + 5) + 1);
+                strcpy(sub->path_prefix, token + 5);
+            } else {
+                clearFilter(sub);
+                replyToSubscriber(sub, "error", "Unrecognised filter term");
+                return;
+            }
+        }
+        replyToSubscriber(sub, "ok", NULL);
+    } else if(strcmp(cmd, "hot") == 0) {
+        cJSON * hot = hotPathsToJSON(hotPaths);
+        char * hot_str = cJSON_PrintUnformatted(hot);
+        cJSON_Delete(hot);
+        struct daemon_msg * msg = createMessage(hot_str);
+        free(hot_str);
+        enqueueMessage(sub, msg);
+        unrefMessage(msg);
+    } else if(strlen(cmd) > 0) {
+        replyToSubscriber(sub, "error", "Unrecognised command");
+    }
+}
+
+// Returns false if the subscriber has gone away
+static bool readSubscriber(struct subscriber * sub) {
+    ssize_t n = read(sub->fd, sub->inbuf + sub->inlen, sizeof(sub->inbuf) - sub->inlen - 1);
+    if(n < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    } else if(n == 0) {
+        return false;
+    }
+    sub->inlen += n;
+    sub->inbuf[sub->inlen] = '\0';
+
+    // Handle each complete line
+    char * line_start = sub->inbuf;
+    char * newline;
+    while((newline = strchr(line_start, '\n')) != NULL) {
+        *newline = '\0';
+        if(newline > line_start && *(newline - 1) == '\r') *(newline - 1) = '\0';
+        handleSubscriberCommand(sub, line_start);
+        line_start = newline + 1;
+    }
+    sub->inlen = strlen(line_start);
+    memmove(sub->inbuf, line_start, sub->inlen + 1);
+
+    // Drop overlong lines rather than waiting forever for a newline
+    if(sub->inlen == sizeof(sub->inbuf) - 1) {
+        sub->inlen = 0;
+        replyToSubscriber(sub, "error", "Command too long");
+    }
+    return true;
+}
+
+static void acceptSubscribers() {
+    int fd;
+    while((fd = accept(listenSocket, NULL, NULL)) >= 0) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        struct subscriber * sub = calloc(1, sizeof(*sub));
+        sub->fd = fd;
+        clearFilter(sub);
+        LIST_INSERT_HEAD(&subscribers, sub, entries);
+        num_subscribers++;
+        printf("Subscriber attached (%d total)\n", num_subscribers);
+    }
+}
+
+static bool subscriberWantsEvent(struct subscriber * sub, int type, const char * name, const char * path) {
+    if((sub->types & type) == 0) return false;
+    if(sub->num_names > 0) {
+        bool found = false;
+        for(int i = 0; i < sub->num_names && !found; i++) {
+            if(strcmp(sub->names[i], name) == 0) found = true;
+        }
+        if(!found) return false;
+    }
+    if(sub->path_prefix != NULL) {
+        if(path == NULL || strncmp(path, sub->path_prefix, strlen(sub->path_prefix)) != 0) return false;
+    }
+    return true;
+}
+
+stopToolFunc startDaemon() {
+
+    closing = FALSE;
+
+    // Channels belong to the session of the filesystem being started
+    sessionChannel(getCurrentSession(), FDT_CHANNEL_DEBUG, debugFifoName, sizeof(debugFifoName));
+    sessionChannel(getCurrentSession(), FDT_CHANNEL_STEP, stepSemName, sizeof(stepSemName));
+
+    // Create a FIFO so that libfuse can tell us what's going on
+    unlink(debugFifoName);
+    mkfifo(debugFifoName, 0666);
+
+    // The daemon never pauses the filesystem, but libfuse still waits on the step semaphore
+    sem_unlink(stepSemName);
+    stepSem = sem_open(stepSemName, O_CREAT, 0644, 0);
+
+    if(socketPath == NULL) {
+        setDaemonSocketPath("fdt-daemon.sock");
+    }
+
+    setStopToolFunction(stopDaemon);
+    doStartDaemon();
+
+    return stopDaemon;
+}
+
+void stopDaemon() {
+    printf("Stopping daemon\n");
+    closing = TRUE;
+    pid_t fuse_pid = getFusePID();
+    if(fuse_pid != 0) {
+        setFusePID(0);
+        kill(fuse_pid, SIGINT);
+        printf("Sent SIGINT to FUSE binary\n");
+    }
+}
+
+void doStartDaemon() {
+
+    // Subscribers disconnecting mid-write must not kill the daemon
+    signal(SIGPIPE, SIG_IGN);
+
+    // Listen for subscribers on a UNIX domain socket
+    listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listenSocket < 0) {
+        perror("Unable to create daemon socket");
+        return;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath, sizeof(addr.sun_path) - 1);
+    unlink(socketPath);
+    if(bind(listenSocket, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(listenSocket, 16) != 0) {
+        perror("Unable to listen on daemon socket");
+        close(listenSocket);
+        return;
+    }
+    fcntl(listenSocket, F_SETFL, fcntl(listenSocket, F_GETFL, 0) | O_NONBLOCK);
+    printf("Daemon listening for subscribers on %s\n", socketPath);
+
+    if(traceDir != NULL) {
+        traceWriter = traceWriterOpen(traceDir, TRACE_DEFAULT_SEGMENT_SIZE, TRUE);
+        if(traceWriter != NULL) {
+            printf("Recording trace to %s\n", traceDir);
+        }
+    }
+
+    // Open the FIFO without blocking, so subscribers can attach before the filesystem mounts
+    debugFifo = open(debugFifoName, O_RDONLY | O_NONBLOCK);
+    if(debugFifo >= 0) fifoOpen = TRUE;
+    else fifoOpen = FALSE;
+    bool writer_seen = FALSE;
+
+    LIST_INIT(&subscribers);
+    inflight_paths = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free);
+    hotPaths = hotPathsNew();
+
+    size_t chunk_pos = 0;
+    size_t json_chunk_capacity = 1024;
+    char *json_chunk = malloc(json_chunk_capacity);
+    int unclosed_braces = 0;
+    bool unclosed_quotes = false;
+    bool escaping = false;
+    char read_buf[65536];
+
+    while(fifoOpen) {
+
+        // Poll the FIFO, the listening socket and every subscriber
+        struct pollfd fds[num_subscribers + 2];
+        struct subscriber * polled[num_subscribers + 1];
+        fds[0].fd = debugFifo;
+        fds[0].events = POLLIN;
+        fds[1].fd = listenSocket;
+        fds[1].events = POLLIN;
+        int nfds = 2;
+        struct subscriber * sub;
+        LIST_FOREACH(sub, &subscribers, entries) {
+            fds[nfds].fd = sub->fd;
+            fds[nfds].events = POLLIN | (sub->queue_count > 0 ? POLLOUT : 0);
+            polled[nfds - 2] = sub;
+            nfds++;
+        }
+        if(poll(fds, nfds, 100) < 0) {
+            if(errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+
+        if(fds[0].revents != 0) {
+            ssize_t n = read(debugFifo, read_buf, sizeof(read_buf));
+            if(n > 0) {
+                writer_seen = TRUE;
+
+                // Split the stream into chunks of JSON, which may span several reads
+                for(ssize_t i = 0; i < n; i++) {
+                    char c = read_buf[i];
+                    if(chunk_pos == 0 && c != '{') continue;
+                    if(chunk_pos+1 >= json_chunk_capacity) {
+                        // Double string capacity before we overflow it
+                        json_chunk_capacity *= 2;
+                        json_chunk = realloc(json_chunk, json_chunk_capacity);
+                    }
+                    json_chunk[chunk_pos++] = c;
+                    if(!unclosed_quotes && c == '{') unclosed_braces++;
+                    else if(!unclosed_quotes && c == '}') unclosed_braces--;
+                    else if(!escaping && c == '"') unclosed_quotes = !unclosed_quotes;
+
+                    if(c == '\\') escaping = !escaping;
+                    else escaping = false;
+
+                    if(unclosed_braces == 0) {
+                        json_chunk[chunk_pos] = '\0';
+                        chunk_pos = 0;
+                        cJSON * event = cJSON_Parse(json_chunk);
+                        if(event != NULL) {
+                            handleDaemonEvent(event);
+                        }
+                    }
+                }
+            } else if(n == 0 && writer_seen) {
+                fifoOpen = FALSE;
+            } else if(n == 0) {
+                // Nobody has opened the FIFO for writing yet
+                if(closing || getFusePID() == 0) break;
+                usleep(100000);
+            }
+        }
+
+        if(fds[1].revents & POLLIN) {
+            acceptSubscribers();
+        }
+
+        for(int i = 2; i < nfds; i++) {
+            sub = polled[i - 2];
+            bool alive = TRUE;
+            if(fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                alive = readSubscriber(sub);
+            }
+            if(alive && sub->queue_count > 0) {
+                alive = flushSubscriber(sub);
+            }
+            if(!alive) {
+                removeSubscriber(sub);
+            }
+        }
+    }
+    free(json_chunk);
+
+    printf("FUSE binary detached so daemon will terminate.\n");
+
+    while(!LIST_EMPTY(&subscribers)) {
+        removeSubscriber(LIST_FIRST(&subscribers));
+    }
+    g_hash_table_destroy(inflight_paths);
+    inflight_paths = NULL;
+    hotPathsFree(hotPaths);
+    hotPaths = NULL;
+
+    traceWriterClose(traceWriter);
+    traceWriter = NULL;
+
+    close(listenSocket);
+    unlink(socketPath);
+
+    if(debugFifo >= 0) {
+        close(debugFifo);
+    }
+
+    unlink(debugFifoName);
+    sem_unlink(stepSemName);
+}
+
+void handleDaemonEvent(cJSON * event) {
+    char * type = cJSON_GetObjectItem(event, "type")->valuestring;
+    char * name = cJSON_GetObjectItem(event, "name")->valuestring;
+    int seqnum = cJSON_GetObjectItem(event, "seqnum")->valueint;
+
+    int type_flag;
+    const char * path = NULL;
+    if(strcmp(type, "invoke") == 0) {
+        // Never hold up the filesystem, as that's the point of running headless
+        sem_post(stepSem);
+        type_flag = EVENT_TYPE_INVOKE;
+
+        cJSON * path_obj = cJSON_GetObjectItem(cJSON_GetObjectItem(event, "params"), "path");
+        if(path_obj != NULL && path_obj->type == cJSON_String) {
+            path = path_obj->valuestring;
+            char * path_cpy = malloc(strlen(path) + 1);
+            strcpy(path_cpy, path);
+            g_hash_table_insert(inflight_paths, GINT_TO_POINTER(seqnum), path_cpy);
+        }
+    } else if(strcmp(type, "return") == 0) {
+        type_flag = EVENT_TYPE_RETURN;
+        path = g_hash_table_lookup(inflight_paths, GINT_TO_POINTER(seqnum));
+    } else {
+        fprintf(stderr, "Unexpected event type '%s'\n", type);
+        cJSON_Delete(event);
+        return;
+    }
+
+    if(traceWriter != NULL) {
+        traceWriteEvent(traceWriter, event, path);
+    }
+    hotPathsHandleEvent(hotPaths, event);
+
+    // Serialise the event once, and share it between every interested subscriber
+    struct daemon_msg * msg = NULL;
+    struct subscriber * sub;
+    LIST_FOREACH(sub, &subscribers, entries) {
+        if(subscriberWantsEvent(sub, type_flag, name, path)) {
+            if(msg == NULL) {
+                char * event_json = cJSON_PrintUnformatted(event);
+                msg = createMessage(event_json);
+                free(event_json);
+            }
+            enqueueMessage(sub, msg);
+        }
+    }
+    if(msg != NULL) {
+        unrefMessage(msg);
+    }
+
+    if(type_flag == EVENT_TYPE_RETURN) {
+        g_hash_table_remove(inflight_paths, GINT_TO_POINTER(seqnum));
+    }
+    cJSON_Delete(event);
+}
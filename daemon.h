@@ -0,0 +1,14 @@
+#pragma once
+#define _GNU_SOURCE
+#include <gtk/gtk.h>
+#include <stdbool.h>
+
+#include "cJSON.h"
+#include "fdt.h"
+
+void setDaemonSocketPath(const char * path);
+void setDaemonTraceDir(const char * dir);
+stopToolFunc startDaemon();
+void stopDaemon();
+void doStartDaemon();
+void handleDaemonEvent(cJSON * event);
@@ -9,6 +9,7 @@
 #include <sys/stat.h>
 #include <semaphore.h>
 #include <string.h>
+#include <limits.h>
 #include <gtk/gtk.h>
 #include <pthread.h>
 #include <stdbool.h>
@@ -17,15 +18,19 @@
 #include "cJSON.h"
 #include "fdt.h"
 #include "debugger.h"
+#include "hotpaths.h"
+#include "eventstore.h"
+#include "timeline.h"
+#include "latency.h"
 
 static int pendingInvocations = 0;
 static bool autoAdvance = FALSE;
 static bool closing = FALSE;
 
-static char *debugFifoName = "fuse-debug.fifo";
+static char debugFifoName[PATH_MAX];
 static FILE *debugFifo = NULL;
 
-static char *stepSemName = "fuse-step.sem";
+static char stepSemName[PATH_MAX];
 static sem_t *stepSem = NULL;
 
 struct tailq_event {
@@ -33,15 +38,27 @@ struct tailq_event {
     TAILQ_ENTRY(tailq_event) entries;
 };
 
+TAILQ_HEAD(tailq_event_head, tailq_event);
 pthread_mutex_t tailq_events_lock;
-TAILQ_HEAD(, tailq_event) tailq_events;
+struct tailq_event_head tailq_events;
 
 /* GUI widgets */
 static GtkWidget * advance_btn;
 static GtkWidget * autoadvance_btn;
 static GtkWidget * events_view;
-static GtkTreeStore * event_table_model;
-static GtkTreeIter event_table_iter;
+static GtkWidget * events_tree_view;
+static GtkWidget * filter_status;
+static FdtEventStore * event_table_model;
+static GtkListStore * hot_calls_model;
+static GtkListStore * hot_bytes_model;
+
+// Calls on each thread over time, drawn as an alternative to the event list
+static struct timeline * timeline = NULL;
+
+// Hottest paths, tracked as events arrive and shown beneath the events
+static struct hot_paths * hot_paths = NULL;
+static gint64 hot_paths_refreshed = 0;
+static guint hot_paths_timer = 0;
 
 GtkWidget * createTopButtons() {
     GtkWidget * top_buttons = gtk_hbox_new(TRUE, 5);
@@ -64,27 +81,121 @@ GtkWidget * createEventsView() {
     GtkWidget * scrolled_window = gtk_scrolled_window_new(NULL, NULL);
     gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
    
-    event_table_model = gtk_tree_store_new(3, G_TYPE_INT, G_TYPE_STRING, G_TYPE_STRING);
-    GtkWidget * tree_view = gtk_tree_view_new();
+    // Only the most recent events are kept in memory, and only so many older ones on disk, so the
+    // debugger can be left running on a busy filesystem
+    event_table_model = eventStoreNew(DEBUGGER_EVENT_CAPACITY, DEBUGGER_EVENT_BYTES, DEBUGGER_SPILL_CAPACITY);
+    GtkWidget * tree_view = events_tree_view = gtk_tree_view_new();
     gtk_container_add(GTK_CONTAINER(scrolled_window), tree_view);
     gtk_tree_view_set_model(GTK_TREE_VIEW(tree_view), GTK_TREE_MODEL(event_table_model));
+    g_signal_connect(tree_view, "row-collapsed", G_CALLBACK(events_view_row_collapsed), NULL);
     gtk_widget_show(tree_view);
     
     GtkCellRenderer * cell_seqnum = gtk_cell_renderer_text_new();
-    GtkTreeViewColumn * column_seqnum = gtk_tree_view_column_new_with_attributes("Call #", cell_seqnum, "text", 0, NULL);
+    GtkTreeViewColumn * column_seqnum = gtk_tree_view_column_new_with_attributes("Call #", cell_seqnum, "text", EVENT_STORE_COL_SEQNUM, NULL);
     gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view), GTK_TREE_VIEW_COLUMN(column_seqnum));
     
     GtkCellRenderer * cell_event = gtk_cell_renderer_text_new();
-    GtkTreeViewColumn * column_event = gtk_tree_view_column_new_with_attributes("Event", cell_event, "text", 1, NULL);
+    GtkTreeViewColumn * column_event = gtk_tree_view_column_new_with_attributes("Event", cell_event, "text", EVENT_STORE_COL_TYPE, NULL);
     gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view), GTK_TREE_VIEW_COLUMN(column_event));
     
     GtkCellRenderer * cell_func = gtk_cell_renderer_text_new();
-    GtkTreeViewColumn * column_func = gtk_tree_view_column_new_with_attributes("Function", cell_func, "text", 2, NULL);
+    GtkTreeViewColumn * column_func = gtk_tree_view_column_new_with_attributes("Function", cell_func, "text", EVENT_STORE_COL_NAME, NULL);
     gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view), GTK_TREE_VIEW_COLUMN(column_func));
 
     return scrolled_window;
 }
 
+// Parameters are parsed when an event is expanded, so they can be let go again when it's collapsed
+void events_view_row_collapsed(GtkTreeView * tree_view, GtkTreeIter * iter, GtkTreePath * path, gpointer data) {
+    if(gtk_tree_path_get_depth(path) == 1) {
+        eventStoreCollapsed(event_table_model, iter);
+    }
+}
+
+GtkWidget * createFilterBar() {
+    GtkWidget * filter_bar = gtk_hbox_new(FALSE, 5);
+
+    GtkWidget * filter_label = gtk_label_new("Filter:");
+    gtk_widget_show(filter_label);
+    gtk_box_pack_start((GtkBox *) filter_bar, filter_label, FALSE, TRUE, 0);
+
+    GtkWidget * filter_entry = gtk_entry_new();
+    gtk_widget_set_tooltip_text(filter_entry, "Operation, errno and path, eg. \"rename /tmp/* EXDEV\"");
+    g_signal_connect(filter_entry, "changed", G_CALLBACK(filter_entry_changed), NULL);
+    gtk_widget_show(filter_entry);
+    gtk_box_pack_start((GtkBox *) filter_bar, filter_entry, TRUE, TRUE, 0);
+
+    filter_status = gtk_label_new(NULL);
+    gtk_widget_show(filter_status);
+    gtk_box_pack_start((GtkBox *) filter_bar, filter_status, FALSE, TRUE, 0);
+
+    return filter_bar;
+}
+
+void updateFilterStatus(const char * error) {
+    if(error != NULL) {
+        gtk_label_set_text(GTK_LABEL(filter_status), error);
+    } else if(event_table_model->filtered) {
+        char * status = g_strdup_printf("%u of %u events", eventStoreMatchCount(event_table_model), eventStoreCount(event_table_model));
+        gtk_label_set_text(GTK_LABEL(filter_status), status);
+        g_free(status);
+    } else {
+        gtk_label_set_text(GTK_LABEL(filter_status), "");
+    }
+}
+
+/* Filter the events as the filter is typed, which the store answers from its indexes
+ * Every row can change, so the view is given the store back afterwards rather than told about each row
+ */
+void filter_entry_changed(GtkEditable * editable, gpointer data) {
+    const char * text = gtk_entry_get_text(GTK_ENTRY(editable));
+    char * error = NULL;
+    gtk_tree_view_set_model(GTK_TREE_VIEW(events_tree_view), NULL);
+    eventStoreSetFilter(event_table_model, text, &error);
+    gtk_tree_view_set_model(GTK_TREE_VIEW(events_tree_view), GTK_TREE_MODEL(event_table_model));
+
+    // A filter that doesn't parse leaves the previous one in place
+    updateFilterStatus(error);
+    g_free(error);
+}
+
+GtkWidget * createHotPathsList(const char * count_title, GtkListStore ** model) {
+
+    GtkWidget * scrolled_window = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+
+    *model = gtk_list_store_new(2, G_TYPE_UINT64, G_TYPE_STRING);
+    GtkWidget * tree_view = gtk_tree_view_new();
+    gtk_container_add(GTK_CONTAINER(scrolled_window), tree_view);
+    gtk_tree_view_set_model(GTK_TREE_VIEW(tree_view), GTK_TREE_MODEL(*model));
+    gtk_widget_show(tree_view);
+
+    GtkCellRenderer * cell_count = gtk_cell_renderer_text_new();
+    GtkTreeViewColumn * column_count = gtk_tree_view_column_new_with_attributes(count_title, cell_count, "text", 0, NULL);
+    gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view), GTK_TREE_VIEW_COLUMN(column_count));
+
+    GtkCellRenderer * cell_path = gtk_cell_renderer_text_new();
+    GtkTreeViewColumn * column_path = gtk_tree_view_column_new_with_attributes("Path", cell_path, "text", 1, NULL);
+    gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view), GTK_TREE_VIEW_COLUMN(column_path));
+
+    return scrolled_window;
+}
+
+GtkWidget * createHotPathsView() {
+    GtkWidget * hot_paths_view = gtk_hbox_new(TRUE, 5);
+
+    GtkWidget * calls_list = createHotPathsList("Calls", &hot_calls_model);
+    gtk_widget_show(calls_list);
+    gtk_box_pack_start((GtkBox *) hot_paths_view, calls_list, TRUE, TRUE, 0);
+
+    GtkWidget * bytes_list = createHotPathsList("Bytes", &hot_bytes_model);
+    gtk_widget_show(bytes_list);
+    gtk_box_pack_start((GtkBox *) hot_paths_view, bytes_list, TRUE, TRUE, 0);
+
+    gtk_widget_set_size_request(hot_paths_view, -1, 150);
+    return hot_paths_view;
+}
+
 GtkWidget * createDebuggerTab() {
 
     GtkWidget * tab = gtk_vbox_new(FALSE, 5);
@@ -94,9 +205,40 @@ GtkWidget * createDebuggerTab() {
     gtk_widget_show(top_buttons);
     gtk_box_pack_start((GtkBox *) tab, top_buttons, FALSE, TRUE, 0);
     
-    events_view = createEventsView();
-    gtk_widget_show(events_view);
-    gtk_box_pack_start((GtkBox *) tab, events_view, TRUE, TRUE, 0);
+    // The events are shown either as a list, or as a timeline of the calls on each thread,
+    // alongside the latency of each operation over time
+    GtkWidget * views = gtk_notebook_new();
+        GtkWidget * events_page = gtk_vbox_new(FALSE, 5);
+            GtkWidget * filter_bar = createFilterBar();
+            gtk_widget_show(filter_bar);
+            gtk_box_pack_start((GtkBox *) events_page, filter_bar, FALSE, TRUE, 0);
+
+            events_view = createEventsView();
+            gtk_widget_show(events_view);
+            gtk_box_pack_start((GtkBox *) events_page, events_view, TRUE, TRUE, 0);
+        gtk_widget_show(events_page);
+        gtk_notebook_append_page(GTK_NOTEBOOK(views), events_page, gtk_label_new("Events"));
+
+        timeline = timelineNew();
+        GtkWidget * timeline_view = createTimelineView(timeline);
+        gtk_widget_show(timeline_view);
+        gtk_notebook_append_page(GTK_NOTEBOOK(views), timeline_view, gtk_label_new("Timeline"));
+
+        GtkWidget * latency_view = createLatencyView();
+        gtk_widget_show(latency_view);
+        gtk_notebook_append_page(GTK_NOTEBOOK(views), latency_view, gtk_label_new("Latency"));
+    gtk_widget_show(views);
+    gtk_box_pack_start((GtkBox *) tab, views, TRUE, TRUE, 0);
+
+    // Show the hottest paths underneath, as these are what caches need to be sized for
+    GtkWidget * hot_paths_label = gtk_label_new("Hot paths (recent calls and bytes transferred)");
+    gtk_misc_set_alignment(GTK_MISC(hot_paths_label), 0, 0.5);
+    gtk_widget_show(hot_paths_label);
+    gtk_box_pack_start((GtkBox *) tab, hot_paths_label, FALSE, TRUE, 0);
+
+    GtkWidget * hot_paths_view = createHotPathsView();
+    gtk_widget_show(hot_paths_view);
+    gtk_box_pack_start((GtkBox *) tab, hot_paths_view, FALSE, TRUE, 0);
 
     return tab;
 }
@@ -105,6 +247,10 @@ stopToolFunc startDebugger() {
 
     closing = FALSE;
 
+    // Channels belong to the session of the filesystem being started
+    sessionChannel(getCurrentSession(), FDT_CHANNEL_DEBUG, debugFifoName, sizeof(debugFifoName));
+    sessionChannel(getCurrentSession(), FDT_CHANNEL_STEP, stepSemName, sizeof(stepSemName));
+
     // Create a FIFO so that libfuse can tell us what's going on
     unlink(debugFifoName);
     mkfifo(debugFifoName, 0666);
@@ -113,6 +259,17 @@ stopToolFunc startDebugger() {
     sem_unlink(stepSemName);
     stepSem = sem_open(stepSemName, O_CREAT, 0644, 0);
 
+    if(hot_paths == NULL) {
+        hot_paths = hotPathsNew();
+    }
+
+    // Threads and times from a previous run mean nothing to this one
+    if(timeline != NULL) {
+        timelineClear(timeline);
+        timelineRefresh();
+    }
+    latencyStart();
+
     // Start debugging in a separate thread
     pthread_t debugger_thread;
     int debugger_thread_retval;
@@ -224,13 +381,19 @@ void advancePending() {
     }
 }
 
-void scrollToTop(GtkWidget * scrolled_window) {
+// Whether the view is scrolled to the newest events, which are at the top
+bool isScrolledToTop(GtkWidget * scrolled_window) {
     gdk_threads_enter();
-    GtkObject * top = gtk_adjustment_new(-1, -1, 0, 0, 0, 0);
+    GtkAdjustment * adjustment = gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(scrolled_window));
+    bool at_top = gtk_adjustment_get_value(adjustment) <= gtk_adjustment_get_lower(adjustment);
     gdk_threads_leave();
-    
+    return at_top;
+}
+
+void scrollToTop(GtkWidget * scrolled_window) {
     gdk_threads_enter();
-    gtk_scrolled_window_set_vadjustment((GtkScrolledWindow *) scrolled_window, (GtkAdjustment *) top);
+    GtkAdjustment * adjustment = gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(scrolled_window));
+    gtk_adjustment_set_value(adjustment, gtk_adjustment_get_lower(adjustment));
     gdk_threads_leave();
 }
 
@@ -246,95 +409,83 @@ void updateAdvanceButtonState() {
     }
 }
 
-gboolean gui_idle_debugger(void) {
-    pthread_mutex_lock(&tailq_events_lock);
-    while(!TAILQ_EMPTY(&tailq_events)) {
+void refreshHotPathsList(GtkListStore * model, bool by_bytes) {
+    struct hot_entry entries[HOT_TOP_K];
+    int n = hotPathsTop(hot_paths, by_bytes, entries, HOT_TOP_K);
 
-        struct tailq_event * tailq_event_node;
-        tailq_event_node = TAILQ_FIRST(&tailq_events);
-        
-        if(tailq_event_node != NULL) {
-        
-            cJSON * event = tailq_event_node->value;
-            char * type = cJSON_GetObjectItem(event, "type")->valuestring;
-            char * type_labelled = NULL;
-            char * name = cJSON_GetObjectItem(event, "name")->valuestring;
-            int seqnum = cJSON_GetObjectItem(event, "seqnum")->valueint;
-            
-            cJSON * params;
-            if(strcmp(type, "invoke") == 0) {
-                params = cJSON_GetObjectItem(event, "params");
-            } else if(strcmp(type, "return") == 0) {
-                params = cJSON_GetObjectItem(event, "modified_params");
-                
-                // If there is a return value then add this next to the event
-                cJSON *returnval_obj = cJSON_GetObjectItem(event, "returnval");
-                if(returnval_obj->type == cJSON_Number) {
-                    size_t new_len = strlen(type) + 1 + 50;
-                    type_labelled = malloc(new_len);
-                    snprintf(type_labelled, new_len, "%s %d", type, returnval_obj->valueint);
-                    type = type_labelled;
-                }
-            }
-            
-            gdk_threads_enter();
-            gtk_tree_store_prepend(GTK_TREE_STORE(event_table_model), &event_table_iter, NULL);
-            gdk_threads_leave();
-            
-            gdk_threads_enter();
-            gtk_tree_store_set(GTK_TREE_STORE(event_table_model), &event_table_iter, 0, seqnum, 1, type, 2, name, -1);
-            gdk_threads_leave();
-            
-            showParams(params, event_table_iter);
-            
-            if(type_labelled != NULL) {
-                free(type_labelled);
-            }
-            
-            // Enable or disable the advance button
-            updateAdvanceButtonState();
-            
-            scrollToTop(events_view);
-            
-            // Remove the event from the queue and destroy it
-            TAILQ_REMOVE(&tailq_events, tailq_event_node, entries);
-            cJSON_Delete(tailq_event_node->value);
-            free(tailq_event_node);
-        }
+    gdk_threads_enter();
+    gtk_list_store_clear(model);
+    for(int i = 0; i < n; i++) {
+        GtkTreeIter iter;
+        gtk_list_store_append(model, &iter);
+        gtk_list_store_set(model, &iter, 0, (guint64) entries[i].count, 1, entries[i].path, -1);
+    }
+    gdk_threads_leave();
+
+    for(int i = 0; i < n; i++) {
+        free(entries[i].path);
     }
-    pthread_mutex_unlock(&tailq_events_lock);
-    return TRUE; // only return false if we never want to be called again
 }
 
-void showParams(cJSON * node, GtkTreeIter parent) {
-    if(node->type == cJSON_Array || node->type == cJSON_Object) {
-        for(int i = 0; i < cJSON_GetArraySize(node); i++) {
-            cJSON * item = cJSON_GetArrayItem(node, i);
-            
-            GtkTreeIter itr;
-            gdk_threads_enter();
-            gtk_tree_store_prepend(GTK_TREE_STORE(event_table_model), &itr, &parent);
-            gdk_threads_leave();
-            
-            gdk_threads_enter();
-            if(item->type == cJSON_Array || item->type == cJSON_Object) {
-                // inside node, so just show the label
-                gtk_tree_store_set(GTK_TREE_STORE(event_table_model), &itr, 2, item->string, -1);
-            } else {
-                // leaf node, so show label with value (eg, "timestamp: 0189276")
-                char * label = item->string;
-                char * value = cJSON_Print(item);
-                char label_and_value[strlen(label) + 2 + strlen(value) + 1];
-                snprintf(label_and_value, sizeof label_and_value, "%s: %s", label, value);
-                gtk_tree_store_set(GTK_TREE_STORE(event_table_model), &itr, 2, label_and_value, -1);
-            }
-            gdk_threads_leave();
-            
-            showParams(item, itr);
+static gboolean hotPathsTimerFired(gpointer data) {
+    hot_paths_timer = 0;
+    requestGUIUpdate();
+    return FALSE;
+}
+
+// Refresh the hot paths at most once a second, as they change with every call
+void refreshHotPaths() {
+    if(hot_paths == NULL) return;
+    gint64 now = g_get_monotonic_time();
+    if(now - hot_paths_refreshed < G_USEC_PER_SEC) {
+        // The GUI only wakes up for new events, so make sure the calls that were held back get shown
+        if(hot_paths_timer == 0) {
+            guint remaining_ms = (hot_paths_refreshed + G_USEC_PER_SEC - now) / 1000 + 1;
+            hot_paths_timer = g_timeout_add(remaining_ms, hotPathsTimerFired, NULL);
         }
-    } else {
         return;
     }
+    hot_paths_refreshed = now;
+    refreshHotPathsList(hot_calls_model, FALSE);
+    refreshHotPathsList(hot_bytes_model, TRUE);
+}
+
+gboolean gui_idle_debugger(void) {
+    refreshHotPaths();
+
+    // Take everything that's queued, so the reader isn't held up while rows are added
+    struct tailq_event_head pending = TAILQ_HEAD_INITIALIZER(pending);
+    pthread_mutex_lock(&tailq_events_lock);
+    TAILQ_CONCAT(&pending, &tailq_events, entries);
+    pthread_mutex_unlock(&tailq_events_lock);
+    if(TAILQ_EMPTY(&pending)) return TRUE;
+
+    // Only follow new events if the view is already showing the newest, so older ones can be inspected
+    bool follow = isScrolledToTop(events_view);
+
+    while(!TAILQ_EMPTY(&pending)) {
+        struct tailq_event * tailq_event_node = TAILQ_FIRST(&pending);
+
+        timelineHandleEvent(timeline, tailq_event_node->value);
+        gdk_threads_enter();
+        eventStoreAppend(event_table_model, tailq_event_node->value);
+        gdk_threads_leave();
+
+        // Remove the event from the queue and destroy it, as the store keeps its own copy
+        TAILQ_REMOVE(&pending, tailq_event_node, entries);
+        cJSON_Delete(tailq_event_node->value);
+        free(tailq_event_node);
+    }
+
+    // Enable or disable the advance button
+    updateAdvanceButtonState();
+
+    updateFilterStatus(NULL);
+    timelineRefresh();
+    if(follow) {
+        scrollToTop(events_view);
+    }
+    return TRUE; // only return false if we never want to be called again
 }
 
 void handleDebuggerEvent(cJSON * event) {
@@ -374,6 +525,10 @@ void handleDebuggerEvent(cJSON * event) {
     } else {
         fprintf(stderr, "Unexpected event type '%s'\n", type);
     }
+
+    if(hot_paths != NULL) {
+        hotPathsHandleEvent(hot_paths, event);
+    }
     
     if(isUsingGui()) {
         // Add event to GUI queue (as we can't make changes from this thread directly)
@@ -383,6 +538,7 @@ void handleDebuggerEvent(cJSON * event) {
         tailq_event_node->value = event;
         TAILQ_INSERT_TAIL(&tailq_events, tailq_event_node, entries);
         pthread_mutex_unlock(&tailq_events_lock);
+        requestGUIUpdate();
     } else {
         // Otherwise, we don't need the event anymore
         cJSON_Delete(event);
@@ -6,8 +6,21 @@
 #include "cJSON.h"
 #include "fdt.h"
 
+// Most events the debugger keeps in memory, by count and by size
+#define DEBUGGER_EVENT_CAPACITY 100000
+#define DEBUGGER_EVENT_BYTES (64 * 1024 * 1024)
+
+// Most older events kept on disk to be scrolled back to
+#define DEBUGGER_SPILL_CAPACITY 1000000
+
 GtkWidget * createTopButtons();
 GtkWidget * createEventsView();
+void events_view_row_collapsed(GtkTreeView * tree_view, GtkTreeIter * iter, GtkTreePath * path, gpointer data);
+GtkWidget * createFilterBar();
+void updateFilterStatus(const char * error);
+void filter_entry_changed(GtkEditable * editable, gpointer data);
+GtkWidget * createHotPathsList(const char * count_title, GtkListStore ** model);
+GtkWidget * createHotPathsView();
 GtkWidget * createDebuggerTab();
 stopToolFunc startDebugger();
 void stopDebugger();
@@ -16,10 +29,12 @@ void waitToAdvance();
 bool canAdvance();
 void advance();
 void advancePending();
+bool isScrolledToTop(GtkWidget * scrolled_window);
 void scrollToTop(GtkWidget * scrolled_window);
 void updateAdvanceButtonState();
+void refreshHotPathsList(GtkListStore * model, bool by_bytes);
+void refreshHotPaths();
 gboolean gui_idle_debugger(void);
-void showParams(cJSON * node, GtkTreeIter parent);
 void handleDebuggerEvent(cJSON * event);
 static void autoadvance_btn_handler(GtkWidget * widget, gpointer data);
 static void advance_btn_handler(GtkWidget * widget, gpointer data);
@@ -0,0 +1,266 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+
+#include "trace.h"
+#include "analyzer.h"
+#include "diff.h"
+
+// Latency distributions are reported as different below this p-value
+#define SIGNIFICANCE 0.01
+
+// Too few samples make the test meaningless
+#define MIN_SAMPLES 20
+
+// A call pattern is only reported once it has been seen this many times, and its rate has changed by this much
+#define MIN_PATTERN_CALLS 10
+#define MIN_PATTERN_CHANGE 0.25
+
+// An error rate is only reported once it has changed by this much, as a fraction of the operation's calls
+#define MIN_ERROR_RATE_CHANGE 0.001
+
+#define PRINTED_PATHS 20
+
+/* Two-sample Kolmogorov-Smirnov test on a pair of histograms with the same buckets
+ * Returns the approximate p-value of both samples coming from the same distribution
+ */
+double ksTest(const uint64_t * hist_a, const uint64_t * hist_b, int buckets, double * d_out) {
+    uint64_t n_a = 0, n_b = 0;
+    for(int i = 0; i < buckets; i++) {
+        n_a += hist_a[i];
+        n_b += hist_b[i];
+    }
+    if(d_out != NULL) *d_out = 0;
+    if(n_a == 0 || n_b == 0) return 1;
+
+    double d = 0;
+    uint64_t cum_a = 0, cum_b = 0;
+    for(int i = 0; i < buckets; i++) {
+        cum_a += hist_a[i];
+        cum_b += hist_b[i];
+        double diff = fabs((double) cum_a / n_a - (double) cum_b / n_b);
+        if(diff > d) d = diff;
+    }
+    if(d_out != NULL) *d_out = d;
+
+    // Asymptotic Kolmogorov distribution, with Stephens' correction for small samples
+    double n_e = (double) n_a * n_b / (n_a + n_b);
+    double lambda = (sqrt(n_e) + 0.12 + 0.11 / sqrt(n_e)) * d;
+    if(lambda < 0.2) return 1;
+    double p = 0;
+    for(int k = 1; k <= 100; k++) {
+        double term = 2 * (k % 2 == 1 ? 1 : -1) * exp(-2 * k * k * lambda * lambda);
+        p += term;
+        if(fabs(term) < 1e-10) break;
+    }
+    if(p < 0) p = 0;
+    if(p > 1) p = 1;
+    return p;
+}
+
+/* Two-proportion z-test of x_a in n_a against x_b in n_b
+ * Returns the two-sided p-value of both coming from the same rate
+ */
+double proportionTest(uint64_t x_a, uint64_t n_a, uint64_t x_b, uint64_t n_b) {
+    if(n_a == 0 || n_b == 0) return 1;
+    double pooled = (double) (x_a + x_b) / (n_a + n_b);
+    double se = sqrt(pooled * (1 - pooled) * (1.0 / n_a + 1.0 / n_b));
+    if(se == 0) return 1;
+    double z = fabs((double) x_a / n_a - (double) x_b / n_b) / se;
+    return erfc(z / sqrt(2));
+}
+
+static uint64_t latencySamples(const struct op_stats * op) {
+    uint64_t n = 0;
+    for(int b = 0; b < LATENCY_BUCKETS; b++) n += op->latency[b];
+    return n;
+}
+
+static void printLatency(uint64_t ns) {
+    if(ns < 1000) printf("%7lluns", (unsigned long long) ns);
+    else if(ns < 1000000) printf("%7.1fus", ns / 1000.0);
+    else if(ns < 1000000000) printf("%7.1fms", ns / 1000000.0);
+    else printf("%8.2fs", ns / 1000000000.0);
+}
+
+static double percentChange(double before, double after) {
+    return (after - before) * 100 / before;
+}
+
+static int diffOperations(struct trace_stats * before, struct trace_stats * after) {
+    int flagged = 0;
+    printf("Operations:\n");
+    printf("%-12s %10s %10s %8s %9s %9s %9s %9s %9s %9s %8s\n", "name", "before", "after", "change",
+            "err% a", "err% b", "p50 a", "p50 b", "p99 a", "p99 b", "p-value");
+    for(int o = 0; o < NUM_OPCODES; o++) {
+        struct op_stats * a = &before->ops[o];
+        struct op_stats * b = &after->ops[o];
+        if(a->returns == 0 && b->returns == 0) continue;
+
+        uint64_t n_a = latencySamples(a);
+        uint64_t n_b = latencySamples(b);
+        double d;
+        double p = ksTest(a->latency, b->latency, LATENCY_BUCKETS, &d);
+        bool significant = n_a >= MIN_SAMPLES && n_b >= MIN_SAMPLES && p < SIGNIFICANCE;
+
+        printf("%-12s %10llu %10llu ", traceOpName(o), (unsigned long long) a->returns, (unsigned long long) b->returns);
+        if(a->returns == 0) printf("%8s ", "new");
+        else printf("%7.1f%% ", percentChange(a->returns, b->returns));
+        printf("%8.2f%% %8.2f%% ", a->returns > 0 ? a->errors * 100.0 / a->returns : 0.0, b->returns > 0 ? b->errors * 100.0 / b->returns : 0.0);
+        printLatency(MIN(latencyPercentile(a->latency, n_a, 0.5), a->latency_max));
+        printf(" ");
+        printLatency(MIN(latencyPercentile(b->latency, n_b, 0.5), b->latency_max));
+        printf(" ");
+        printLatency(MIN(latencyPercentile(a->latency, n_a, 0.99), a->latency_max));
+        printf(" ");
+        printLatency(MIN(latencyPercentile(b->latency, n_b, 0.99), b->latency_max));
+        printf(" %8.4f%s\n", p, significant ? " *" : "");
+        if(significant) flagged++;
+    }
+    printf("* latency distribution differs (Kolmogorov-Smirnov, p < %.2f)\n", SIGNIFICANCE);
+    return flagged;
+}
+
+/* Report errors whose rate has changed, as a fraction of the calls to each operation
+ * Counts alone would differ between almost any two runs, so a change has to be large enough and significant
+ */
+static int diffErrors(struct trace_stats * before, struct trace_stats * after) {
+    int flagged = 0;
+    printf("\nError rate changes:\n");
+    for(int o = 0; o < NUM_OPCODES; o++) {
+        uint64_t n_a = before->ops[o].returns;
+        uint64_t n_b = after->ops[o].returns;
+        if(n_a < MIN_SAMPLES || n_b < MIN_SAMPLES) continue;
+        for(int e = 0; e < MAX_ERRNO; e++) {
+            uint64_t a = before->errors[o][e];
+            uint64_t b = after->errors[o][e];
+            if(a == b) continue;
+            double rate_a = (double) a / n_a;
+            double rate_b = (double) b / n_b;
+            if(fabs(rate_b - rate_a) < MIN_ERROR_RATE_CHANGE) continue;
+            double p = proportionTest(a, n_a, b, n_b);
+            if(p >= SIGNIFICANCE) continue;
+
+            const char * note = "";
+            if(a == 0) note = " (new)";
+            else if(b == 0) note = " (gone)";
+            printf("%-12s %-28s %8.3f%% -> %-8.3f%% p=%.4f%s\n", traceOpName(o), strerror(e),
+                    rate_a * 100, rate_b * 100, p, note);
+            flagged++;
+        }
+    }
+    if(flagged == 0) printf("None\n");
+    printf("Changes of at least %.1f%% of calls, significant at p < %.2f (two-proportion z-test)\n", MIN_ERROR_RATE_CHANGE * 100, SIGNIFICANCE);
+    return flagged;
+}
+
+struct path_delta {
+    const char * path;
+    int64_t before;
+    int64_t after;
+    bool before_approx;     // Path fell outside the tracked set, so its count is an upper bound
+    bool after_approx;
+};
+
+static int comparePathDeltas(const void * a, const void * b) {
+    const struct path_delta * pa = a;
+    const struct path_delta * pb = b;
+    int64_t da = llabs(pa->after - pa->before);
+    int64_t db = llabs(pb->after - pb->before);
+    if(da == db) return 0;
+    return da < db ? 1 : -1;
+}
+
+// Counts for paths outside a full tracked set are at most the smallest tracked count
+static int64_t untrackedPathCount(struct trace_stats * stats) {
+    if(stats->num_paths < TOP_PATHS_CAPACITY) return 0;
+    return stats->paths[stats->num_paths - 1].count;
+}
+
+static void diffPaths(struct trace_stats * before, struct trace_stats * after) {
+    GHashTable * index = g_hash_table_new(g_str_hash, g_str_equal);
+    struct path_delta * deltas = malloc((before->num_paths + after->num_paths + 1) * sizeof(*deltas));
+    int num_deltas = 0;
+    for(int i = 0; i < before->num_paths; i++) {
+        struct path_delta * delta = &deltas[num_deltas];
+        delta->path = before->paths[i].path;
+        delta->before = before->paths[i].count;
+        delta->before_approx = before->paths[i].error > 0;
+        delta->after = untrackedPathCount(after);
+        delta->after_approx = delta->after > 0;
+        g_hash_table_insert(index, (gpointer) delta->path, GINT_TO_POINTER(num_deltas + 1));
+        num_deltas++;
+    }
+    for(int i = 0; i < after->num_paths; i++) {
+        int idx = GPOINTER_TO_INT(g_hash_table_lookup(index, after->paths[i].path)) - 1;
+        struct path_delta * delta;
+        if(idx >= 0) {
+            delta = &deltas[idx];
+        } else {
+            delta = &deltas[num_deltas++];
+            delta->path = after->paths[i].path;
+            delta->before = untrackedPathCount(before);
+            delta->before_approx = delta->before > 0;
+        }
+        delta->after = after->paths[i].count;
+        delta->after_approx = after->paths[i].error > 0;
+    }
+    qsort(deltas, num_deltas, sizeof(*deltas), comparePathDeltas);
+
+    printf("\nLargest changes in calls per path:\n");
+    int printed = 0;
+    for(int i = 0; i < num_deltas && printed < PRINTED_PATHS; i++) {
+        if(deltas[i].before == deltas[i].after) continue;
+        printf("%s%10lld -> %s%-10lld  %s\n", deltas[i].before_approx ? "~" : " ", (long long) deltas[i].before,
+                deltas[i].after_approx ? "~" : " ", (long long) deltas[i].after, deltas[i].path);
+        printed++;
+    }
+    if(printed == 0) printf("None\n");
+
+    free(deltas);
+    g_hash_table_destroy(index);
+}
+
+/* Report pairs of consecutive calls whose rate has changed, e.g. an extra getattr after every open
+ * Rates are per call of the first operation, so they don't depend on how long each trace ran for
+ */
+static int diffPatterns(struct trace_stats * before, struct trace_stats * after) {
+    int flagged = 0;
+    printf("\nChanged call patterns (per call of the first operation):\n");
+    for(int a = 0; a < NUM_OPCODES; a++) {
+        for(int b = 0; b < NUM_OPCODES; b++) {
+            uint64_t count_before = before->patterns[a][b];
+            uint64_t count_after = after->patterns[a][b];
+            if(count_before < MIN_PATTERN_CALLS && count_after < MIN_PATTERN_CALLS) continue;
+            double rate_before = before->ops[a].invokes > 0 ? (double) count_before / before->ops[a].invokes : 0;
+            double rate_after = after->ops[a].invokes > 0 ? (double) count_after / after->ops[a].invokes : 0;
+            if(fabs(rate_after - rate_before) < MIN_PATTERN_CHANGE) continue;
+
+            const char * note = "";
+            if(count_before == 0) note = " (new)";
+            else if(count_after == 0) note = " (gone)";
+            printf("%12s -> %-12s %6.2f -> %-6.2f%s\n", traceOpName(a), traceOpName(b), rate_before, rate_after, note);
+            flagged++;
+        }
+    }
+    if(flagged == 0) printf("None\n");
+    return flagged;
+}
+
+// Print the differences between two analyzed traces, returning how many were flagged
+int diffTraceStats(struct trace_stats * before, struct trace_stats * after) {
+    printf("Before: %llu records over %.1f seconds\n", (unsigned long long) before->records,
+            before->records > 0 ? (before->max_timestamp - before->min_timestamp) / 1000000.0 : 0.0);
+    printf("After:  %llu records over %.1f seconds\n\n", (unsigned long long) after->records,
+            after->records > 0 ? (after->max_timestamp - after->min_timestamp) / 1000000.0 : 0.0);
+
+    int flagged = diffOperations(before, after);
+    flagged += diffErrors(before, after);
+    diffPaths(before, after);
+    flagged += diffPatterns(before, after);
+    return flagged;
+}
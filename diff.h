@@ -0,0 +1,8 @@
+#pragma once
+#define _GNU_SOURCE
+
+#include "analyzer.h"
+
+double ksTest(const uint64_t * hist_a, const uint64_t * hist_b, int buckets, double * d_out);
+double proportionTest(uint64_t x_a, uint64_t n_a, uint64_t x_b, uint64_t n_b);
+int diffTraceStats(struct trace_stats * before, struct trace_stats * after);
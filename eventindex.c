@@ -0,0 +1,342 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <glib.h>
+
+#include "eventindex.h"
+
+// Names accepted for errno in queries, as the wrapper only reports the number
+static const struct {
+    const char * name;
+    int err;
+} errno_names[] = {
+    {"EPERM", EPERM}, {"ENOENT", ENOENT}, {"EINTR", EINTR}, {"EIO", EIO}, {"ENXIO", ENXIO},
+    {"E2BIG", E2BIG}, {"EBADF", EBADF}, {"EAGAIN", EAGAIN}, {"ENOMEM", ENOMEM}, {"EACCES", EACCES},
+    {"EFAULT", EFAULT}, {"EBUSY", EBUSY}, {"EEXIST", EEXIST}, {"EXDEV", EXDEV}, {"ENODEV", ENODEV},
+    {"ENOTDIR", ENOTDIR}, {"EISDIR", EISDIR}, {"EINVAL", EINVAL}, {"ENFILE", ENFILE}, {"EMFILE", EMFILE},
+    {"EFBIG", EFBIG}, {"ENOSPC", ENOSPC}, {"ESPIPE", ESPIPE}, {"EROFS", EROFS}, {"EMLINK", EMLINK},
+    {"ERANGE", ERANGE}, {"EDEADLK", EDEADLK}, {"ENAMETOOLONG", ENAMETOOLONG}, {"ENOLCK", ENOLCK},
+    {"ENOSYS", ENOSYS}, {"ENOTEMPTY", ENOTEMPTY}, {"ELOOP", ELOOP}, {"ENODATA", ENODATA},
+    {"ENOTSUP", ENOTSUP}, {"EOVERFLOW", EOVERFLOW}, {"ESTALE", ESTALE}, {"EDQUOT", EDQUOT}
+};
+
+static GArray * newIds() {
+    return g_array_new(FALSE, FALSE, sizeof(guint64));
+}
+
+static void freeIds(gpointer ids) {
+    g_array_free(ids, TRUE);
+}
+
+// Add an id to a list, which it's already at the end of if the event was indexed under this key before
+static void appendId(GArray * ids, guint64 id) {
+    if(ids->len > 0 && g_array_index(ids, guint64, ids->len - 1) == id) return;
+    g_array_append_val(ids, id);
+}
+
+static GArray * lookupIds(GHashTable * table, guint key, bool create) {
+    GArray * ids = g_hash_table_lookup(table, GUINT_TO_POINTER(key));
+    if(ids == NULL && create) {
+        ids = newIds();
+        g_hash_table_insert(table, GUINT_TO_POINTER(key), ids);
+    }
+    return ids;
+}
+
+// Trigrams are never zero, as none of their bytes can be the end of the string
+static guint trigramKey(const char * s) {
+    const unsigned char * c = (const unsigned char *) s;
+    return (c[0] << 16) | (c[1] << 8) | c[2];
+}
+
+static void indexPath(struct event_index * index, guint64 id, const char * path) {
+    if(path == NULL) return;
+    size_t len = strlen(path);
+    for(size_t i = 0; i + 3 <= len; i++) {
+        appendId(lookupIds(index->by_trigram, trigramKey(path + i), TRUE), id);
+    }
+}
+
+// First position at or after from holding an id no less than id, galloping as the ids searched for rise
+static guint lowerBound(GArray * ids, guint from, guint64 id) {
+    guint step = 1;
+    guint high = from;
+    while(high < ids->len && g_array_index(ids, guint64, high) < id) {
+        from = high + 1;
+        high += step;
+        step *= 2;
+    }
+    high = MIN(high, ids->len);
+    while(from < high) {
+        guint mid = from + (high - from) / 2;
+        if(g_array_index(ids, guint64, mid) < id) from = mid + 1;
+        else high = mid;
+    }
+    return from;
+}
+
+static void compactIds(GArray * ids, guint64 oldest) {
+    guint evicted = lowerBound(ids, 0, oldest);
+    if(evicted > 0) g_array_remove_range(ids, 0, evicted);
+}
+
+static gboolean compactEntry(gpointer key, gpointer value, gpointer oldest) {
+    compactIds(value, *(guint64 *) oldest);
+    return ((GArray *) value)->len == 0;
+}
+
+struct event_index * eventIndexNew() {
+    struct event_index * index = calloc(1, sizeof(*index));
+    index->failed = newIds();
+    index->by_errno = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, freeIds);
+    index->by_trigram = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, freeIds);
+    return index;
+}
+
+void eventIndexClear(struct event_index * index) {
+    for(int o = 0; o < FDT_STATS_OPS; o++) {
+        if(index->by_opcode[o] != NULL) freeIds(index->by_opcode[o]);
+        index->by_opcode[o] = NULL;
+    }
+    g_array_set_size(index->failed, 0);
+    g_hash_table_remove_all(index->by_errno);
+    g_hash_table_remove_all(index->by_trigram);
+    index->oldest = 0;
+    index->path_oldest = 0;
+    index->compacted = 0;
+    index->paths_compacted = 0;
+}
+
+void eventIndexFree(struct event_index * index) {
+    eventIndexClear(index);
+    freeIds(index->failed);
+    g_hash_table_destroy(index->by_errno);
+    g_hash_table_destroy(index->by_trigram);
+    free(index);
+}
+
+void eventIndexAdd(struct event_index * index, guint64 id, const struct event_keys * keys) {
+    if(index->by_opcode[keys->opcode] == NULL) index->by_opcode[keys->opcode] = newIds();
+    appendId(index->by_opcode[keys->opcode], id);
+    if(keys->failed) {
+        appendId(index->failed, id);
+        appendId(lookupIds(index->by_errno, keys->err, TRUE), id);
+    }
+    indexPath(index, id, keys->path);
+    indexPath(index, id, keys->newpath);
+}
+
+/* Forget the events before oldest
+ * Lists are only searched from oldest onwards, so evicted ids can be left in them until enough have built up
+ * to be worth a pass over every list
+ */
+void eventIndexEvict(struct event_index * index, guint64 oldest) {
+    index->oldest = oldest;
+    eventIndexEvictPaths(index, MAX(index->path_oldest, oldest));
+    if(oldest - index->compacted < EVENT_INDEX_COMPACT_INTERVAL) return;
+
+    for(int o = 0; o < FDT_STATS_OPS; o++) {
+        if(index->by_opcode[o] != NULL) compactIds(index->by_opcode[o], oldest);
+    }
+    compactIds(index->failed, oldest);
+    g_hash_table_foreach_remove(index->by_errno, compactEntry, &oldest);
+    index->compacted = oldest;
+}
+
+// Forget the paths of the events before path_oldest, which are still found by their other keys
+void eventIndexEvictPaths(struct event_index * index, guint64 path_oldest) {
+    index->path_oldest = path_oldest;
+    if(path_oldest - index->paths_compacted < EVENT_INDEX_COMPACT_INTERVAL) return;
+
+    g_hash_table_foreach_remove(index->by_trigram, compactEntry, &path_oldest);
+    index->paths_compacted = path_oldest;
+}
+
+static gint compareLength(gconstpointer a, gconstpointer b) {
+    guint len_a = (*(GArray * const *) a)->len;
+    guint len_b = (*(GArray * const *) b)->len;
+    return len_a < len_b ? -1 : len_a > len_b;
+}
+
+// Add the ids from from up to to that are in every list
+static void intersectIds(GPtrArray * lists, guint64 from, guint64 to, GArray * found) {
+    if(lists->len == 0 || from >= to) return;
+    for(guint l = 0; l < lists->len; l++) {
+        if(g_ptr_array_index(lists, l) == NULL) return;
+    }
+    g_ptr_array_sort(lists, compareLength);
+    guint pos[lists->len];
+    for(guint l = 0; l < lists->len; l++) {
+        pos[l] = lowerBound(g_ptr_array_index(lists, l), 0, from);
+    }
+
+    GArray * shortest = g_ptr_array_index(lists, 0);
+    for(guint i = pos[0]; i < shortest->len; i++) {
+        guint64 id = g_array_index(shortest, guint64, i);
+        if(id >= to) return;
+        bool in_all = TRUE;
+        for(guint l = 1; l < lists->len && in_all; l++) {
+            GArray * ids = g_ptr_array_index(lists, l);
+            pos[l] = lowerBound(ids, pos[l], id);
+            if(pos[l] == ids->len) return;
+            in_all = g_array_index(ids, guint64, pos[l]) == id;
+        }
+        if(in_all) g_array_append_val(found, id);
+    }
+}
+
+/* Ids of the events that may match a query, oldest first, or NULL if none of its conditions are indexed
+ * Operations and errors are matched exactly, but paths are only narrowed down to those containing every
+ * trigram of the glob, so the events found still need to be checked with eventQueryMatches. Paths are
+ * no longer indexed for older events, so if nothing else narrows those down, every event from oldest up
+ * to scan_to has to be checked as well.
+ */
+GArray * eventIndexCandidates(struct event_index * index, const struct event_query * query, guint64 * scan_to) {
+    GPtrArray * lists = g_ptr_array_new();
+    GPtrArray * path_lists = g_ptr_array_new();
+    *scan_to = index->oldest;
+
+    if(query->opcode >= 0) {
+        g_ptr_array_add(lists, index->by_opcode[query->opcode]);
+    }
+    if(query->failed) {
+        g_ptr_array_add(lists, query->err != 0 ? lookupIds(index->by_errno, query->err, FALSE) : index->failed);
+    }
+    if(query->path_glob != NULL) {
+        // Only runs of at least three literal characters between wildcards have trigrams to look up
+        const char * run = query->path_glob;
+        for(const char * c = run; ; c++) {
+            if(*c != '*' && *c != '?' && *c != '\0') continue;
+            for(const char * t = run; t + 3 <= c; t++) {
+                g_ptr_array_add(path_lists, g_hash_table_lookup(index->by_trigram, GUINT_TO_POINTER(trigramKey(t))));
+            }
+            if(*c == '\0') break;
+            run = c + 1;
+        }
+    }
+
+    GArray * found = NULL;
+    if(lists->len > 0 || path_lists->len > 0) {
+        found = newIds();
+        guint64 path_from = MAX(index->path_oldest, index->oldest);
+        if(lists->len > 0) {
+            intersectIds(lists, index->oldest, path_from, found);
+        } else {
+            *scan_to = path_from;
+        }
+        for(guint l = 0; l < path_lists->len; l++) {
+            g_ptr_array_add(lists, g_ptr_array_index(path_lists, l));
+        }
+        intersectIds(lists, path_from, G_MAXUINT64, found);
+    }
+    g_ptr_array_free(lists, TRUE);
+    g_ptr_array_free(path_lists, TRUE);
+    return found;
+}
+
+/* Queries */
+
+static int errnoFromName(const char * name) {
+    for(int i = 0; i < G_N_ELEMENTS(errno_names); i++) {
+        if(strcmp(errno_names[i].name, name) == 0) return errno_names[i].err;
+    }
+    return 0;
+}
+
+static int opcodeFromName(const char * name) {
+    for(int i = 0; i < FDT_NUM_OP_NAMES; i++) {
+        if(strcmp(fdt_op_names[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+// errno given by name, by number, or as the negative value returned
+static bool parseErrno(const char * value, struct event_query * query) {
+    query->failed = TRUE;
+    if(strcmp(value, "*") == 0 || strcmp(value, "any") == 0) return TRUE;
+    char * end;
+    long err = strtol(value, &end, 10);
+    query->err = *value != '\0' && *end == '\0' ? labs(err) : errnoFromName(value);
+    return query->err != 0;
+}
+
+static bool setPathGlob(struct event_query * query, char * glob, char ** error) {
+    if(query->path_glob != NULL) {
+        *error = g_strdup("Only one path can be given");
+        g_free(glob);
+        return FALSE;
+    }
+    query->path_glob = glob;
+    query->path_spec = g_pattern_spec_new(glob);
+    return TRUE;
+}
+
+/* Parse a filter typed into the debugger, made up of terms separated by spaces:
+ *   an operation, as "rename" or "op:rename"
+ *   an error, as "EXDEV", "errno:18", "errno:-18" or "failed" for any error
+ *   a path, as a glob such as "*.tmp" or "path:/tmp/x", and otherwise as text anywhere in the path
+ * All the terms have to match. On failure the error is set to a message to be freed by the caller.
+ */
+bool eventQueryParse(const char * text, struct event_query * query, char ** error) {
+    memset(query, 0, sizeof(*query));
+    query->opcode = -1;
+    *error = NULL;
+
+    gchar ** terms = g_strsplit(text, " ", -1);
+    for(gchar ** term = terms; *term != NULL && *error == NULL; term++) {
+        const char * t = *term;
+        if(*t == '\0') continue;
+
+        if(g_str_has_prefix(t, "op:") || opcodeFromName(t) >= 0) {
+            const char * name = g_str_has_prefix(t, "op:") ? t + 3 : t;
+            if(query->opcode >= 0) {
+                *error = g_strdup("Only one operation can be given");
+            } else if((query->opcode = opcodeFromName(name)) < 0) {
+                *error = g_strdup_printf("Unknown operation %s", name);
+            }
+        } else if(g_str_has_prefix(t, "errno:")) {
+            if(!parseErrno(t + 6, query)) *error = g_strdup_printf("Unknown errno %s", t + 6);
+        } else if(errnoFromName(t) != 0) {
+            parseErrno(t, query);
+        } else if(strcmp(t, "failed") == 0) {
+            query->failed = TRUE;
+        } else if(g_str_has_prefix(t, "path:")) {
+            setPathGlob(query, g_strdup(t + 5), error);
+        } else if(strchr(t, '*') != NULL || strchr(t, '?') != NULL) {
+            setPathGlob(query, g_strdup(t), error);
+        } else {
+            setPathGlob(query, g_strdup_printf("*%s*", t), error);
+        }
+    }
+    g_strfreev(terms);
+
+    if(*error != NULL) {
+        eventQueryClear(query);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void eventQueryClear(struct event_query * query) {
+    g_free(query->path_glob);
+    if(query->path_spec != NULL) g_pattern_spec_free(query->path_spec);
+    memset(query, 0, sizeof(*query));
+    query->opcode = -1;
+}
+
+bool eventQueryIsEmpty(const struct event_query * query) {
+    return query->opcode < 0 && !query->failed && query->path_glob == NULL;
+}
+
+bool eventQueryMatches(const struct event_query * query, const struct event_keys * keys) {
+    if(query->opcode >= 0 && keys->opcode != query->opcode) return FALSE;
+    if(query->failed && (!keys->failed || (query->err != 0 && keys->err != query->err))) return FALSE;
+    if(query->path_spec != NULL) {
+        bool path_matches = keys->path != NULL && g_pattern_match_string(query->path_spec, keys->path);
+        bool newpath_matches = keys->newpath != NULL && g_pattern_match_string(query->path_spec, keys->newpath);
+        if(!path_matches && !newpath_matches) return FALSE;
+    }
+    return TRUE;
+}
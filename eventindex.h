@@ -0,0 +1,62 @@
+#pragma once
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdbool.h>
+#include <glib.h>
+
+#include "fdt_stats.h"
+
+// Evicted ids are only dropped from the posting lists once this many have built up
+#define EVENT_INDEX_COMPACT_INTERVAL 65536
+
+/* Posting lists of debugger event ids, added to as events arrive so that the event list can be filtered
+ * without looking at every event
+ *
+ * Ids only ever grow, so each list is kept sorted just by appending to it. A query intersects the lists
+ * for its conditions by searching the others for each id of the shortest, so its cost depends on how
+ * selective it is rather than on how many events are kept.
+ *
+ * Path trigrams take far more space than the rest, so they're only kept for the events still in memory,
+ * and dropped for events that have been spilled to disk while those are still indexed otherwise.
+ */
+struct event_index {
+    GArray * by_opcode[FDT_STATS_OPS];  // guint64 ids of the invocations and returns of each operation
+    GArray * failed;                    // Returns with a negative value
+    GHashTable * by_errno;              // errno to the returns that failed with it
+    GHashTable * by_trigram;            // Three bytes of a path, packed into an int, to the events on paths containing them
+    guint64 oldest;                     // Ids before this have been evicted
+    guint64 path_oldest;                // Paths of events before this are no longer indexed
+    guint64 compacted;                  // Value of oldest when evicted ids were last dropped from the lists
+    guint64 paths_compacted;            // Likewise for path_oldest and the trigram lists
+};
+
+// What an event is indexed by. Returns don't carry paths, so they're given those of their invocation
+struct event_keys {
+    int opcode;
+    bool failed;
+    int err;                    // errno, if failed
+    const char * path;          // NULL if the call has no path
+    const char * newpath;       // Second path of rename, link and symlink
+};
+
+// A filter on the event list, where unset conditions match everything
+struct event_query {
+    int opcode;                 // -1 for any operation
+    bool failed;
+    int err;                    // 0 for any errno, if failed
+    char * path_glob;           // Matched against either path of the call
+    GPatternSpec * path_spec;
+};
+
+struct event_index * eventIndexNew();
+void eventIndexFree(struct event_index * index);
+void eventIndexClear(struct event_index * index);
+void eventIndexAdd(struct event_index * index, guint64 id, const struct event_keys * keys);
+void eventIndexEvict(struct event_index * index, guint64 oldest);
+void eventIndexEvictPaths(struct event_index * index, guint64 path_oldest);
+GArray * eventIndexCandidates(struct event_index * index, const struct event_query * query, guint64 * scan_to);
+
+bool eventQueryParse(const char * text, struct event_query * query, char ** error);
+void eventQueryClear(struct event_query * query);
+bool eventQueryIsEmpty(const struct event_query * query);
+bool eventQueryMatches(const struct event_query * query, const struct event_keys * keys);
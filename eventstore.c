@@ -0,0 +1,610 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gtk/gtk.h>
+
+#include "cJSON.h"
+#include "eventindex.h"
+#include "eventstore.h"
+#include "spill.h"
+
+static void fdt_event_store_tree_model_init(GtkTreeModelIface * iface);
+
+G_DEFINE_TYPE_WITH_CODE(FdtEventStore, fdt_event_store, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL, fdt_event_store_tree_model_init))
+
+/* Iterators point at an event, and at a node of its parsed parameters for child rows
+ * user_data is the event's id and user_data2 the node, which is NULL for the event's own row. Spilled
+ * records move between pages as they're read back, so iterators hold ids rather than records.
+ */
+
+// Paths of a call, kept from its invocation until it returns
+struct call_paths {
+    char * path;
+    char * newpath;
+};
+
+static void freeCallPaths(gpointer data) {
+    struct call_paths * paths = data;
+    free(paths->path);
+    free(paths->newpath);
+    free(paths);
+}
+
+static void clearRecord(struct event_record * record) {
+    free(record->params);
+    cJSON_Delete(record->params_tree);
+    free(record->path);
+    free(record->newpath);
+    memset(record, 0, sizeof(*record));
+}
+
+static size_t recordBytes(struct event_record * record) {
+    size_t bytes = sizeof(*record);
+    if(record->params != NULL) bytes += strlen(record->params) + 1;
+    if(record->path != NULL) bytes += strlen(record->path) + 1;
+    if(record->newpath != NULL) bytes += strlen(record->newpath) + 1;
+    return bytes;
+}
+
+static void recordKeys(struct event_record * record, struct event_keys * keys) {
+    keys->opcode = record->opcode;
+    keys->failed = record->is_return && record->has_returnval && record->returnval < 0;
+    keys->err = keys->failed ? -record->returnval : 0;
+    keys->path = record->path;
+    keys->newpath = record->newpath;
+}
+
+static guint64 ringOldest(FdtEventStore * store) {
+    return store->next_id - store->count;
+}
+
+static guint numRows(FdtEventStore * store) {
+    return store->filtered ? store->matches->len - store->matches_start : (guint) (store->next_id - store->first_row);
+}
+
+/* Pages of spilled records */
+
+static void freePage(gpointer data) {
+    struct event_page * page = data;
+    for(int i = 0; i < EVENT_STORE_PAGE_SIZE; i++) {
+        clearRecord(&page->records[i]);
+    }
+    free(page);
+}
+
+// A page with an expanded record is kept, as the view has rows for the nodes of its parameters
+static bool pageInUse(struct event_page * page) {
+    for(int i = 0; i < EVENT_STORE_PAGE_SIZE; i++) {
+        if(page->records[i].params_tree != NULL) return TRUE;
+    }
+    return FALSE;
+}
+
+static struct event_page * findPage(FdtEventStore * store, guint64 id) {
+    guint64 first_id = id & ~(guint64) (EVENT_STORE_PAGE_SIZE - 1);
+    for(guint p = 0; p < store->pages->len; p++) {
+        struct event_page * page = g_ptr_array_index(store->pages, p);
+        if(page->first_id == first_id) {
+            page->last_used = ++store->page_clock;
+            return page;
+        }
+    }
+    return NULL;
+}
+
+static void copySpilledRecord(guint64 id, const struct event_record * record, gpointer data) {
+    struct event_page * page = data;
+    struct event_record * copy = &page->records[id - page->first_id];
+    *copy = *record;
+    copy->path = record->path != NULL ? strdup(record->path) : NULL;
+    copy->newpath = record->newpath != NULL ? strdup(record->newpath) : NULL;
+    copy->params = record->params != NULL ? strdup(record->params) : NULL;
+}
+
+// Read back the page holding a spilled event, making room by dropping the least recently used page
+static struct event_page * loadPage(FdtEventStore * store, guint64 id) {
+    struct event_page * page = findPage(store, id);
+    if(page != NULL) return page;
+
+    if(store->pages->len >= EVENT_STORE_PAGES) {
+        int lru = -1;
+        for(guint p = 0; p < store->pages->len; p++) {
+            struct event_page * candidate = g_ptr_array_index(store->pages, p);
+            if(pageInUse(candidate)) continue;
+            if(lru < 0 || candidate->last_used < ((struct event_page *) g_ptr_array_index(store->pages, lru))->last_used) lru = p;
+        }
+        if(lru >= 0) g_ptr_array_remove_index_fast(store->pages, lru);
+    }
+
+    page = calloc(1, sizeof(*page));
+    page->first_id = id & ~(guint64) (EVENT_STORE_PAGE_SIZE - 1);
+    page->last_used = ++store->page_clock;
+    spillScan(store->spill, page->first_id, MIN(page->first_id + EVENT_STORE_PAGE_SIZE, ringOldest(store)), copySpilledRecord, page);
+    g_ptr_array_add(store->pages, page);
+    return page;
+}
+
+static struct event_record * recordWithId(FdtEventStore * store, guint64 id) {
+    if(id >= ringOldest(store)) return &store->ring[id % store->capacity];
+    struct event_page * page = loadPage(store, id);
+    return &page->records[id - page->first_id];
+}
+
+/* Rows */
+
+// Id of the event shown at a top-level row, where row 0 is the newest event, or the newest match if filtered
+static bool idAtRow(FdtEventStore * store, guint row, guint64 * id) {
+    if(row >= numRows(store)) return FALSE;
+    if(store->filtered) {
+        *id = g_array_index(store->matches, guint64, store->matches->len - 1 - row);
+    } else {
+        *id = store->next_id - 1 - row;
+    }
+    return TRUE;
+}
+
+static guint rowOfId(FdtEventStore * store, guint64 id) {
+    if(!store->filtered) return (guint) (store->next_id - 1 - id);
+
+    // Matches are sorted by id, so the event is found by bisection
+    guint low = store->matches_start;
+    guint high = store->matches->len;
+    while(low < high) {
+        guint mid = low + (high - low) / 2;
+        if(g_array_index(store->matches, guint64, mid) < id) low = mid + 1;
+        else high = mid;
+    }
+    return store->matches->len - 1 - low;
+}
+
+static cJSON * recordParams(struct event_record * record) {
+    if(record->params_tree == NULL && record->params != NULL) {
+        record->params_tree = cJSON_Parse(record->params);
+    }
+    return record->params_tree;
+}
+
+static gboolean setIter(FdtEventStore * store, GtkTreeIter * iter, guint64 id, cJSON * node) {
+    iter->stamp = store->stamp;
+    iter->user_data = GSIZE_TO_POINTER(id);
+    iter->user_data2 = node;
+    iter->user_data3 = NULL;
+    return TRUE;
+}
+
+static guint64 iterId(GtkTreeIter * iter) {
+    return GPOINTER_TO_SIZE(iter->user_data);
+}
+
+static struct event_record * iterRecord(GtkTreeModel * model, GtkTreeIter * iter) {
+    return recordWithId(FDT_EVENT_STORE(model), iterId(iter));
+}
+
+// Append the indices leading from parent down to target, returning FALSE if target isn't beneath parent
+static bool appendNodePath(cJSON * parent, cJSON * target, GtkTreePath * path) {
+    int i = 0;
+    for(cJSON * child = parent->child; child != NULL; child = child->next, i++) {
+        gtk_tree_path_append_index(path, i);
+        if(child == target || appendNodePath(child, target, path)) return TRUE;
+        gtk_tree_path_up(path);
+    }
+    return FALSE;
+}
+
+// cJSON nodes don't know their parent, but parameters are small enough to just search for it
+static cJSON * findParentNode(cJSON * parent, cJSON * target) {
+    for(cJSON * child = parent->child; child != NULL; child = child->next) {
+        if(child == target) return parent;
+        cJSON * found = findParentNode(child, target);
+        if(found != NULL) return found;
+    }
+    return NULL;
+}
+
+static GtkTreeModelFlags getFlags(GtkTreeModel * model) {
+    return 0;
+}
+
+static gint getNColumns(GtkTreeModel * model) {
+    return EVENT_STORE_N_COLUMNS;
+}
+
+static GType getColumnType(GtkTreeModel * model, gint column) {
+    return column == EVENT_STORE_COL_SEQNUM ? G_TYPE_INT : G_TYPE_STRING;
+}
+
+static gboolean iterNthChild(GtkTreeModel * model, GtkTreeIter * iter, GtkTreeIter * parent, gint n) {
+    FdtEventStore * store = FDT_EVENT_STORE(model);
+    if(n < 0) return FALSE;
+    if(parent == NULL) {
+        guint64 id;
+        return idAtRow(store, n, &id) && setIter(store, iter, id, NULL);
+    }
+
+    cJSON * node = parent->user_data2 != NULL ? parent->user_data2 : recordParams(iterRecord(model, parent));
+    if(node == NULL) return FALSE;
+    cJSON * child = node->child;
+    for(int i = 0; i < n && child != NULL; i++) child = child->next;
+    return child != NULL && setIter(store, iter, iterId(parent), child);
+}
+
+static gboolean getIter(GtkTreeModel * model, GtkTreeIter * iter, GtkTreePath * path) {
+    gint depth = gtk_tree_path_get_depth(path);
+    gint * indices = gtk_tree_path_get_indices(path);
+    GtkTreeIter parent;
+    for(int d = 0; d < depth; d++) {
+        if(!iterNthChild(model, iter, d == 0 ? NULL : &parent, indices[d])) return FALSE;
+        parent = *iter;
+    }
+    return depth > 0;
+}
+
+static GtkTreePath * getPath(GtkTreeModel * model, GtkTreeIter * iter) {
+    FdtEventStore * store = FDT_EVENT_STORE(model);
+    GtkTreePath * path = gtk_tree_path_new_from_indices(rowOfId(store, iterId(iter)), -1);
+    if(iter->user_data2 != NULL) {
+        appendNodePath(recordParams(iterRecord(model, iter)), iter->user_data2, path);
+    }
+    return path;
+}
+
+static void getValue(GtkTreeModel * model, GtkTreeIter * iter, gint column, GValue * value) {
+    struct event_record * record = iterRecord(model, iter);
+    cJSON * node = iter->user_data2;
+    g_value_init(value, getColumnType(model, column));
+
+    switch(column) {
+        case EVENT_STORE_COL_SEQNUM:
+            g_value_set_int(value, node == NULL ? record->seqnum : 0);
+        break;
+        case EVENT_STORE_COL_TYPE:
+            if(node != NULL) {
+                g_value_set_string(value, NULL);
+            } else if(!record->is_return) {
+                g_value_set_static_string(value, "invoke");
+            } else if(record->has_returnval) {
+                g_value_take_string(value, g_strdup_printf("return %d", record->returnval));
+            } else {
+                g_value_set_static_string(value, "return");
+            }
+        break;
+        case EVENT_STORE_COL_NAME:
+            if(node == NULL) {
+                g_value_set_static_string(value, record->name);
+            } else if(node->type == cJSON_Array || node->type == cJSON_Object) {
+                // inside node, so just show the label
+                g_value_set_string(value, node->string);
+            } else {
+                // leaf node, so show label with value (eg, "timestamp: 0189276")
+                char * leaf_value = cJSON_PrintUnformatted(node);
+                if(node->string != NULL) {
+                    g_value_take_string(value, g_strdup_printf("%s: %s", node->string, leaf_value));
+                } else {
+                    g_value_set_string(value, leaf_value);
+                }
+                free(leaf_value);
+            }
+        break;
+    }
+}
+
+static gboolean iterNext(GtkTreeModel * model, GtkTreeIter * iter) {
+    FdtEventStore * store = FDT_EVENT_STORE(model);
+    cJSON * node = iter->user_data2;
+    if(node == NULL) {
+        // Rows run from newest to oldest
+        guint64 id;
+        return idAtRow(store, rowOfId(store, iterId(iter)) + 1, &id) && setIter(store, iter, id, NULL);
+    }
+    return node->next != NULL && setIter(store, iter, iterId(iter), node->next);
+}
+
+static gboolean iterChildren(GtkTreeModel * model, GtkTreeIter * iter, GtkTreeIter * parent) {
+    return iterNthChild(model, iter, parent, 0);
+}
+
+static gboolean iterHasChild(GtkTreeModel * model, GtkTreeIter * iter) {
+    cJSON * node = iter->user_data2;
+    // Answered without parsing, as the view asks this of every row it shows
+    if(node == NULL) return iterRecord(model, iter)->params != NULL;
+    return node->child != NULL;
+}
+
+static gint iterNChildren(GtkTreeModel * model, GtkTreeIter * iter) {
+    FdtEventStore * store = FDT_EVENT_STORE(model);
+    if(iter == NULL) return numRows(store);
+
+    cJSON * node = iter->user_data2 != NULL ? iter->user_data2 : recordParams(iterRecord(model, iter));
+    return node != NULL ? cJSON_GetArraySize(node) : 0;
+}
+
+static gboolean iterParent(GtkTreeModel * model, GtkTreeIter * iter, GtkTreeIter * child) {
+    FdtEventStore * store = FDT_EVENT_STORE(model);
+    cJSON * node = child->user_data2;
+    if(node == NULL) return FALSE;
+
+    cJSON * root = recordParams(iterRecord(model, child));
+    cJSON * parent = findParentNode(root, node);
+    if(parent == NULL) return FALSE;
+    return setIter(store, iter, iterId(child), parent == root ? NULL : parent);
+}
+
+static void fdt_event_store_tree_model_init(GtkTreeModelIface * iface) {
+    iface->get_flags = getFlags;
+    iface->get_n_columns = getNColumns;
+    iface->get_column_type = getColumnType;
+    iface->get_iter = getIter;
+    iface->get_path = getPath;
+    iface->get_value = getValue;
+    iface->iter_next = iterNext;
+    iface->iter_children = iterChildren;
+    iface->iter_has_child = iterHasChild;
+    iface->iter_n_children = iterNChildren;
+    iface->iter_nth_child = iterNthChild;
+    iface->iter_parent = iterParent;
+}
+
+static void fdt_event_store_finalize(GObject * object) {
+    FdtEventStore * store = FDT_EVENT_STORE(object);
+    for(guint i = 0; i < store->capacity; i++) {
+        clearRecord(&store->ring[i]);
+    }
+    free(store->ring);
+    g_ptr_array_free(store->pages, TRUE);
+    if(store->spill != NULL) spillFree(store->spill);
+    eventIndexFree(store->index);
+    g_hash_table_destroy(store->pending);
+    eventQueryClear(&store->filter);
+    g_array_free(store->matches, TRUE);
+    G_OBJECT_CLASS(fdt_event_store_parent_class)->finalize(object);
+}
+
+static void fdt_event_store_class_init(FdtEventStoreClass * klass) {
+    G_OBJECT_CLASS(klass)->finalize = fdt_event_store_finalize;
+}
+
+static void fdt_event_store_init(FdtEventStore * store) {
+    store->stamp = g_random_int();
+}
+
+/* Create a store keeping up to capacity events or max_bytes of them in memory, and up to spill_capacity
+ * older events on disk, which can be 0 to drop events as they leave memory
+ */
+FdtEventStore * eventStoreNew(guint capacity, size_t max_bytes, guint64 spill_capacity) {
+    FdtEventStore * store = g_object_new(FDT_TYPE_EVENT_STORE, NULL);
+    store->capacity = capacity;
+    store->max_bytes = max_bytes;
+    store->ring = calloc(capacity, sizeof(*store->ring));
+    store->spill = spill_capacity > 0 ? spillNew(spill_capacity) : NULL;
+    store->pages = g_ptr_array_new_with_free_func(freePage);
+    store->index = eventIndexNew();
+    store->pending = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, freeCallPaths);
+    eventQueryClear(&store->filter);
+    store->matches = g_array_new(FALSE, FALSE, sizeof(guint64));
+    return store;
+}
+
+/* Drop the parsed parameters of a collapsed event, which are parsed again if it's expanded
+ * The view has forgotten the child rows by then, so nothing still refers to them
+ */
+void eventStoreCollapsed(FdtEventStore * store, GtkTreeIter * iter) {
+    if(iter->user_data2 != NULL) return;
+    struct event_record * record = iterRecord(GTK_TREE_MODEL(store), iter);
+    cJSON_Delete(record->params_tree);
+    record->params_tree = NULL;
+}
+
+// Number of events shown without a filter, including those spilled to disk
+guint eventStoreCount(FdtEventStore * store) {
+    return (guint) (store->next_id - store->first_row);
+}
+
+guint eventStoreMatchCount(FdtEventStore * store) {
+    return numRows(store);
+}
+
+struct filter_scan {
+    const struct event_query * query;
+    GArray * matches;
+};
+
+static void matchSpilledRecord(guint64 id, const struct event_record * record, gpointer data) {
+    struct filter_scan * scan = data;
+    struct event_keys keys;
+    recordKeys((struct event_record *) record, &keys);
+    if(eventQueryMatches(scan->query, &keys)) g_array_append_val(scan->matches, id);
+}
+
+// Add the matching events from from up to to, reading those that have been spilled straight from disk
+static void matchRange(FdtEventStore * store, const struct event_query * query, guint64 from, guint64 to) {
+    struct filter_scan scan = {query, store->matches};
+    guint64 ring_oldest = ringOldest(store);
+    if(store->spill != NULL && from < ring_oldest) {
+        spillScan(store->spill, from, MIN(to, ring_oldest), matchSpilledRecord, &scan);
+    }
+    struct event_keys keys;
+    for(guint64 id = MAX(from, ring_oldest); id < to; id++) {
+        recordKeys(recordWithId(store, id), &keys);
+        if(eventQueryMatches(query, &keys)) g_array_append_val(store->matches, id);
+    }
+}
+
+/* Show only the events matching a filter, or all of them if it's empty. See eventQueryParse for the syntax
+ * Every row can change, so the store should be taken out of its view while this is done. On failure the
+ * filter is left as it was and the error is set to a message to be freed by the caller.
+ */
+bool eventStoreSetFilter(FdtEventStore * store, const char * text, char ** error) {
+    struct event_query query;
+    if(!eventQueryParse(text, &query, error)) return FALSE;
+
+    eventQueryClear(&store->filter);
+    store->filter = query;
+    store->filtered = !eventQueryIsEmpty(&query);
+    store->stamp++;
+    g_array_set_size(store->matches, 0);
+    store->matches_start = 0;
+    if(!store->filtered) return TRUE;
+
+    // Check every event the index can't narrow down, then those it narrows it down to
+    guint64 scan_to;
+    GArray * candidates = eventIndexCandidates(store->index, &query, &scan_to);
+    matchRange(store, &query, store->first_row, candidates != NULL ? scan_to : store->next_id);
+    for(guint i = 0; candidates != NULL && i < candidates->len; i++) {
+        guint64 id = g_array_index(candidates, guint64, i);
+        if(query.path_glob == NULL) {
+            // Operations and errors are indexed exactly, so only paths need checking
+            g_array_append_val(store->matches, id);
+            continue;
+        }
+        // Runs of consecutive candidates are checked together, so spilled ones are read back in one go
+        guint run = i + 1;
+        while(run < candidates->len && g_array_index(candidates, guint64, run) == id + (run - i)) run++;
+        matchRange(store, &query, id, id + (run - i));
+        i = run - 1;
+    }
+    if(candidates != NULL) g_array_free(candidates, TRUE);
+    return TRUE;
+}
+
+/* Stop showing the events before first, from the bottom up as the view expects
+ * The pages they were read back into are dropped too, even if expanded, as their rows have gone
+ */
+static void dropRows(FdtEventStore * store, guint64 first) {
+    GtkTreeModel * model = GTK_TREE_MODEL(store);
+    if(first <= store->first_row) return;
+    eventIndexEvict(store->index, first);
+
+    if(!store->filtered) {
+        while(store->first_row < first) {
+            store->first_row++;
+            GtkTreePath * path = gtk_tree_path_new_from_indices(numRows(store), -1);
+            gtk_tree_model_row_deleted(model, path);
+            gtk_tree_path_free(path);
+        }
+    } else {
+        store->first_row = first;
+        while(numRows(store) > 0 && g_array_index(store->matches, guint64, store->matches_start) < first) {
+            store->matches_start++;
+            GtkTreePath * path = gtk_tree_path_new_from_indices(numRows(store), -1);
+            gtk_tree_model_row_deleted(model, path);
+            gtk_tree_path_free(path);
+        }
+        if(store->matches_start >= store->matches->len / 2) {
+            g_array_remove_range(store->matches, 0, store->matches_start);
+            store->matches_start = 0;
+        }
+    }
+
+    for(guint p = store->pages->len; p > 0; p--) {
+        struct event_page * page = g_ptr_array_index(store->pages, p - 1);
+        if(page->first_id + EVENT_STORE_PAGE_SIZE <= first) g_ptr_array_remove_index_fast(store->pages, p - 1);
+    }
+}
+
+/* Move the oldest event out of the ring, to disk if there's a spill and otherwise out of the view
+ * An event whose page has been read back is moved into it, as is one that's expanded, so that the
+ * nodes the view has rows for stay put
+ */
+static void evictOldest(FdtEventStore * store) {
+    guint64 oldest = ringOldest(store);
+    struct event_record * record = &store->ring[oldest % store->capacity];
+    store->bytes -= recordBytes(record);
+    store->count--;
+    eventIndexEvictPaths(store->index, oldest + 1);
+
+    if(store->spill != NULL && spillWrite(store->spill, record)) {
+        struct event_page * page = findPage(store, oldest);
+        if(page == NULL && record->params_tree != NULL) page = loadPage(store, oldest);
+        if(page != NULL) {
+            struct event_record * slot = &page->records[oldest - page->first_id];
+            clearRecord(slot);
+            *slot = *record;
+            memset(record, 0, sizeof(*record));
+        } else {
+            clearRecord(record);
+        }
+        dropRows(store, spillFirstId(store->spill));
+    } else {
+        clearRecord(record);
+        dropRows(store, oldest + 1);
+    }
+}
+
+// Add an event as the first row, moving the oldest events out of the ring if it's full. The event isn't kept
+// If there's a filter, the event is indexed but only shown if it matches
+void eventStoreAppend(FdtEventStore * store, cJSON * event) {
+    GtkTreeModel * model = GTK_TREE_MODEL(store);
+
+    if(store->count == store->capacity) {
+        evictOldest(store);
+    }
+
+    struct event_record * record = &store->ring[store->next_id % store->capacity];
+    record->id = store->next_id++;
+    record->seqnum = cJSON_GetObjectItem(event, "seqnum")->valueint;
+    record->name = g_intern_string(cJSON_GetObjectItem(event, "name")->valuestring);
+    record->opcode = fdt_stats_opcode(record->name);
+    gpointer seqnum_key = GINT_TO_POINTER(record->seqnum);
+
+    cJSON * params;
+    if(strcmp(cJSON_GetObjectItem(event, "type")->valuestring, "return") == 0) {
+        record->is_return = TRUE;
+        params = cJSON_GetObjectItem(event, "modified_params");
+
+        // Returns are searched for by the paths they were called with
+        struct call_paths * paths = g_hash_table_lookup(store->pending, seqnum_key);
+        if(paths != NULL) {
+            g_hash_table_steal(store->pending, seqnum_key);
+            record->path = paths->path;
+            record->newpath = paths->newpath;
+            free(paths);
+        }
+
+        // If there is a return value then show this next to the event
+        cJSON * returnval_obj = cJSON_GetObjectItem(event, "returnval");
+        if(returnval_obj != NULL && returnval_obj->type == cJSON_Number) {
+            record->has_returnval = TRUE;
+            record->returnval = returnval_obj->valueint;
+        }
+    } else {
+        params = cJSON_GetObjectItem(event, "params");
+        cJSON * path = params != NULL ? cJSON_GetObjectItem(params, "path") : NULL;
+        cJSON * newpath = params != NULL ? cJSON_GetObjectItem(params, "newpath") : NULL;
+        if(path != NULL && path->type == cJSON_String) record->path = strdup(path->valuestring);
+        if(newpath != NULL && newpath->type == cJSON_String) record->newpath = strdup(newpath->valuestring);
+        if(record->path != NULL) {
+            struct call_paths * paths = calloc(1, sizeof(*paths));
+            paths->path = strdup(record->path);
+            paths->newpath = record->newpath != NULL ? strdup(record->newpath) : NULL;
+            g_hash_table_replace(store->pending, seqnum_key, paths);
+        }
+    }
+    if(params != NULL && (params->type == cJSON_Array || params->type == cJSON_Object) && params->child != NULL) {
+        record->params = cJSON_PrintUnformatted(params);
+    }
+    store->count++;
+    store->bytes += recordBytes(record);
+
+    struct event_keys keys;
+    recordKeys(record, &keys);
+    eventIndexAdd(store->index, record->id, &keys);
+    if(!store->filtered || eventQueryMatches(&store->filter, &keys)) {
+        if(store->filtered) g_array_append_val(store->matches, record->id);
+
+        GtkTreeIter iter;
+        setIter(store, &iter, record->id, NULL);
+        GtkTreePath * path = gtk_tree_path_new_from_indices(0, -1);
+        gtk_tree_model_row_inserted(model, path, &iter);
+        if(record->params != NULL) {
+            gtk_tree_model_row_has_child_toggled(model, path, &iter);
+        }
+        gtk_tree_path_free(path);
+    }
+
+    // Events with large parameters take the ring over its byte budget before it's full
+    while(store->bytes > store->max_bytes && store->count > 1) {
+        evictOldest(store);
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+#define _GNU_SOURCE
+#include <gtk/gtk.h>
+#include <stdbool.h>
+
+#include "cJSON.h"
+#include "eventindex.h"
+
+/* A GtkTreeModel over a fixed-capacity ring of debugger events
+ *
+ * Each event is kept as a compact record, and rows are only built when the tree view asks for them,
+ * so the cost of an event doesn't depend on how many came before it. Once the ring holds as many
+ * events or bytes as it's allowed, the oldest events are spilled to disk, and read back a page at a
+ * time when their rows are looked at, until there are too many on disk as well. Parameters are kept
+ * as unformatted JSON and only parsed into child rows when a row is expanded.
+ *
+ * Events are indexed as they're added, and a filter narrows the rows down to the matching events, which
+ * are found through the index rather than by looking at each event.
+ *
+ * Rows are newest first, with the columns: call number (int), event type (string), function or parameter (string)
+ */
+
+#define FDT_TYPE_EVENT_STORE (fdt_event_store_get_type())
+#define FDT_EVENT_STORE(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), FDT_TYPE_EVENT_STORE, FdtEventStore))
+#define FDT_IS_EVENT_STORE(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj), FDT_TYPE_EVENT_STORE))
+
+enum {
+    EVENT_STORE_COL_SEQNUM,
+    EVENT_STORE_COL_TYPE,
+    EVENT_STORE_COL_NAME,
+    EVENT_STORE_N_COLUMNS
+};
+
+// Spilled events are read back in pages of this many, of which this many are kept
+#define EVENT_STORE_PAGE_SHIFT 8
+#define EVENT_STORE_PAGE_SIZE (1 << EVENT_STORE_PAGE_SHIFT)
+#define EVENT_STORE_PAGES 16
+
+struct event_spill;
+
+struct event_record {
+    guint64 id;             // Position in the stream of events, which decides the record's slot in the ring
+    int seqnum;
+    const char * name;      // Interned, as there are only as many names as FUSE operations
+    bool is_return;
+    bool has_returnval;
+    int returnval;
+    int opcode;
+    char * path;            // Paths of the call, which returns are given from their invocation
+    char * newpath;
+    char * params;          // Unformatted JSON, or NULL if there's nothing to expand
+    cJSON * params_tree;    // Parsed from params once the row is expanded
+};
+
+// Spilled events read back for display, which are kept while any of them is expanded
+struct event_page {
+    guint64 first_id;
+    guint64 last_used;
+    struct event_record records[EVENT_STORE_PAGE_SIZE];
+};
+
+typedef struct _FdtEventStore FdtEventStore;
+typedef struct _FdtEventStoreClass FdtEventStoreClass;
+
+struct _FdtEventStore {
+    GObject parent;
+    gint stamp;
+    struct event_record * ring;
+    guint capacity;
+    guint count;
+    size_t bytes;                   // Taken by the records in the ring
+    size_t max_bytes;
+    guint64 next_id;
+    guint64 first_row;              // Id of the oldest event shown, which may have been spilled
+    struct event_spill * spill;     // NULL if events are dropped once they leave the ring
+    GPtrArray * pages;              // struct event_page
+    guint64 page_clock;
+    struct event_index * index;
+    GHashTable * pending;           // seqnum to the paths of calls that haven't returned yet
+    bool filtered;
+    struct event_query filter;
+    GArray * matches;               // guint64 ids of the events matching the filter, oldest first
+    guint matches_start;            // Matches before this have been dropped
+};
+
+struct _FdtEventStoreClass {
+    GObjectClass parent_class;
+};
+
+GType fdt_event_store_get_type(void);
+FdtEventStore * eventStoreNew(guint capacity, size_t max_bytes, guint64 spill_capacity);
+void eventStoreAppend(FdtEventStore * store, cJSON * event);
+void eventStoreCollapsed(FdtEventStore * store, GtkTreeIter * iter);
+guint eventStoreCount(FdtEventStore * store);
+bool eventStoreSetFilter(FdtEventStore * store, const char * text, char ** error);
+guint eventStoreMatchCount(FdtEventStore * store);
@@ -0,0 +1,404 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <glib.h>
+
+#include "trace.h"
+#include "export.h"
+
+/* Exporters from recorded traces to timeline viewer formats
+ *
+ * Each return record carries the time spent in the filesystem, so a complete slice can be written as soon
+ * as its return is read and the trace is converted in a single streaming pass. The filesystem is shown as
+ * one process with a track per worker thread. Every client process which made a call is shown too, with
+ * flow arrows from the client to the worker which dispatched the call and back again for the reply.
+ * The time a request spends queued in the kernel isn't recorded, so the client slice starts at dispatch.
+ *
+ * Only the client's pid is recorded, not its thread, so calls a multithreaded client makes at once would
+ * overlap on a single track. Each client gets as many tracks as it had calls in flight at once instead.
+ */
+
+// Process ID used for the filesystem in the exported trace, as the recorded pids are those of clients
+#define FS_PID 0
+
+// Track UUIDs for the Perfetto format
+#define FS_TRACK_UUID 1
+#define THREAD_TRACK_UUID(tid) (0x100000000ULL | (uint32_t) (tid))
+#define CLIENT_TRACK_UUID(pid) (0x200000000ULL | (uint32_t) (pid))
+#define CLIENT_LANE_TRACK_UUID(pid, lane) (0x1000000000000000ULL | (uint64_t) (lane) << 32 | (uint32_t) (pid))
+
+// Flow IDs, two per call: request (client to worker) and reply (worker to client)
+#define REQUEST_FLOW_ID(seqnum) ((uint64_t) (seqnum) * 2 + 1)
+#define REPLY_FLOW_ID(seqnum) ((uint64_t) (seqnum) * 2 + 2)
+
+/* Tracks of a client's calls, filled in order of their returns
+ * A lane only ever holds calls ending before the next one starts, so its slices never overlap
+ */
+struct client_lanes {
+    GHashTable * clients;   // Pid to a GArray of the latest end of a call on each of its lanes
+};
+
+static void freeLaneEnds(gpointer ends) {
+    g_array_free(ends, TRUE);
+}
+
+static void clientLanesInit(struct client_lanes * lanes) {
+    lanes->clients = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, freeLaneEnds);
+}
+
+static void clientLanesFree(struct client_lanes * lanes) {
+    g_hash_table_destroy(lanes->clients);
+}
+
+// Find a lane for a call from start to end in nanoseconds, setting is_new if it's the client's first use of it
+static guint clientLane(struct client_lanes * lanes, int pid, uint64_t start, uint64_t end, bool * is_new) {
+    GArray * ends = g_hash_table_lookup(lanes->clients, GINT_TO_POINTER(pid));
+    if(ends == NULL) {
+        ends = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+        g_hash_table_insert(lanes->clients, GINT_TO_POINTER(pid), ends);
+    }
+    guint lane;
+    for(lane = 0; lane < ends->len && g_array_index(ends, uint64_t, lane) > start; lane++);
+    *is_new = lane == ends->len;
+    if(*is_new) g_array_append_val(ends, end);
+    else g_array_index(ends, uint64_t, lane) = MAX(g_array_index(ends, uint64_t, lane), end);
+    return lane;
+}
+
+static void writeJSONString(FILE * out, const char * str) {
+    fputc('"', out);
+    for(const unsigned char * c = (const unsigned char *) str; *c != '\0'; c++) {
+        if(*c == '"' || *c == '\\') fprintf(out, "\\%c", *c);
+        else if(*c < 0x20) fprintf(out, "\\u%04x", *c);
+        else fputc(*c, out);
+    }
+    fputc('"', out);
+}
+
+// Writes the separator between events, as the trace is streamed as a single JSON array
+static void startChromeEvent(FILE * out, bool * first) {
+    fputs(*first ? "\n" : ",\n", out);
+    *first = false;
+}
+
+static void writeChromeSlice(FILE * out, bool * first, const struct trace_record * rec, int pid, int tid,
+        double start, double dur) {
+    startChromeEvent(out, first);
+    fprintf(out, "{\"name\":\"%s\",\"cat\":\"fuse\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"seqnum\":%lld",
+            traceOpName(rec->opcode), start, dur, pid, tid, (long long) rec->seqnum);
+    const char * path = traceRecordPath(rec);
+    if(path != NULL) {
+        fputs(",\"path\":", out);
+        writeJSONString(out, path);
+    }
+    if(rec->type == TRACE_TYPE_RETURN && rec->has_retval) {
+        fprintf(out, ",\"returnval\":%d", rec->retval);
+    }
+    fputs("}}", out);
+}
+
+static void writeChromeFlow(FILE * out, bool * first, const char * ph, uint64_t id, int pid, int tid, double ts, bool enclosing) {
+    startChromeEvent(out, first);
+    fprintf(out, "{\"name\":\"call\",\"cat\":\"fuse\",\"ph\":\"%s\",\"id\":%llu,\"pid\":%d,\"tid\":%d,\"ts\":%.3f%s}",
+            ph, (unsigned long long) id, pid, tid, ts, enclosing ? ",\"bp\":\"e\"" : "");
+}
+
+static void writeChromeTrackName(FILE * out, bool * first, int pid, int tid, const char * kind, const char * name) {
+    startChromeEvent(out, first);
+    fprintf(out, "{\"name\":\"%s\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":", kind, pid, tid);
+    writeJSONString(out, name);
+    fputs("}}", out);
+}
+
+bool exportChromeTrace(struct trace_reader * reader, FILE * out) {
+    GHashTable * seen_tids = g_hash_table_new(g_direct_hash, g_direct_equal);
+    GHashTable * seen_pids = g_hash_table_new(g_direct_hash, g_direct_equal);
+    struct client_lanes lanes;
+    clientLanesInit(&lanes);
+
+    // Invocations which haven't returned yet, so calls still in progress at the end aren't lost
+    GHashTable * pending = g_hash_table_new(g_int64_hash, g_int64_equal);
+
+    bool first = true;
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", out);
+    writeChromeTrackName(out, &first, FS_PID, 0, "process_name", "FUSE filesystem");
+
+    struct trace_cursor cursor;
+    traceRewind(reader, &cursor);
+    const struct trace_record * rec;
+    char name[64];
+    while((rec = traceNext(&cursor)) != NULL) {
+        if(g_hash_table_insert(seen_tids, GINT_TO_POINTER(rec->tid), NULL)) {
+            snprintf(name, sizeof(name), "worker %d", rec->tid);
+            writeChromeTrackName(out, &first, FS_PID, rec->tid, "thread_name", name);
+        }
+        if(rec->pid != 0 && g_hash_table_insert(seen_pids, GINT_TO_POINTER(rec->pid), NULL)) {
+            snprintf(name, sizeof(name), "client %d", rec->pid);
+            writeChromeTrackName(out, &first, rec->pid, 0, "process_name", name);
+        }
+
+        if(rec->type == TRACE_TYPE_INVOKE) {
+            g_hash_table_insert(pending, (gpointer) &rec->seqnum, (gpointer) rec);
+            continue;
+        }
+        g_hash_table_remove(pending, &rec->seqnum);
+        if(rec->elapsed < 0) continue;
+
+        double end = rec->timestamp;
+        double dur = rec->elapsed / 1000.0;
+        double start = end - dur;
+        writeChromeSlice(out, &first, rec, FS_PID, rec->tid, start, dur);
+        if(rec->pid != 0) {
+            // Client lanes are numbered from 1, as tid 0 is taken by the process name
+            uint64_t end_ns = (uint64_t) rec->timestamp * 1000;
+            bool new_lane;
+            int lane = clientLane(&lanes, rec->pid, end_ns - rec->elapsed, end_ns, &new_lane) + 1;
+            if(new_lane) {
+                snprintf(name, sizeof(name), "calls %d", lane);
+                writeChromeTrackName(out, &first, rec->pid, lane, "thread_name", name);
+            }
+            writeChromeSlice(out, &first, rec, rec->pid, lane, start, dur);
+            writeChromeFlow(out, &first, "s", REQUEST_FLOW_ID(rec->seqnum), rec->pid, lane, start, false);
+            writeChromeFlow(out, &first, "f", REQUEST_FLOW_ID(rec->seqnum), FS_PID, rec->tid, start, true);
+            writeChromeFlow(out, &first, "s", REPLY_FLOW_ID(rec->seqnum), FS_PID, rec->tid, end, false);
+            writeChromeFlow(out, &first, "f", REPLY_FLOW_ID(rec->seqnum), rec->pid, lane, end, true);
+        }
+    }
+
+    // Calls which never returned are left open until the end of the trace
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, pending);
+    while(g_hash_table_iter_next(&iter, &key, &value)) {
+        rec = value;
+        startChromeEvent(out, &first);
+        fprintf(out, "{\"name\":\"%s\",\"cat\":\"fuse\",\"ph\":\"B\",\"ts\":%lld,\"pid\":%d,\"tid\":%d,\"args\":{\"seqnum\":%lld}}",
+                traceOpName(rec->opcode), (long long) rec->timestamp, FS_PID, rec->tid, (long long) rec->seqnum);
+    }
+    fputs("\n]}\n", out);
+
+    g_hash_table_destroy(pending);
+    clientLanesFree(&lanes);
+    g_hash_table_destroy(seen_pids);
+    g_hash_table_destroy(seen_tids);
+    return ferror(out) == 0;
+}
+
+/* Minimal protobuf encoder for the Perfetto trace format
+ * Nested messages are built in their own buffer and then appended with their length
+ */
+struct pb_buf {
+    uint8_t * data;
+    size_t len;
+    size_t capacity;
+};
+
+static void pbReserve(struct pb_buf * buf, size_t extra) {
+    if(buf->len + extra > buf->capacity) {
+        buf->capacity = (buf->len + extra) * 2;
+        buf->data = realloc(buf->data, buf->capacity);
+    }
+}
+
+static void pbVarint(struct pb_buf * buf, uint64_t value) {
+    pbReserve(buf, 10);
+    do {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        buf->data[buf->len++] = byte | (value != 0 ? 0x80 : 0);
+    } while(value != 0);
+}
+
+static void pbTag(struct pb_buf * buf, int field, int wire_type) {
+    pbVarint(buf, (uint64_t) field << 3 | wire_type);
+}
+
+static void pbUint(struct pb_buf * buf, int field, uint64_t value) {
+    pbTag(buf, field, 0);
+    pbVarint(buf, value);
+}
+
+static void pbFixed64(struct pb_buf * buf, int field, uint64_t value) {
+    pbTag(buf, field, 1);
+    pbReserve(buf, 8);
+    for(int i = 0; i < 8; i++) {
+        buf->data[buf->len++] = value >> (8 * i);
+    }
+}
+
+static void pbBytes(struct pb_buf * buf, int field, const void * data, size_t len) {
+    pbTag(buf, field, 2);
+    pbVarint(buf, len);
+    pbReserve(buf, len);
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+static void pbString(struct pb_buf * buf, int field, const char * str) {
+    pbBytes(buf, field, str, strlen(str));
+}
+
+static void pbMessage(struct pb_buf * buf, int field, struct pb_buf * msg) {
+    pbBytes(buf, field, msg->data, msg->len);
+    msg->len = 0;
+}
+
+// Field numbers from perfetto/protos/perfetto/trace
+#define TRACE_PACKET 1
+#define PACKET_TIMESTAMP 8
+#define PACKET_SEQUENCE_ID 10
+#define PACKET_TRACK_EVENT 11
+#define PACKET_TRACK_DESCRIPTOR 60
+#define EVENT_DEBUG_ANNOTATIONS 4
+#define EVENT_TYPE 9
+#define EVENT_TRACK_UUID 11
+#define EVENT_NAME 23
+#define EVENT_FLOW_IDS 47
+#define EVENT_TERMINATING_FLOW_IDS 48
+#define EVENT_TYPE_SLICE_BEGIN 1
+#define EVENT_TYPE_SLICE_END 2
+#define ANNOTATION_INT_VALUE 4
+#define ANNOTATION_STRING_VALUE 6
+#define ANNOTATION_NAME 10
+#define DESCRIPTOR_UUID 1
+#define DESCRIPTOR_NAME 2
+#define DESCRIPTOR_PROCESS 3
+#define DESCRIPTOR_THREAD 4
+#define DESCRIPTOR_PARENT_UUID 5
+#define PROCESS_PID 1
+#define PROCESS_NAME 6
+#define THREAD_PID 1
+#define THREAD_TID 2
+#define THREAD_NAME 5
+
+// Every packet is written from a single sequence
+#define SEQUENCE_ID 1
+
+struct perfetto_writer {
+    FILE * out;
+    struct pb_buf packet;
+    struct pb_buf event;
+    struct pb_buf inner;
+};
+
+static void writePacket(struct perfetto_writer * writer) {
+    struct pb_buf framed = {0};
+    pbMessage(&framed, TRACE_PACKET, &writer->packet);
+    fwrite(framed.data, 1, framed.len, writer->out);
+    free(framed.data);
+}
+
+static void writeProcessTrack(struct perfetto_writer * writer, uint64_t uuid, int pid, const char * name) {
+    pbUint(&writer->inner, PROCESS_PID, pid);
+    pbString(&writer->inner, PROCESS_NAME, name);
+    pbUint(&writer->event, DESCRIPTOR_UUID, uuid);
+    pbMessage(&writer->event, DESCRIPTOR_PROCESS, &writer->inner);
+    pbMessage(&writer->packet, PACKET_TRACK_DESCRIPTOR, &writer->event);
+    writePacket(writer);
+}
+
+static void writeThreadTrack(struct perfetto_writer * writer, int tid) {
+    char name[64];
+    snprintf(name, sizeof(name), "worker %d", tid);
+    pbUint(&writer->inner, THREAD_PID, FS_PID);
+    pbUint(&writer->inner, THREAD_TID, tid);
+    pbString(&writer->inner, THREAD_NAME, name);
+    pbUint(&writer->event, DESCRIPTOR_UUID, THREAD_TRACK_UUID(tid));
+    pbUint(&writer->event, DESCRIPTOR_PARENT_UUID, FS_TRACK_UUID);
+    pbMessage(&writer->event, DESCRIPTOR_THREAD, &writer->inner);
+    pbMessage(&writer->packet, PACKET_TRACK_DESCRIPTOR, &writer->event);
+    writePacket(writer);
+}
+
+static void writeClientLaneTrack(struct perfetto_writer * writer, int pid, guint lane) {
+    char name[64];
+    snprintf(name, sizeof(name), "calls %u", lane + 1);
+    pbUint(&writer->event, DESCRIPTOR_UUID, CLIENT_LANE_TRACK_UUID(pid, lane));
+    pbString(&writer->event, DESCRIPTOR_NAME, name);
+    pbUint(&writer->event, DESCRIPTOR_PARENT_UUID, CLIENT_TRACK_UUID(pid));
+    pbMessage(&writer->packet, PACKET_TRACK_DESCRIPTOR, &writer->event);
+    writePacket(writer);
+}
+
+static void writeSliceEvent(struct perfetto_writer * writer, const struct trace_record * rec, uint64_t track,
+        uint64_t ts, int type, uint64_t flow_id, uint64_t terminating_flow_id) {
+    pbUint(&writer->packet, PACKET_TIMESTAMP, ts);
+    pbUint(&writer->packet, PACKET_SEQUENCE_ID, SEQUENCE_ID);
+    pbUint(&writer->event, EVENT_TYPE, type);
+    pbUint(&writer->event, EVENT_TRACK_UUID, track);
+    if(type == EVENT_TYPE_SLICE_BEGIN) {
+        pbString(&writer->event, EVENT_NAME, traceOpName(rec->opcode));
+
+        pbString(&writer->inner, ANNOTATION_NAME, "seqnum");
+        pbUint(&writer->inner, ANNOTATION_INT_VALUE, rec->seqnum);
+        pbMessage(&writer->event, EVENT_DEBUG_ANNOTATIONS, &writer->inner);
+        const char * path = traceRecordPath(rec);
+        if(path != NULL) {
+            pbString(&writer->inner, ANNOTATION_NAME, "path");
+            pbString(&writer->inner, ANNOTATION_STRING_VALUE, path);
+            pbMessage(&writer->event, EVENT_DEBUG_ANNOTATIONS, &writer->inner);
+        }
+        if(rec->has_retval) {
+            pbString(&writer->inner, ANNOTATION_NAME, "returnval");
+            pbUint(&writer->inner, ANNOTATION_INT_VALUE, (int64_t) rec->retval);
+            pbMessage(&writer->event, EVENT_DEBUG_ANNOTATIONS, &writer->inner);
+        }
+    }
+    if(flow_id != 0) pbFixed64(&writer->event, EVENT_FLOW_IDS, flow_id);
+    if(terminating_flow_id != 0) pbFixed64(&writer->event, EVENT_TERMINATING_FLOW_IDS, terminating_flow_id);
+    pbMessage(&writer->packet, PACKET_TRACK_EVENT, &writer->event);
+    writePacket(writer);
+}
+
+bool exportPerfettoTrace(struct trace_reader * reader, FILE * out) {
+    struct perfetto_writer writer = {0};
+    writer.out = out;
+    GHashTable * seen_tids = g_hash_table_new(g_direct_hash, g_direct_equal);
+    GHashTable * seen_pids = g_hash_table_new(g_direct_hash, g_direct_equal);
+    struct client_lanes lanes;
+    clientLanesInit(&lanes);
+
+    writeProcessTrack(&writer, FS_TRACK_UUID, FS_PID, "FUSE filesystem");
+
+    struct trace_cursor cursor;
+    traceRewind(reader, &cursor);
+    const struct trace_record * rec;
+    while((rec = traceNext(&cursor)) != NULL) {
+        if(rec->type != TRACE_TYPE_RETURN || rec->elapsed < 0) continue;
+
+        if(g_hash_table_insert(seen_tids, GINT_TO_POINTER(rec->tid), NULL)) {
+            writeThreadTrack(&writer, rec->tid);
+        }
+        if(rec->pid != 0 && g_hash_table_insert(seen_pids, GINT_TO_POINTER(rec->pid), NULL)) {
+            char name[64];
+            snprintf(name, sizeof(name), "client %d", rec->pid);
+            writeProcessTrack(&writer, CLIENT_TRACK_UUID(rec->pid), rec->pid, name);
+        }
+
+        uint64_t end = (uint64_t) rec->timestamp * 1000;
+        uint64_t start = end - rec->elapsed;
+        if(rec->pid != 0) {
+            bool new_lane;
+            guint lane = clientLane(&lanes, rec->pid, start, end, &new_lane);
+            if(new_lane) writeClientLaneTrack(&writer, rec->pid, lane);
+            uint64_t client_track = CLIENT_LANE_TRACK_UUID(rec->pid, lane);
+            writeSliceEvent(&writer, rec, client_track, start, EVENT_TYPE_SLICE_BEGIN, REQUEST_FLOW_ID(rec->seqnum), 0);
+            writeSliceEvent(&writer, rec, THREAD_TRACK_UUID(rec->tid), start, EVENT_TYPE_SLICE_BEGIN, 0, REQUEST_FLOW_ID(rec->seqnum));
+            writeSliceEvent(&writer, rec, THREAD_TRACK_UUID(rec->tid), end, EVENT_TYPE_SLICE_END, REPLY_FLOW_ID(rec->seqnum), 0);
+            writeSliceEvent(&writer, rec, client_track, end, EVENT_TYPE_SLICE_END, 0, REPLY_FLOW_ID(rec->seqnum));
+        } else {
+            writeSliceEvent(&writer, rec, THREAD_TRACK_UUID(rec->tid), start, EVENT_TYPE_SLICE_BEGIN, 0, 0);
+            writeSliceEvent(&writer, rec, THREAD_TRACK_UUID(rec->tid), end, EVENT_TYPE_SLICE_END, 0, 0);
+        }
+    }
+
+    free(writer.packet.data);
+    free(writer.event.data);
+    free(writer.inner.data);
+    clientLanesFree(&lanes);
+    g_hash_table_destroy(seen_pids);
+    g_hash_table_destroy(seen_tids);
+    return ferror(out) == 0;
+}
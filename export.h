@@ -0,0 +1,9 @@
+#pragma once
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "trace.h"
+
+bool exportChromeTrace(struct trace_reader * reader, FILE * out);
+bool exportPerfettoTrace(struct trace_reader * reader, FILE * out);
@@ -20,6 +20,14 @@
 #include "testsuite.h"
 #include "debugger.h"
 #include "logger.h"
+#include "daemon.h"
+#include "trace.h"
+#include "analyzer.h"
+#include "export.h"
+#include "diff.h"
+#include "top.h"
+#include "session.h"
+#include "capture.h"
 #include "fdt.h"
 
 static const int window_width = 700;
@@ -29,7 +37,7 @@ static char * abs_libpath;
 static char * bin_path;
 static bool usingGui = TRUE;
 static int terminate_calls = 0;
-static pid_t fuse_pid = 0;
+static struct fdt_session * current_session = NULL;     // Filesystem being run from the GUI or a single-filesystem tool
 static stopToolFunc stopToolFunction = NULL;
 static bool * fs_mounted;
 static char * shared_error;
@@ -39,6 +47,16 @@ static cJSON * resources;
 static time_t last_fuse_activity;
 static char * skipped_tests = NULL;
 static char * test_data_file = NULL;
+static int testsuite_jobs = 1;
+
+/* GUI wakeups
+ * Reader threads write a byte to this pipe when they queue something for the GUI, instead of the GUI
+ * polling their queues whenever it's idle. Updates are coalesced so the GUI redraws at most once a frame
+ */
+static int gui_wakeup_pipe[2] = {-1, -1};
+static volatile gint gui_wakeup_pending = 0;
+static guint gui_update_timer = 0;
+static const guint gui_frame_ms = 16;
 
 /* GUI widgets */
 static GtkWidget * window;
@@ -140,16 +158,23 @@ char * getLibpath() {
     return abs_libpath;
 }
 
+struct fdt_session * getCurrentSession() {
+    return current_session;
+}
+
 pid_t getFusePID() {
-    return fuse_pid;
+    return current_session != NULL ? current_session->fuse_pid : 0;
 }
 
 void setFusePID(pid_t id) {
-    fuse_pid = id;
+    if(current_session != NULL) {
+        current_session->fuse_pid = id;
+    }
 }
 
 void setFSMounted(bool mounted) {
     *fs_mounted = mounted;
+    requestGUIUpdate();
 }
 
 bool isFSMounted() {
@@ -182,11 +207,15 @@ void setTestDataFile(const char * fname) {
     printf("Set test data file to '%s'\n", test_data_file);
 }
 
+void setTestsuiteJobs(int jobs) {
+    testsuite_jobs = jobs;
+}
+
 /**
  * Setup environment variables before executing a filesystem, mainly for communication with libfuse
  */
-char ** getEnvVarsForFork(const char * tool_ident) {
-    char ** envp = malloc(10 * sizeof(char*));
+char ** getEnvVarsForFork(const char * tool_ident, struct fdt_session * session) {
+    char ** envp = malloc(12 * sizeof(char*));
     size_t envp_idx = 0;
 
     // Use libfuse wrapper is used instead of the real libfuse
@@ -206,7 +235,21 @@ char ** getEnvVarsForFork(const char * tool_ident) {
     char * tool_declaration = malloc(tool_len);
     snprintf(tool_declaration, tool_len, "FDT_TOOL=%s", tool_ident);
     envp[envp_idx++] = tool_declaration;
-    
+
+    // Identify the session, so that the wrapper talks to us over this filesystem's own channels
+    size_t session_len = strlen(FDT_SESSION_ENV) + 1 + strlen(session->id) + 1;
+    char * session_declaration = malloc(session_len);
+    snprintf(session_declaration, session_len, "%s=%s", FDT_SESSION_ENV, session->id);
+    envp[envp_idx++] = session_declaration;
+
+    // The runtime directory may come from our own environment, which the filesystem doesn't inherit
+    char runtime_dir[PATH_MAX];
+    fdt_runtime_dir(runtime_dir, sizeof(runtime_dir));
+    size_t runtime_len = strlen(FDT_RUNTIME_DIR_ENV) + 1 + strlen(runtime_dir) + 1;
+    char * runtime_declaration = malloc(runtime_len);
+    snprintf(runtime_declaration, runtime_len, "%s=%s", FDT_RUNTIME_DIR_ENV, runtime_dir);
+    envp[envp_idx++] = runtime_declaration;
+
     // Add the name and IDs of any skipped tests (for the wizard)
     if(skipped_tests != NULL) {
         size_t skipped_len = 14 + strlen(skipped_tests) + 1;
@@ -224,6 +267,14 @@ char ** getEnvVarsForFork(const char * tool_ident) {
         envp[envp_idx++] = testdatafile_declaration;
     }
 
+    // Let the test suite run several groups at once, for filesystems that can be run that way
+    if(testsuite_jobs > 1) {
+        size_t jobs_len = strlen(FDT_TS_JOBS_ENV) + 1 + 11 + 1;
+        char * jobs_declaration = malloc(jobs_len);
+        snprintf(jobs_declaration, jobs_len, "%s=%d", FDT_TS_JOBS_ENV, testsuite_jobs);
+        envp[envp_idx++] = jobs_declaration;
+    }
+
     envp[envp_idx++] = 0;
     return envp;
 }
@@ -296,11 +347,8 @@ void terminate() {
 
     if(stopToolFunction == NULL) {
         // No stop function available, so it's safe to just quit
-        if(fuse_pid != 0) {
-            // Might as well send a SIGKILL to make sure the FUSE binary isn't left running
-            kill(fuse_pid, SIGKILL);
-            printf("Sent SIGKILL to FUSE binary\n");
-        }
+        // Might as well send a SIGKILL to make sure no FUSE binary is left running
+        sessionKillAll(SIGKILL);
         exit(0);
     } else {
         // Killing the FUSE binary -should- cause the debugger to close gracefully
@@ -313,10 +361,8 @@ void terminate() {
             //kill(fuse_pid, SIGINT);
         } else {
             printf("Terminating forcefully\n");
-            if(fuse_pid != 0) {
-                kill(fuse_pid, SIGKILL);
-                printf("Sent SIGKILL to FUSE binary\n");
-            }
+            sessionKillAll(SIGKILL);
+            printf("Sent SIGKILL to FUSE binaries\n");
             exit(0);
         }
     }
@@ -463,14 +509,63 @@ void showGUI(int * argc, char *** argv) {
     gtk_widget_show(window_vbox);
     gtk_window_present(GTK_WINDOW(window));
     
-    // Call this function whenever the GUI is idle so that it can perform queued updates
-    g_idle_add((GSourceFunc) gui_idle, NULL);
+    // Perform queued updates whenever something is queued, rather than every time the GUI is idle
+    if(pipe(gui_wakeup_pipe) == 0) {
+        for(int i = 0; i < 2; i++) {
+            fcntl(gui_wakeup_pipe[i], F_SETFL, fcntl(gui_wakeup_pipe[i], F_GETFL) | O_NONBLOCK);
+            fcntl(gui_wakeup_pipe[i], F_SETFD, FD_CLOEXEC);
+        }
+        GIOChannel * wakeup_channel = g_io_channel_unix_new(gui_wakeup_pipe[0]);
+        g_io_add_watch(wakeup_channel, G_IO_IN, gui_wakeup, NULL);
+        g_io_channel_unref(wakeup_channel);
+    } else {
+        perror("Unable to create GUI wakeup pipe");
+        gui_wakeup_pipe[0] = gui_wakeup_pipe[1] = -1;
+    }
+    requestGUIUpdate();
 
     // Hand over control of the thread to gtk
     gtk_main();
 }
 
+// Write to the wakeup pipe regardless of any pending wakeup, for callers that can't rely on gui_wakeup_pending
+static void wakeGUI() {
+    if(gui_wakeup_pipe[1] < 0) return;
+    int saved_errno = errno;
+    char c = 0;
+    // The pipe is non-blocking, and if it's full then the GUI is going to wake up anyway
+    while(write(gui_wakeup_pipe[1], &c, 1) < 0 && errno == EINTR);
+    errno = saved_errno;
+}
+
+/* Ask the GUI to show whatever has been queued for it
+ * Safe to call from any thread and from signal handlers. Only the first request since the GUI last
+ * woke up writes to the pipe, so a burst of events costs a single write
+ */
+void requestGUIUpdate() {
+    if(g_atomic_int_compare_and_exchange(&gui_wakeup_pending, 0, 1)) {
+        wakeGUI();
+    }
+}
+
+// Called by the main loop when the wakeup pipe is readable
+gboolean gui_wakeup(GIOChannel * source, GIOCondition condition, gpointer data) {
+    // Cleared before draining, so a request made while draining still gets its own wakeup
+    g_atomic_int_set(&gui_wakeup_pending, 0);
+    char buf[64];
+    while(read(gui_wakeup_pipe[0], buf, sizeof(buf)) > 0);
+
+    // Anything else queued before the frame is up is picked up by the same update
+    if(gui_update_timer == 0) {
+        gui_update_timer = g_timeout_add(gui_frame_ms, (GSourceFunc) gui_idle, NULL);
+    }
+    return TRUE;
+}
+
+// Perform queued updates, once per wakeup
 gboolean gui_idle(void) {
+    gui_update_timer = 0;
+
     if(shared_error[0] != '\0') {
         showErrorDialog(shared_error);
         shared_error[0] = '\0';
@@ -491,7 +586,7 @@ gboolean gui_idle(void) {
     gui_idle_testsuite();
     gui_idle_debugger();
     
-    return TRUE;
+    return FALSE;
 }
 
 void setSharedError(char * err_str) {
@@ -499,6 +594,9 @@ void setSharedError(char * err_str) {
         err_str[shared_error_maxlen-1] = '\0';
     }
     strcpy(shared_error, err_str);
+
+    // This may be the child after a failed exec, whose copy of gui_wakeup_pending can't be trusted
+    wakeGUI();
 }
 
 void setSharedErrorPrefixed(char * prefix, char * err_str_raw) {
@@ -507,37 +605,28 @@ void setSharedErrorPrefixed(char * prefix, char * err_str_raw) {
     setSharedError(err_str);
 }
 
-/* Start a tool by passing info about the FUSE binary and a
- * function pointer to either the wizard, test suite or debugger
+/* Fork and execute a FUSE binary in a session, with the libfuse wrapper in place of the real libfuse
+ * Returns the pid of the filesystem, or 0 if it couldn't be forked
  */
-void startTool(const char * bin_str, const char * args_str, const char * tool_ident, startToolFunc toolFunc) {
-
-    terminate_calls = 0;
-
-    char * args_str_cpy = malloc(strlen(args_str) + 1);
-    strcpy(args_str_cpy, args_str);
+pid_t forkFilesystem(const char * bin_str, const char * args_str, const char * tool_ident, struct fdt_session * session) {
 
     // First count the number of arguments in the string, and init an empty array
     int num_args = 0;
-    char ** stringp = &args_str_cpy;
-    char * token = NULL;
-    while(token = strsep(stringp, " ")) {
-        num_args++;
+    for(const char * c = args_str; *c != '\0'; c++) {
+        if(*c != ' ' && (c == args_str || c[-1] == ' ')) num_args++;
     }
-    free(args_str_cpy);
-    char * fuse_argv[num_args + 1];
+    char * fuse_argv[num_args + 2];
 
-    // Parse the arg string again, putting the args into the array
-    args_str_cpy = malloc(strlen(args_str) + 1);
+    // Split a copy of the arg string, putting the args into the array
+    // The copy has to outlive the fork, as the array points into it
+    char * args_str_cpy = malloc(strlen(args_str) + 1);
     strcpy(args_str_cpy, args_str);
-    stringp = &args_str_cpy;
-    token = NULL;
+    char * args_str_start = args_str_cpy;
+    char * token = NULL;
     int i = 1;
-    while(token = strsep(stringp, " ")) {
-        fuse_argv[i] = token;
-        i++;
+    while(token = strsep(&args_str_cpy, " ")) {
+        if(token[0] != '\0') fuse_argv[i++] = token;
     }
-    free(args_str_cpy);
 
     // Add binary name and NULL terminator
     char * bin_str_cpy = malloc(strlen(bin_str) + 1);
@@ -546,37 +635,71 @@ void startTool(const char * bin_str, const char * args_str, const char * tool_id
     fuse_argv[num_args + 1] = NULL;
 
     // Get environment variables needed to run filesystem with our modified libfuse
-    char ** envp = getEnvVarsForFork(tool_ident);
+    char ** envp = getEnvVarsForFork(tool_ident, session);
 
-    // Execute both the tool and FUSE binary in parallel
-    // The tool executes in a new thread while the FUSE binary executes in a new forked process
-    int status;
-    switch((fuse_pid = fork())) {
+    // Anything still buffered would otherwise be written again by the child if execve fails
+    fflush(stdout);
+    switch((session->fuse_pid = fork())) {
         case -1:
             perror("fork");
+            session->fuse_pid = 0;
             break;
         case 0:
             *fs_mounted = TRUE;
+            wakeGUI();
             execve(fuse_argv[0], fuse_argv, envp);
             setSharedErrorPrefixed("Could not execute fuse binary: ", strerror(errno));
-            fuse_pid = 0;
             //perror("Could not execute fuse binary");
             //fprintf(stderr, "Try using the absolute path to the FUSE implementation if it was not found\n");
             exit(EXIT_FAILURE);
             break;
         default:
-            stopToolFunction = toolFunc();
             break;
     }
+    for(char ** env = envp; *env != NULL; env++) {
+        free(*env);
+    }
+    free(envp);
+    free(args_str_start);
     free(bin_str_cpy);
+    return session->fuse_pid;
+}
+
+/* Start a tool by passing info about the FUSE binary and a
+ * function pointer to either the wizard, test suite or debugger
+ */
+void startTool(const char * bin_str, const char * args_str, const char * tool_ident, startToolFunc toolFunc) {
+
+    terminate_calls = 0;
+
+    // Every run gets a fresh session, as the filesystem from any previous run has exited by now
+    sessionFree(current_session);
+    current_session = sessionNew(bin_str);
+    if(current_session == NULL) {
+        setSharedError("Unable to create a runtime directory for the filesystem");
+        return;
+    }
+
+    // Execute both the tool and FUSE binary in parallel
+    // The tool executes in a new thread while the FUSE binary executes in a new forked process
+    if(forkFilesystem(bin_str, args_str, tool_ident, current_session) != 0) {
+        stopToolFunction = toolFunc();
+    }
 }
 
 static void childKilled(int sig) {
     // Iterate over killed child processes
     pid_t pid;
     int status;
-    while((pid = waitpid(-1, &status, WNOHANG)) != -1) {
-        if(pid == fuse_pid) {
+    while((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        // Filesystems run outside the GUI are followed by whoever started them
+        struct fdt_session * session = sessionForPid(pid);
+        if(session != NULL && session != current_session) {
+            sessionExited(session, status);
+            continue;
+        }
+
+        if(pid == getFusePID()) {
             // FUSE binary terminated but we expect it to be running
             // This detects when the FUSE binary crashes, but we wait a bit to make sure we don't show an error just because the event reader is slow
             // Wait up to 1s, checking every 100ms
@@ -585,7 +708,7 @@ static void childKilled(int sig) {
             int slot_id = 0;
             for(slot_id = 0; slot_id < 10; slot_id++) {
                 usleep(100000);
-                if(pid != fuse_pid) {
+                if(pid != getFusePID()) {
                     // Fuse unmounted cleanly, so don't need to wait any longer
                     printf("Filesystem unmounted cleanly while waiting\n");
                     *fs_mounted = FALSE;
@@ -599,15 +722,16 @@ static void childKilled(int sig) {
                     // Child exited but didn't pass an error message
                     setSharedError("FUSE module terminated unexpectedly or crashed. This is likely due to a runtime error in the filesystem, so check the console for the cause.");
                 }
-                fuse_pid = 0;
+                setFusePID(0);
                 *fs_mounted = FALSE;
             }
             break;
-        } else if(fuse_pid == 0) {
+        } else if(getFusePID() == 0) {
             // If we don't have a FUSE PID but something exited, then we have to assume the FS is unmounted
             *fs_mounted = FALSE;
         }
     }
+    requestGUIUpdate();
 }
 
 // Open a file, read the string, and parse it into a JSON object
@@ -633,12 +757,104 @@ cJSON * readJSONFile(const char * fpath) {
 }
 
 void printLoggerUsage() {
-    printf("Usage: fdt --logger [-a] [FUSE Binary] [FUSE Arguments]\n\n");
+    printf("Usage: fdt --logger [-a] [-o capture_file] [-c operations] [FUSE Binary] [FUSE Arguments]\n\n");
+    printf("Each captured sequence is appended to the capture file as soon as it is described, one line of\n");
+    printf("JSON per sequence. Use fdt --convert to turn a capture file into test data.\n\n");
     printf("Options:\n");
-    printf("\t-a\t Start capturing sequence automatically on mount\n\n");
+    printf("\t-a\t Start capturing sequence automatically on mount\n");
+    printf("\t-o\t File to append sequences to (default: asked for after the first sequence)\n");
+    printf("\t-c\t Comma-separated operations, or all, whose back-to-back calls with identical parameters\n");
+    printf("\t\t are captured once with a repeat count, e.g. -c getattr,access\n\n");
     printf("Example: ./fdt --logger /Users/md49/hg/CS4099-MajorSP/loopback-mac/loopback /tmp/lfsroot -f /tmp/lfsmnt -oallow_other,native_xattr,volname=LoopbackFS\n");
 }
 
+void printDaemonUsage() {
+    printf("Usage: fdt --daemon [-s socket] [-r trace_dir] [FUSE Binary] [FUSE Arguments]\n\n");
+    printf("Runs the filesystem without pausing it, and streams its calls to any number of subscribers\n");
+    printf("connected to a UNIX domain socket. Each event is sent as a single line of JSON.\n\n");
+    printf("Options:\n");
+    printf("\t-s\t Path of the socket to listen on (default: fdt-daemon.sock)\n");
+    printf("\t-r\t Record every event to segment files in this directory, for later inspection\n\n");
+    printf("Subscribers may send a line to filter the events they receive, for example:\n");
+    printf("\tfilter name=read,write type=return path=/var/log\n");
+    printf("or ask for the hottest paths by calls and by bytes transferred, decaying over time:\n");
+    printf("\thot\n\n");
+    printf("Example: ./fdt --daemon -s /tmp/fdt.sock -r /tmp/soak-trace /home/md49/hg/CS4099-MajorSP/demofs-2/bbfs -f rootdir /tmp/fsmnt\n");
+}
+
+void printAnalyzeUsage() {
+    printf("Usage: fdt --analyze [-j threads] [Trace Directory]\n\n");
+    printf("Summarises a trace recorded with fdt --daemon -r: per-operation counts, throughput and latency\n");
+    printf("percentiles, errors, the most common paths, read/write sizes and concurrency over time.\n\n");
+    printf("Options:\n");
+    printf("\t-j\t Number of threads to analyze segments with (default: one per core)\n\n");
+    printf("Example: ./fdt --analyze -j 4 /tmp/soak-trace\n");
+}
+
+void printExportUsage() {
+    printf("Usage: fdt --export [-f chrome|perfetto] [Trace Directory] [Output File]\n\n");
+    printf("Converts a trace recorded with fdt --daemon -r for viewing in a timeline viewer such as\n");
+    printf("chrome://tracing or ui.perfetto.dev, with one track per FUSE worker thread.\n\n");
+    printf("Options:\n");
+    printf("\t-f\t Output format: chrome (JSON trace events, the default) or perfetto (protobuf)\n\n");
+    printf("Example: ./fdt --export -f perfetto /tmp/soak-trace /tmp/soak.perfetto-trace\n");
+}
+
+void printDiffUsage() {
+    printf("Usage: fdt --diff [-j threads] [Before Trace Directory] [After Trace Directory]\n\n");
+    printf("Compares two traces of the same workload, recorded with fdt --daemon -r: calls per operation\n");
+    printf("and per path, error rates, latency distributions and patterns of consecutive calls.\n");
+    printf("Exits with status 2 if any significant differences were found.\n\n");
+    printf("Options:\n");
+    printf("\t-j\t Number of threads to analyze segments with (default: one per core)\n\n");
+    printf("Example: ./fdt --diff /tmp/before-trace /tmp/after-trace\n");
+}
+
+void printConvertUsage() {
+    printf("Usage: fdt --convert [Input File] [Output File]\n\n");
+    printf("Converts a capture file written by fdt --logger into the grouped JSON used as test data, with one\n");
+    printf("group per logger run. Grouped JSON is converted the other way, appending to the output, so that\n");
+    printf("older test data can be captured into again.\n\n");
+    printf("Example: ./fdt --convert /tmp/capture.jsonl /tmp/tests.json\n");
+}
+
+void printTopUsage() {
+    printf("Usage: fdt --top [FUSE PID]\n\n");
+    printf("Shows live per-operation rates, latency percentiles and error rates, calls in flight, and the\n");
+    printf("busiest client processes and paths of a filesystem started through fdt, refreshed every second.\n");
+    printf("The figures come from counters kept in shared memory by the libfuse wrapper.\n\n");
+    printf("The pid may be left out on Linux when only one such filesystem is running.\n\n");
+    printf("Example: ./fdt --top 4242\n");
+}
+
+void printTestsuiteUsage() {
+    printf("Usage: fdt --testsuite [-j jobs] [Test Data] [FUSE Command] [FUSE Command]...\n\n");
+    printf("Runs the test suite without the GUI against each filesystem in parallel, reporting failures as they\n");
+    printf("happen and a summary at the end. Each FUSE command is the binary and its arguments as a single\n");
+    printf("argument, and each filesystem needs its own mountpoint and must stay in the foreground.\n");
+    printf("Each test group runs in a process of its own, so a filesystem that crashes only fails that group.\n");
+    printf("Exits with status 1 if any filesystem failed a test group or couldn't be run.\n\n");
+    printf("Options:\n");
+    printf("\t-j\t Number of test groups each filesystem runs at once (default: 1). Only for filesystems\n");
+    printf("\t\t that keep all of their state in memory\n\n");
+    printf("Example: ./fdt --testsuite tests.json \"/home/md49/build-a/bbfs -f /tmp/root-a /tmp/mnt-a\" \"/home/md49/build-b/bbfs -f /tmp/root-b /tmp/mnt-b\"\n");
+}
+
+// Join the arguments from argv[start] onwards into a single space-separated string
+char * concatArguments(int argc, char **argv, int start) {
+    size_t args_len = 1;
+    for(int i = start; i < argc; i++) {
+        args_len += strlen(argv[i]) + 1;
+    }
+    char * args_str = malloc(args_len);
+    args_str[0] = '\0';
+    for(int i = start; i < argc; i++) {
+        if(i > start) strcat(args_str, " ");
+        strcat(args_str, argv[i]);
+    }
+    return args_str;
+}
+
 void resolveLibraryPaths(int argc, char **argv) {
     // Get the path of the binary (only works when executed from special shell script)
     int last_slash_pos = 0;
@@ -712,8 +928,9 @@ int main(int argc, char **argv) {
 
     // Handle SIGCHLD, which occurs when child processes exit
     struct sigaction sa;
+    // Reads from the FIFOs are restarted, as one filesystem exiting mustn't cut short the events of another
     sigemptyset(&sa.sa_mask);
-    sa.sa_flags = 0;
+    sa.sa_flags = SA_RESTART;
     sa.sa_handler = childKilled;
     sigaction(SIGCHLD, &sa, NULL);
 
@@ -736,39 +953,191 @@ int main(int argc, char **argv) {
 
     /* Console-based logger */
     if(argc >= 2 && strcmp(argv[1], "--logger") == 0) {
-        if(argc >= 4) {
-            
-            // Check for the -a flag, and also get the FUSE binary name
-            int bin_idx;
-            if(strcmp(argv[2], "-a") == 0) {
+
+        // Check for the -a, -o and -c options, and also get the FUSE binary name
+        int bin_idx = 2;
+        while(argc >= bin_idx + 2) {
+            if(strcmp(argv[bin_idx], "-a") == 0) {
                 setLoggerState(CAPTURING_SEQUENCE);
-                bin_idx = 3;
+                bin_idx++;
+            } else if(strcmp(argv[bin_idx], "-o") == 0 && argc >= bin_idx + 3) {
+                setLoggerCaptureFile(argv[bin_idx + 1]);
+                bin_idx += 2;
+            } else if(strcmp(argv[bin_idx], "-c") == 0 && argc >= bin_idx + 3) {
+                if(!setLoggerCompaction(argv[bin_idx + 1])) {
+                    printLoggerUsage();
+                    return 1;
+                }
+                bin_idx += 2;
             } else {
-                bin_idx = 2;
+                break;
             }
-            char * bin_str = argv[bin_idx];
+        }
 
-            // Concatenate remaining arguments into a single string
-            size_t args_len = 1;
-            for(int i = bin_idx + 1; i < argc; i++) {
-                args_len = strlen(argv[i]) + 1;
-            }
-            char args_str[args_len];
-            args_str[0] = '\0';
-            strcat(args_str, argv[bin_idx+1]);
-            for(int i = bin_idx + 2; i < argc; i++) {
-                strcat(args_str, " ");
-                strcat(args_str, argv[i]);
-            }
+        if(argc >= bin_idx + 2) {
+            char * args_str = concatArguments(argc, argv, bin_idx + 1);
 
             // The tool identifier is debugger as we need to debug to log calls
-            startTool(bin_str, args_str, "debugger", &startLogger);
+            startTool(argv[bin_idx], args_str, "debugger", &startLogger);
+            free(args_str);
         } else {
             printLoggerUsage();
         }
         return 0;
     }
 
+    /* Headless daemon that fans events out to subscribers */
+    if(argc >= 2 && strcmp(argv[1], "--daemon") == 0) {
+        usingGui = FALSE;
+
+        // Check for the -s and -r options, and also get the FUSE binary name
+        int bin_idx = 2;
+        while(argc >= bin_idx + 2) {
+            if(strcmp(argv[bin_idx], "-s") == 0) {
+                setDaemonSocketPath(argv[bin_idx + 1]);
+            } else if(strcmp(argv[bin_idx], "-r") == 0) {
+                setDaemonTraceDir(argv[bin_idx + 1]);
+            } else {
+                break;
+            }
+            bin_idx += 2;
+        }
+
+        if(argc >= bin_idx + 2) {
+            char * args_str = concatArguments(argc, argv, bin_idx + 1);
+
+            // The tool identifier is debugger as the libfuse wrapper reports calls in the same way
+            startTool(argv[bin_idx], args_str, "debugger", &startDaemon);
+            free(args_str);
+        } else {
+            printDaemonUsage();
+        }
+        return 0;
+    }
+
+    /* Offline trace analyzer */
+    if(argc >= 2 && strcmp(argv[1], "--analyze") == 0) {
+        int dir_idx = 2;
+        int num_threads = 0;
+        if(argc >= 4 && strcmp(argv[2], "-j") == 0) {
+            num_threads = atoi(argv[3]);
+            dir_idx = 4;
+        }
+        if(argc != dir_idx + 1) {
+            printAnalyzeUsage();
+            return 1;
+        }
+        struct trace_reader * reader = traceOpen(argv[dir_idx]);
+        if(reader == NULL) {
+            return 1;
+        }
+        struct trace_stats * stats = analyzeTrace(reader, num_threads);
+        printTraceStats(stats);
+        freeTraceStats(stats);
+        traceClose(reader);
+        return 0;
+    }
+
+    /* Comparison of two traces */
+    if(argc >= 2 && strcmp(argv[1], "--diff") == 0) {
+        int dir_idx = 2;
+        int num_threads = 0;
+        if(argc >= 4 && strcmp(argv[2], "-j") == 0) {
+            num_threads = atoi(argv[3]);
+            dir_idx = 4;
+        }
+        if(argc != dir_idx + 2) {
+            printDiffUsage();
+            return 1;
+        }
+
+        // Each trace is analyzed in its own pass, and only the aggregates are kept
+        struct trace_stats * stats[2];
+        for(int i = 0; i < 2; i++) {
+            struct trace_reader * reader = traceOpen(argv[dir_idx + i]);
+            if(reader == NULL) {
+                if(i == 1) freeTraceStats(stats[0]);
+                return 1;
+            }
+            stats[i] = analyzeTrace(reader, num_threads);
+            traceClose(reader);
+        }
+        int flagged = diffTraceStats(stats[0], stats[1]);
+        freeTraceStats(stats[0]);
+        freeTraceStats(stats[1]);
+        return flagged > 0 ? 2 : 0;
+    }
+
+    /* Trace exporter */
+    if(argc >= 2 && strcmp(argv[1], "--export") == 0) {
+        int dir_idx = 2;
+        bool perfetto = FALSE;
+        if(argc >= 4 && strcmp(argv[2], "-f") == 0) {
+            if(strcmp(argv[3], "perfetto") == 0) {
+                perfetto = TRUE;
+            } else if(strcmp(argv[3], "chrome") != 0) {
+                printExportUsage();
+                return 1;
+            }
+            dir_idx = 4;
+        }
+        if(argc != dir_idx + 2) {
+            printExportUsage();
+            return 1;
+        }
+        struct trace_reader * reader = traceOpen(argv[dir_idx]);
+        if(reader == NULL) {
+            return 1;
+        }
+        FILE * out = fopen(argv[dir_idx + 1], "wb");
+        if(out == NULL) {
+            perror("Unable to open output file");
+            traceClose(reader);
+            return 1;
+        }
+        bool ok = perfetto ? exportPerfettoTrace(reader, out) : exportChromeTrace(reader, out);
+        if(fclose(out) != 0) ok = FALSE;
+        traceClose(reader);
+        if(!ok) {
+            fprintf(stderr, "Unable to write %s\n", argv[dir_idx + 1]);
+            return 1;
+        }
+        return 0;
+    }
+
+    /* Headless test suite against one or more filesystems */
+    if(argc >= 2 && strcmp(argv[1], "--testsuite") == 0) {
+        usingGui = FALSE;
+        int data_idx = 2;
+        if(argc >= 4 && strcmp(argv[2], "-j") == 0) {
+            setTestsuiteJobs(atoi(argv[3]));
+            data_idx = 4;
+        }
+        if(argc < data_idx + 2) {
+            printTestsuiteUsage();
+            return 1;
+        }
+        return runTestsuiteSessions(argv[data_idx], argc - data_idx - 1, &argv[data_idx + 1]);
+    }
+
+    /* Conversion between capture files and test data */
+    if(argc >= 2 && strcmp(argv[1], "--convert") == 0) {
+        if(argc != 4) {
+            printConvertUsage();
+            return 1;
+        }
+        return convertCapture(argv[2], argv[3]) ? 0 : 1;
+    }
+
+    /* Live dashboard for a running filesystem */
+    if(argc >= 2 && strcmp(argv[1], "--top") == 0) {
+        if(argc > 3 || (argc == 3 && atoi(argv[2]) <= 0)) {
+            printTopUsage();
+            return 1;
+        }
+        return runTop(argc == 3 ? atoi(argv[2]) : 0);
+    }
+
     // Load the JSON file containing function signatures
     #if __APPLE__
         char * suf_fsigs_path = "/osxfuse/fuse/fsigs.json";
@@ -3,6 +3,8 @@
 #include <gtk/gtk.h>
 #include <stdbool.h>
 
+#include "session.h"
+
 typedef void (*stopToolFunc)(void);
 typedef stopToolFunc (*startToolFunc)(void);
 typedef enum {IMPLEMENTED, DEFINED, UNDEFINED, SKIPPED} funcstat;
@@ -15,13 +17,15 @@ void testToFunction(char * function, const char * test);
 char * wrap_text(const char * original, int line_length);
 bool isUsingGui();
 char * getLibpath();
+struct fdt_session * getCurrentSession();
 pid_t getFusePID();
 void setFusePID(pid_t);
 void setFSMounted(bool mounted);
 bool isFSMounted();
 void addSkippedTest(const char * func_name, const int test_num);
 void setTestDataFile(const char * fname);
-char ** getEnvVarsForFork(const char * tool_ident);
+void setTestsuiteJobs(int jobs);
+char ** getEnvVarsForFork(const char * tool_ident, struct fdt_session * session);
 GtkWidget * createBinarySelectionWidgets();
 GtkWidget * createControlButtons();
 void terminate();
@@ -36,11 +40,22 @@ gboolean delete_event(GtkWidget * widget, GdkEvent * event, gpointer data);
 void destroy(GtkWidget *widget, gpointer data);
 void showErrorDialog(char * message);
 void showGUI(int * argc, char *** argv);
+void requestGUIUpdate();
+gboolean gui_wakeup(GIOChannel * source, GIOCondition condition, gpointer data);
 gboolean gui_idle(void);
 void setSharedError(char * err_str);
+pid_t forkFilesystem(const char * bin_str, const char * args_str, const char * tool_ident, struct fdt_session * session);
 void startTool(const char * bin_str, const char * args_str, const char * tool_ident, startToolFunc toolFunc);
 static void childKilled(int sig);
 cJSON * readJSONFile(const char * fpath);
 void printLoggerUsage();
+void printDaemonUsage();
+void printAnalyzeUsage();
+void printExportUsage();
+void printDiffUsage();
+void printConvertUsage();
+void printTopUsage();
+void printTestsuiteUsage();
+char * concatArguments(int argc, char **argv, int start);
 void resolveLibraryPaths(int argc, char **argv);
 int main(int argc, char **argv);
\ No newline at end of file
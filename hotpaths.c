@@ -0,0 +1,223 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <glib.h>
+
+#include "cJSON.h"
+#include "trace.h"
+#include "hotpaths.h"
+
+static int64_t monotonicMicros() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void initTracker(struct hot_tracker * tracker) {
+    memset(tracker->sketch, 0, sizeof(tracker->sketch));
+    tracker->heap_size = 0;
+    tracker->heap_index = g_hash_table_new(g_str_hash, g_str_equal);
+    tracker->last_decay = monotonicMicros();
+}
+
+static void clearTracker(struct hot_tracker * tracker) {
+    for(int i = 0; i < tracker->heap_size; i++) {
+        free(tracker->heap[i].path);
+    }
+    g_hash_table_destroy(tracker->heap_index);
+}
+
+struct hot_paths * hotPathsNew() {
+    struct hot_paths * hot = malloc(sizeof(*hot));
+    pthread_mutex_init(&hot->lock, NULL);
+    initTracker(&hot->by_calls);
+    initTracker(&hot->by_bytes);
+    hot->inflight = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free);
+    return hot;
+}
+
+void hotPathsFree(struct hot_paths * hot) {
+    if(hot == NULL) return;
+    clearTracker(&hot->by_calls);
+    clearTracker(&hot->by_bytes);
+    g_hash_table_destroy(hot->inflight);
+    pthread_mutex_destroy(&hot->lock);
+    free(hot);
+}
+
+static void swapEntries(struct hot_tracker * tracker, int a, int b) {
+    struct hot_entry tmp = tracker->heap[a];
+    tracker->heap[a] = tracker->heap[b];
+    tracker->heap[b] = tmp;
+    g_hash_table_insert(tracker->heap_index, tracker->heap[a].path, GINT_TO_POINTER(a + 1));
+    g_hash_table_insert(tracker->heap_index, tracker->heap[b].path, GINT_TO_POINTER(b + 1));
+}
+
+static void siftDown(struct hot_tracker * tracker, int i) {
+    while(TRUE) {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = 2 * i + 2;
+        if(left < tracker->heap_size && tracker->heap[left].count < tracker->heap[smallest].count) smallest = left;
+        if(right < tracker->heap_size && tracker->heap[right].count < tracker->heap[smallest].count) smallest = right;
+        if(smallest == i) break;
+        swapEntries(tracker, i, smallest);
+        i = smallest;
+    }
+}
+
+static void siftUp(struct hot_tracker * tracker, int i) {
+    while(i > 0 && tracker->heap[(i - 1) / 2].count > tracker->heap[i].count) {
+        swapEntries(tracker, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+// Halve every count once per half-life that has passed, which keeps the heap ordered
+static void decayTracker(struct hot_tracker * tracker, int64_t now) {
+    int halvings = 0;
+    while(now - tracker->last_decay >= HOT_HALF_LIFE && halvings < 64) {
+        tracker->last_decay += HOT_HALF_LIFE;
+        halvings++;
+    }
+    if(halvings == 0) return;
+    if(halvings >= 64) tracker->last_decay = now;
+
+    for(int d = 0; d < HOT_SKETCH_DEPTH; d++) {
+        for(int w = 0; w < HOT_SKETCH_WIDTH; w++) {
+            tracker->sketch[d][w] = halvings >= 64 ? 0 : tracker->sketch[d][w] >> halvings;
+        }
+    }
+    for(int i = 0; i < tracker->heap_size; i++) {
+        tracker->heap[i].count = halvings >= 64 ? 0 : tracker->heap[i].count >> halvings;
+    }
+}
+
+static void addToTracker(struct hot_tracker * tracker, const char * path, uint64_t weight, int64_t now) {
+    decayTracker(tracker, now);
+
+    // Each row of the sketch uses a different combination of two hashes of the path
+    uint32_t hash1 = tracePathHash(path);
+    uint32_t hash2 = (hash1 >> 16 | hash1 << 16) * 0x85EBCA6Bu | 1;
+    uint64_t estimate = UINT64_MAX;
+    for(int d = 0; d < HOT_SKETCH_DEPTH; d++) {
+        uint64_t * counter = &tracker->sketch[d][(hash1 + d * hash2) % HOT_SKETCH_WIDTH];
+        *counter += weight;
+        if(*counter < estimate) estimate = *counter;
+    }
+
+    int idx = GPOINTER_TO_INT(g_hash_table_lookup(tracker->heap_index, path)) - 1;
+    if(idx >= 0) {
+        tracker->heap[idx].count = estimate;
+        siftDown(tracker, idx);
+    } else if(tracker->heap_size < HOT_TOP_K) {
+        idx = tracker->heap_size++;
+        tracker->heap[idx].path = malloc(strlen(path) + 1);
+        strcpy(tracker->heap[idx].path, path);
+        tracker->heap[idx].count = estimate;
+        g_hash_table_insert(tracker->heap_index, tracker->heap[idx].path, GINT_TO_POINTER(idx + 1));
+        siftUp(tracker, idx);
+    } else if(estimate > tracker->heap[0].count) {
+        // Replace the coolest of the hot paths
+        g_hash_table_remove(tracker->heap_index, tracker->heap[0].path);
+        free(tracker->heap[0].path);
+        tracker->heap[0].path = malloc(strlen(path) + 1);
+        strcpy(tracker->heap[0].path, path);
+        tracker->heap[0].count = estimate;
+        g_hash_table_insert(tracker->heap_index, tracker->heap[0].path, GINT_TO_POINTER(1));
+        siftDown(tracker, 0);
+    }
+}
+
+static bool isTransferCall(const char * name) {
+    return strcmp(name, "read") == 0 || strcmp(name, "write") == 0
+        || strcmp(name, "read_buf") == 0 || strcmp(name, "write_buf") == 0;
+}
+
+/* Count a call against its path when it's invoked, and the bytes a read or write transferred when it returns
+ * Returns don't carry the path, so it's remembered by seqnum in the meantime
+ */
+void hotPathsHandleEvent(struct hot_paths * hot, cJSON * event) {
+    char * type = cJSON_GetObjectItem(event, "type")->valuestring;
+    char * name = cJSON_GetObjectItem(event, "name")->valuestring;
+    int seqnum = cJSON_GetObjectItem(event, "seqnum")->valueint;
+    int64_t now = monotonicMicros();
+
+    pthread_mutex_lock(&hot->lock);
+    if(strcmp(type, "invoke") == 0) {
+        cJSON * path_obj = cJSON_GetObjectItem(cJSON_GetObjectItem(event, "params"), "path");
+        if(path_obj != NULL && path_obj->type == cJSON_String) {
+            addToTracker(&hot->by_calls, path_obj->valuestring, 1, now);
+            if(isTransferCall(name)) {
+                char * path_cpy = malloc(strlen(path_obj->valuestring) + 1);
+                strcpy(path_cpy, path_obj->valuestring);
+                g_hash_table_insert(hot->inflight, GINT_TO_POINTER(seqnum), path_cpy);
+            }
+        }
+    } else if(strcmp(type, "return") == 0 && isTransferCall(name)) {
+        char * path = g_hash_table_lookup(hot->inflight, GINT_TO_POINTER(seqnum));
+        cJSON * returnval = cJSON_GetObjectItem(event, "returnval");
+        if(path != NULL && returnval != NULL && returnval->type == cJSON_Number && returnval->valueint > 0) {
+            addToTracker(&hot->by_bytes, path, returnval->valueint, now);
+        }
+        g_hash_table_remove(hot->inflight, GINT_TO_POINTER(seqnum));
+    }
+    pthread_mutex_unlock(&hot->lock);
+}
+
+static int compareEntries(const void * a, const void * b) {
+    const struct hot_entry * ea = a;
+    const struct hot_entry * eb = b;
+    if(ea->count == eb->count) return strcmp(ea->path, eb->path);
+    return ea->count < eb->count ? 1 : -1;
+}
+
+/* Copy the hottest paths into out, hottest first, returning how many were copied
+ * The caller must free the path of each entry
+ */
+int hotPathsTop(struct hot_paths * hot, bool by_bytes, struct hot_entry * out, int max) {
+    pthread_mutex_lock(&hot->lock);
+    struct hot_tracker * tracker = by_bytes ? &hot->by_bytes : &hot->by_calls;
+    decayTracker(tracker, monotonicMicros());
+    struct hot_entry sorted[HOT_TOP_K];
+    int n = 0;
+    for(int i = 0; i < tracker->heap_size; i++) {
+        if(tracker->heap[i].count > 0) sorted[n++] = tracker->heap[i];
+    }
+    qsort(sorted, n, sizeof(sorted[0]), compareEntries);
+    if(n > max) n = max;
+    for(int i = 0; i < n; i++) {
+        out[i].path = malloc(strlen(sorted[i].path) + 1);
+        strcpy(out[i].path, sorted[i].path);
+        out[i].count = sorted[i].count;
+    }
+    pthread_mutex_unlock(&hot->lock);
+    return n;
+}
+
+static cJSON * entriesToJSON(struct hot_paths * hot, bool by_bytes) {
+    struct hot_entry entries[HOT_TOP_K];
+    int n = hotPathsTop(hot, by_bytes, entries, HOT_TOP_K);
+    cJSON * list = cJSON_CreateArray();
+    for(int i = 0; i < n; i++) {
+        cJSON * item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "path", entries[i].path);
+        cJSON_AddNumberToObject(item, by_bytes ? "bytes" : "calls", entries[i].count);
+        cJSON_AddItemToArray(list, item);
+        free(entries[i].path);
+    }
+    return list;
+}
+
+cJSON * hotPathsToJSON(struct hot_paths * hot) {
+    cJSON * obj = cJSON_CreateObject();
+    cJSON_AddStringToObject(obj, "type", "hot");
+    cJSON_AddNumberToObject(obj, "half_life", HOT_HALF_LIFE / 1000000);
+    cJSON_AddItemToObject(obj, "calls", entriesToJSON(hot, FALSE));
+    cJSON_AddItemToObject(obj, "bytes", entriesToJSON(hot, TRUE));
+    return obj;
+}
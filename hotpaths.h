@@ -0,0 +1,47 @@
+#pragma once
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <glib.h>
+
+#include "cJSON.h"
+
+// Size of each count-min sketch
+#define HOT_SKETCH_WIDTH 8192
+#define HOT_SKETCH_DEPTH 4
+
+// Number of hottest paths kept by each tracker
+#define HOT_TOP_K 20
+
+// Counts are halved this often (in microseconds), so the trackers follow the current load
+#define HOT_HALF_LIFE 10000000
+
+struct hot_entry {
+    char * path;
+    uint64_t count;
+};
+
+/* Approximate heavy hitters: a count-min sketch estimates the weight of every path in fixed memory,
+ * and a min-heap keeps the K paths with the largest estimates
+ */
+struct hot_tracker {
+    uint64_t sketch[HOT_SKETCH_DEPTH][HOT_SKETCH_WIDTH];
+    struct hot_entry heap[HOT_TOP_K];
+    int heap_size;
+    GHashTable * heap_index;    // Path to position in the heap, plus one
+    int64_t last_decay;
+};
+
+struct hot_paths {
+    pthread_mutex_t lock;
+    struct hot_tracker by_calls;
+    struct hot_tracker by_bytes;
+    GHashTable * inflight;      // Paths of reads and writes which haven't returned yet, by seqnum
+};
+
+struct hot_paths * hotPathsNew();
+void hotPathsFree(struct hot_paths * hot);
+void hotPathsHandleEvent(struct hot_paths * hot, cJSON * event);
+int hotPathsTop(struct hot_paths * hot, bool by_bytes, struct hot_entry * out, int max);
+cJSON * hotPathsToJSON(struct hot_paths * hot);
@@ -0,0 +1,337 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <gtk/gtk.h>
+#include <glib.h>
+
+#include "cJSON.h"
+#include "fdt.h"
+#include "top.h"
+#include "latency.h"
+
+/* Latency of each operation over time, drawn as a heatmap with a histogram of the last few seconds
+ *
+ * This is fed from the histograms the libfuse wrapper keeps in shared memory for fdt --top, rather than
+ * from the debugger's events, so it costs the same once a second however busy the filesystem is.
+ */
+
+// Layout, in pixels
+#define LATENCY_RULER_HEIGHT 20
+#define LATENCY_GUTTER_WIDTH 80
+#define LATENCY_HISTOGRAM_WIDTH 120
+#define LATENCY_HISTOGRAM_GAP 10
+#define LATENCY_COLUMN_WIDTH 4
+#define LATENCY_BUCKET_HEIGHT 3
+#define LATENCY_LANE_GAP 8
+
+#define LATENCY_NUM_BUCKETS (LATENCY_MAX_BUCKET - LATENCY_MIN_BUCKET + 1)
+#define LATENCY_LANE_HEIGHT (LATENCY_NUM_BUCKETS * LATENCY_BUCKET_HEIGHT)
+
+static const double heat_colour[3] = {0.80, 0.25, 0.10};
+
+/* Counters and history */
+static const struct fdt_stats * stats = NULL;
+static pid_t stats_pid = 0;
+static bool sampled = FALSE;
+static struct fdt_op_counters prev_ops[FDT_STATS_OPS];
+static struct fdt_op_counters now_ops[FDT_STATS_OPS];
+static uint32_t * history[FDT_STATS_OPS];      // Ring of LATENCY_COLUMNS columns of buckets, or NULL until the operation is first seen
+static uint64_t num_columns = 0;
+static guint latency_timer = 0;
+
+/* GUI widgets */
+static GtkWidget * latency_area;
+static GtkWidget * latency_status;
+
+static int visibleBucket(int bucket) {
+    return CLAMP(bucket, LATENCY_MIN_BUCKET, LATENCY_MAX_BUCKET) - LATENCY_MIN_BUCKET;
+}
+
+// Column of an operation's history, where age 0 is the latest second, or NULL if it's no longer kept
+static const uint32_t * historyColumn(int opcode, uint64_t age) {
+    if(history[opcode] == NULL || age >= num_columns || age >= LATENCY_COLUMNS) return NULL;
+    return &history[opcode][((num_columns - 1 - age) % LATENCY_COLUMNS) * FDT_STATS_LATENCY_BUCKETS];
+}
+
+static int numActiveOps() {
+    int n = 0;
+    for(int o = 0; o < FDT_STATS_OPS; o++) {
+        if(history[o] != NULL) n++;
+    }
+    return n;
+}
+
+static void latencyRefresh() {
+    int height = LATENCY_RULER_HEIGHT + numActiveOps() * (LATENCY_LANE_HEIGHT + LATENCY_LANE_GAP);
+    gtk_widget_set_size_request(latency_area, -1, height);
+    gtk_widget_queue_draw(latency_area);
+}
+
+static void closeLatencyStats() {
+    if(stats != NULL) {
+        closeStats(stats);
+        stats = NULL;
+    }
+    stats_pid = 0;
+}
+
+/* Add a column for the last second, from the difference between two copies of the counters
+ * Stops once the filesystem it was sampling has gone, so as not to poll between sessions
+ */
+static gboolean latencySample(gpointer data) {
+    pid_t pid = getFusePID();
+    if(stats != NULL && pid != stats_pid) {
+        closeLatencyStats();
+    }
+    if(pid == 0) {
+        if(!sampled) return TRUE;
+        latency_timer = 0;
+        return FALSE;
+    }
+    if(stats == NULL) {
+        // The counters are created as the filesystem starts, so may not be there yet
+        stats = openStats(pid, TRUE);
+        if(stats == NULL) return TRUE;
+        stats_pid = pid;
+        memset(prev_ops, 0, sizeof(prev_ops));
+    }
+    sampled = TRUE;
+
+    memcpy(now_ops, stats->ops, sizeof(now_ops));
+    uint64_t slot = num_columns % LATENCY_COLUMNS;
+    for(int o = 0; o < FDT_STATS_OPS; o++) {
+        if(history[o] == NULL) {
+            if(now_ops[o].returns == prev_ops[o].returns) continue;
+            history[o] = calloc(LATENCY_COLUMNS * FDT_STATS_LATENCY_BUCKETS, sizeof(uint32_t));
+        }
+        uint32_t * column = &history[o][slot * FDT_STATS_LATENCY_BUCKETS];
+        for(int b = 0; b < FDT_STATS_LATENCY_BUCKETS; b++) {
+            column[b] = (uint32_t) MIN(now_ops[o].latency[b] - prev_ops[o].latency[b], UINT32_MAX);
+        }
+    }
+    memcpy(prev_ops, now_ops, sizeof(prev_ops));
+    num_columns++;
+
+    latencyRefresh();
+    return TRUE;
+}
+
+// Forget the previous filesystem's latencies and start sampling the one being started
+void latencyStart() {
+    closeLatencyStats();
+    for(int o = 0; o < FDT_STATS_OPS; o++) {
+        free(history[o]);
+        history[o] = NULL;
+    }
+    num_columns = 0;
+    sampled = FALSE;
+    if(latency_timer == 0) {
+        latency_timer = g_timeout_add(1000, latencySample, NULL);
+    }
+    if(latency_area != NULL) latencyRefresh();
+}
+
+/* Drawing */
+
+static int visibleColumns(int width) {
+    int fit = (width - LATENCY_GUTTER_WIDTH - LATENCY_HISTOGRAM_GAP - LATENCY_HISTOGRAM_WIDTH) / LATENCY_COLUMN_WIDTH;
+    return MAX(MIN(fit, LATENCY_COLUMNS), 0);
+}
+
+// Top of a bucket's row within a lane, with the longest latencies at the top
+static double bucketY(int visible_bucket) {
+    return (LATENCY_NUM_BUCKETS - 1 - visible_bucket) * LATENCY_BUCKET_HEIGHT;
+}
+
+static void drawRuler(cairo_t * cr, int columns) {
+    int step = 10;
+    while(step * LATENCY_COLUMN_WIDTH < 60) step *= step == 10 ? 3 : 2;
+    double right = LATENCY_GUTTER_WIDTH + columns * LATENCY_COLUMN_WIDTH;
+    cairo_set_source_rgb(cr, 0.3, 0.3, 0.3);
+    cairo_set_line_width(cr, 1);
+    char label[32];
+    for(int age = 0; age <= columns; age += step) {
+        double x = right - age * LATENCY_COLUMN_WIDTH;
+        cairo_move_to(cr, floor(x) + 0.5, LATENCY_RULER_HEIGHT - 6);
+        cairo_line_to(cr, floor(x) + 0.5, LATENCY_RULER_HEIGHT);
+        cairo_stroke(cr);
+        snprintf(label, sizeof(label), age == 0 ? "now" : "-%ds", age);
+        cairo_move_to(cr, x + 2, LATENCY_RULER_HEIGHT - 8);
+        cairo_show_text(cr, label);
+    }
+    snprintf(label, sizeof(label), "last %ds", LATENCY_RECENT_COLUMNS);
+    cairo_move_to(cr, right + LATENCY_HISTOGRAM_GAP, LATENCY_RULER_HEIGHT - 8);
+    cairo_show_text(cr, label);
+}
+
+static void drawLane(cairo_t * cr, int opcode, double y, int columns) {
+    double right = LATENCY_GUTTER_WIDTH + columns * LATENCY_COLUMN_WIDTH;
+
+    // Cells are shaded on a log scale, so that a few slow calls still show up next to many fast ones
+    uint32_t max_cell = 0;
+    for(int age = 0; age < columns; age++) {
+        const uint32_t * column = historyColumn(opcode, age);
+        if(column == NULL) break;
+        uint32_t cells[LATENCY_NUM_BUCKETS] = {0};
+        for(int b = 0; b < FDT_STATS_LATENCY_BUCKETS; b++) cells[visibleBucket(b)] += column[b];
+        for(int v = 0; v < LATENCY_NUM_BUCKETS; v++) max_cell = MAX(max_cell, cells[v]);
+    }
+
+    cairo_set_source_rgb(cr, 0.97, 0.97, 0.97);
+    cairo_rectangle(cr, LATENCY_GUTTER_WIDTH, y, columns * LATENCY_COLUMN_WIDTH, LATENCY_LANE_HEIGHT);
+    cairo_fill(cr);
+
+    uint64_t recent[FDT_STATS_LATENCY_BUCKETS] = {0};
+    uint64_t recent_total = 0;
+    for(int age = 0; age < columns; age++) {
+        const uint32_t * column = historyColumn(opcode, age);
+        if(column == NULL) break;
+        double x = right - (age + 1) * LATENCY_COLUMN_WIDTH;
+        uint32_t cells[LATENCY_NUM_BUCKETS] = {0};
+        for(int b = 0; b < FDT_STATS_LATENCY_BUCKETS; b++) {
+            cells[visibleBucket(b)] += column[b];
+            if(age < LATENCY_RECENT_COLUMNS) {
+                recent[b] += column[b];
+                recent_total += column[b];
+            }
+        }
+        for(int v = 0; v < LATENCY_NUM_BUCKETS; v++) {
+            if(cells[v] == 0) continue;
+            double shade = log1p(cells[v]) / log1p(max_cell);
+            cairo_set_source_rgba(cr, heat_colour[0], heat_colour[1], heat_colour[2], 0.15 + 0.85 * shade);
+            cairo_rectangle(cr, x, y + bucketY(v), LATENCY_COLUMN_WIDTH, LATENCY_BUCKET_HEIGHT);
+            cairo_fill(cr);
+        }
+    }
+
+    // Histogram of the last few seconds, which is what the heatmap's latest columns look like side on
+    uint64_t bars[LATENCY_NUM_BUCKETS] = {0};
+    uint64_t max_bar = 0;
+    for(int b = 0; b < FDT_STATS_LATENCY_BUCKETS; b++) bars[visibleBucket(b)] += recent[b];
+    for(int v = 0; v < LATENCY_NUM_BUCKETS; v++) max_bar = MAX(max_bar, bars[v]);
+    double hist_x = right + LATENCY_HISTOGRAM_GAP;
+    cairo_set_source_rgb(cr, heat_colour[0], heat_colour[1], heat_colour[2]);
+    for(int v = 0; v < LATENCY_NUM_BUCKETS && max_bar > 0; v++) {
+        if(bars[v] == 0) continue;
+        cairo_rectangle(cr, hist_x, y + bucketY(v), MAX(LATENCY_HISTOGRAM_WIDTH * bars[v] / (double) max_bar, 1), LATENCY_BUCKET_HEIGHT - 1);
+        cairo_fill(cr);
+    }
+
+    // Latency axis at 1us, 1ms and 1s, then the operation's name and recent percentiles
+    cairo_set_source_rgba(cr, 0, 0, 0, 0.25);
+    cairo_set_line_width(cr, 1);
+    static const struct { uint64_t ns; const char * label; } ticks[] = {{1000, "1us"}, {1000000, "1ms"}, {1000000000, "1s"}};
+    for(int t = 0; t < G_N_ELEMENTS(ticks); t++) {
+        double tick_y = floor(y + bucketY(visibleBucket(fdt_stats_latency_bucket(ticks[t].ns)))) + 0.5;
+        cairo_move_to(cr, LATENCY_GUTTER_WIDTH - 4, tick_y);
+        cairo_line_to(cr, right, tick_y);
+        cairo_stroke(cr);
+        cairo_move_to(cr, LATENCY_GUTTER_WIDTH - 26, tick_y + 3);
+        cairo_show_text(cr, ticks[t].label);
+    }
+
+    cairo_set_source_rgb(cr, 0.2, 0.2, 0.2);
+    cairo_move_to(cr, 4, y + 10);
+    cairo_show_text(cr, fdt_stats_op_name(opcode));
+    if(recent_total > 0) {
+        char p50[16], p99[16], label[40];
+        formatLatency(p50, sizeof(p50), histogramPercentile(recent, recent_total, 0.5));
+        formatLatency(p99, sizeof(p99), histogramPercentile(recent, recent_total, 0.99));
+        snprintf(label, sizeof(label), "p50 %s", p50);
+        cairo_move_to(cr, 4, y + 24);
+        cairo_show_text(cr, label);
+        snprintf(label, sizeof(label), "p99 %s", p99);
+        cairo_move_to(cr, 4, y + 36);
+        cairo_show_text(cr, label);
+    }
+}
+
+static gboolean latency_expose_handler(GtkWidget * widget, GdkEventExpose * event, gpointer data) {
+    GtkAllocation allocation;
+    gtk_widget_get_allocation(widget, &allocation);
+    int columns = visibleColumns(allocation.width);
+    if(columns == 0) return TRUE;
+
+    cairo_t * cr = gdk_cairo_create(gtk_widget_get_window(widget));
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    cairo_paint(cr);
+    cairo_select_font_face(cr, "Sans", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+    cairo_set_font_size(cr, 10);
+
+    drawRuler(cr, columns);
+    int lane = 0;
+    for(int o = 0; o < FDT_STATS_OPS; o++) {
+        if(history[o] == NULL) continue;
+        drawLane(cr, o, LATENCY_RULER_HEIGHT + lane * (LATENCY_LANE_HEIGHT + LATENCY_LANE_GAP), columns);
+        lane++;
+    }
+    cairo_destroy(cr);
+    return TRUE;
+}
+
+// Describe the cell under the pointer, as the shading only gives the shape of the latencies
+static gboolean latency_motion_handler(GtkWidget * widget, GdkEventMotion * event, gpointer data) {
+    GtkAllocation allocation;
+    gtk_widget_get_allocation(widget, &allocation);
+    int columns = visibleColumns(allocation.width);
+    double right = LATENCY_GUTTER_WIDTH + columns * LATENCY_COLUMN_WIDTH;
+    if(event->x < LATENCY_GUTTER_WIDTH || event->x >= right || event->y < LATENCY_RULER_HEIGHT) return FALSE;
+
+    int lane = (event->y - LATENCY_RULER_HEIGHT) / (LATENCY_LANE_HEIGHT + LATENCY_LANE_GAP);
+    double lane_y = event->y - LATENCY_RULER_HEIGHT - lane * (LATENCY_LANE_HEIGHT + LATENCY_LANE_GAP);
+    if(lane_y >= LATENCY_LANE_HEIGHT) return FALSE;
+    int opcode = -1;
+    for(int o = 0; o < FDT_STATS_OPS && lane >= 0; o++) {
+        if(history[o] != NULL && lane-- == 0) opcode = o;
+    }
+    int age = (right - event->x) / LATENCY_COLUMN_WIDTH;
+    const uint32_t * column = opcode >= 0 ? historyColumn(opcode, age) : NULL;
+    if(column == NULL) return FALSE;
+
+    int v = LATENCY_NUM_BUCKETS - 1 - (int) (lane_y / LATENCY_BUCKET_HEIGHT);
+    uint64_t calls = 0;
+    for(int b = 0; b < FDT_STATS_LATENCY_BUCKETS; b++) {
+        if(visibleBucket(b) == v) calls += column[b];
+    }
+    int bucket = v + LATENCY_MIN_BUCKET;
+    char low[16], high[16];
+    formatLatency(low, sizeof(low), (double) (1ULL << (bucket - 1)));
+    formatLatency(high, sizeof(high), (double) (1ULL << bucket));
+    char * text;
+    if(bucket == LATENCY_MIN_BUCKET) {
+        text = g_strdup_printf("%s, %ds ago: %llu calls under %s", fdt_stats_op_name(opcode), age, (unsigned long long) calls, high);
+    } else if(bucket == LATENCY_MAX_BUCKET) {
+        text = g_strdup_printf("%s, %ds ago: %llu calls of %s or more", fdt_stats_op_name(opcode), age, (unsigned long long) calls, low);
+    } else {
+        text = g_strdup_printf("%s, %ds ago: %llu calls between %s and %s", fdt_stats_op_name(opcode), age, (unsigned long long) calls, low, high);
+    }
+    gtk_label_set_text(GTK_LABEL(latency_status), text);
+    g_free(text);
+    return FALSE;
+}
+
+GtkWidget * createLatencyView() {
+    GtkWidget * view = gtk_vbox_new(FALSE, 5);
+
+    GtkWidget * scrolled_window = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+
+    latency_area = gtk_drawing_area_new();
+    gtk_widget_add_events(latency_area, GDK_POINTER_MOTION_MASK);
+    g_signal_connect(latency_area, "expose-event", G_CALLBACK(latency_expose_handler), NULL);
+    g_signal_connect(latency_area, "motion-notify-event", G_CALLBACK(latency_motion_handler), NULL);
+    gtk_scrolled_window_add_with_viewport(GTK_SCROLLED_WINDOW(scrolled_window), latency_area);
+    gtk_widget_show(latency_area);
+    gtk_widget_show(scrolled_window);
+    gtk_box_pack_start((GtkBox *) view, scrolled_window, TRUE, TRUE, 0);
+
+    latency_status = gtk_label_new("Latency of each operation per second, with the histogram of the last few seconds beside it");
+    gtk_misc_set_alignment(GTK_MISC(latency_status), 0, 0.5);
+    gtk_widget_show(latency_status);
+    gtk_box_pack_start((GtkBox *) view, latency_status, FALSE, TRUE, 0);
+
+    latencyRefresh();
+    return view;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdbool.h>
+#include <gtk/gtk.h>
+#include <glib.h>
+
+#include "fdt_stats.h"
+
+// Seconds of latency history kept for each operation, one column per second
+#define LATENCY_COLUMNS 600
+
+// Seconds summed into the histogram drawn beside each heatmap
+#define LATENCY_RECENT_COLUMNS 10
+
+// Latencies outside these buckets are drawn in the nearest one, as they'd otherwise mostly be empty rows
+#define LATENCY_MIN_BUCKET 7     // Under 128ns
+#define LATENCY_MAX_BUCKET 35    // 17s and over
+
+GtkWidget * createLatencyView();
+void latencyStart();
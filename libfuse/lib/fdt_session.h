@@ -0,0 +1 @@
+../../fdt_session.h
\ No newline at end of file
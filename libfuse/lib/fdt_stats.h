@@ -0,0 +1 @@
+../../fdt_stats.h
\ No newline at end of file
@@ -19,6 +19,8 @@
 #include "fuse_compat.h"
 #include "fuse_kernel.h"
 #include "cJSON.c"
+#include "fdt_stats.h"
+#include "fdt_session.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -39,6 +41,10 @@
 #include <sys/time.h>
 #include <sys/mman.h>
 #include <semaphore.h>
+#include <sys/syscall.h>
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#endif
 #include <glib.h>
 
 #define FUSE_NODE_SLAB 1
@@ -1594,13 +1600,16 @@ static inline int fuse_compat_statfs(struct fuse_fs *fs, const char *path,
 
 #endif /* __FreeBSD__ || __NetBSD__ */
 
-const char *debugFifoName = "fuse-debug.fifo";
+char debugFifoName[PATH_MAX];
 FILE *debugFifo = NULL;
 
-const char *stepSemName = "fuse-step.sem";
+char stepSemName[PATH_MAX];
 sem_t *stepSem = NULL;
 
 void log_init(void) {
+    // Channels belong to the session fdt started the filesystem in
+    fdt_channel_name(getenv(FDT_SESSION_ENV), FDT_CHANNEL_DEBUG, debugFifoName, sizeof(debugFifoName));
+    fdt_channel_name(getenv(FDT_SESSION_ENV), FDT_CHANNEL_STEP, stepSemName, sizeof(stepSemName));
     if(debugFifo == NULL) {
     	debugFifo = fopen(debugFifoName, "w");
     }
@@ -1755,13 +1764,132 @@ cJSON * flockToJSONObject(struct flock * flock)
     return obj;
 }
 
+// The call currently being made by a thread, kept under fdt_call_key as older toolchains have no __thread
+struct fdt_call {
+	uint64_t start;		// When it started, in nanoseconds from fdt_duration_now()
+	int opcode;		// Stats opcode, looked up once when it starts
+};
+
+static pthread_key_t fdt_call_key;
+static pthread_once_t fdt_call_key_once = PTHREAD_ONCE_INIT;
+
+// Live counters read by fdt --top, or NULL if shared memory couldn't be set up
+static struct fdt_stats * fdtStats = NULL;
+static char fdtStatsName[64];
+
+void fdt_stats_init(void)
+{
+	if(fdtStats != NULL) {
+		return;
+	}
+	snprintf(fdtStatsName, sizeof(fdtStatsName), FDT_STATS_SHM_PREFIX "%d", getpid());
+	int fd = shm_open(fdtStatsName, O_CREAT | O_RDWR | O_TRUNC, 0644);
+	if(fd < 0) {
+		return;
+	}
+	if(ftruncate(fd, sizeof(struct fdt_stats)) != 0) {
+		close(fd);
+		shm_unlink(fdtStatsName);
+		return;
+	}
+	struct fdt_stats * stats = mmap(NULL, sizeof(struct fdt_stats), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(stats == MAP_FAILED) {
+		shm_unlink(fdtStatsName);
+		return;
+	}
+	stats->version = FDT_STATS_VERSION;
+	stats->fs_pid = getpid();
+	__atomic_store_n(&stats->magic, FDT_STATS_MAGIC, __ATOMIC_RELEASE);
+	fdtStats = stats;
+}
+
+void fdt_stats_destroy(void)
+{
+	if(fdtStats != NULL) {
+		munmap(fdtStats, sizeof(struct fdt_stats));
+		shm_unlink(fdtStatsName);
+		fdtStats = NULL;
+	}
+}
+
+// Durations are measured on the monotonic clock, so setting the time can't make them negative
+#ifdef __APPLE__
+// Older SDKs have no clock_gettime, so mach_absolute_time() is used, converted to nanoseconds
+static mach_timebase_info_data_t fdt_timebase;
+#elif defined(CLOCK_MONOTONIC)
+#define FDT_DURATION_CLOCK CLOCK_MONOTONIC
+#else
+#define FDT_DURATION_CLOCK CLOCK_REALTIME
+#endif
+
+static void fdt_call_key_create(void)
+{
+#ifdef __APPLE__
+	mach_timebase_info(&fdt_timebase);
+#endif
+	pthread_key_create(&fdt_call_key, free);
+}
+
+// The call this thread is making, or NULL if there's no memory for it
+static struct fdt_call * fdt_current_call(void)
+{
+	pthread_once(&fdt_call_key_once, fdt_call_key_create);
+	struct fdt_call * call = pthread_getspecific(fdt_call_key);
+	if(call == NULL) {
+		call = calloc(1, sizeof(*call));
+		if(call != NULL)
+			pthread_setspecific(fdt_call_key, call);
+	}
+	return call;
+}
+
+// Nanoseconds from some fixed point, only meaningful compared with each other
+static uint64_t fdt_duration_now(void)
+{
+#ifdef __APPLE__
+	return mach_absolute_time() * fdt_timebase.numer / fdt_timebase.denom;
+#else
+	struct timespec now;
+	clock_gettime(FDT_DURATION_CLOCK, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+// Add the time, thread and calling process to an event
+// The timestamp is in microseconds so that it survives being printed as a JSON number
+static void add_call_context(cJSON * event)
+{
+#ifdef __APPLE__
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	cJSON_AddNumberToObject(event, "timestamp", (double) now.tv_sec * 1000000.0 + now.tv_usec);
+	cJSON_AddNumberToObject(event, "tid", pthread_mach_thread_np(pthread_self()));
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	cJSON_AddNumberToObject(event, "timestamp", (double) now.tv_sec * 1000000.0 + now.tv_nsec / 1000);
+	cJSON_AddNumberToObject(event, "tid", syscall(SYS_gettid));
+#endif
+	cJSON_AddNumberToObject(event, "pid", fuse_get_context()->pid);
+}
+
 void report_fs_call(struct fuse_fs * fs, const char *name, int seqnum, cJSON * params)
 {
+	struct fdt_call * call = fdt_current_call();
+	int opcode = fdtStats != NULL ? fdt_stats_opcode(name) : FDT_STATS_OP_UNKNOWN;
+	if(call != NULL)
+		call->opcode = opcode;
+	cJSON * path_obj = params != NULL ? cJSON_GetObjectItem(params, "path") : NULL;
+	fdt_stats_call(fdtStats, opcode, fuse_get_context()->pid,
+		path_obj != NULL && path_obj->type == cJSON_String ? path_obj->valuestring : NULL);
+
 	if(fs->fdt_debug_mode) {
 		cJSON *event = cJSON_CreateObject();
 		cJSON_AddStringToObject(event, "type", "invoke");
 		cJSON_AddStringToObject(event, "name", name);
 		cJSON_AddNumberToObject(event, "seqnum", seqnum);
+		add_call_context(event);
 		cJSON_AddItemToObject(event, "params", params);
 
 		char *event_json = cJSON_Print(event);
@@ -1773,15 +1901,26 @@ void report_fs_call(struct fuse_fs * fs, const char *name, int seqnum, cJSON * p
 		// Wait until the debugger advances execution
 		sem_wait(stepSem);
 	}
+
+	// Time spent in the filesystem is measured from here, so it excludes any time spent paused
+	if(call != NULL)
+		call->start = fdt_duration_now();
 }
 
 void report_fs_call_return(struct fuse_fs * fs, const char *name, int seqnum, int *return_val_ptr, cJSON * modified_params)
 {
+	struct fdt_call * call = fdt_current_call();
+	double elapsed = call != NULL ? (double) (fdt_duration_now() - call->start) : 0;
+	fdt_stats_return(fdtStats, call != NULL ? call->opcode : FDT_STATS_OP_UNKNOWN,
+		return_val_ptr != NULL ? *return_val_ptr : 0, elapsed);
+
 	if(fs->fdt_debug_mode) {
 	    cJSON *event = cJSON_CreateObject();
 		cJSON_AddStringToObject(event, "type", "return");
 		cJSON_AddStringToObject(event, "name", name);
 		cJSON_AddNumberToObject(event, "seqnum", seqnum);
+		add_call_context(event);
+		cJSON_AddNumberToObject(event, "elapsed", elapsed);
 		
 		if(return_val_ptr != NULL) {
 		    cJSON_AddNumberToObject(event, "returnval", *return_val_ptr);
@@ -4321,6 +4460,7 @@ void fuse_fs_destroy(struct fuse_fs *fs)
 	if (fs->m)
 		fuse_put_module(fs->m);
 	free(fs);
+	fdt_stats_destroy();
 }
 
 static void fuse_lib_destroy(void *data)
@@ -6254,6 +6394,9 @@ struct fuse_fs *fuse_fs_new(const struct fuse_operations *op, size_t op_size,
 	} else {
 		fs->fdt_debug_mode = 0;
 	}
+
+	// Keep live counters for fdt --top
+	fdt_stats_init();
 	
 	wrapper_operations = (struct fuse_wrapper_operations *) calloc(1, sizeof(struct fuse_wrapper_operations));
 	if (!wrapper_operations) {
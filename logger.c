@@ -9,6 +9,7 @@
 #include <sys/stat.h>
 #include <semaphore.h>
 #include <string.h>
+#include <limits.h>
 #include <gtk/gtk.h>
 #include <pthread.h>
 #include <stdbool.h>
@@ -20,18 +21,29 @@
 
 #include "cJSON.h"
 #include "fdt.h"
+#include "capture.h"
+#include "trace.h"
 #include "logger.h"
 
 static bool fifoOpen;
 static int prompting = 0;
 static int pendingInvocations = 0;
 static cJSON * current_sequence = NULL;
-static cJSON * all_sequences = NULL;
 
-static char *debugFifoName = "fuse-debug.fifo";
+// Finished sequences are streamed to the capture file rather than kept in memory
+static char * capture_path = NULL;
+static int capture_fd = -1;
+static char capture_group[64];
+static int sequences_written = 0;
+
+// Operations whose back-to-back identical calls are captured once, with a repeat count
+static bool compact_ops[TRACE_OP_UNKNOWN + 1];
+static char * last_call_params = NULL;
+
+static char debugFifoName[PATH_MAX];
 static FILE *debugFifo = NULL;
 
-static char *stepSemName = "fuse-step.sem";
+static char stepSemName[PATH_MAX];
 static sem_t *stepSem = NULL;
 
 static state current_state = IDLE;
@@ -40,6 +52,59 @@ void setLoggerState(state s) {
     current_state = s;
 }
 
+void setLoggerCaptureFile(const char * path) {
+    free(capture_path);
+    capture_path = malloc(strlen(path) + 1);
+    strcpy(capture_path, path);
+}
+
+/* Set which operations are compacted from a comma-separated list of names, or "all"
+ * Returns false if any name isn't an operation
+ */
+bool setLoggerCompaction(const char * ops) {
+    char * ops_cpy = malloc(strlen(ops) + 1);
+    strcpy(ops_cpy, ops);
+    char * stringp = ops_cpy;
+    char * token;
+    bool ok = TRUE;
+    while((token = strsep(&stringp, ",")) != NULL) {
+        if(strcmp(token, "all") == 0) {
+            for(int o = 0; o < TRACE_OP_UNKNOWN; o++) compact_ops[o] = TRUE;
+        } else if(traceOpcode(token) != TRACE_OP_UNKNOWN) {
+            compact_ops[traceOpcode(token)] = TRUE;
+        } else {
+            fprintf(stderr, "Unknown operation '%s'\n", token);
+            ok = FALSE;
+        }
+    }
+    free(ops_cpy);
+    return ok;
+}
+
+// Open the capture file, asking for its name if it wasn't given on the command line
+static bool openCaptureFile() {
+    while(capture_fd < 0) {
+        if(capture_path == NULL) {
+            printf("Enter filename to append sequences to. Leave blank to discard this sequence.\n > ");
+            char * fname_str = NULL;
+            size_t line_len = 0;
+            getline(&fname_str, &line_len, stdin);
+            fname_str[strcspn(fname_str, "\n")] = '\0';
+            if(strlen(fname_str) == 0) {
+                free(fname_str);
+                return FALSE;
+            }
+            capture_path = fname_str;
+        }
+        capture_fd = captureOpen(capture_path);
+        if(capture_fd < 0) {
+            free(capture_path);
+            capture_path = NULL;
+        }
+    }
+    return TRUE;
+}
+
 void quitLogger() {
     pid_t fuse_pid = getFusePID();
     if(fuse_pid != 0) {
@@ -119,15 +184,6 @@ int isKeyAvailable() {
     return FD_ISSET(fd, &fdset);
 }
 
-void exportJSON(const char * fname, cJSON * obj) {
-    char * data = cJSON_Print(obj);
-    FILE * f = fopen(fname, "w+");
-    if(f != NULL) {
-        fputs(data, f);
-        fclose(f);
-    }
-}
-
 void choicePrompt() {
 
     // If we were not already prompting, print the choice
@@ -136,7 +192,7 @@ void choicePrompt() {
             case IDLE:
                 printf("\nNot capturing data. Choose an action:\n");
                 printf("  s : start capturing sequence\n");
-                printf("  q : quit and (optionally) export\n");
+                printf("  q : quit\n");
             break;
             case CAPTURING_SEQUENCE:
                 printf("\nPress 'e' key to end this sequence capture.\n");
@@ -155,38 +211,14 @@ void choicePrompt() {
                     current_state = CAPTURING_SEQUENCE;
                 } else if(c == 'q') {
                     /* Handle quit */
-                    if(cJSON_GetArraySize(all_sequences) > 0) {
-                        
-                        // Prompt for export filename
-                        printf("Enter filename to export sequences to. Leave blank to discard data.\n > ");
-                        char * fname_str = NULL;
-                        size_t line_len = 0;
-                        getline(&fname_str, &line_len, stdin);
-                        fname_str[strlen(fname_str)-1] = '\0';
-
-                        if(strlen(fname_str) > 0) {
-                            if(access(fname_str, F_OK) != -1) {
-                                // File already exists, so read it in and append the new group of sequences
-                                printf("Appending to existing file '%s'\n", fname_str);
-                                cJSON * groups = readJSONFile(fname_str);
-                                if(groups != NULL) {
-                                    cJSON_AddItemToArray(groups, all_sequences);
-                                    exportJSON(fname_str, groups);
-                                } else {
-                                    printf("Did not export data as there was an error reading the existing file\n");
-                                }
-                            } else {
-                                // File does not exist, so create it and export the data
-                                printf("Exporting to new file '%s'\n", fname_str);
-                                cJSON * groups = cJSON_CreateArray();
-                                cJSON_AddItemToArray(groups, all_sequences);
-                                exportJSON(fname_str, groups);
-                            }
-                        } else {
-                            printf("Discarding data\n");
-                        }
+                    if(sequences_written > 0) {
+                        printf("%d sequences were appended to '%s'\n", sequences_written, capture_path);
                     } else {
-                        printf("Nothing to export as no sequences were captured\n");
+                        printf("Nothing was written as no sequences were captured\n");
+                    }
+                    if(capture_fd >= 0) {
+                        close(capture_fd);
+                        capture_fd = -1;
                     }
                     quitLogger();
                 }
@@ -216,6 +248,7 @@ void choicePrompt() {
 
                         // Create wrapper object that contains metadata about the call sequence
                         cJSON * sequence_obj = cJSON_CreateObject();
+                        cJSON_AddStringToObject(sequence_obj, "group", capture_group);
                         cJSON_AddStringToObject(sequence_obj, "action", action_str);
                         cJSON_AddStringToObject(sequence_obj, "application", application_str);
                         cJSON_AddStringToObject(sequence_obj, "os", os_str);
@@ -224,10 +257,15 @@ void choicePrompt() {
                         free(application_str);
                         free(os_str);
 
-                        // Append the sequence to the set of logged sequences
-                        cJSON_AddItemToArray(all_sequences, sequence_obj);
-                        printf("Sequence saved (but not written to disk!)\n");
-                        printf("Number of sequences logged so far: %d\n", cJSON_GetArraySize(all_sequences));
+                        // Append the sequence to the capture file straight away
+                        if(!openCaptureFile()) {
+                            printf("Discarding sequence\n");
+                        } else if(captureAppendSequence(capture_fd, sequence_obj)) {
+                            sequences_written++;
+                            printf("Sequence appended to '%s'\n", capture_path);
+                            printf("Number of sequences logged so far: %d\n", sequences_written);
+                        }
+                        cJSON_Delete(sequence_obj);
                     } else {
                         printf("\nNo calls captured so did not log empty sequence\n");
                         cJSON_Delete(current_sequence);
@@ -235,6 +273,8 @@ void choicePrompt() {
 
                     // Prepare a new empty sequence
                     current_sequence = cJSON_CreateArray();
+                    free(last_call_params);
+                    last_call_params = NULL;
 
                     current_state = IDLE;
                 }
@@ -246,6 +286,10 @@ void choicePrompt() {
 
 stopToolFunc startLogger() {
 
+    // Channels belong to the session of the filesystem being started
+    sessionChannel(getCurrentSession(), FDT_CHANNEL_DEBUG, debugFifoName, sizeof(debugFifoName));
+    sessionChannel(getCurrentSession(), FDT_CHANNEL_STEP, stepSemName, sizeof(stepSemName));
+
     // Create a FIFO so that libfuse can tell us what's going on
     unlink(debugFifoName);
     mkfifo(debugFifoName, 0666);
@@ -287,7 +331,8 @@ void doStartLogger() {
     char *json_chunk = malloc(json_chunk_capacity);
 
     current_sequence = cJSON_CreateArray();
-    all_sequences = cJSON_CreateArray();
+    captureGroupId(capture_group, sizeof(capture_group));
+    sequences_written = 0;
 
     long min_sleep_time = 10;
     long max_sleep_time = 1000000;
@@ -385,6 +430,36 @@ void l_advancePending() {
 
 
 
+/* Fold a call into the previous one if both are the same compacted operation with the same parameters
+ * Returns true if the event was folded, in which case it has been freed
+ */
+bool compactLoggerEvent(cJSON * event) {
+    char * name = cJSON_GetObjectItem(event, "name")->valuestring;
+    cJSON * params = cJSON_GetObjectItem(event, "params");
+    char * params_str = params != NULL ? cJSON_PrintUnformatted(params) : NULL;
+
+    int num_calls = cJSON_GetArraySize(current_sequence);
+    cJSON * last = num_calls > 0 ? cJSON_GetArrayItem(current_sequence, num_calls - 1) : NULL;
+    if(compact_ops[traceOpcode(name)] && last != NULL && last_call_params != NULL && params_str != NULL
+            && strcmp(cJSON_GetObjectItem(last, "name")->valuestring, name) == 0
+            && strcmp(last_call_params, params_str) == 0) {
+        cJSON * repeat = cJSON_GetObjectItem(last, "repeat");
+        if(repeat == NULL) {
+            cJSON_AddNumberToObject(last, "repeat", 2);
+        } else {
+            cJSON_SetIntValue(repeat, repeat->valueint + 1);
+        }
+        printf("%s captured (repeated %d times)\n", name, cJSON_GetObjectItem(last, "repeat")->valueint);
+        free(params_str);
+        cJSON_Delete(event);
+        return TRUE;
+    }
+
+    free(last_call_params);
+    last_call_params = params_str;
+    return FALSE;
+}
+
 void handleLoggerEvent(cJSON * event) {
     char * type = cJSON_GetObjectItem(event, "type")->valuestring;
     char * name = cJSON_GetObjectItem(event, "name")->valuestring;
@@ -400,8 +475,10 @@ void handleLoggerEvent(cJSON * event) {
 
         switch(current_state) {
             case CAPTURING_SEQUENCE:
-                cJSON_AddItemToArray(current_sequence, event);
-                printf("%s captured\n", name);
+                if(!compactLoggerEvent(event)) {
+                    cJSON_AddItemToArray(current_sequence, event);
+                    printf("%s captured\n", name);
+                }
             break;
             default:
                 printf("%s ignored\n", name);
@@ -10,6 +10,8 @@ typedef enum {IDLE, CAPTURING_SEQUENCE} state;
 
 void quitLogger();
 void setLoggerState(state s);
+void setLoggerCaptureFile(const char * path);
+bool setLoggerCompaction(const char * ops);
 stopToolFunc startLogger();
 void stopLogger();
 void doStartLogger();
@@ -17,4 +19,5 @@ void l_waitToAdvance();
 bool l_canAdvance();
 void l_advance();
 void l_advancePending();
+bool compactLoggerEvent(cJSON * event);
 void handleLoggerEvent(cJSON * event);
@@ -0,0 +1,62 @@
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Names of the channels between fdt and the libfuse wrapper
+ *
+ * This header is shared between fdt and the libfuse wrappers, so it must stay self-contained.
+ * fdt gives every filesystem it starts a session ID, and the FIFOs for that session live in a
+ * directory of their own under the runtime directory, so any number of filesystems can be traced
+ * at once. A filesystem started without a session falls back to the old names in the working directory.
+ */
+
+#define FDT_SESSION_ENV "FDT_SESSION"
+#define FDT_RUNTIME_DIR_ENV "FDT_RUNTIME_DIR"
+#define FDT_TS_JOBS_ENV "FDT_TS_JOBS"         // How many test groups a filesystem may run at once
+
+#define FDT_SESSION_ID_LEN 32
+
+#define FDT_CHANNEL_DEBUG "debug.fifo"
+#define FDT_CHANNEL_STEP "step.sem"
+#define FDT_CHANNEL_TESTSUITE "testsuite.fifo"
+#define FDT_CHANNEL_WIZARD "wizard.fifo"
+#define FDT_CHANNEL_TS_ROOT "ts-root"
+
+// Directory holding one subdirectory per session: $FDT_RUNTIME_DIR, $XDG_RUNTIME_DIR/fdt or /tmp/fdt-<uid>
+static inline void fdt_runtime_dir(char * buf, size_t len) {
+    const char * dir = getenv(FDT_RUNTIME_DIR_ENV);
+    if(dir != NULL && dir[0] != '\0') {
+        snprintf(buf, len, "%s", dir);
+        return;
+    }
+    dir = getenv("XDG_RUNTIME_DIR");
+    if(dir != NULL && dir[0] != '\0') {
+        snprintf(buf, len, "%s/fdt", dir);
+    } else {
+        snprintf(buf, len, "/tmp/fdt-%d", (int) getuid());
+    }
+}
+
+static inline void fdt_session_dir(const char * session, char * buf, size_t len) {
+    char runtime_dir[len];
+    fdt_runtime_dir(runtime_dir, len);
+    snprintf(buf, len, "%s/%s", runtime_dir, session);
+}
+
+/* Name of a channel for a session, or the legacy name if session is NULL
+ * Named semaphores can't live in a directory, and macOS limits their names to 31 characters,
+ * so the step semaphore is named after the session alone
+ */
+static inline void fdt_channel_name(const char * session, const char * channel, char * buf, size_t len) {
+    if(session == NULL || session[0] == '\0') {
+        snprintf(buf, len, "fuse-%s", channel);
+    } else if(strcmp(channel, FDT_CHANNEL_STEP) == 0) {
+        snprintf(buf, len, "/fdt-%s", session);
+    } else {
+        char session_dir[len];
+        fdt_session_dir(session, session_dir, len);
+        snprintf(buf, len, "%s/%s", session_dir, channel);
+    }
+}
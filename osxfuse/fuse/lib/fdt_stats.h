@@ -0,0 +1,146 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+/* Live per-operation counters, kept by the libfuse wrapper in shared memory and read by fdt --top
+ *
+ * This header is shared between fdt and the libfuse wrappers, so it must stay self-contained.
+ * Every counter is updated with relaxed atomic adds, so keeping them costs the filesystem next to
+ * nothing, and a reader only ever sees slightly stale values.
+ */
+
+#define FDT_STATS_MAGIC 0x53544446     // "FDTS"
+#define FDT_STATS_VERSION 1
+
+// Shared memory object name, followed by the pid of the filesystem
+#define FDT_STATS_SHM_PREFIX "/fdt-stats."
+
+#define FDT_STATS_OPS 64
+#define FDT_STATS_OP_UNKNOWN 63
+
+// Latency histograms have one bucket per power of two nanoseconds
+#define FDT_STATS_LATENCY_BUCKETS 64
+
+// Client pids and paths share a small number of slots, with heavy hitters winning collisions
+#define FDT_STATS_PID_SLOTS 128
+#define FDT_STATS_PATH_SLOTS 512
+#define FDT_STATS_PATH_LEN 120
+
+// Operation names in opcode order, shared with the trace store so that opcodes mean the same everywhere
+static const char * const fdt_op_names[] = {
+    "getattr", "readlink", "getdir", "mknod", "mkdir", "unlink", "rmdir", "symlink",
+    "rename", "link", "chmod", "chown", "truncate", "utime", "open", "read",
+    "write", "statfs", "flush", "release", "fsync", "setxattr", "getxattr", "listxattr",
+    "removexattr", "opendir", "readdir", "releasedir", "fsyncdir", "init", "destroy", "access",
+    "create", "ftruncate", "fgetattr", "lock", "utimens", "bmap", "ioctl", "poll",
+    "write_buf", "read_buf", "flock", "fallocate"
+};
+#define FDT_NUM_OP_NAMES (sizeof(fdt_op_names) / sizeof(fdt_op_names[0]))
+
+struct fdt_op_counters {
+    uint64_t calls;
+    uint64_t returns;
+    uint64_t errors;
+    uint64_t latency_total;
+    uint64_t latency[FDT_STATS_LATENCY_BUCKETS];
+};
+
+struct fdt_pid_slot {
+    int32_t pid;
+    uint32_t reserved;
+    uint64_t calls;
+};
+
+struct fdt_path_slot {
+    uint32_t hash;
+    uint32_t ready;     // Set once path has been written
+    uint64_t calls;
+    char path[FDT_STATS_PATH_LEN];
+};
+
+struct fdt_stats {
+    uint32_t magic;
+    uint32_t version;
+    int32_t fs_pid;
+    uint32_t reserved;
+    int64_t in_flight;
+    struct fdt_op_counters ops[FDT_STATS_OPS];
+    struct fdt_pid_slot pids[FDT_STATS_PID_SLOTS];
+    struct fdt_path_slot paths[FDT_STATS_PATH_SLOTS];
+};
+
+static inline int fdt_stats_opcode(const char * name) {
+    for(int i = 0; i < FDT_NUM_OP_NAMES; i++) {
+        if(strcmp(fdt_op_names[i], name) == 0) return i;
+    }
+    return FDT_STATS_OP_UNKNOWN;
+}
+
+static inline const char * fdt_stats_op_name(int opcode) {
+    if(opcode >= 0 && opcode < FDT_NUM_OP_NAMES) return fdt_op_names[opcode];
+    return "unknown";
+}
+
+static inline int fdt_stats_latency_bucket(uint64_t ns) {
+    return ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+}
+
+static inline uint32_t fdt_stats_path_hash(const char * path) {
+    uint32_t hash = 2166136261u;
+    for(const unsigned char * c = (const unsigned char *) path; *c != '\0'; c++) {
+        hash ^= *c;
+        hash *= 16777619u;
+    }
+    return hash != 0 ? hash : 1;
+}
+
+/* Count a key in a direct-mapped slot. A different key in the slot has its count worn down instead,
+ * and takes over the slot once that reaches zero, so frequent keys hold on to their slots.
+ * Returns 1 if the caller has just claimed the slot for its key.
+ */
+static inline int fdt_stats_count_slot(uint32_t * slot_key, uint64_t * slot_calls, uint32_t key) {
+    uint32_t current = __atomic_load_n(slot_key, __ATOMIC_RELAXED);
+    if(current == key) {
+        __atomic_fetch_add(slot_calls, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    if(current != 0 && __atomic_sub_fetch(slot_calls, 1, __ATOMIC_RELAXED) + 1 > 1) {
+        return 0;
+    }
+    if(__atomic_compare_exchange_n(slot_key, &current, key, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+        __atomic_store_n(slot_calls, 1, __ATOMIC_RELAXED);
+        return 1;
+    }
+    return 0;
+}
+
+static inline void fdt_stats_call(struct fdt_stats * stats, int opcode, int32_t pid, const char * path) {
+    if(stats == NULL) return;
+    __atomic_fetch_add(&stats->ops[opcode].calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->in_flight, 1, __ATOMIC_RELAXED);
+
+    if(pid != 0) {
+        struct fdt_pid_slot * slot = &stats->pids[(uint32_t) pid % FDT_STATS_PID_SLOTS];
+        fdt_stats_count_slot((uint32_t *) &slot->pid, &slot->calls, pid);
+    }
+    if(path != NULL) {
+        uint32_t hash = fdt_stats_path_hash(path);
+        struct fdt_path_slot * slot = &stats->paths[hash % FDT_STATS_PATH_SLOTS];
+        if(fdt_stats_count_slot(&slot->hash, &slot->calls, hash)) {
+            __atomic_store_n(&slot->ready, 0, __ATOMIC_RELEASE);
+            strncpy(slot->path, path, FDT_STATS_PATH_LEN - 1);
+            slot->path[FDT_STATS_PATH_LEN - 1] = '\0';
+            __atomic_store_n(&slot->ready, 1, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+static inline void fdt_stats_return(struct fdt_stats * stats, int opcode, int retval, uint64_t elapsed_ns) {
+    if(stats == NULL) return;
+    struct fdt_op_counters * op = &stats->ops[opcode];
+    __atomic_fetch_add(&op->returns, 1, __ATOMIC_RELAXED);
+    if(retval < 0) __atomic_fetch_add(&op->errors, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&op->latency_total, elapsed_ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&op->latency[fdt_stats_latency_bucket(elapsed_ns)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&stats->in_flight, 1, __ATOMIC_RELAXED);
+}
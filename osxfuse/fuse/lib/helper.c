@@ -319,7 +319,7 @@ static struct fuse *fuse_setup_common(int argc, char *argv[],
 	} else if(strcmp(tool_ident, "testsuite") == 0) {
 		/* Test Suite */
 		printf("[osxfuse] FDT_TOOL is 'testsuite'\n");
-		testsuite_init(op, op_size, *mountpoint);
+		testsuite_init(op, op_size, *mountpoint, multithreaded != NULL && *multithreaded);
 		goto err_unmount;
 	} else if(strcmp(tool_ident, "debugger") == 0) {
 		/* Debugger - so continue with normal mount */
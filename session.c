@@ -0,0 +1,127 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <semaphore.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <glib.h>
+
+#include "session.h"
+
+/* Sessions are only added and removed by the main thread, but are looked up from the SIGCHLD handler,
+ * so the table is a plain array rather than anything that needs a lock
+ */
+static struct fdt_session * volatile sessions[MAX_SESSIONS];
+static unsigned int next_session_num = 0;
+
+/* Create a directory only we can use, or check that one already there is just that
+ * The fallback runtime directory is in /tmp, where another user could have made it first, or left a
+ * symlink in its place, to get at our FIFOs and stats
+ */
+static bool makeDirectory(const char * path) {
+    if(mkdir(path, 0700) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Unable to create %s: %s\n", path, strerror(errno));
+        return FALSE;
+    }
+    struct stat st;
+    if(lstat(path, &st) != 0) {
+        fprintf(stderr, "Unable to create %s: %s\n", path, strerror(errno));
+        return FALSE;
+    }
+    if(!S_ISDIR(st.st_mode) || st.st_uid != getuid() || (st.st_mode & 0777) != 0700) {
+        fprintf(stderr, "Refusing to use %s, as it isn't a directory owned by and only accessible to this user\n", path);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Create a session and its runtime directory, returning NULL if either isn't possible
+struct fdt_session * sessionNew(const char * label) {
+    int slot;
+    for(slot = 0; slot < MAX_SESSIONS; slot++) {
+        if(sessions[slot] == NULL) break;
+    }
+    if(slot == MAX_SESSIONS) {
+        fprintf(stderr, "Too many filesystems running (at most %d)\n", MAX_SESSIONS);
+        return NULL;
+    }
+
+    struct fdt_session * session = calloc(1, sizeof(*session));
+    snprintf(session->id, sizeof(session->id), "%d-%u", (int) getpid(), next_session_num++);
+    session->label = malloc(strlen(label) + 1);
+    strcpy(session->label, label);
+
+    char runtime_dir[PATH_MAX];
+    fdt_runtime_dir(runtime_dir, sizeof(runtime_dir));
+    session->dir = malloc(PATH_MAX);
+    fdt_session_dir(session->id, session->dir, PATH_MAX);
+    if(!makeDirectory(runtime_dir) || !makeDirectory(session->dir)) {
+        free(session->dir);
+        free(session->label);
+        free(session);
+        return NULL;
+    }
+
+    sessions[slot] = session;
+    return session;
+}
+
+// Forget a session whose filesystem has exited, and remove whatever it left in its runtime directory
+void sessionFree(struct fdt_session * session) {
+    if(session == NULL) return;
+    for(int slot = 0; slot < MAX_SESSIONS; slot++) {
+        if(sessions[slot] == session) sessions[slot] = NULL;
+    }
+
+    const char * channels[] = {FDT_CHANNEL_DEBUG, FDT_CHANNEL_TESTSUITE, FDT_CHANNEL_WIZARD};
+    char path[PATH_MAX];
+    for(int i = 0; i < sizeof(channels) / sizeof(channels[0]); i++) {
+        sessionChannel(session, channels[i], path, sizeof(path));
+        unlink(path);
+    }
+    sessionChannel(session, FDT_CHANNEL_STEP, path, sizeof(path));
+    sem_unlink(path);
+
+    // The test suite empties its root directory between groups, so it's only left behind if that failed
+    sessionChannel(session, FDT_CHANNEL_TS_ROOT, path, sizeof(path));
+    rmdir(path);
+    rmdir(session->dir);
+
+    free(session->dir);
+    free(session->label);
+    free(session);
+}
+
+// Name of one of the session's channels, or its legacy name if there is no session
+void sessionChannel(struct fdt_session * session, const char * channel, char * buf, size_t len) {
+    fdt_channel_name(session != NULL ? session->id : NULL, channel, buf, len);
+}
+
+// Safe to call from a signal handler
+struct fdt_session * sessionForPid(pid_t pid) {
+    for(int slot = 0; slot < MAX_SESSIONS; slot++) {
+        struct fdt_session * session = sessions[slot];
+        if(session != NULL && session->fuse_pid == pid) return session;
+    }
+    return NULL;
+}
+
+void sessionExited(struct fdt_session * session, int status) {
+    session->status = status;
+    session->exited = TRUE;
+}
+
+// Send a signal to every filesystem that is still running
+void sessionKillAll(int sig) {
+    for(int slot = 0; slot < MAX_SESSIONS; slot++) {
+        struct fdt_session * session = sessions[slot];
+        if(session != NULL && session->fuse_pid != 0 && !session->exited) {
+            kill(session->fuse_pid, sig);
+        }
+    }
+}
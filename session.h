@@ -0,0 +1,27 @@
+#pragma once
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <signal.h>
+#include <sys/types.h>
+
+#include "fdt_session.h"
+
+// Most filesystems a single fdt process can supervise at once
+#define MAX_SESSIONS 64
+
+// A filesystem started by fdt, together with the channels used to talk to its libfuse wrapper
+struct fdt_session {
+    char id[FDT_SESSION_ID_LEN];
+    char * dir;
+    char * label;                   // Shown alongside anything reported for this session
+    pid_t fuse_pid;
+    volatile sig_atomic_t exited;   // Set from the SIGCHLD handler
+    int status;
+};
+
+struct fdt_session * sessionNew(const char * label);
+void sessionFree(struct fdt_session * session);
+void sessionChannel(struct fdt_session * session, const char * channel, char * buf, size_t len);
+struct fdt_session * sessionForPid(pid_t pid);
+void sessionExited(struct fdt_session * session, int status);
+void sessionKillAll(int sig);
@@ -0,0 +1,224 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <glib.h>
+
+#include "eventstore.h"
+#include "spill.h"
+
+static struct spill_segment * segmentNew() {
+    char name[] = "/tmp/fdt-events-XXXXXX";
+    int fd = mkstemp(name);
+    if(fd < 0) {
+        perror("Unable to create file for old debugger events");
+        return NULL;
+    }
+    // Nothing else needs the name, and the space is given back as soon as the file is closed
+    unlink(name);
+
+    struct spill_segment * segment = malloc(sizeof(*segment));
+    segment->fd = fd;
+    segment->size = 0;
+    segment->offsets = g_array_sized_new(FALSE, FALSE, sizeof(uint64_t), SPILL_SEGMENT_EVENTS);
+    return segment;
+}
+
+static void segmentFree(gpointer data) {
+    struct spill_segment * segment = data;
+    close(segment->fd);
+    g_array_free(segment->offsets, TRUE);
+    free(segment);
+}
+
+struct event_spill * spillNew(guint64 capacity) {
+    struct event_spill * spill = calloc(1, sizeof(*spill));
+    spill->segments = g_ptr_array_new_with_free_func(segmentFree);
+    spill->capacity = capacity;
+    return spill;
+}
+
+void spillClear(struct event_spill * spill) {
+    g_ptr_array_set_size(spill->segments, 0);
+    spill->first_id = spill->next_id = 0;
+}
+
+void spillFree(struct event_spill * spill) {
+    g_ptr_array_free(spill->segments, TRUE);
+    free(spill->scan_buf);
+    free(spill);
+}
+
+guint64 spillFirstId(struct event_spill * spill) {
+    return spill->first_id;
+}
+
+guint64 spillCount(struct event_spill * spill) {
+    return spill->next_id - spill->first_id;
+}
+
+static uint32_t stringLength(const char * s) {
+    return s != NULL ? strlen(s) + 1 : 0;
+}
+
+static char * appendString(char * pos, const char * s, uint32_t len) {
+    if(len > 0) memcpy(pos, s, len);
+    return pos + len;
+}
+
+/* Append a record, which has to be the one after the last spilled unless the spill is empty
+ * Returns FALSE if it couldn't be written, in which case everything spilled so far is dropped, as
+ * records can only be found by their position.
+ */
+bool spillWrite(struct event_spill * spill, const struct event_record * record) {
+    if(spillCount(spill) > 0 && record->id != spill->next_id) {
+        spillClear(spill);
+    }
+    if(spillCount(spill) == 0) {
+        spill->first_id = spill->next_id = record->id;
+    }
+
+    struct spill_segment * segment = NULL;
+    if(spill->segments->len > 0) {
+        segment = g_ptr_array_index(spill->segments, spill->segments->len - 1);
+    }
+    if(segment == NULL || segment->offsets->len == SPILL_SEGMENT_EVENTS) {
+        if((segment = segmentNew()) == NULL) {
+            spillClear(spill);
+            return FALSE;
+        }
+        g_ptr_array_add(spill->segments, segment);
+    }
+
+    struct spill_record header;
+    memset(&header, 0, sizeof(header));
+    header.seqnum = record->seqnum;
+    header.returnval = record->returnval;
+    header.opcode = record->opcode;
+    header.flags = (record->is_return ? SPILL_RETURN : 0) | (record->has_returnval ? SPILL_HAS_RETURNVAL : 0);
+    header.name_len = stringLength(record->name);
+    header.path_len = stringLength(record->path);
+    header.newpath_len = stringLength(record->newpath);
+    header.params_len = stringLength(record->params);
+    header.length = sizeof(header) + header.name_len + header.path_len + header.newpath_len + header.params_len;
+
+    char * buf = malloc(header.length);
+    char * pos = appendString(buf, (const char *) &header, sizeof(header));
+    pos = appendString(pos, record->name, header.name_len);
+    pos = appendString(pos, record->path, header.path_len);
+    pos = appendString(pos, record->newpath, header.newpath_len);
+    appendString(pos, record->params, header.params_len);
+
+    bool written = pwrite(segment->fd, buf, header.length, segment->size) == header.length;
+    free(buf);
+    if(!written) {
+        perror("Unable to write old debugger events");
+        spillClear(spill);
+        return FALSE;
+    }
+    g_array_append_val(segment->offsets, segment->size);
+    segment->size += header.length;
+    spill->next_id++;
+
+    // Keep within capacity by dropping whole segments, so files are only ever appended to
+    while(spillCount(spill) > spill->capacity && spill->segments->len > 1) {
+        struct spill_segment * oldest = g_ptr_array_index(spill->segments, 0);
+        spill->first_id += oldest->offsets->len;
+        g_ptr_array_remove_index(spill->segments, 0);
+    }
+    return TRUE;
+}
+
+static const char * decodeString(const char ** pos, uint32_t len) {
+    const char * s = len > 0 ? *pos : NULL;
+    *pos += len;
+    return s;
+}
+
+/* Fill in a record from its encoding, with its strings pointing into the encoding
+ * Names are interned, as the store expects
+ */
+static void decodeRecord(const char * buf, guint64 id, struct event_record * record) {
+    // Records aren't padded, so the header is copied out rather than read in place
+    struct spill_record header;
+    memcpy(&header, buf, sizeof(header));
+    const char * pos = buf + sizeof(header);
+    memset(record, 0, sizeof(*record));
+    record->id = id;
+    record->seqnum = header.seqnum;
+    record->returnval = header.returnval;
+    record->opcode = header.opcode;
+    record->is_return = (header.flags & SPILL_RETURN) != 0;
+    record->has_returnval = (header.flags & SPILL_HAS_RETURNVAL) != 0;
+    record->name = g_intern_string(decodeString(&pos, header.name_len));
+    record->path = (char *) decodeString(&pos, header.path_len);
+    record->newpath = (char *) decodeString(&pos, header.newpath_len);
+    record->params = (char *) decodeString(&pos, header.params_len);
+}
+
+// Segments are only dropped whole and every one but the last is full, so a record's segment follows from its id
+static struct spill_segment * segmentOf(struct event_spill * spill, guint64 id, guint * index) {
+    if(id < spill->first_id || id >= spill->next_id) return NULL;
+    guint64 pos = id - spill->first_id;
+    *index = pos % SPILL_SEGMENT_EVENTS;
+    return g_ptr_array_index(spill->segments, pos / SPILL_SEGMENT_EVENTS);
+}
+
+static uint64_t recordEnd(struct spill_segment * segment, guint index) {
+    return index + 1 < segment->offsets->len ? g_array_index(segment->offsets, uint64_t, index + 1) : segment->size;
+}
+
+// Read back a spilled record, with strings of its own for the caller to free. Returns FALSE if it's not on disk
+bool spillRead(struct event_spill * spill, guint64 id, struct event_record * record) {
+    guint index;
+    struct spill_segment * segment = segmentOf(spill, id, &index);
+    if(segment == NULL) return FALSE;
+
+    uint64_t offset = g_array_index(segment->offsets, uint64_t, index);
+    size_t length = recordEnd(segment, index) - offset;
+    char * buf = malloc(length);
+    if(pread(segment->fd, buf, length, offset) != length) {
+        free(buf);
+        return FALSE;
+    }
+    decodeRecord(buf, id, record);
+    record->path = record->path != NULL ? strdup(record->path) : NULL;
+    record->newpath = record->newpath != NULL ? strdup(record->newpath) : NULL;
+    record->params = record->params != NULL ? strdup(record->params) : NULL;
+    free(buf);
+    return TRUE;
+}
+
+/* Call func for each record from id from up to to, reading the segments in chunks of up to SPILL_SCAN_CHUNK
+ * The records given to func only last until it returns, and func mustn't scan the spill itself
+ */
+void spillScan(struct event_spill * spill, guint64 from, guint64 to, spillScanFunc func, gpointer data) {
+    from = MAX(from, spill->first_id);
+    to = MIN(to, spill->next_id);
+
+    while(from < to) {
+        guint index;
+        struct spill_segment * segment = segmentOf(spill, from, &index);
+        guint last = MIN(segment->offsets->len, index + (to - from));
+
+        // Take as many whole records as fit in a chunk, or the next one alone if it's bigger
+        uint64_t offset = g_array_index(segment->offsets, uint64_t, index);
+        guint end = index + 1;
+        while(end < last && recordEnd(segment, end) - offset <= SPILL_SCAN_CHUNK) end++;
+        size_t length = recordEnd(segment, end - 1) - offset;
+        if(length > spill->scan_capacity) {
+            spill->scan_capacity = MAX(length, MIN(spill->scan_capacity * 2, SPILL_SCAN_CHUNK));
+            spill->scan_buf = realloc(spill->scan_buf, spill->scan_capacity);
+        }
+        char * buf = spill->scan_buf;
+        if(pread(segment->fd, buf, length, offset) != length) break;
+
+        for(guint i = index; i < end; i++, from++) {
+            struct event_record record;
+            decodeRecord(buf + (g_array_index(segment->offsets, uint64_t, i) - offset), from, &record);
+            func(from, &record, data);
+        }
+    }
+}
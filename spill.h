@@ -0,0 +1,61 @@
+#pragma once
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdbool.h>
+#include <glib.h>
+
+#include "eventstore.h"
+
+/* Debugger events evicted from memory, kept in temporary segment files so they can still be shown
+ *
+ * Records are appended in order of id, so a record is found from its id alone through the offsets of
+ * its segment. The files are unlinked as soon as they're created, so they go away with fdt however it
+ * exits. Once more than the spill's capacity is on disk, the oldest segment is deleted as a whole.
+ */
+
+#define SPILL_SEGMENT_EVENTS 65536
+
+// Records are scanned in chunks of at least this many bytes
+#define SPILL_SCAN_CHUNK (1024 * 1024)
+
+// Fixed-size part of a spilled record, followed by the NUL-terminated name, paths and params
+struct spill_record {
+    uint32_t length;        // Of the whole record, including the strings after it
+    int32_t seqnum;
+    int32_t returnval;
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t name_len;      // Lengths include the NUL, or are 0 for a string that isn't there
+    uint32_t path_len;
+    uint32_t newpath_len;
+    uint32_t params_len;
+};
+
+#define SPILL_RETURN 1
+#define SPILL_HAS_RETURNVAL 2
+
+struct spill_segment {
+    int fd;
+    uint64_t size;
+    GArray * offsets;       // uint64_t offset of each record
+};
+
+struct event_spill {
+    GPtrArray * segments;   // Oldest first, all but the last holding SPILL_SEGMENT_EVENTS records
+    guint64 first_id;       // Id of the first record on disk
+    guint64 next_id;        // Id the next record spilled should have
+    guint64 capacity;
+    char * scan_buf;        // Kept between scans, so scanning a record at a time doesn't allocate each time
+    size_t scan_capacity;
+};
+
+typedef void (*spillScanFunc)(guint64 id, const struct event_record * record, gpointer data);
+
+struct event_spill * spillNew(guint64 capacity);
+void spillFree(struct event_spill * spill);
+void spillClear(struct event_spill * spill);
+bool spillWrite(struct event_spill * spill, const struct event_record * record);
+bool spillRead(struct event_spill * spill, guint64 id, struct event_record * record);
+void spillScan(struct event_spill * spill, guint64 from, guint64 to, spillScanFunc func, gpointer data);
+guint64 spillFirstId(struct event_spill * spill);
+guint64 spillCount(struct event_spill * spill);
@@ -2,10 +2,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <gtk/gtk.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <sys/queue.h>
 #include <glib.h>
 
@@ -13,14 +18,14 @@
 #include "fdt.h"
 #include "testsuite.h"
 
-static const char * testsuite_fifo_name = "fuse-testsuite.fifo";
+static char testsuite_fifo_name[PATH_MAX];
 static FILE * testsuite_fifo = NULL;
 
-static pthread_mutex_t tailq_events_lock;
-static GSList * ts_events;
-static GSList * ts_events_displayed;
-static GHashTable * rows;
-static GtkTreeStore * event_table_model;
+// Events are queued by the reader thread and taken by the GUI, which adds each to the results table once
+static pthread_mutex_t tailq_events_lock = PTHREAD_MUTEX_INITIALIZER;
+static GQueue ts_events = G_QUEUE_INIT;
+static GtkTreeStore * event_table_model;     // Columns: test, status, unformatted JSON of parameters not yet shown, and
+                                             // where a group's rows were spilled (see SPILLED_GROUP_COLUMN)
 
 static GtkWidget * testdata_selector;
 static bool testdata_select_open = FALSE;
@@ -31,6 +36,220 @@ static bool recv_end_event = FALSE;
 static GtkTreeIter * group_iter = NULL;
 static GtkTreeIter * sequence_iter = NULL;
 
+// Passing calls of each function in the current sequence share a row, so long runs don't grow the table
+struct passed_row {
+    GtkTreeIter iter;
+    guint calls;
+};
+static GHashTable * passed_rows = NULL;     // Function name to its struct passed_row
+
+static void resetPassedRows() {
+    if(passed_rows == NULL) {
+        passed_rows = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+    }
+    g_hash_table_remove_all(passed_rows);
+}
+
+/* Once the table passes a limit, the rows under the oldest finished groups are written to a file and the groups
+ * are shown collapsed, to be read back when expanded, so long sessions take a bounded amount of memory
+ */
+#define TESTSUITE_MAX_ROWS 50000
+#define SPILLED_GROUP_COLUMN 3              // Where the group's rows are in the spill file plus one, or 0 if shown
+
+// A finished group whose rows are shown, found by reference as rows above it may have been added or removed
+struct finished_group {
+    GtkTreeRowReference * ref;
+    guint rows;                                     // Rows under the group, counting itself
+};
+
+static GQueue finished_groups = G_QUEUE_INIT;       // Finished groups whose rows are shown, oldest first
+static guint finished_rows = 0;
+static int groups_spill_fd = -1;                    // Unlinked file holding the rows of collapsed groups
+static guint64 groups_spill_size = 0;
+
+// How each spilled row is written, followed by its columns as nul terminated strings
+struct spilled_row {
+    uint32_t depth;                                 // 0 for the group's children
+    uint32_t lengths[3];                            // Of each column including its nul, or 0 if it's NULL
+};
+
+static void freeFinishedGroup(struct finished_group * group) {
+    gtk_tree_row_reference_free(group->ref);
+    free(group);
+}
+
+static void resetFinishedGroups() {
+    struct finished_group * group;
+    while((group = g_queue_pop_head(&finished_groups)) != NULL) freeFinishedGroup(group);
+    finished_rows = 0;
+    // Every group read back from the file is about to go with the table, so the file can start again
+    if(groups_spill_fd >= 0 && ftruncate(groups_spill_fd, 0) != 0) {
+        close(groups_spill_fd);
+        groups_spill_fd = -1;
+    }
+    groups_spill_size = 0;
+}
+
+// Count a row and every row beneath it
+static guint countRows(GtkTreeModel * model, GtkTreeIter * iter) {
+    guint rows = 1;
+    GtkTreeIter child;
+    gboolean valid = gtk_tree_model_iter_children(model, &child, iter);
+    while(valid) {
+        rows += countRows(model, &child);
+        valid = gtk_tree_model_iter_next(model, &child);
+    }
+    return rows;
+}
+
+static void addFinishedGroup(GtkTreeIter * group_row, guint rows) {
+    GtkTreeModel * model = GTK_TREE_MODEL(event_table_model);
+    struct finished_group * group = malloc(sizeof(*group));
+    GtkTreePath * path = gtk_tree_model_get_path(model, group_row);
+    group->ref = gtk_tree_row_reference_new(model, path);
+    gtk_tree_path_free(path);
+    group->rows = rows;
+    g_queue_push_tail(&finished_groups, group);
+    finished_rows += rows;
+}
+
+// Append the rows under parent to buf, parents before their children
+static void encodeRows(GtkTreeModel * model, GtkTreeIter * parent, uint32_t depth, GString * buf) {
+    GtkTreeIter child;
+    gboolean valid = gtk_tree_model_iter_children(model, &child, parent);
+    while(valid) {
+        char * columns[3];
+        gtk_tree_model_get(model, &child, 0, &columns[0], 1, &columns[1], 2, &columns[2], -1);
+        struct spilled_row row;
+        row.depth = depth;
+        for(int i = 0; i < 3; i++) row.lengths[i] = columns[i] != NULL ? strlen(columns[i]) + 1 : 0;
+        g_string_append_len(buf, (const char *) &row, sizeof(row));
+        for(int i = 0; i < 3; i++) {
+            g_string_append_len(buf, columns[i] != NULL ? columns[i] : "", row.lengths[i]);
+            g_free(columns[i]);
+        }
+        encodeRows(model, &child, depth + 1, buf);
+        valid = gtk_tree_model_iter_next(model, &child);
+    }
+}
+
+/* Write the rows under a group to the spill file and replace them with a placeholder for when it's expanded
+ * If they can't be written they're dropped, leaving a row to say so
+ */
+static void spillGroupRows(GtkTreeIter * group_row) {
+    GtkTreeModel * model = GTK_TREE_MODEL(event_table_model);
+    if(groups_spill_fd < 0) {
+        char name[] = "/tmp/fdt-tests-XXXXXX";
+        groups_spill_fd = mkstemp(name);
+        if(groups_spill_fd < 0) perror("Unable to create file for old test results");
+        else unlink(name);
+        groups_spill_size = 0;
+    }
+
+    // The length of the group's rows comes first, so they can be read back in one go
+    GString * buf = g_string_new(NULL);
+    uint64_t length = 0;
+    g_string_append_len(buf, (const char *) &length, sizeof(length));
+    encodeRows(model, group_row, 0, buf);
+    length = buf->len - sizeof(length);
+    memcpy(buf->str, &length, sizeof(length));
+
+    guint64 offset = groups_spill_size;
+    bool written = groups_spill_fd >= 0 && pwrite(groups_spill_fd, buf->str, buf->len, offset) == buf->len;
+    if(groups_spill_fd >= 0 && !written) perror("Unable to write old test results");
+    if(written) groups_spill_size += buf->len;
+    g_string_free(buf, TRUE);
+
+    GtkTreeIter child;
+    while(gtk_tree_model_iter_children(model, &child, group_row)) {
+        gtk_tree_store_remove(GTK_TREE_STORE(event_table_model), &child);
+    }
+    gtk_tree_store_append(GTK_TREE_STORE(event_table_model), &child, group_row);
+    gtk_tree_store_set(GTK_TREE_STORE(event_table_model), &child, 0, written ? "..." : "Calls not kept, as they couldn't be written to disk", -1);
+    if(written) gtk_tree_store_set(GTK_TREE_STORE(event_table_model), group_row, SPILLED_GROUP_COLUMN, offset + 1, -1);
+}
+
+/* Read back the rows of a group that were spilled, in place of its placeholder
+ * Returns FALSE if the group's rows are shown already, or couldn't be read
+ */
+static bool unspillGroupRows(GtkTreeIter * group_row) {
+    GtkTreeModel * model = GTK_TREE_MODEL(event_table_model);
+    guint64 spilled = 0;
+    gtk_tree_model_get(model, group_row, SPILLED_GROUP_COLUMN, &spilled, -1);
+    if(spilled == 0 || groups_spill_fd < 0) return FALSE;
+    gtk_tree_store_set(GTK_TREE_STORE(event_table_model), group_row, SPILLED_GROUP_COLUMN, (guint64) 0, -1);
+
+    uint64_t length;
+    if(pread(groups_spill_fd, &length, sizeof(length), spilled - 1) != sizeof(length)) {
+        perror("Unable to read old test results");
+        return FALSE;
+    }
+    char * buf = malloc(length);
+    if(pread(groups_spill_fd, buf, length, spilled - 1 + sizeof(length)) != length) {
+        perror("Unable to read old test results");
+        free(buf);
+        return FALSE;
+    }
+
+    GtkTreeIter placeholder;
+    gtk_tree_model_iter_children(model, &placeholder, group_row);
+
+    // The last row added at each depth, which is the parent of the rows one deeper that follow it
+    GArray * parents = g_array_new(FALSE, FALSE, sizeof(GtkTreeIter));
+    g_array_append_val(parents, *group_row);
+    const char * pos = buf;
+    while(pos + sizeof(struct spilled_row) <= buf + length) {
+        // Rows aren't padded, so the header is copied out rather than read in place
+        struct spilled_row row;
+        memcpy(&row, pos, sizeof(row));
+        pos += sizeof(row);
+        const char * columns[3];
+        for(int i = 0; i < 3; i++) {
+            columns[i] = row.lengths[i] > 0 ? pos : NULL;
+            pos += row.lengths[i];
+        }
+        if(row.depth >= parents->len) break;
+
+        GtkTreeIter iter;
+        gtk_tree_store_append(GTK_TREE_STORE(event_table_model), &iter, &g_array_index(parents, GtkTreeIter, row.depth));
+        gtk_tree_store_set(GTK_TREE_STORE(event_table_model), &iter, 0, columns[0], 1, columns[1], 2, columns[2], -1);
+        g_array_set_size(parents, row.depth + 1);
+        g_array_append_val(parents, iter);
+    }
+    g_array_free(parents, TRUE);
+    free(buf);
+
+    // Removed last, so that the row never loses its children and collapses
+    gtk_tree_store_remove(GTK_TREE_STORE(event_table_model), &placeholder);
+    return TRUE;
+}
+
+// Spill the oldest groups whose rows are shown while that puts the table over its limit, keeping the newest
+static void limitFinishedRows() {
+    GtkTreeModel * model = GTK_TREE_MODEL(event_table_model);
+    while(finished_rows > TESTSUITE_MAX_ROWS && g_queue_get_length(&finished_groups) > 1) {
+        struct finished_group * oldest = g_queue_pop_head(&finished_groups);
+        finished_rows -= oldest->rows;
+        GtkTreePath * path = gtk_tree_row_reference_get_path(oldest->ref);
+        GtkTreeIter iter;
+        if(path != NULL && gtk_tree_model_get_iter(model, &iter, path)) spillGroupRows(&iter);
+        gtk_tree_path_free(path);
+        freeFinishedGroup(oldest);
+    }
+}
+
+// Keep the group that's just finished, spilling the rows of the oldest ones if the table is over its limit
+// Must be called with the GDK lock held
+static void finishGroupRows(GtkTreeIter * group_row) {
+    addFinishedGroup(group_row, countRows(GTK_TREE_MODEL(event_table_model), group_row));
+    limitFinishedRows();
+}
+
+// Calls are shown under the open Sequence, or under the open group when a crash or reset fails between sequences
+static GtkTreeIter * callParentIter() {
+    return sequence_iter != NULL ? sequence_iter : group_iter;
+}
+
 GtkWidget * createTestsuiteTab() {
 
     GtkWidget * tab = gtk_vbox_new(FALSE, 5);
@@ -68,10 +287,11 @@ GtkWidget * createTestsView() {
     gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
     gtk_widget_set_size_request(scrolled_window, 200, -1);
     
-    event_table_model = gtk_tree_store_new(3, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
+    event_table_model = gtk_tree_store_new(4, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_UINT64);
     GtkWidget * tree_view = gtk_tree_view_new();
     gtk_container_add(GTK_CONTAINER(scrolled_window), tree_view);
     gtk_tree_view_set_model(GTK_TREE_VIEW(tree_view), GTK_TREE_MODEL(event_table_model));
+    g_signal_connect(tree_view, "row-expanded", G_CALLBACK(tests_view_row_expanded), NULL);
     gtk_widget_show(tree_view);
     
     GtkCellRenderer * cell_func = gtk_cell_renderer_text_new();
@@ -113,8 +333,72 @@ void testdata_select_handler(GtkWidget * widget, gpointer data) {
     }
 }
 
+/* Read the next event from a test suite FIFO, each of which the libfuse wrapper writes as a chunk of JSON
+ * Returns NULL once the FIFO has been closed
+ */
+cJSON * readTestsuiteEvent(FILE * fifo, char ** json_chunk, size_t * json_chunk_capacity) {
+    while(TRUE) {
+        // Construct a chunk of JSON
+        int unclosed_braces = 0;
+        bool unclosed_quotes = false;
+        bool escaping = false;
+        size_t chunk_pos = 0;
+
+        do {
+            int c = fgetc(fifo);
+            if(c == EOF) {
+                return NULL;
+            }
+            if(chunk_pos+1 >= *json_chunk_capacity) {
+                // Double string capacity before we overflow it
+                *json_chunk_capacity *= 2;
+                *json_chunk = realloc(*json_chunk, *json_chunk_capacity);
+            }
+            (*json_chunk)[chunk_pos++] = (char) c;
+            if(!unclosed_quotes && c == '{') unclosed_braces++;
+            else if(!unclosed_quotes && c == '}') unclosed_braces--;
+            else if(!escaping && c == '"') unclosed_quotes = !unclosed_quotes;
+
+            if(c == '\\') escaping = true;
+            else escaping = false;
+        } while(unclosed_braces > 0);
+        (*json_chunk)[chunk_pos] = '\0';
+
+        // Anything between chunks, such as whitespace, is skipped
+        cJSON * event = cJSON_Parse(*json_chunk);
+        if(event != NULL) {
+            return event;
+        }
+    }
+}
+
+// Forget the results of any previous run, which has to happen on the GUI thread
+void resetTestsuiteResults() {
+    pthread_mutex_lock(&tailq_events_lock);
+    cJSON * event;
+    while((event = g_queue_pop_head(&ts_events)) != NULL) {
+        cJSON_Delete(event);
+    }
+    pthread_mutex_unlock(&tailq_events_lock);
+
+    free(group_iter);
+    free(sequence_iter);
+    group_iter = NULL;
+    sequence_iter = NULL;
+    resetPassedRows();
+    resetFinishedGroups();
+    if(event_table_model != NULL) {
+        gtk_tree_store_clear(GTK_TREE_STORE(event_table_model));
+    }
+}
+
 stopToolFunc startTestsuite() {
 
+    // Channels belong to the session of the filesystem being started
+    sessionChannel(getCurrentSession(), FDT_CHANNEL_TESTSUITE, testsuite_fifo_name, sizeof(testsuite_fifo_name));
+
+    resetTestsuiteResults();
+
 	// Create a FIFO so that we can receive events
     recv_end_event = FALSE;
     unlink(testsuite_fifo_name);
@@ -135,60 +419,13 @@ void * doStartTestsuite(void * ptr) {
     // Read JSON chunks from the shared pipe that the libfuse wrapper logs to
     testsuite_fifo = fopen(testsuite_fifo_name, "r");
 
-    // Local lists of events sent by libfuse wrapper
-    if(ts_events != NULL) {
-        // Clear any old events from previous runs
-        g_slist_free(ts_events);
-        g_slist_free(ts_events_displayed);
-        g_hash_table_destroy(rows);
-    }
-
-    ts_events = g_slist_alloc();
-    ts_events_displayed = g_slist_alloc();
-    rows = g_hash_table_new(g_str_hash, g_str_equal);
-    
-    bool fifo_open;
-    if(testsuite_fifo != NULL) fifo_open = TRUE;
-    else fifo_open = FALSE;
-    
-    size_t chunk_pos = 0;
     size_t json_chunk_capacity = 1024;
     char *json_chunk = malloc(json_chunk_capacity);
 
-    while(fifo_open) {
-        // Construct a chunk of JSON
-        int unclosed_braces = 0;
-        bool unclosed_quotes = false;
-        bool escaping = false;
-        chunk_pos = 0;
-        
-        do {
-            int c = fgetc(testsuite_fifo);
-            if(c == EOF) {
-                fifo_open = FALSE;
-            } else {
-                if(chunk_pos+1 >= json_chunk_capacity) {
-                    // Double string capacity before we overflow it
-                    json_chunk_capacity *= 2;
-                    json_chunk = realloc(json_chunk, json_chunk_capacity);
-                }
-                json_chunk[chunk_pos++] = (char) c;
-                if(!unclosed_quotes && c == '{') unclosed_braces++;
-                else if(!unclosed_quotes && c == '}') unclosed_braces--;
-                else if(!escaping && c == '"') unclosed_quotes = !unclosed_quotes;
-
-                if(c == '\\') escaping = true;
-                else escaping = false;
-            }
-        } while(unclosed_braces > 0);
-        json_chunk[chunk_pos++] = '\0';
-        
-        // Parse the JSON and display the event
-        if(strlen(json_chunk) > 0) {
-            cJSON * event = cJSON_Parse(json_chunk);
-            json_chunk[0] = '\0';
-            handleTestsuiteEvent(event);
-        }
+    // Parse the JSON and display each event
+    cJSON * event;
+    while(testsuite_fifo != NULL && (event = readTestsuiteEvent(testsuite_fifo, &json_chunk, &json_chunk_capacity)) != NULL) {
+        handleTestsuiteEvent(event);
     }
     free(json_chunk);
 
@@ -210,168 +447,204 @@ void stopTestsuite() {
 
 gboolean gui_idle_testsuite(void) {
 
+    // Take everything that's queued, so each event is only looked at once
     pthread_mutex_lock(&tailq_events_lock);
+    GQueue pending = ts_events;
+    g_queue_init(&ts_events);
+    pthread_mutex_unlock(&tailq_events_lock);
 
-    // Clear table if there are no events currently displayed
-    if(ts_events_displayed != NULL && ts_events_displayed->next == NULL) {
-        gtk_tree_store_clear(GTK_TREE_STORE(event_table_model));
-    }
-    
-    // Append any new rows
-    GSList * node = ts_events;
-    while(node != NULL) {
-        cJSON * event = (cJSON *) node->data;
-        if(event != NULL && !isTSFunctionDisplayed(event)) {
-            const char * test_name = cJSON_GetObjectItem(event, "func_name")->valuestring;
-
-            if(strcmp(test_name, "__GROUP_START") == 0) {
-                // Create Group branch in tree
-                GtkTreeIter * iter = malloc(sizeof(*iter));
-                group_iter = iter;
-                gdk_threads_enter();
-                gtk_tree_store_append(GTK_TREE_STORE(event_table_model), iter, NULL);
-                gtk_tree_store_set(GTK_TREE_STORE(event_table_model), iter, 0, "Test Group", 1, "Running", -1);
-                gdk_threads_leave();
-            } else if(strcmp(test_name, "__SEQUENCE_START") == 0) {
-                // Create Sequence branch in current Group branch
-                char * action = cJSON_GetObjectItem(event, "action")->valuestring;
-                char * application = cJSON_GetObjectItem(event, "application")->valuestring;
-                char * os = cJSON_GetObjectItem(event, "os")->valuestring;
-                char sequence_label[strlen(action) + strlen(application) + strlen(os) + 128];
-                sequence_label[0] = '\0';
-                strcat(sequence_label, action);
-                strcat(sequence_label, " using ");
-                strcat(sequence_label, application);
-                strcat(sequence_label, " on ");
-                strcat(sequence_label, os);
-
-                GtkTreeIter * iter = malloc(sizeof(*iter));
-                sequence_iter = iter;
-                gdk_threads_enter();
-                gtk_tree_store_append(GTK_TREE_STORE(event_table_model), iter, group_iter);
-                gtk_tree_store_set(GTK_TREE_STORE(event_table_model), iter, 0, sequence_label, 1, "Running", -1);
-                gdk_threads_leave();
-            } else if(strcmp(test_name, "__SEQUENCE_END") == 0) {
-                // Close Sequence branch and display whether it passed or failed
-                char * result = NULL;
-                if(cJSON_GetObjectItem(event, "passed")->valueint == 0) result = "FAIL";
-                else result = "PASS";
-                gdk_threads_enter();
-                gtk_tree_store_set(GTK_TREE_STORE(event_table_model), sequence_iter, 1, result, -1);
-                gdk_threads_leave();
-                sequence_iter = NULL;
-            } else if(strcmp(test_name, "__GROUP_END") == 0) {
-                // Close Group branch and display whether it passed or failed
-                char * result = NULL;
-                if(cJSON_GetObjectItem(event, "passed")->valueint == 0) result = "FAIL";
-                else result = "PASS";
-                gdk_threads_enter();
-                gtk_tree_store_set(GTK_TREE_STORE(event_table_model), group_iter, 1, result, -1);
-                gdk_threads_leave();
-                group_iter = NULL;
-            } else if(strcmp(test_name, "__ERROR") == 0) {
-                // Display error but let the tool continue reporting any other events as it might not be critical
-                // __END will be sent when its time to terminate
-                showErrorDialog(cJSON_GetObjectItem(event, "message")->valuestring);
-            } else {
-                // Add call to current Sequence branch
-                GtkTreeIter iter;
-                char * result = NULL;
-                if(cJSON_GetObjectItem(event, "passed")->valueint == 0) result = "FAIL";
-                else result = "PASS";
-                gdk_threads_enter();
-                gtk_tree_store_append(GTK_TREE_STORE(event_table_model), &iter, sequence_iter);
-                gtk_tree_store_set(GTK_TREE_STORE(event_table_model), &iter, 0, test_name, 1, result, -1);
-                gdk_threads_leave();
-
-                // If the test failed then display the parameter values that were passed to it
-                if(cJSON_GetObjectItem(event, "passed")->valueint == 0) {
-                    
-                    // Display error message
-                    cJSON * message = cJSON_GetObjectItem(event, "message");
-                    if(message != NULL) {
-                        char * wrapped = wrap_text(message->valuestring, 40); // wrap with linebreaks every 40 chars
-                        GtkTreeIter msg_iter;
-                        gdk_threads_enter();
-                        gtk_tree_store_append(GTK_TREE_STORE(event_table_model), &msg_iter, &iter);
-                        gtk_tree_store_set(GTK_TREE_STORE(event_table_model), &msg_iter, 0, wrapped, -1);
-                        gdk_threads_leave();
-                        free(wrapped);
-                    } else {
-                        fprintf(stderr, "Failing test did not include an error message\n");
-                    }
-
-                    // Display parameter data if present (it wont be present if the error is irrelevant to parameter values)
-                    // Also enclose params within their own branch
-                    cJSON * params = cJSON_GetObjectItem(event, "params");
-                    if(params != NULL) {
-                        GtkTreeIter params_iter;
-                        gdk_threads_enter();
-                        gtk_tree_store_append(GTK_TREE_STORE(event_table_model), &params_iter, &iter);
-                        gtk_tree_store_set(GTK_TREE_STORE(event_table_model), &params_iter, 0, "Parameters passed to function", -1);
-                        gdk_threads_leave();
-                        showFailingTestParams(params, params_iter);
-                    }
-                }
+    // Append a row for each new event
+    cJSON * event;
+    while((event = g_queue_pop_head(&pending)) != NULL) {
+        const char * test_name = cJSON_GetObjectItem(event, "func_name")->valuestring;
+
+        if(strcmp(test_name, "__GROUP_START") == 0) {
+            // Create Group branch in tree
+            GtkTreeIter * iter = malloc(sizeof(*iter));
+            free(group_iter);
+            group_iter = iter;
+            resetPassedRows();
+            gdk_threads_enter();
+            gtk_tree_store_append(GTK_TREE_STORE(event_table_model), iter, NULL);
+            gtk_tree_store_set(GTK_TREE_STORE(event_table_model), iter, 0, "Test Group", 1, "Running", -1);
+            gdk_threads_leave();
+        } else if(strcmp(test_name, "__SEQUENCE_START") == 0) {
+            // Create Sequence branch in current Group branch
+            char * action = cJSON_GetObjectItem(event, "action")->valuestring;
+            char * application = cJSON_GetObjectItem(event, "application")->valuestring;
+            char * os = cJSON_GetObjectItem(event, "os")->valuestring;
+            char sequence_label[strlen(action) + strlen(application) + strlen(os) + 128];
+            sequence_label[0] = '\0';
+            strcat(sequence_label, action);
+            strcat(sequence_label, " using ");
+            strcat(sequence_label, application);
+            strcat(sequence_label, " on ");
+            strcat(sequence_label, os);
+
+            GtkTreeIter * iter = malloc(sizeof(*iter));
+            free(sequence_iter);
+            sequence_iter = iter;
+            resetPassedRows();
+            gdk_threads_enter();
+            gtk_tree_store_append(GTK_TREE_STORE(event_table_model), iter, group_iter);
+            gtk_tree_store_set(GTK_TREE_STORE(event_table_model), iter, 0, sequence_label, 1, "Running", -1);
+            gdk_threads_leave();
+        } else if(strcmp(test_name, "__SEQUENCE_END") == 0) {
+            // Close Sequence branch and display whether it passed or failed
+            char * result = NULL;
+            if(cJSON_GetObjectItem(event, "passed")->valueint == 0) result = "FAIL";
+            else result = "PASS";
+            gdk_threads_enter();
+            gtk_tree_store_set(GTK_TREE_STORE(event_table_model), sequence_iter, 1, result, -1);
+            gdk_threads_leave();
+            free(sequence_iter);
+            sequence_iter = NULL;
+            resetPassedRows();
+        } else if(strcmp(test_name, "__GROUP_END") == 0) {
+            // Close Group branch and display whether it passed or failed
+            char * result = NULL;
+            if(cJSON_GetObjectItem(event, "passed")->valueint == 0) result = "FAIL";
+            else result = "PASS";
+            gdk_threads_enter();
+            gtk_tree_store_set(GTK_TREE_STORE(event_table_model), group_iter, 1, result, -1);
+            finishGroupRows(group_iter);
+            gdk_threads_leave();
+            free(group_iter);
+            group_iter = NULL;
+            resetPassedRows();
+        } else if(strcmp(test_name, "__ERROR") == 0) {
+            // Display error but let the tool continue reporting any other events as it might not be critical
+            // __END will be sent when its time to terminate
+            showErrorDialog(cJSON_GetObjectItem(event, "message")->valuestring);
+        } else if(cJSON_GetObjectItem(event, "passed")->valueint != 0) {
+            // Count the call on its function's row in the current Sequence branch, adding the row for its first
+            struct passed_row * row = g_hash_table_lookup(passed_rows, test_name);
+            gdk_threads_enter();
+            if(row == NULL) {
+                row = calloc(1, sizeof(*row));
+                g_hash_table_insert(passed_rows, strdup(test_name), row);
+                gtk_tree_store_append(GTK_TREE_STORE(event_table_model), &row->iter, callParentIter());
+                gtk_tree_store_set(GTK_TREE_STORE(event_table_model), &row->iter, 0, test_name, -1);
             }
+            row->calls++;
+            char result[64];
+            if(row->calls == 1) snprintf(result, sizeof(result), "PASS");
+            else snprintf(result, sizeof(result), "PASS (%u calls)", row->calls);
+            gtk_tree_store_set(GTK_TREE_STORE(event_table_model), &row->iter, 1, result, -1);
+            gdk_threads_leave();
+        } else {
+            // Add failing call to current Sequence branch
+            GtkTreeIter iter;
+            char * result = NULL;
+            if(cJSON_GetObjectItem(event, "passed")->valueint == 0) result = "FAIL";
+            else result = "PASS";
+            gdk_threads_enter();
+            gtk_tree_store_append(GTK_TREE_STORE(event_table_model), &iter, callParentIter());
+            gtk_tree_store_set(GTK_TREE_STORE(event_table_model), &iter, 0, test_name, 1, result, -1);
+            gdk_threads_leave();
+
+            // If the test failed then display the parameter values that were passed to it
+            if(cJSON_GetObjectItem(event, "passed")->valueint == 0) {
+                
+                // Display error message
+                cJSON * message = cJSON_GetObjectItem(event, "message");
+                if(message != NULL) {
+                    char * wrapped = wrap_text(message->valuestring, 40); // wrap with linebreaks every 40 chars
+                    GtkTreeIter msg_iter;
+                    gdk_threads_enter();
+                    gtk_tree_store_append(GTK_TREE_STORE(event_table_model), &msg_iter, &iter);
+                    gtk_tree_store_set(GTK_TREE_STORE(event_table_model), &msg_iter, 0, wrapped, -1);
+                    gdk_threads_leave();
+                    free(wrapped);
+                } else {
+                    fprintf(stderr, "Failing test did not include an error message\n");
+                }
 
-            ts_events_displayed = g_slist_prepend(ts_events_displayed, event);
+                // Display parameter data if present (it wont be present if the error is irrelevant to parameter values)
+                // Also enclose params within their own branch
+                cJSON * params = cJSON_GetObjectItem(event, "params");
+                if(params != NULL) {
+                    GtkTreeIter params_iter;
+                    gdk_threads_enter();
+                    gtk_tree_store_append(GTK_TREE_STORE(event_table_model), &params_iter, &iter);
+                    gtk_tree_store_set(GTK_TREE_STORE(event_table_model), &params_iter, 0, "Parameters passed to function", -1);
+                    gdk_threads_leave();
+                    showFailingTestParams(params, &params_iter);
+                }
+            }
         }
 
-        node = node->next;
+        // The row holds everything that's needed from the event
+        cJSON_Delete(event);
     }
 
-    pthread_mutex_unlock(&tailq_events_lock);
-
     return TRUE; // only return false if we never want to be called again
 }
 
-void showFailingTestParams(cJSON * node, GtkTreeIter parent) {
-    if(node->type == cJSON_Array || node->type == cJSON_Object) {
-        for(int i = 0; i < cJSON_GetArraySize(node); i++) {
-            cJSON * item = cJSON_GetArrayItem(node, i);
-            
-            GtkTreeIter itr;
-            gdk_threads_enter();
-            gtk_tree_store_prepend(GTK_TREE_STORE(event_table_model), &itr, &parent);
-            gdk_threads_leave();
-            
-            gdk_threads_enter();
-            if(item->type == cJSON_Array || item->type == cJSON_Object) {
-                // inside node, so just show the label
-                gtk_tree_store_set(GTK_TREE_STORE(event_table_model), &itr, 0, item->string, -1);
-            } else {
-                // leaf node, so show label with value (eg, "timestamp: 0189276")
-                char * label = item->string;
-                char * value = cJSON_Print(item);
-                char label_and_value[strlen(label) + 2 + strlen(value) + 1];
-                snprintf(label_and_value, sizeof label_and_value, "%s: %s", label, value);
-                gtk_tree_store_set(GTK_TREE_STORE(event_table_model), &itr, 0, label_and_value, -1);
-            }
-            gdk_threads_leave();
-            
-            showFailingTestParams(item, itr);
-        }
-    } else {
+/* Give a row a placeholder child standing in for the parameters beneath it
+ * Most failures are never expanded, so the parameters are only kept as unformatted JSON until they are
+ */
+void showFailingTestParams(cJSON * node, GtkTreeIter * parent) {
+    if((node->type != cJSON_Array && node->type != cJSON_Object) || node->child == NULL) {
         return;
     }
+    char * json = cJSON_PrintUnformatted(node);
+    GtkTreeIter placeholder;
+    gdk_threads_enter();
+    gtk_tree_store_set(GTK_TREE_STORE(event_table_model), parent, 2, json, -1);
+    gtk_tree_store_append(GTK_TREE_STORE(event_table_model), &placeholder, parent);
+    gtk_tree_store_set(GTK_TREE_STORE(event_table_model), &placeholder, 0, "...", -1);
+    gdk_threads_leave();
+    free(json);
 }
 
-// True if this test result is already displayed in the results table
-bool isTSFunctionDisplayed(cJSON * event) {
-    GSList * node = ts_events_displayed;
-    while(node != NULL) {
-        cJSON * t_event = (cJSON *) node->data;
-        if(event == t_event) {
-            return true;
+// Replace the placeholder beneath a row with the parameters it stands for, the first time the row is expanded
+void tests_view_row_expanded(GtkTreeView * tree_view, GtkTreeIter * parent, GtkTreePath * path, gpointer data) {
+    GtkTreeModel * model = GTK_TREE_MODEL(event_table_model);
+    if(unspillGroupRows(parent)) {
+        // Shown again, so its rows count towards the limit like those of a group that's just finished
+        addFinishedGroup(parent, countRows(model, parent));
+        limitFinishedRows();
+        return;
+    }
+
+    char * json = NULL;
+    gtk_tree_model_get(model, parent, 2, &json, -1);
+    if(json == NULL) return;
+    cJSON * node = cJSON_Parse(json);
+    g_free(json);
+    gtk_tree_store_set(GTK_TREE_STORE(event_table_model), parent, 2, NULL, -1);
+    if(node == NULL) return;
+
+    GtkTreeIter placeholder;
+    gtk_tree_model_iter_children(model, &placeholder, parent);
+
+    for(cJSON * item = node->child; item != NULL; item = item->next) {
+        GtkTreeIter itr;
+        gtk_tree_store_append(GTK_TREE_STORE(event_table_model), &itr, parent);
+        if(item->type == cJSON_Array || item->type == cJSON_Object) {
+            // inside node, so just show the label
+            gtk_tree_store_set(GTK_TREE_STORE(event_table_model), &itr, 0, item->string, -1);
+            showFailingTestParams(item, &itr);
+        } else {
+            // leaf node, so show label with value (eg, "timestamp: 0189276")
+            char * value = cJSON_PrintUnformatted(item);
+            char * label_and_value = g_strdup_printf("%s: %s", item->string != NULL ? item->string : "", value);
+            gtk_tree_store_set(GTK_TREE_STORE(event_table_model), &itr, 0, label_and_value, -1);
+            g_free(label_and_value);
+            free(value);
         }
-        node = node->next;
     }
-    return false;
+
+    // Removed last, so that the row never loses its children and collapses
+    gtk_tree_store_remove(GTK_TREE_STORE(event_table_model), &placeholder);
+    cJSON_Delete(node);
 }
 
 void handleTestsuiteEvent(cJSON * event) {
-    printf("%s\n", cJSON_Print(event));
+    char * event_json = cJSON_Print(event);
+    printf("%s\n", event_json);
+    free(event_json);
     char * func_name = cJSON_GetObjectItem(event, "func_name")->valuestring;
     if(strcmp(func_name, "__END") == 0) {
         // Special event indicating that the test suite is finished
@@ -383,11 +656,166 @@ void handleTestsuiteEvent(cJSON * event) {
         if(isUsingGui()) {
             // Add event to GUI queue (as we can't make changes from this thread directly)
             pthread_mutex_lock(&tailq_events_lock);
-            ts_events = g_slist_append(ts_events, event);
+            g_queue_push_tail(&ts_events, event);
             pthread_mutex_unlock(&tailq_events_lock);
+            requestGUIUpdate();
         } else {
             // Otherwise, we don't need the event anymore
             cJSON_Delete(event);
         }
     }
-}
\ No newline at end of file
+}
+
+/* Test suite runs against several filesystems at once, each in its own session */
+struct testsuite_run {
+    struct fdt_session * session;
+    char fifo_name[PATH_MAX];
+    pthread_t thread;
+    volatile bool reader_done;
+    int groups_passed;
+    int groups_failed;
+    int errors;
+};
+
+// Report the results for one filesystem as they arrive, each line prefixed with its session
+static void * doRunTestsuiteSession(void * ptr) {
+    struct testsuite_run * run = ptr;
+    const char * label = run->session->label;
+    FILE * fifo = fopen(run->fifo_name, "r");
+
+    size_t json_chunk_capacity = 1024;
+    char * json_chunk = malloc(json_chunk_capacity);
+    char * sequence_label = NULL;
+    cJSON * event;
+    while(fifo != NULL && (event = readTestsuiteEvent(fifo, &json_chunk, &json_chunk_capacity)) != NULL) {
+        cJSON * func_name_obj = cJSON_GetObjectItem(event, "func_name");
+        cJSON * passed_obj = cJSON_GetObjectItem(event, "passed");
+        cJSON * message_obj = cJSON_GetObjectItem(event, "message");
+        const char * func_name = func_name_obj != NULL ? func_name_obj->valuestring : "";
+        bool passed = passed_obj != NULL && passed_obj->type == cJSON_True;
+        const char * message = message_obj != NULL ? message_obj->valuestring : "";
+
+        if(strcmp(func_name, "__END") == 0) {
+            cJSON_Delete(event);
+            break;
+        } else if(strcmp(func_name, "__GROUP_END") == 0) {
+            if(passed) run->groups_passed++;
+            else run->groups_failed++;
+            printf("[%s] Group %d: %s\n", label, run->groups_passed + run->groups_failed, passed ? "PASS" : "FAIL");
+        } else if(strcmp(func_name, "__SEQUENCE_START") == 0) {
+            const char * action = cJSON_GetObjectItem(event, "action")->valuestring;
+            const char * application = cJSON_GetObjectItem(event, "application")->valuestring;
+            const char * os = cJSON_GetObjectItem(event, "os")->valuestring;
+            free(sequence_label);
+            asprintf(&sequence_label, "%s using %s on %s", action, application, os);
+        } else if(strcmp(func_name, "__SEQUENCE_END") == 0) {
+            if(!passed) printf("[%s]   Failed sequence: %s\n", label, sequence_label != NULL ? sequence_label : "");
+        } else if(strcmp(func_name, "__ERROR") == 0) {
+            run->errors++;
+            printf("[%s] Error: %s\n", label, message);
+        } else if(strcmp(func_name, "__GROUP_START") != 0 && !passed) {
+            printf("[%s]   FAIL %s: %s\n", label, func_name, message);
+        }
+        fflush(stdout);
+        cJSON_Delete(event);
+    }
+    free(sequence_label);
+    free(json_chunk);
+    if(fifo != NULL) {
+        fclose(fifo);
+    }
+
+    // The filesystem stays mounted after the test suite, so stop it in the same way as the GUI would
+    if(!run->session->exited && run->session->fuse_pid != 0) {
+        kill(run->session->fuse_pid, SIGINT);
+    }
+    run->reader_done = TRUE;
+    return NULL;
+}
+
+/* Run the test suite headlessly against each filesystem command line in parallel
+ * Returns 0 if every group passed on every filesystem
+ */
+int runTestsuiteSessions(const char * test_data, int num_fs, char ** commands) {
+    setTestDataFile(test_data);
+    struct testsuite_run * runs = calloc(num_fs, sizeof(*runs));
+
+    int started = 0;
+    for(int i = 0; i < num_fs; i++) {
+        struct testsuite_run * run = &runs[started];
+        run->session = sessionNew(commands[i]);
+        if(run->session == NULL) {
+            break;
+        }
+
+        // The FIFO has to exist before the filesystem starts, or the wrapper would create a plain file instead
+        sessionChannel(run->session, FDT_CHANNEL_TESTSUITE, run->fifo_name, sizeof(run->fifo_name));
+        unlink(run->fifo_name);
+        mkfifo(run->fifo_name, 0666);
+
+        // Split the command line into the binary and its arguments
+        char bin_str[strlen(commands[i]) + 1];
+        strcpy(bin_str, commands[i]);
+        char * args_str = strchr(bin_str, ' ');
+        if(args_str != NULL) *args_str++ = '\0';
+        else args_str = "";
+
+        printf("[%s] Session %s\n", run->session->label, run->session->id);
+        if(forkFilesystem(bin_str, args_str, "testsuite", run->session) == 0) {
+            sessionFree(run->session);
+            break;
+        }
+        if(pthread_create(&run->thread, NULL, doRunTestsuiteSession, run) != 0) {
+            perror("pthread_create");
+            kill(run->session->fuse_pid, SIGKILL);
+            sessionFree(run->session);
+            break;
+        }
+        started++;
+    }
+
+    // A filesystem that exits before opening its FIFO would leave its reader blocked, so open the
+    // other end on its behalf. This fails harmlessly if the reader hasn't reached its open yet.
+    bool all_done = FALSE;
+    while(!all_done) {
+        all_done = TRUE;
+        for(int i = 0; i < started; i++) {
+            if(runs[i].reader_done) continue;
+            all_done = FALSE;
+            if(runs[i].session->exited) {
+                int fd = open(runs[i].fifo_name, O_WRONLY | O_NONBLOCK);
+                if(fd >= 0) close(fd);
+            }
+        }
+        if(!all_done) usleep(100000);
+    }
+
+    // Give each filesystem a few seconds to unmount before forcing it to stop
+    for(int wait = 0; wait < 50; wait++) {
+        bool all_exited = TRUE;
+        for(int i = 0; i < started; i++) {
+            if(!runs[i].session->exited) all_exited = FALSE;
+        }
+        if(all_exited) break;
+        usleep(100000);
+    }
+    sessionKillAll(SIGKILL);
+
+    printf("\nSummary:\n");
+    int failures = started < num_fs ? 1 : 0;
+    for(int i = 0; i < started; i++) {
+        pthread_join(runs[i].thread, NULL);
+        struct testsuite_run * run = &runs[i];
+        printf("%4d passed %4d failed %4d errors  %s\n", run->groups_passed, run->groups_failed, run->errors, run->session->label);
+        if(run->groups_passed + run->groups_failed == 0 && WIFEXITED(run->session->status)) {
+            printf("%30s(exited with status %d before running any tests)\n", "", WEXITSTATUS(run->session->status));
+        }
+        if(run->groups_failed > 0 || run->errors > 0 || run->groups_passed == 0) failures++;
+        sessionFree(run->session);
+    }
+    if(started < num_fs) {
+        printf("Only %d of %d filesystems could be started\n", started, num_fs);
+    }
+    free(runs);
+    return failures > 0 ? 1 : 0;
+}
@@ -12,10 +12,13 @@ void testdata_select_okbutton_handler(GtkWidget *, gpointer);
 void testdata_select_cancelbutton_handler(GtkWidget *, gpointer);
 gboolean testdata_select_close_handler(GtkWidget *, GdkEvent *, gpointer);
 void testdata_select_handler(GtkWidget *, gpointer);
+void resetTestsuiteResults();
 stopToolFunc startTestsuite();
 void * doStartTestsuite(void *);
+cJSON * readTestsuiteEvent(FILE * fifo, char ** json_chunk, size_t * json_chunk_capacity);
 void stopTestsuite();
 gboolean gui_idle_testsuite(void);
-void showFailingTestParams(cJSON * node, GtkTreeIter parent);
-bool isTSFunctionDisplayed(cJSON *);
-void handleTestsuiteEvent(cJSON *);
\ No newline at end of file
+void showFailingTestParams(cJSON * node, GtkTreeIter * parent);
+void tests_view_row_expanded(GtkTreeView * tree_view, GtkTreeIter * parent, GtkTreePath * path, gpointer data);
+void handleTestsuiteEvent(cJSON *);
+int runTestsuiteSessions(const char * test_data, int num_fs, char ** commands);
@@ -26,23 +26,209 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <glib.h>
-
-static const char * testsuite_fifo_name = "fuse-testsuite.fifo";
+#include <pthread.h>
+#include <dirent.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fdt_session.h"
+#include "fdt_stats.h"
+
+static char testsuite_fifo_name[PATH_MAX];
+static char testsuite_root_path[PATH_MAX];
 static FILE * testsuite_fifo = NULL;
-static cJSON * groups;
 static const struct fuse_operations * passthru_ops;
 static const struct fuse_operations * real_ops;
 static struct fuse_file_info * fi_passthru;
 static struct fuse_file_info * fi_real;
-static GHashTable * fhs_passthru;
-static GHashTable * fhs_real;
+static struct fh_slot * fhs_passthru;
+static struct fh_slot * fhs_real;
 static char * mountpoint;
 
-struct fh_entry {
+/* Test data is compiled into a plan before it's run, so replaying a call costs little more than the call itself
+ *
+ * A plan is a header followed by its groups, and each group is a self-contained blob: sequences, calls,
+ * strings and the structs passed to calls, all referred to by offsets from the start of the group. Every
+ * path a group uses gets a filehandle slot, so filehandles are found by index rather than by hashing the
+ * path. Plans are cached on disk under a hash of the test data, and a cached plan is mapped in and run as is.
+ */
+
+#define TS_PLAN_MAGIC 0x4e4c5054     // "TPLN"
+#define TS_PLAN_VERSION 1
+
+// Operations in the order of fdt_op_names, followed by those only osxfuse has
+enum ts_op {
+    TS_OP_GETATTR, TS_OP_READLINK, TS_OP_GETDIR, TS_OP_MKNOD, TS_OP_MKDIR, TS_OP_UNLINK, TS_OP_RMDIR, TS_OP_SYMLINK,
+    TS_OP_RENAME, TS_OP_LINK, TS_OP_CHMOD, TS_OP_CHOWN, TS_OP_TRUNCATE, TS_OP_UTIME, TS_OP_OPEN, TS_OP_READ,
+    TS_OP_WRITE, TS_OP_STATFS, TS_OP_FLUSH, TS_OP_RELEASE, TS_OP_FSYNC, TS_OP_SETXATTR, TS_OP_GETXATTR, TS_OP_LISTXATTR,
+    TS_OP_REMOVEXATTR, TS_OP_OPENDIR, TS_OP_READDIR, TS_OP_RELEASEDIR, TS_OP_FSYNCDIR, TS_OP_INIT, TS_OP_DESTROY, TS_OP_ACCESS,
+    TS_OP_CREATE, TS_OP_FTRUNCATE, TS_OP_FGETATTR, TS_OP_LOCK, TS_OP_UTIMENS, TS_OP_BMAP, TS_OP_IOCTL, TS_OP_POLL,
+    TS_OP_WRITE_BUF, TS_OP_READ_BUF, TS_OP_FLOCK, TS_OP_FALLOCATE,
+    TS_OP_SETVOLNAME, TS_OP_EXCHANGE, TS_OP_GETXTIMES, TS_OP_SETBKUPTIME, TS_OP_SETCHGTIME, TS_OP_SETCRTIME, TS_OP_CHFLAGS,
+    TS_OP_SETATTR_X, TS_OP_FSETATTR_X,
+    TS_OP_UNKNOWN
+};
+
+static const char * const ts_osxfuse_op_names[] = {
+    "setvolname", "exchange", "getxtimes", "setbkuptime", "setchgtime", "setcrtime", "chflags", "setattr_x", "fsetattr_x"
+};
+
+struct ts_plan_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t hash;              // Of the test data the plan was compiled from
+    uint32_t call_size;         // Structs are stored as they are in memory, so a plan only suits the build that wrote it
+    uint32_t stat_size;
+    uint32_t num_groups;
+    uint32_t reserved;
+};
+
+struct ts_plan_group {
+    uint32_t size;              // Of the whole group, including everything it refers to
+    uint32_t num_slots;         // Filehandle slots, one per path
+    uint32_t num_sequences;
+    uint32_t sequences;         // Offset of the struct ts_plan_sequence array
+};
+
+struct ts_plan_sequence {
+    uint32_t action;            // Offsets of strings
+    uint32_t application;
+    uint32_t os;
+    uint32_t num_calls;
+    uint32_t calls;             // Offset of the struct ts_plan_call array
+    uint32_t reserved;
+};
+
+// File info as it was logged. The filehandle isn't kept, as it's resolved from the path's slot instead
+struct ts_plan_fi {
+    int32_t flags;
+    int32_t writepage;
+    int32_t direct_io;
+    int32_t keep_cache;
+    int32_t flush;
+    int32_t reserved;
+    uint64_t lock_owner;
+};
+
+struct ts_plan_call {
+    uint16_t op;
+    uint16_t reserved;
+    uint32_t repeat;
+    int32_t slot;               // Filehandle slot of path, or -1 if the call has no path
+    uint32_t func;              // Offsets of strings, or 0 if the call doesn't have them
+    uint32_t path;
+    uint32_t path2;             // newpath of rename and link, link of symlink, path2 of exchange
+    uint32_t str;               // buf of write, name of the xattr calls, volname of setvolname
+    uint32_t str2;              // value of setxattr
+    uint32_t params;            // Unformatted JSON of the parameters, only parsed to report a failure
+    uint32_t data;              // Offset of a struct argument, decoded when the plan was compiled
+    int64_t args[4];            // Numeric arguments, in the order the operation takes them
+    struct ts_plan_fi fi;
+};
+
+struct ts_plan {
+    char * base;
+    size_t size;
+    bool mapped;
+    const struct ts_plan_header * header;
+};
+
+struct fh_slot {
     uint64_t fh;
     int open;
 };
 
+static inline const char * plan_string(const struct ts_plan_group * group, uint32_t offset) {
+    return offset != 0 ? (const char *) group + offset : NULL;
+}
+
+static inline const void * plan_data(const struct ts_plan_group * group, uint32_t offset) {
+    return (const char *) group + offset;
+}
+
+const char * ts_op_name(int op);
+const char * ts_op_name(int op) {
+    if(op < FDT_NUM_OP_NAMES) return fdt_op_names[op];
+    if(op < TS_OP_UNKNOWN) return ts_osxfuse_op_names[op - FDT_NUM_OP_NAMES];
+    return "unknown";
+}
+
+enum ts_op ts_op_from_name(const char * name);
+enum ts_op ts_op_from_name(const char * name) {
+    int op = fdt_stats_opcode(name);
+    if(op != FDT_STATS_OP_UNKNOWN) return op;
+    size_t i;
+    for(i = 0; i < sizeof(ts_osxfuse_op_names) / sizeof(ts_osxfuse_op_names[0]); i++) {
+        if(strcmp(ts_osxfuse_op_names[i], name) == 0) return FDT_NUM_OP_NAMES + i;
+    }
+    return TS_OP_UNKNOWN;
+}
+
+/* What a call can change, so only those paths need checking once it's been made
+ *
+ * Calls that only read are never checked on their own; the whole tree is still compared at the end of every
+ * sequence, without trusting any directory summaries, which catches anything these miss (e.g. a call on a
+ * filehandle whose path has since been renamed).
+ */
+#define TS_EFFECT_PATH      0x01    // path itself
+#define TS_EFFECT_PATH2     0x02    // path2 (newpath of rename and link, link of symlink, path2 of exchange)
+#define TS_EFFECT_PARENTS   0x04    // the directories containing the above, as entries were added or removed
+#define TS_EFFECT_SUBTREE   0x08    // everything beneath the above, as whole directories were moved
+#define TS_EFFECT_ALL       0x10    // could be anything, so check the whole tree
+
+unsigned ts_op_effects(int op);
+unsigned ts_op_effects(int op) {
+    switch(op) {
+    case TS_OP_MKNOD:
+    case TS_OP_MKDIR:
+    case TS_OP_UNLINK:
+    case TS_OP_RMDIR:
+    case TS_OP_CREATE:
+        return TS_EFFECT_PATH | TS_EFFECT_PARENTS;
+    case TS_OP_SYMLINK:
+        return TS_EFFECT_PATH2 | TS_EFFECT_PARENTS;
+    case TS_OP_LINK:
+        return TS_EFFECT_PATH | TS_EFFECT_PATH2 | TS_EFFECT_PARENTS;
+    case TS_OP_RENAME:
+    case TS_OP_EXCHANGE:
+        return TS_EFFECT_PATH | TS_EFFECT_PATH2 | TS_EFFECT_PARENTS | TS_EFFECT_SUBTREE;
+    case TS_OP_CHMOD:
+    case TS_OP_CHOWN:
+    case TS_OP_TRUNCATE:
+    case TS_OP_UTIME:
+    case TS_OP_OPEN:
+    case TS_OP_WRITE:
+    case TS_OP_FLUSH:
+    case TS_OP_RELEASE:
+    case TS_OP_FSYNC:
+    case TS_OP_SETXATTR:
+    case TS_OP_REMOVEXATTR:
+    case TS_OP_FSYNCDIR:
+    case TS_OP_FTRUNCATE:
+    case TS_OP_UTIMENS:
+    case TS_OP_IOCTL:
+    case TS_OP_WRITE_BUF:
+    case TS_OP_FALLOCATE:
+    case TS_OP_SETBKUPTIME:
+    case TS_OP_SETCHGTIME:
+    case TS_OP_SETCRTIME:
+    case TS_OP_CHFLAGS:
+    case TS_OP_SETATTR_X:
+    case TS_OP_FSETATTR_X:
+        return TS_EFFECT_PATH;
+    case TS_OP_INIT:
+    case TS_OP_DESTROY:
+    case TS_OP_SETVOLNAME:
+        return TS_EFFECT_ALL;
+    default:
+        return 0;
+    }
+}
+
 void empty_fi(struct fuse_file_info * fi);
 void empty_fi(struct fuse_file_info * fi)
 {
@@ -56,80 +242,90 @@ void empty_fi(struct fuse_file_info * fi)
     fi->lock_owner = 0;
 }
 
-void store_fh(GHashTable * fhs, const char * path, uint64_t fh);
-void store_fh(GHashTable * fhs, const char * path, uint64_t fh) {
-    size_t path_len = strlen(path);
-    char * path_m = malloc(path_len + 1);
-    strcpy(path_m, path);
-    struct fh_entry * entry = malloc(sizeof(*entry));
-    entry->fh = fh;
-    entry->open = 0;
-    g_hash_table_insert(fhs, path_m, (void *) entry);
+// A call that opens its path gets a new filehandle, which is closed once it's been opened as often as it's been destroyed
+void store_fh(struct fh_slot * fhs, int slot, uint64_t fh);
+void store_fh(struct fh_slot * fhs, int slot, uint64_t fh) {
+    if(slot < 0) return;
+    fhs[slot].fh = fh;
+    fhs[slot].open = 0;
 }
 
-void increment_open(GHashTable * fhs, const char * path);
-void increment_open(GHashTable * fhs, const char * path) {
-    struct fh_entry * entry = ((struct fh_entry *) g_hash_table_lookup(fhs, path));
-    entry->open++;
+void increment_open(struct fh_slot * fhs, int slot);
+void increment_open(struct fh_slot * fhs, int slot) {
+    if(slot >= 0) fhs[slot].open++;
 }
 
-uint64_t path_to_fh(GHashTable * fhs, const char * path);
-uint64_t path_to_fh(GHashTable * fhs, const char * path) {
-    return ((struct fh_entry *) g_hash_table_lookup(fhs, path))->fh;
+uint64_t path_to_fh(struct fh_slot * fhs, int slot);
+uint64_t path_to_fh(struct fh_slot * fhs, int slot) {
+    return slot >= 0 ? fhs[slot].fh : 0;
 }
 
-void update_fi(GHashTable * fhs, const char * path, struct fuse_file_info * fi, cJSON * obj);
-void update_fi(GHashTable * fhs, const char * path, struct fuse_file_info * fi, cJSON * obj)
+// Fill in the file info passed to a call, resolving its path into a filehandle as the logged one will be wrong
+void update_fi(struct fh_slot * fhs, int slot, struct fuse_file_info * fi, const struct ts_plan_fi * logged);
+void update_fi(struct fh_slot * fhs, int slot, struct fuse_file_info * fi, const struct ts_plan_fi * logged)
 {
-    fi->flags = cJSON_GetObjectItem(obj, "flags")->valueint;
-    fi->writepage = cJSON_GetObjectItem(obj, "writepage")->valueint;
-    fi->direct_io = cJSON_GetObjectItem(obj, "direct_io")->valueint;
-    fi->keep_cache = cJSON_GetObjectItem(obj, "keep_cache")->valueint;
-    fi->flush = cJSON_GetObjectItem(obj, "flush")->valueint;
-    fi->lock_owner = cJSON_GetObjectItem(obj, "lock_owner")->valueint;
-
-    // Resolve the path into a filehandle, as the logged filehandle will be wrong
+    fi->flags = logged->flags;
+    fi->writepage = logged->writepage;
+    fi->direct_io = logged->direct_io;
+    fi->keep_cache = logged->keep_cache;
+    fi->flush = logged->flush;
+    fi->lock_owner = logged->lock_owner;
     fi->fh_old = 0;
-    if(path != NULL) {
-        fi->fh = path_to_fh(fhs, path);
-    } else {
-        fi->fh = 0;
-    }
+    fi->fh = fhs != NULL ? path_to_fh(fhs, slot) : 0;
 }
 
-// Remove a path->fh entry from a filehandle map
-void destroy_fh(GHashTable * fhs, const char * path);
-void destroy_fh(GHashTable * fhs, const char * path)
+// Close a path's filehandle once every open of it has been matched
+void destroy_fh(struct fh_slot * fhs, int slot);
+void destroy_fh(struct fh_slot * fhs, int slot)
 {
-    // Find the file entry and decrement its open counter
-    struct fh_entry * entry = ((struct fh_entry *) g_hash_table_lookup(fhs, path));
-    entry->open--;
-
-    // If we've had a close for every open then we can remove the entry
-    if(entry->open == 0) {
-        g_hash_table_remove(fhs, (void *) path);
-        free(entry);
+    if(slot < 0 || fhs[slot].open == 0) return;
+    if(--fhs[slot].open == 0) {
+        fhs[slot].fh = 0;
     }
 }
 
-struct stat * json_to_stat(cJSON * obj);
-struct stat * json_to_stat(cJSON * obj)
+// Test data may leave out values, which are taken as 0 as the fields of a struct would be
+cJSON * json_item(cJSON * obj, const char * key);
+cJSON * json_item(cJSON * obj, const char * key) {
+    return obj != NULL ? cJSON_GetObjectItem(obj, key) : NULL;
+}
+
+int json_array_size(cJSON * array);
+int json_array_size(cJSON * array) {
+    return array != NULL ? cJSON_GetArraySize(array) : 0;
+}
+
+int64_t json_int(cJSON * obj, const char * key);
+int64_t json_int(cJSON * obj, const char * key) {
+    cJSON * item = json_item(obj, key);
+    if(item == NULL) return 0;
+    if(item->type == cJSON_True) return 1;
+    return item->type == cJSON_Number ? (int64_t) item->valuedouble : 0;
+}
+
+const char * json_string(cJSON * obj, const char * key);
+const char * json_string(cJSON * obj, const char * key) {
+    cJSON * item = json_item(obj, key);
+    return item != NULL && item->type == cJSON_String ? item->valuestring : NULL;
+}
+
+void json_to_stat(cJSON * obj, struct stat * s);
+void json_to_stat(cJSON * obj, struct stat * s)
 {
-    struct stat * s = malloc(sizeof(*s));
-    s->st_dev = cJSON_GetObjectItem(obj, "st_dev")->valueint;
-    s->st_ino = cJSON_GetObjectItem(obj, "st_ino")->valueint;
-    s->st_mode = cJSON_GetObjectItem(obj, "st_mode")->valueint;
-    s->st_nlink = cJSON_GetObjectItem(obj, "st_nlink")->valueint;
-    s->st_uid = cJSON_GetObjectItem(obj, "st_uid")->valueint;
-    s->st_gid = cJSON_GetObjectItem(obj, "st_gid")->valueint;
-    s->st_rdev = cJSON_GetObjectItem(obj, "st_rdev")->valueint;
-    s->st_size = cJSON_GetObjectItem(obj, "st_size")->valueint;
-    s->st_atime = cJSON_GetObjectItem(obj, "st_atime")->valueint;
-    s->st_mtime = cJSON_GetObjectItem(obj, "st_mtime")->valueint;
-    s->st_ctime = cJSON_GetObjectItem(obj, "st_ctime")->valueint;
-    s->st_blksize = cJSON_GetObjectItem(obj, "st_blksize")->valueint;
-    s->st_blocks = cJSON_GetObjectItem(obj, "st_blocks")->valueint;
-    return s;
+    memset(s, 0, sizeof(*s));
+    s->st_dev = json_int(obj, "st_dev");
+    s->st_ino = json_int(obj, "st_ino");
+    s->st_mode = json_int(obj, "st_mode");
+    s->st_nlink = json_int(obj, "st_nlink");
+    s->st_uid = json_int(obj, "st_uid");
+    s->st_gid = json_int(obj, "st_gid");
+    s->st_rdev = json_int(obj, "st_rdev");
+    s->st_size = json_int(obj, "st_size");
+    s->st_atime = json_int(obj, "st_atime");
+    s->st_mtime = json_int(obj, "st_mtime");
+    s->st_ctime = json_int(obj, "st_ctime");
+    s->st_blksize = json_int(obj, "st_blksize");
+    s->st_blocks = json_int(obj, "st_blocks");
 }
 
 cJSON * stat_to_json(struct stat * s);
@@ -155,195 +351,924 @@ cJSON * stat_to_json(struct stat * s)
 struct timespec json_to_timespec(cJSON * obj);
 struct timespec json_to_timespec(cJSON * obj)
 {
-    struct timespec * tv = malloc(sizeof(*tv));
-    tv->tv_sec = cJSON_GetObjectItem(obj, "tv_sec")->valueint;
-    tv->tv_nsec = cJSON_GetObjectItem(obj, "tv_nsec")->valueint;
-    return *tv;
+    struct timespec tv;
+    tv.tv_sec = json_int(obj, "tv_sec");
+    tv.tv_nsec = json_int(obj, "tv_nsec");
+    return tv;
 }
 
-struct timespec * json_to_timespec_array(cJSON * obj);
-struct timespec * json_to_timespec_array(cJSON * obj)
+void json_to_utimbuf(cJSON * obj, struct utimbuf * ubuf);
+void json_to_utimbuf(cJSON * obj, struct utimbuf * ubuf)
 {
+    ubuf->actime = json_int(obj, "actime");
+    ubuf->modtime = json_int(obj, "modtime");
+}
 
-    // Construct an array of timespec structs
-    size_t size = cJSON_GetArraySize(obj);
-    struct timespec * tv = malloc(size * sizeof(*tv));
-    size_t i;
-    for(i = 0; i < size; i++) {
-        cJSON * tv_obj = cJSON_GetArrayItem(obj, i);
-        tv[i].tv_sec = cJSON_GetObjectItem(tv_obj, "tv_sec")->valueint;
-        tv[i].tv_nsec = cJSON_GetObjectItem(tv_obj, "tv_nsec")->valueint;
-    }
-    return tv;
+void json_to_statvfs(cJSON * obj, struct statvfs * s);
+void json_to_statvfs(cJSON * obj, struct statvfs * s)
+{
+    memset(s, 0, sizeof(*s));
+    s->f_bsize = json_int(obj, "f_bsize");
+    s->f_frsize = json_int(obj, "f_frsize");
+    s->f_blocks = json_int(obj, "f_blocks");
+    s->f_bfree = json_int(obj, "f_bfree");
+    s->f_bavail = json_int(obj, "f_bavail");
+    s->f_files = json_int(obj, "f_files");
+    s->f_ffree = json_int(obj, "f_ffree");
+    s->f_favail = json_int(obj, "f_favail");
+    s->f_fsid = json_int(obj, "f_fsid");
+    s->f_flag = json_int(obj, "f_flag");
+    s->f_namemax = json_int(obj, "f_namemax");
+}
+
+void json_to_fuse_conn_info(cJSON * obj, struct fuse_conn_info * conn);
+void json_to_fuse_conn_info(cJSON * obj, struct fuse_conn_info * conn)
+{
+    memset(conn, 0, sizeof(*conn));
+    conn->proto_major = json_int(obj, "proto_major");
+    conn->proto_minor = json_int(obj, "proto_minor");
+    conn->async_read = json_int(obj, "async_read");
+    conn->max_write = json_int(obj, "max_write");
+    conn->max_readahead = json_int(obj, "max_readahead");
+
+#ifdef __APPLE__
+    cJSON * enable = json_item(obj, "enable");
+    conn->enable.case_insensitive = json_int(enable, "case_insensitive");
+    conn->enable.setvolname = json_int(enable, "setvolname");
+    conn->enable.xtimes = json_int(enable, "xtimes");
+#endif /* __APPLE__ */
+}
+
+void json_to_flock(cJSON * obj, struct flock * f);
+void json_to_flock(cJSON * obj, struct flock * f)
+{
+    memset(f, 0, sizeof(*f));
+    f->l_type = json_int(obj, "l_type");
+    f->l_whence = json_int(obj, "l_whence");
+    f->l_start = json_int(obj, "l_start");
+    f->l_len = json_int(obj, "l_len");
+    f->l_pid = json_int(obj, "l_pid");
 }
 
-struct utimbuf * json_to_utimbuf(cJSON * obj);
-struct utimbuf * json_to_utimbuf(cJSON * obj)
+void json_to_fi(cJSON * obj, struct ts_plan_fi * fi);
+void json_to_fi(cJSON * obj, struct ts_plan_fi * fi)
 {
-    struct utimbuf * ubuf = malloc(sizeof(*ubuf));
-    ubuf->actime = cJSON_GetObjectItem(obj, "actime")->valueint;
-    ubuf->modtime = cJSON_GetObjectItem(obj, "modtime")->valueint;
-    return ubuf;
+    memset(fi, 0, sizeof(*fi));
+    fi->flags = json_int(obj, "flags");
+    fi->writepage = json_int(obj, "writepage");
+    fi->direct_io = json_int(obj, "direct_io");
+    fi->keep_cache = json_int(obj, "keep_cache");
+    fi->flush = json_int(obj, "flush");
+    fi->lock_owner = json_int(obj, "lock_owner");
 }
 
-// Linux libfuse-only
 #ifdef __APPLE__
-#else
-struct fuse_bufvec * json_to_fuse_bufvec(const char * path, GHashTable * fhs, cJSON * obj);
-struct fuse_bufvec * json_to_fuse_bufvec(const char * path, GHashTable * fhs, cJSON * obj)
+void json_to_setattr_x(cJSON * obj, struct setattr_x * attr);
+void json_to_setattr_x(cJSON * obj, struct setattr_x * attr)
 {
-    struct fuse_bufvec * bufvec = malloc(sizeof(*bufvec));
+    memset(attr, 0, sizeof(*attr));
+    attr->valid = json_int(obj, "valid");
+    attr->mode = json_int(obj, "mode");
+    attr->uid = json_int(obj, "uid");
+    attr->gid = json_int(obj, "gid");
+    attr->size = json_int(obj, "size");
+    attr->acctime = json_to_timespec(json_item(obj, "acctime"));
+    attr->modtime = json_to_timespec(json_item(obj, "modtime"));
+    attr->crtime = json_to_timespec(json_item(obj, "crtime"));
+    attr->chgtime = json_to_timespec(json_item(obj, "chgtime"));
+    attr->bkuptime = json_to_timespec(json_item(obj, "bkuptime"));
+    attr->flags = json_int(obj, "flags");
+}
+#endif /* __APPLE__ */
+
+/* Hashing, with XXH64 (with a seed of 0): four independent lanes over 32-byte stripes, which the compiler can
+ * keep in registers and vectorise, folded together at the end. Used for test data and file contents alike.
+ */
+
+#define TS_HASH_PRIME1 0x9E3779B185EBCA87ULL
+#define TS_HASH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define TS_HASH_PRIME3 0x165667B19E3779F9ULL
+#define TS_HASH_PRIME4 0x85EBCA77C2B2AE63ULL
+#define TS_HASH_PRIME5 0x27D4EB2F165667C5ULL
+
+struct ts_hash {
+    uint64_t lanes[4];
+    unsigned char stripe[32];   // Input that doesn't yet fill a stripe
+    size_t buffered;
+    uint64_t total;
+};
 
-    bufvec->count = cJSON_GetObjectItem(obj, "count")->valueint;
-    bufvec->idx = cJSON_GetObjectItem(obj, "idx")->valueint;
-    bufvec->off = cJSON_GetObjectItem(obj, "off")->valueint;
+static inline uint64_t ts_hash_rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
 
-    cJSON * buf_array = cJSON_GetObjectItem(obj, "buf");
-    size_t buf_array_len = cJSON_GetArraySize(buf_array);
+static inline uint64_t ts_hash_round(uint64_t acc, uint64_t input) {
+    acc += input * TS_HASH_PRIME2;
+    acc = ts_hash_rotl(acc, 31);
+    return acc * TS_HASH_PRIME1;
+}
 
-    // Read buffers into array
-    size_t i;
-    for(i = 0; i < buf_array_len; i++) {
-        cJSON * buf_obj = cJSON_GetArrayItem(buf_array, i);
-        struct fuse_buf * buf = malloc(sizeof(*buf));
-        buf->size = cJSON_GetObjectItem(buf_obj, "size")->valueint;
-        const char * flags = cJSON_GetObjectItem(buf_obj, "flags")->valuestring;
-        if(strcmp(flags, "FUSE_BUF_IS_FD") == 0) {
-            buf->flags = FUSE_BUF_IS_FD;
-        } else if(strcmp(flags, "FUSE_BUF_FD_SEEK") == 0) {
-            buf->flags = FUSE_BUF_FD_SEEK;
-        } else if(strcmp(flags, "FUSE_BUF_FD_RETRY") == 0) {
-            buf->flags = FUSE_BUF_FD_RETRY;
+static inline uint64_t ts_hash_read64(const unsigned char * p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t ts_hash_read32(const unsigned char * p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+void ts_hash_init(struct ts_hash * h);
+void ts_hash_init(struct ts_hash * h) {
+    h->lanes[0] = TS_HASH_PRIME1 + TS_HASH_PRIME2;
+    h->lanes[1] = TS_HASH_PRIME2;
+    h->lanes[2] = 0;
+    h->lanes[3] = -TS_HASH_PRIME1;
+    h->buffered = 0;
+    h->total = 0;
+}
+
+void ts_hash_update(struct ts_hash * h, const void * data, size_t len);
+void ts_hash_update(struct ts_hash * h, const void * data, size_t len) {
+    const unsigned char * p = data;
+    h->total += len;
+
+    // Top up a partial stripe first
+    if(h->buffered > 0) {
+        size_t fill = 32 - h->buffered;
+        if(fill > len) fill = len;
+        memcpy(h->stripe + h->buffered, p, fill);
+        h->buffered += fill;
+        p += fill;
+        len -= fill;
+        if(h->buffered < 32) return;
+        int i;
+        for(i = 0; i < 4; i++) h->lanes[i] = ts_hash_round(h->lanes[i], ts_hash_read64(h->stripe + i * 8));
+        h->buffered = 0;
+    }
+
+    // Then whole stripes straight from the input, with the lanes independent of each other
+    uint64_t l0 = h->lanes[0], l1 = h->lanes[1], l2 = h->lanes[2], l3 = h->lanes[3];
+    for(; len >= 32; p += 32, len -= 32) {
+        l0 = ts_hash_round(l0, ts_hash_read64(p));
+        l1 = ts_hash_round(l1, ts_hash_read64(p + 8));
+        l2 = ts_hash_round(l2, ts_hash_read64(p + 16));
+        l3 = ts_hash_round(l3, ts_hash_read64(p + 24));
+    }
+    h->lanes[0] = l0; h->lanes[1] = l1; h->lanes[2] = l2; h->lanes[3] = l3;
+
+    memcpy(h->stripe, p, len);
+    h->buffered = len;
+}
+
+uint64_t ts_hash_final(const struct ts_hash * h);
+uint64_t ts_hash_final(const struct ts_hash * h) {
+    uint64_t acc;
+    int i;
+    if(h->total >= 32) {
+        acc = ts_hash_rotl(h->lanes[0], 1) + ts_hash_rotl(h->lanes[1], 7) + ts_hash_rotl(h->lanes[2], 12) + ts_hash_rotl(h->lanes[3], 18);
+        for(i = 0; i < 4; i++) {
+            acc ^= ts_hash_round(0, h->lanes[i]);
+            acc = acc * TS_HASH_PRIME1 + TS_HASH_PRIME4;
         }
-        buf->mem = malloc(buf->size);
-        buf->fd = path_to_fh(fhs, path);
-        buf->pos = cJSON_GetObjectItem(buf_obj, "pos")->valueint;
-        bufvec->buf[i] = *buf;
+    } else {
+        acc = TS_HASH_PRIME5;
+    }
+    acc += h->total;
+
+    // Whatever's left over, a word, then half a word, and then a byte at a time
+    const unsigned char * p = h->stripe;
+    size_t len = h->buffered;
+    for(; len >= 8; p += 8, len -= 8) {
+        acc ^= ts_hash_round(0, ts_hash_read64(p));
+        acc = ts_hash_rotl(acc, 27) * TS_HASH_PRIME1 + TS_HASH_PRIME4;
+    }
+    if(len >= 4) {
+        acc ^= ts_hash_read32(p) * TS_HASH_PRIME1;
+        acc = ts_hash_rotl(acc, 23) * TS_HASH_PRIME2 + TS_HASH_PRIME3;
+        p += 4;
+        len -= 4;
+    }
+    for(; len > 0; p++, len--) {
+        acc ^= *p * TS_HASH_PRIME5;
+        acc = ts_hash_rotl(acc, 11) * TS_HASH_PRIME1;
     }
 
-    return bufvec;
+    acc ^= acc >> 33;
+    acc *= TS_HASH_PRIME2;
+    acc ^= acc >> 29;
+    acc *= TS_HASH_PRIME3;
+    acc ^= acc >> 32;
+    return acc;
 }
-#endif
 
-struct statvfs * json_to_statvfs(cJSON * obj);
-struct statvfs * json_to_statvfs(cJSON * obj)
-{
-    struct statvfs * s = malloc(sizeof(*s));
-    s->f_bsize = cJSON_GetObjectItem(obj, "f_bsize")->valueint;
-    s->f_frsize = cJSON_GetObjectItem(obj, "f_frsize")->valueint;
-    s->f_blocks = cJSON_GetObjectItem(obj, "f_blocks")->valueint;
-    s->f_bfree = cJSON_GetObjectItem(obj, "f_bfree")->valueint;
-    s->f_bavail = cJSON_GetObjectItem(obj, "f_bavail")->valueint;
-    s->f_files = cJSON_GetObjectItem(obj, "f_files")->valueint;
-    s->f_ffree = cJSON_GetObjectItem(obj, "f_ffree")->valueint;
-    s->f_favail = cJSON_GetObjectItem(obj, "f_favail")->valueint;
-    s->f_fsid = cJSON_GetObjectItem(obj, "f_fsid")->valueint;
-    s->f_flag = cJSON_GetObjectItem(obj, "f_flag")->valueint;
-    s->f_namemax = cJSON_GetObjectItem(obj, "f_namemax")->valueint;
-    return s;
-}
-
-struct fuse_conn_info * json_to_fuse_conn_info(cJSON * obj);
-struct fuse_conn_info * json_to_fuse_conn_info(cJSON * obj)
-{
-    struct fuse_conn_info * conn = malloc(sizeof(*conn));
-    conn->proto_major = cJSON_GetObjectItem(obj, "proto_major")->valueint;
-    conn->proto_minor = cJSON_GetObjectItem(obj, "proto_minor")->valueint;
-    conn->async_read = cJSON_GetObjectItem(obj, "async_read")->valueint;
-    conn->max_write = cJSON_GetObjectItem(obj, "max_write")->valueint;
-    conn->max_readahead = cJSON_GetObjectItem(obj, "max_readahead")->valueint;
+uint64_t ts_hash_bytes(const void * data, size_t len);
+uint64_t ts_hash_bytes(const void * data, size_t len) {
+    struct ts_hash h;
+    ts_hash_init(&h);
+    ts_hash_update(&h, data, len);
+    return ts_hash_final(&h);
+}
 
-#ifdef __APPLE__
-    cJSON * enable = cJSON_GetObjectItem(obj, "enable");
-    conn->enable.case_insensitive = cJSON_GetObjectItem(enable, "case_insensitive")->valueint;
-    conn->enable.setvolname = cJSON_GetObjectItem(enable, "setvolname")->valueint;
-    conn->enable.xtimes = cJSON_GetObjectItem(enable, "xtimes")->valueint;
-#endif /* __APPLE__ */
+// Combine two digests, in an order-dependent way
+static inline uint64_t ts_hash_combine(uint64_t a, uint64_t b) {
+    return ts_hash_round(a ^ TS_HASH_PRIME3, b) * TS_HASH_PRIME1 + TS_HASH_PRIME4;
+}
 
-    return conn;
+/* Test data is read one group at a time
+ *
+ * The file is mapped in rather than read, and each group's text is found by scanning for the end of its array,
+ * then parsed on its own. So only the group being compiled is ever held as cJSON, and the first group can run
+ * without waiting for the rest of the file.
+ */
+
+struct test_data {
+    const char * base;          // The whole file, mapped in
+    size_t len;
+    uint64_t hash;
+    struct ts_plan * plan;      // The cached plan for this test data, if there is one
+};
+
+struct ts_plan * load_cached_plan(uint64_t hash);
+
+// Map a test data file in, and look for a plan already compiled from it
+bool open_test_data(const char * fpath, struct test_data * data);
+bool open_test_data(const char * fpath, struct test_data * data) {
+    printf("Loading JSON file: %s\n", fpath);
+    data->base = NULL;
+    data->len = 0;
+    data->plan = NULL;
+
+    int fd = open(fpath, O_RDONLY);
+    if(fd < 0) {
+        perror("Unable to read file");
+        return false;
+    }
+    struct stat s;
+    if(fstat(fd, &s) != 0 || s.st_size == 0) {
+        close(fd);
+        errno = 0;
+        return false;
+    }
+    void * base = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(base == MAP_FAILED) {
+        perror("Unable to map file");
+        return false;
+    }
+    madvise(base, s.st_size, MADV_SEQUENTIAL);
+    data->base = base;
+    data->len = s.st_size;
+    printf("Mapped %zu bytes\n", data->len);
+
+    data->hash = ts_hash_bytes(data->base, data->len);
+    data->plan = load_cached_plan(data->hash);
+    if(data->plan != NULL) {
+        printf("Using compiled test plan for %016llx\n", (unsigned long long) data->hash);
+    }
+    return true;
 }
 
-struct flock * json_to_flock(cJSON * obj);
-struct flock * json_to_flock(cJSON * obj)
-{
-    struct flock * f = malloc(sizeof(*f));
-    f->l_type = cJSON_GetObjectItem(obj, "l_type")->valueint;
-    f->l_whence = cJSON_GetObjectItem(obj, "l_whence")->valueint;
-    f->l_start = cJSON_GetObjectItem(obj, "l_start")->valueint;
-    f->l_len = cJSON_GetObjectItem(obj, "l_len")->valueint;
-    f->l_pid = cJSON_GetObjectItem(obj, "l_pid")->valueint;
-    return f;
+void free_plan(struct ts_plan * plan);
+
+void close_test_data(struct test_data * data);
+void close_test_data(struct test_data * data) {
+    if(data->plan != NULL) free_plan(data->plan);
+    if(data->base != NULL) munmap((void *) data->base, data->len);
 }
 
-#ifdef __APPLE__
-struct setattr_x * json_to_setattr_x(cJSON * obj);
-struct setattr_x * json_to_setattr_x(cJSON * obj)
-{
-    struct setattr_x * attr = malloc(sizeof(*attr));
-    attr->valid = cJSON_GetObjectItem(obj, "valid")->valueint;
-    attr->mode = cJSON_GetObjectItem(obj, "mode")->valueint;
-    attr->uid = cJSON_GetObjectItem(obj, "uid")->valueint;
-    attr->gid = cJSON_GetObjectItem(obj, "gid")->valueint;
-    attr->size = cJSON_GetObjectItem(obj, "size")->valueint;
-    attr->acctime = json_to_timespec(cJSON_GetObjectItem(obj, "acctime"));
-    attr->modtime = json_to_timespec(cJSON_GetObjectItem(obj, "modtime"));
-    attr->crtime = json_to_timespec(cJSON_GetObjectItem(obj, "crtime"));
-    attr->chgtime = json_to_timespec(cJSON_GetObjectItem(obj, "chgtime"));
-    attr->bkuptime = json_to_timespec(cJSON_GetObjectItem(obj, "bkuptime"));
-    attr->flags = cJSON_GetObjectItem(obj, "flags")->valueint;
-    return attr;
+static inline size_t skip_json_space(const char * data, size_t len, size_t pos) {
+    while(pos < len && (data[pos] == ' ' || data[pos] == '\t' || data[pos] == '\n' || data[pos] == '\r')) pos++;
+    return pos;
 }
-#endif /* __APPLE__ */
 
-// Open a file, read the string, and parse it into a JSON object
-cJSON * readJSONFile(const char * fpath);
-cJSON * readJSONFile(const char * fpath) {
-    printf("Loading JSON file: %s\n", fpath);
-    FILE * file = fopen(fpath, "r");
-    if(file != NULL) {
-        fseek(file, 0, SEEK_END);
-        size_t fsize = ftell(file);
-        rewind(file);
-        char * str = malloc((fsize+1) * sizeof(char));
-        fread(str, sizeof(char), fsize, file);
-        str[fsize] = '\0';
-        fclose(file);
-        cJSON * obj = cJSON_Parse(str);
-        free(str);
-        if(obj != NULL) {
-            printf("Loaded %zu bytes\n", fsize);
-            return obj;
-        } else {
-            errno = 0;
-            return NULL;
-        }
+// Find the text of the next group in the top-level array, starting from *pos
+// Returns 1 if there was a group, 0 at the end of the array, or -1 if the test data isn't well formed
+int next_group_text(const struct test_data * data, size_t * pos, const char ** text, size_t * text_len);
+int next_group_text(const struct test_data * data, size_t * pos, const char ** text, size_t * text_len) {
+    const char * d = data->base;
+    size_t len = data->len;
+    size_t i = skip_json_space(d, len, *pos);
+
+    // The array opens before the first group, and each group after it is preceded by a comma
+    if(i >= len) return -1;
+    if(*pos == 0) {
+        if(d[i] != '[') return -1;
+        i = skip_json_space(d, len, i + 1);
+        if(i < len && d[i] == ']') return 0;
+    } else if(d[i] == ']') {
+        return 0;
+    } else if(d[i] == ',') {
+        i = skip_json_space(d, len, i + 1);
     } else {
-        perror("Unable to read file");
+        return -1;
+    }
+    if(i >= len || d[i] != '[') return -1;
+
+    // Find the bracket that closes the group, skipping over anything in strings
+    size_t start = i;
+    int depth = 0;
+    for(; i < len; i++) {
+        char c = d[i];
+        if(c == '"') {
+            for(i++; i < len && d[i] != '"'; i++) {
+                if(d[i] == '\\') i++;
+            }
+        } else if(c == '[' || c == '{') {
+            depth++;
+        } else if(c == ']' || c == '}') {
+            if(--depth == 0) break;
+        }
+    }
+    if(i >= len) return -1;
+
+    *text = d + start;
+    *text_len = i + 1 - start;
+    *pos = i + 1;
+    return 1;
+}
+
+// Parse a group's text on its own, as cJSON wants it NUL-terminated
+cJSON * parse_group_text(const char * text, size_t len);
+cJSON * parse_group_text(const char * text, size_t len) {
+    char * str = malloc(len + 1);
+    memcpy(str, text, len);
+    str[len] = '\0';
+    cJSON * group = cJSON_Parse(str);
+    free(str);
+    if(group != NULL && group->type != cJSON_Array) {
+        cJSON_Delete(group);
         return NULL;
     }
+    return group;
+}
+
+/* Compiling test data into a plan */
+
+struct plan_builder {
+    GByteArray * blob;          // Group being compiled
+    GHashTable * strings;       // String to its offset in the group
+    GHashTable * slots;         // Path to its filehandle slot, plus one
+};
+
+// Append to a blob at the next 8 byte boundary, so that whatever is appended can be used in place
+uint32_t plan_append(GByteArray * blob, const void * data, size_t len);
+uint32_t plan_append(GByteArray * blob, const void * data, size_t len) {
+    static const uint8_t padding[8];
+    if(blob->len % 8 != 0) {
+        g_byte_array_append(blob, padding, 8 - blob->len % 8);
+    }
+    uint32_t offset = blob->len;
+    g_byte_array_append(blob, data, len);
+    return offset;
+}
+
+uint32_t plan_intern(struct plan_builder * builder, const char * s);
+uint32_t plan_intern(struct plan_builder * builder, const char * s) {
+    if(s == NULL) return 0;
+    gpointer offset = g_hash_table_lookup(builder->strings, s);
+    if(offset == NULL) {
+        offset = GUINT_TO_POINTER(plan_append(builder->blob, s, strlen(s) + 1));
+        g_hash_table_insert(builder->strings, strdup(s), offset);
+    }
+    return GPOINTER_TO_UINT(offset);
 }
 
+int plan_slot(struct plan_builder * builder, const char * path);
+int plan_slot(struct plan_builder * builder, const char * path) {
+    if(path == NULL) return -1;
+    gpointer slot = g_hash_table_lookup(builder->slots, path);
+    if(slot == NULL) {
+        slot = GUINT_TO_POINTER(g_hash_table_size(builder->slots) + 1);
+        g_hash_table_insert(builder->slots, strdup(path), slot);
+    }
+    return GPOINTER_TO_UINT(slot) - 1;
+}
+
+// Decode everything a call needs from its JSON, leaving replay nothing to do but make the call
+void compile_call(struct plan_builder * builder, cJSON * call_obj, struct ts_plan_call * call);
+void compile_call(struct plan_builder * builder, cJSON * call_obj, struct ts_plan_call * call) {
+    const char * func_name = json_string(call_obj, "name");
+    cJSON * params = json_item(call_obj, "params");
+    const char * path = json_string(params, "path");
+
+    memset(call, 0, sizeof(*call));
+    call->op = func_name != NULL ? ts_op_from_name(func_name) : TS_OP_UNKNOWN;
+    call->func = plan_intern(builder, func_name != NULL ? func_name : "");
+    call->path = plan_intern(builder, path);
+    call->slot = plan_slot(builder, path);
+
+    // The logger may have compacted identical back-to-back calls into one, so each is replayed
+    int64_t repeat = json_int(call_obj, "repeat");
+    call->repeat = repeat > 1 ? repeat : 1;
+
+    if(params != NULL) {
+        char * params_json = cJSON_PrintUnformatted(params);
+        call->params = plan_append(builder->blob, params_json, strlen(params_json) + 1);
+        free(params_json);
+    }
+    json_to_fi(json_item(params, "fi"), &call->fi);
+
+    union {
+        struct stat stat;
+        struct utimbuf utimbuf;
+        struct statvfs statvfs;
+        struct fuse_conn_info conn;
+        struct flock flock;
+        struct timespec tv[2];
+#ifdef __APPLE__
+        struct setattr_x setattr_x;
+#endif
+    } data;
+    memset(&data, 0, sizeof(data));
+
+    switch(call->op) {
+    case TS_OP_GETATTR:
+    case TS_OP_FGETATTR:
+        json_to_stat(json_item(params, "stat"), &data.stat);
+        call->data = plan_append(builder->blob, &data.stat, sizeof(data.stat));
+        break;
+    case TS_OP_READLINK:
+    case TS_OP_LISTXATTR:
+    case TS_OP_READ_BUF:
+        call->args[0] = json_int(params, "size");
+        call->args[1] = json_int(params, "off");
+        break;
+    case TS_OP_MKNOD:
+        call->args[0] = json_int(params, "mode");
+        call->args[1] = json_int(params, "dev");
+        break;
+    case TS_OP_MKDIR:
+    case TS_OP_CHMOD:
+    case TS_OP_CREATE:
+        call->args[0] = json_int(params, "mode");
+        break;
+    case TS_OP_SYMLINK:
+        call->path2 = plan_intern(builder, json_string(params, "link"));
+        break;
+    case TS_OP_RENAME:
+    case TS_OP_LINK:
+        call->path2 = plan_intern(builder, json_string(params, "newpath"));
+        break;
+    case TS_OP_CHOWN:
+        call->args[0] = json_int(params, "uid");
+        call->args[1] = json_int(params, "gid");
+        break;
+    case TS_OP_TRUNCATE:
+        call->args[0] = json_int(params, "newsize");
+        break;
+    case TS_OP_UTIME:
+        json_to_utimbuf(json_item(params, "ubuf"), &data.utimbuf);
+        call->data = plan_append(builder->blob, &data.utimbuf, sizeof(data.utimbuf));
+        break;
+    case TS_OP_READ:
+    case TS_OP_GETXATTR:
+        call->str = plan_intern(builder, json_string(params, "name"));
+        call->args[0] = json_int(params, "size");
+        call->args[1] = json_int(params, "offset");
+        call->args[2] = json_int(params, "position");
+        break;
+    case TS_OP_WRITE:
+        call->str = plan_intern(builder, json_string(params, "buf"));
+        call->args[0] = json_int(params, "size");
+        call->args[1] = json_int(params, "offset");
+        break;
+    case TS_OP_STATFS:
+        json_to_statvfs(json_item(params, "statvfs"), &data.statvfs);
+        call->data = plan_append(builder->blob, &data.statvfs, sizeof(data.statvfs));
+        break;
+    case TS_OP_FSYNC:
+    case TS_OP_FSYNCDIR:
+        call->args[0] = json_int(params, "datasync");
+        break;
+    case TS_OP_SETXATTR:
+        call->str = plan_intern(builder, json_string(params, "name"));
+        call->str2 = plan_intern(builder, json_string(params, "value"));
+        call->args[0] = json_int(params, "size");
+        call->args[1] = json_int(params, "flags");
+        call->args[2] = json_int(params, "position");
+        break;
+    case TS_OP_REMOVEXATTR:
+        call->str = plan_intern(builder, json_string(params, "name"));
+        break;
+    case TS_OP_READDIR:
+    case TS_OP_FTRUNCATE:
+        call->args[0] = json_int(params, "offset");
+        break;
+    case TS_OP_INIT:
+        json_to_fuse_conn_info(json_item(params, "conn"), &data.conn);
+        call->data = plan_append(builder->blob, &data.conn, sizeof(data.conn));
+        break;
+    case TS_OP_ACCESS:
+        call->args[0] = json_int(params, "mask");
+        break;
+    case TS_OP_LOCK:
+        call->args[0] = json_int(params, "cmd");
+        json_to_flock(json_item(params, "flock"), &data.flock);
+        call->data = plan_append(builder->blob, &data.flock, sizeof(data.flock));
+        break;
+    case TS_OP_UTIMENS: {
+        cJSON * tv = json_item(params, "tv");
+        cJSON * tv_obj = tv != NULL ? tv->child : NULL;
+        int i;
+        for(i = 0; i < 2 && tv_obj != NULL; i++, tv_obj = tv_obj->next) {
+            data.tv[i] = json_to_timespec(tv_obj);
+        }
+        call->data = plan_append(builder->blob, data.tv, sizeof(data.tv));
+        break;
+    }
+    case TS_OP_BMAP:
+        call->args[0] = json_int(params, "blocksize");
+        break;
+    case TS_OP_IOCTL:
+        call->args[0] = json_int(params, "cmd");
+        call->args[1] = json_int(params, "flags");
+        break;
+    case TS_OP_POLL:
+        call->args[0] = json_int(params, "reventsp");
+        break;
+    case TS_OP_WRITE_BUF: {
+        // Buffers are described by their size, flags and position, with memory and fds given at replay
+        cJSON * buf_obj = json_item(params, "buf");
+        cJSON * bufs = json_item(buf_obj, "buf");
+        call->args[0] = json_int(params, "off");
+        call->args[1] = json_int(buf_obj, "count");
+        call->args[2] = json_int(buf_obj, "idx");
+        call->args[3] = json_int(buf_obj, "off");
+        int64_t bufs_data[3 * json_array_size(bufs) + 1];
+        bufs_data[0] = json_array_size(bufs);
+        cJSON * buf = bufs != NULL ? bufs->child : NULL;
+        int i;
+        for(i = 0; buf != NULL; i++, buf = buf->next) {
+            const char * flags = json_string(buf, "flags");
+            bufs_data[3 * i + 1] = json_int(buf, "size");
+            bufs_data[3 * i + 2] = flags == NULL ? 0 :
+                                   strcmp(flags, "FUSE_BUF_IS_FD") == 0 ? 1 :
+                                   strcmp(flags, "FUSE_BUF_FD_SEEK") == 0 ? 2 :
+                                   strcmp(flags, "FUSE_BUF_FD_RETRY") == 0 ? 3 : 0;
+            bufs_data[3 * i + 3] = json_int(buf, "pos");
+        }
+        call->data = plan_append(builder->blob, bufs_data, sizeof(bufs_data));
+        break;
+    }
+    case TS_OP_FLOCK:
+        call->args[0] = json_int(params, "op");
+        break;
+    case TS_OP_FALLOCATE:
+        call->args[0] = json_int(params, "mode");
+        call->args[1] = json_int(params, "offset");
+        call->args[2] = json_int(params, "len");
+        break;
+    case TS_OP_SETVOLNAME:
+        call->str = plan_intern(builder, json_string(params, "volname"));
+        break;
+    case TS_OP_EXCHANGE:
+        call->path = plan_intern(builder, json_string(params, "path1"));
+        call->slot = plan_slot(builder, json_string(params, "path1"));
+        call->path2 = plan_intern(builder, json_string(params, "path2"));
+        call->args[0] = json_int(params, "options");
+        break;
+    case TS_OP_GETXTIMES:
+        data.tv[0] = json_to_timespec(json_item(params, "bkuptime"));
+        data.tv[1] = json_to_timespec(json_item(params, "crtime"));
+        call->data = plan_append(builder->blob, data.tv, sizeof(data.tv));
+        break;
+    case TS_OP_SETBKUPTIME:
+    case TS_OP_SETCHGTIME:
+    case TS_OP_SETCRTIME:
+        data.tv[0] = json_to_timespec(json_item(params, "tv"));
+        call->data = plan_append(builder->blob, data.tv, sizeof(data.tv[0]));
+        break;
+    case TS_OP_CHFLAGS:
+        call->args[0] = json_int(params, "flags");
+        break;
+#ifdef __APPLE__
+    case TS_OP_SETATTR_X:
+    case TS_OP_FSETATTR_X:
+        json_to_setattr_x(json_item(params, "attr"), &data.setattr_x);
+        call->data = plan_append(builder->blob, &data.setattr_x, sizeof(data.setattr_x));
+        break;
+#endif
+    default:
+        break;
+    }
+}
 
+// Compile a group of sequences into a blob that can be run from where it's stored
+GByteArray * compile_group(cJSON * group_obj);
+GByteArray * compile_group(cJSON * group_obj) {
+    struct plan_builder builder;
+    builder.blob = g_byte_array_new();
+    builder.strings = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    builder.slots = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+
+    struct ts_plan_group group;
+    memset(&group, 0, sizeof(group));
+    plan_append(builder.blob, &group, sizeof(group));
+
+    GArray * sequences = g_array_new(FALSE, TRUE, sizeof(struct ts_plan_sequence));
+    GArray * calls = g_array_new(FALSE, TRUE, sizeof(struct ts_plan_call));
+    cJSON * sequence_obj;
+    for(sequence_obj = group_obj->child; sequence_obj != NULL; sequence_obj = sequence_obj->next) {
+        const char * action = json_string(sequence_obj, "action");
+        const char * application = json_string(sequence_obj, "application");
+        const char * os = json_string(sequence_obj, "os");
+        cJSON * calls_obj = json_item(sequence_obj, "calls");
+
+        g_array_set_size(calls, json_array_size(calls_obj));
+        cJSON * call_obj = calls_obj != NULL ? calls_obj->child : NULL;
+        int j;
+        for(j = 0; call_obj != NULL; j++, call_obj = call_obj->next) {
+            compile_call(&builder, call_obj, &g_array_index(calls, struct ts_plan_call, j));
+        }
+
+        struct ts_plan_sequence sequence;
+        memset(&sequence, 0, sizeof(sequence));
+        sequence.action = plan_intern(&builder, action != NULL ? action : "");
+        sequence.application = plan_intern(&builder, application != NULL ? application : "");
+        sequence.os = plan_intern(&builder, os != NULL ? os : "");
+        sequence.num_calls = calls->len;
+        sequence.calls = plan_append(builder.blob, calls->data, calls->len * sizeof(struct ts_plan_call));
+        g_array_append_val(sequences, sequence);
+    }
+
+    group.num_slots = g_hash_table_size(builder.slots);
+    group.num_sequences = sequences->len;
+    group.sequences = plan_append(builder.blob, sequences->data, sequences->len * sizeof(struct ts_plan_sequence));
+    plan_append(builder.blob, NULL, 0);
+    group.size = builder.blob->len;
+    memcpy(builder.blob->data, &group, sizeof(group));
+
+    g_array_free(calls, TRUE);
+    g_array_free(sequences, TRUE);
+    g_hash_table_destroy(builder.strings);
+    g_hash_table_destroy(builder.slots);
+    return builder.blob;
+}
+
+const struct ts_plan_group * plan_first_group(const struct ts_plan * plan);
+const struct ts_plan_group * plan_first_group(const struct ts_plan * plan) {
+    return (const struct ts_plan_group *) (plan->base + sizeof(struct ts_plan_header));
+}
+
+const struct ts_plan_group * plan_next_group(const struct ts_plan_group * group);
+const struct ts_plan_group * plan_next_group(const struct ts_plan_group * group) {
+    return (const struct ts_plan_group *) ((const char *) group + group->size);
+}
+
+void free_plan(struct ts_plan * plan);
+void free_plan(struct ts_plan * plan) {
+    if(plan->mapped) {
+        munmap(plan->base, plan->size);
+    } else {
+        free(plan->base);
+    }
+    free(plan);
+}
+
+/* Caching compiled plans */
+
+// Plans live in $XDG_CACHE_HOME/fdt or ~/.cache/fdt, named after the hash of their test data
+bool plan_cache_path(uint64_t hash, char * buf, size_t len);
+bool plan_cache_path(uint64_t hash, char * buf, size_t len) {
+    char dir[PATH_MAX];
+    const char * cache_home = getenv("XDG_CACHE_HOME");
+    const char * home = getenv("HOME");
+    if(cache_home != NULL && cache_home[0] != '\0') {
+        snprintf(dir, sizeof(dir), "%s", cache_home);
+    } else if(home != NULL && home[0] != '\0') {
+        snprintf(dir, sizeof(dir), "%s/.cache", home);
+    } else {
+        return false;
+    }
+    mkdir(dir, 0700);
+    strncat(dir, "/fdt", sizeof(dir) - strlen(dir) - 1);
+    if(mkdir(dir, 0700) != 0 && errno != EEXIST) {
+        return false;
+    }
+    snprintf(buf, len, "%s/plan-%016llx", dir, (unsigned long long) hash);
+    return true;
+}
 
+/* Checking cached plans
+ * A plan is used where it's mapped, so a truncated or corrupt one has to be caught before anything is read from it
+ */
 
+// Whether len bytes from offset are inside a group, at an 8 byte boundary as plan_append puts them
+bool plan_range_valid(const struct ts_plan_group * group, uint32_t offset, uint64_t len);
+bool plan_range_valid(const struct ts_plan_group * group, uint32_t offset, uint64_t len) {
+    return offset % 8 == 0 && offset >= sizeof(*group) && offset <= group->size && len <= group->size - offset;
+}
 
+// Whether a string offset is 0 or a string that ends inside the group
+bool plan_string_valid(const struct ts_plan_group * group, uint32_t offset);
+bool plan_string_valid(const struct ts_plan_group * group, uint32_t offset) {
+    if(offset == 0) return true;
+    if(offset < sizeof(*group) || offset >= group->size) return false;
+    return memchr((const char *) group + offset, '\0', group->size - offset) != NULL;
+}
 
+// Size of the struct argument compile_call gives an operation, or 0 if it has none
+size_t plan_data_size(int op);
+size_t plan_data_size(int op) {
+    switch(op) {
+    case TS_OP_GETATTR:
+    case TS_OP_FGETATTR:
+        return sizeof(struct stat);
+    case TS_OP_UTIME:
+        return sizeof(struct utimbuf);
+    case TS_OP_STATFS:
+        return sizeof(struct statvfs);
+    case TS_OP_INIT:
+        return sizeof(struct fuse_conn_info);
+    case TS_OP_LOCK:
+        return sizeof(struct flock);
+    case TS_OP_UTIMENS:
+    case TS_OP_GETXTIMES:
+        return 2 * sizeof(struct timespec);
+    case TS_OP_SETBKUPTIME:
+    case TS_OP_SETCHGTIME:
+    case TS_OP_SETCRTIME:
+        return sizeof(struct timespec);
+    case TS_OP_WRITE_BUF:
+        return sizeof(int64_t);     // The number of buffers, which says how much follows
+#ifdef __APPLE__
+    case TS_OP_SETATTR_X:
+    case TS_OP_FSETATTR_X:
+        return sizeof(struct setattr_x);
+#endif
+    default:
+        return 0;
+    }
+}
 
+bool plan_call_valid(const struct ts_plan_group * group, const struct ts_plan_call * call);
+bool plan_call_valid(const struct ts_plan_group * group, const struct ts_plan_call * call) {
+    if(call->op > TS_OP_UNKNOWN || call->slot < -1 || call->slot >= (int64_t) group->num_slots) return false;
+    if(!plan_string_valid(group, call->func) || !plan_string_valid(group, call->path) ||
+       !plan_string_valid(group, call->path2) || !plan_string_valid(group, call->str) ||
+       !plan_string_valid(group, call->str2) || !plan_string_valid(group, call->params)) {
+        return false;
+    }
 
+    size_t data_size = plan_data_size(call->op);
+    if(data_size == 0) return true;
+    if(!plan_range_valid(group, call->data, data_size)) return false;
+    if(call->op == TS_OP_WRITE_BUF) {
+        // Each buffer is its size, flags and position
+        const int64_t * bufs_data = plan_data(group, call->data);
+        if(bufs_data[0] < 0 || bufs_data[0] > group->size) return false;
+        if(!plan_range_valid(group, call->data, (3 * (uint64_t) bufs_data[0] + 1) * sizeof(int64_t))) return false;
+        int64_t i;
+        for(i = 0; i < bufs_data[0]; i++) {
+            if(bufs_data[3 * i + 2] < 0 || bufs_data[3 * i + 2] > 3) return false;
+        }
+    }
+    return true;
+}
 
+// Whether a group and everything it refers to lies within the avail bytes from its start
+bool plan_group_valid(const struct ts_plan_group * group, size_t avail);
+bool plan_group_valid(const struct ts_plan_group * group, size_t avail) {
+    if(avail < sizeof(*group) || group->size < sizeof(*group) || group->size > avail || group->size % 8 != 0) {
+        return false;
+    }
+    if(!plan_range_valid(group, group->sequences, (uint64_t) group->num_sequences * sizeof(struct ts_plan_sequence))) {
+        return false;
+    }
+    const struct ts_plan_sequence * sequences = plan_data(group, group->sequences);
+    uint32_t i, j;
+    for(i = 0; i < group->num_sequences; i++) {
+        const struct ts_plan_sequence * sequence = &sequences[i];
+        if(!plan_string_valid(group, sequence->action) || !plan_string_valid(group, sequence->application) ||
+           !plan_string_valid(group, sequence->os) ||
+           !plan_range_valid(group, sequence->calls, (uint64_t) sequence->num_calls * sizeof(struct ts_plan_call))) {
+            return false;
+        }
+        const struct ts_plan_call * calls = plan_data(group, sequence->calls);
+        for(j = 0; j < sequence->num_calls; j++) {
+            if(!plan_call_valid(group, &calls[j])) return false;
+        }
+    }
+    return true;
+}
 
+// Whether the groups of a mapped plan exactly fill it, and each is valid
+bool plan_valid(const char * base, size_t size);
+bool plan_valid(const char * base, size_t size) {
+    const struct ts_plan_header * header = (const struct ts_plan_header *) base;
+    size_t pos = sizeof(*header);
+    uint32_t i;
+    for(i = 0; i < header->num_groups; i++) {
+        const struct ts_plan_group * group = (const struct ts_plan_group *) (base + pos);
+        if(!plan_group_valid(group, size - pos)) return false;
+        pos += group->size;
+    }
+    return pos == size;
+}
 
+struct ts_plan * load_cached_plan(uint64_t hash);
+struct ts_plan * load_cached_plan(uint64_t hash) {
+    char path[PATH_MAX];
+    if(!plan_cache_path(hash, path, sizeof(path))) return NULL;
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) return NULL;
+
+    struct stat s;
+    void * base = MAP_FAILED;
+    if(fstat(fd, &s) == 0 && s.st_size >= sizeof(struct ts_plan_header)) {
+        base = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if(base == MAP_FAILED) return NULL;
+
+    // A plan written by another version of the test suite, or for other test data, is compiled again
+    const struct ts_plan_header * header = base;
+    if(header->magic != TS_PLAN_MAGIC || header->version != TS_PLAN_VERSION || header->hash != hash ||
+       header->call_size != sizeof(struct ts_plan_call) || header->stat_size != sizeof(struct stat)) {
+        munmap(base, s.st_size);
+        return NULL;
+    }
 
+    // As is one that's been cut short or doesn't hang together
+    if(!plan_valid(base, s.st_size)) {
+        fprintf(stderr, "Cached test plan %s is damaged, so the test data will be compiled again\n", path);
+        munmap(base, s.st_size);
+        return NULL;
+    }
 
+    struct ts_plan * plan = malloc(sizeof(*plan));
+    plan->base = base;
+    plan->size = s.st_size;
+    plan->mapped = true;
+    plan->header = header;
+    return plan;
+}
 
+// Plans are written to the cache a group at a time, as they're compiled, under a temporary name until they're
+// complete so that a partly written plan is never loaded
+struct plan_writer {
+    FILE * file;
+    char path[PATH_MAX];
+    char tmp_path[PATH_MAX + 32];
+    struct ts_plan_header header;
+};
 
+void plan_writer_open(struct plan_writer * writer, uint64_t hash);
+void plan_writer_open(struct plan_writer * writer, uint64_t hash) {
+    memset(&writer->header, 0, sizeof(writer->header));
+    writer->header.magic = TS_PLAN_MAGIC;
+    writer->header.version = TS_PLAN_VERSION;
+    writer->header.hash = hash;
+    writer->header.call_size = sizeof(struct ts_plan_call);
+    writer->header.stat_size = sizeof(struct stat);
+
+    writer->file = NULL;
+    if(!plan_cache_path(hash, writer->path, sizeof(writer->path))) return;
+    snprintf(writer->tmp_path, sizeof(writer->tmp_path), "%s.%d", writer->path, (int) getpid());
+    writer->file = fopen(writer->tmp_path, "w");
+
+    // The header is written again once the number of groups is known
+    if(writer->file != NULL && fwrite(&writer->header, sizeof(writer->header), 1, writer->file) != 1) {
+        fclose(writer->file);
+        unlink(writer->tmp_path);
+        writer->file = NULL;
+    }
+}
 
+// Groups are a multiple of 8 bytes long, so each one written straight after the last stays aligned
+void plan_writer_add(struct plan_writer * writer, const GByteArray * group);
+void plan_writer_add(struct plan_writer * writer, const GByteArray * group) {
+    writer->header.num_groups++;
+    if(writer->file == NULL) return;
+    if(fwrite(group->data, 1, group->len, writer->file) != group->len) {
+        fclose(writer->file);
+        unlink(writer->tmp_path);
+        writer->file = NULL;
+    }
+}
 
+// Put the plan in the cache if every group made it into it, otherwise throw it away
+void plan_writer_close(struct plan_writer * writer, bool complete);
+void plan_writer_close(struct plan_writer * writer, bool complete) {
+    if(writer->file == NULL) return;
+    bool written = complete && fseek(writer->file, 0, SEEK_SET) == 0 &&
+                   fwrite(&writer->header, sizeof(writer->header), 1, writer->file) == 1;
+    if(fclose(writer->file) == 0 && written) {
+        rename(writer->tmp_path, writer->path);
+    } else {
+        unlink(writer->tmp_path);
+    }
+    writer->file = NULL;
+}
 
 /* Open the FIFO for communicating events */
 void testsuite_fifo_init(void);
 void testsuite_fifo_init(void) {
     if(testsuite_fifo == NULL) {
+        fdt_channel_name(getenv(FDT_SESSION_ENV), FDT_CHANNEL_TESTSUITE, testsuite_fifo_name, sizeof(testsuite_fifo_name));
         testsuite_fifo = fopen(testsuite_fifo_name, "w");
     }
 }
@@ -412,12 +1337,12 @@ void ts_test_fail(const char * func_name, cJSON * params, const char * message,
 }
 
 /* Starting a group of sequences */
-void testsuite_grp_start(cJSON * group);
-void testsuite_grp_start(cJSON * group)
+void testsuite_grp_start(int num_sequences);
+void testsuite_grp_start(int num_sequences)
 {
     cJSON * event = cJSON_CreateObject();
     cJSON_AddStringToObject(event, "func_name", "__GROUP_START");
-    cJSON_AddNumberToObject(event, "num_sequences", cJSON_GetArraySize(group));
+    cJSON_AddNumberToObject(event, "num_sequences", num_sequences);
     report_testsuite_event_obj(event);
 }
 
@@ -432,15 +1357,15 @@ void testsuite_grp_end(bool passed)
 }
 
 /* Starting a sequence of calls */
-void testsuite_seq_start(cJSON * sequence);
-void testsuite_seq_start(cJSON * sequence)
+void testsuite_seq_start(const struct ts_plan_group * group, const struct ts_plan_sequence * sequence);
+void testsuite_seq_start(const struct ts_plan_group * group, const struct ts_plan_sequence * sequence)
 {
     cJSON * event = cJSON_CreateObject();
     cJSON_AddStringToObject(event, "func_name", "__SEQUENCE_START");
-    cJSON_AddStringToObject(event, "action", cJSON_GetObjectItem(sequence, "action")->valuestring);
-    cJSON_AddStringToObject(event, "application", cJSON_GetObjectItem(sequence, "application")->valuestring);
-    cJSON_AddStringToObject(event, "os", cJSON_GetObjectItem(sequence, "os")->valuestring);
-    cJSON_AddNumberToObject(event, "num_calls", cJSON_GetArraySize(cJSON_GetObjectItem(sequence, "calls")));
+    cJSON_AddStringToObject(event, "action", plan_string(group, sequence->action));
+    cJSON_AddStringToObject(event, "application", plan_string(group, sequence->application));
+    cJSON_AddStringToObject(event, "os", plan_string(group, sequence->os));
+    cJSON_AddNumberToObject(event, "num_calls", sequence->num_calls);
     report_testsuite_event_obj(event);
 }
 
@@ -487,971 +1412,1233 @@ void testsuite_fifo_destroy(void)
 
 
 
-struct filler_data {
-    char ** files;
-    off_t num_files;
-    size_t capacity;
+/* File contents are compared by digest
+ *
+ * Files are streamed through the same hash as test data, a chunk at a time. Digests are cached per
+ * path and kept while the file's inode, size, modification time (to the nanosecond) and status change time stay
+ * the same, and until a call touches the path. Each directory also gets a summary of everything beneath it,
+ * rolled up from those digests, so the per-call checks can skip a subtree whose summaries are still cached, and
+ * equal, on both filesystems. The check at the end of each sequence walks everything regardless.
+ */
+
+#define TS_DIGEST_CHUNK (1 << 20)   // How much of a file is read at a time
+
+struct ts_digest {
+    uint64_t hash;
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+    long mtime_nsec;
+    time_t ctime;               // As a write through another path or filehandle can land within the same mtime
 };
 
-// Callback invoked during the readdir call in reset_directory_fuse
-int testsuite_filler(void * buf, const char * name, const struct stat * stbuf, off_t off);
-int testsuite_filler(void * buf, const char * name, const struct stat * stbuf, off_t off) {
-    (void) stbuf;
-    (void) off;
+struct ts_digests {
+    GHashTable * files;         // Path to the struct ts_digest of its contents
+    GHashTable * dirs;          // Path to the uint64_t summary of everything beneath it
+};
 
-    struct filler_data * fdata = (struct filler_data *) buf;
+// What a directory's summary is made of, for each filesystem
+struct ts_summary {
+    uint64_t passthru;
+    uint64_t real;
+    bool cacheable;             // False if something beneath could change without a call touching its path
+};
 
-    // Double array capacity if we're about to overflow it
-    if(fdata->num_files + 1 >= fdata->capacity) {
-        fdata->capacity *= 2;
-        fdata->files = realloc(fdata->files, fdata->capacity * sizeof(fdata->files));
-    }
+static struct ts_digests digests_passthru;
+static struct ts_digests digests_real;
 
-    // Append the filename to the array
-    fdata->files[fdata->num_files] = malloc(strlen(name) + 1);
-    strcpy(fdata->files[fdata->num_files], name);
-    fdata->num_files++;
-    
-    return 0;
+void ts_digests_init(void);
+void ts_digests_init(void) {
+    digests_passthru.files = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+    digests_passthru.dirs = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+    digests_real.files = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+    digests_real.dirs = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
 }
 
+void ts_digests_free(void);
+void ts_digests_free(void) {
+    g_hash_table_destroy(digests_passthru.files);
+    g_hash_table_destroy(digests_passthru.dirs);
+    g_hash_table_destroy(digests_real.files);
+    g_hash_table_destroy(digests_real.dirs);
+}
 
-// Reset an entire FUSE filesystem by recursively deleting every file and directory
-// This requires opendir, readdir, releasedir, unlink and rmdir to be defined and implemented correctly
-void reset_filesystem_path(const struct fuse_operations * op, const char * path);
-void reset_filesystem_path(const struct fuse_operations * op, const char * path) {
-    //printf("Entering directory '%s'\n", path);
-
-    // Open directory
-    struct fuse_file_info * fi = malloc(sizeof(*fi));
-    empty_fi(fi);
-    if(op->opendir(path, fi) == 0) {
-
-        // Read in a list of filenames of files/dirs in this dir
-        struct filler_data * fdata = malloc(sizeof(*fdata));
-        fdata->num_files = 0;
-        fdata->capacity = 16; // initial capacity - it will realloc
-        fdata->files = malloc(fdata->capacity * sizeof(fdata->files));
-        op->readdir(path, (void *) fdata, testsuite_filler, 0, fi);
-        op->releasedir(path, fi);
-
-        if(fdata->num_files > 0) {
-            int i;
-            char ** files = fdata->files;
-            for(i = 0; i < fdata->num_files; i++) {
-                char * fname = files[i];
-
-                // Skip pointers to the current and parent directories
-                if(strcmp(fname, ".") == 0 || strcmp(fname, "..") == 0) continue;
-
-                // Construct absolute path (because we just have a filename)
-                size_t path_len = strlen(path) + strlen(fname) + 1;
-                char fpath[path_len + 1];
-                strcpy(fpath, path);
-                if(fpath[strlen(path)-1] != '/') {
-                    // Add a directory separator if we need one
-                    strcat(fpath, "/");
-                }
-                strcat(fpath, fname);
-                free(fname);
-
-                // Delete the file (if it's a file) or recurse into the subdirectory (if it's a directory)
-                struct stat * s = malloc(sizeof(*s));
-                s->st_mode = 0;
-                if(op->getattr(fpath, s) == 0) {
-                    if(S_ISDIR(s->st_mode) != 0) {
-                        reset_filesystem_path(op, fpath);
-                    } else {
-                        printf("Unlinking file '%s'\n", fpath);
-                        if(op->unlink(fpath) < 0) {
-                            ts_test_fail("unlink", NULL, "Call failed on path %s. Error was: %s", fpath, strerror(errno));
-                        }
-                    }
-                } else {
-                    ts_test_fail("getattr", NULL, "Call failed on path %s. Error was: %s", fpath, strerror(errno));
-                }
-                free(s);
-            }
-        } else {
-            ts_test_fail("readdir", NULL, "Directory %s is empty", path);
-        }
-        free(fdata->files);
-        free(fdata);
-    } else {
-        ts_test_fail("opendir", NULL, "Call failed on %s. Error was: %s", path, strerror(errno));
-    }
-    free(fi);
-
-    // Delete empty directory, but not the mountpoint!
-    if(strcmp(path, "/") != 0) {
-        printf("Removing directory '%s'\n", path);
-        int retval = op->rmdir(path);
-        if(retval < 0) {
-            ts_test_fail("rmdir", NULL, "Call failed on %s. Error was: %s", path, strerror(errno));
-        }
-    }
+struct ts_digests * ts_digests_for(const struct fuse_operations * op);
+struct ts_digests * ts_digests_for(const struct fuse_operations * op) {
+    return op == passthru_ops ? &digests_passthru : &digests_real;
 }
 
-// Convenience method for the above
-void reset_filesystem(const struct fuse_operations * op);
-void reset_filesystem(const struct fuse_operations * op) {
-    reset_filesystem_path(op, "/");
+void ts_digests_clear(struct ts_digests * digests);
+void ts_digests_clear(struct ts_digests * digests) {
+    g_hash_table_remove_all(digests->files);
+    g_hash_table_remove_all(digests->dirs);
 }
 
-bool timesRoughlyEqual(time_t t1, time_t t2);
-bool timesRoughlyEqual(time_t t1, time_t t2) {
-    time_t window = 5;
-    if(t2 >= t1 - window && t2 <= t1 + window) return true;
-    else return false;
+// Forget every directory summary, so the next walk lists everything again. File digests are kept, as they're
+// checked against each file's attributes before they're used
+void ts_digests_clear_dirs(void);
+void ts_digests_clear_dirs(void) {
+    g_hash_table_remove_all(digests_passthru.dirs);
+    g_hash_table_remove_all(digests_real.dirs);
 }
 
-// Check whether the states both filesystems are equivalent
-bool assert_equivalent_path(const struct fuse_operations * passthru, const struct fuse_operations * real, const char * path);
-bool assert_equivalent_path(const struct fuse_operations * passthru, const struct fuse_operations * real, const char * path) {
-    
-    bool equivalent = true;
+// Forget what's known about a path after a call on it. Calls that only read leave its contents alone, but still
+// mean its attributes (e.g. access time) must be looked at again, so the summaries above it are dropped either way
+void ts_digests_touch(const char * path, bool contents);
+void ts_digests_touch(const char * path, bool contents) {
+    if(path == NULL || path[0] != '/') return;
+    if(contents) {
+        g_hash_table_remove(digests_passthru.files, path);
+        g_hash_table_remove(digests_real.files, path);
+    }
 
-    // Open directory
-    struct fuse_file_info * fi = malloc(sizeof(*fi));
-    empty_fi(fi);
-    if(passthru->opendir(path, fi) == 0) {
-
-        // Read in a list of filenames of files/dirs in this dir
-        struct filler_data * fdata = malloc(sizeof(*fdata));
-        fdata->num_files = 0;
-        fdata->capacity = 16; // initial capacity - it will realloc
-        fdata->files = malloc(fdata->capacity * sizeof(fdata->files));
-        passthru->readdir(path, (void *) fdata, testsuite_filler, 0, fi);
-        passthru->releasedir(path, fi);
-
-        if(fdata->num_files > 0) {
-            int i;
-            char ** files = fdata->files;
-            for(i = 0; i < fdata->num_files; i++) {
-                char * fname = files[i];
-
-                // Skip pointers to the current and parent directories
-                if(strcmp(fname, ".") == 0 || strcmp(fname, "..") == 0) continue;
-
-                // Construct absolute path (because we just have a filename)
-                size_t path_len = strlen(path) + strlen(fname) + 1;
-                char fpath[path_len + 1];
-                strcpy(fpath, path);
-                if(fpath[strlen(path)-1] != '/') {
-                    // Add a directory separator if we need one
-                    strcat(fpath, "/");
-                }
-                strcat(fpath, fname);
-                free(fname);
-
-                // Read the file from the passthru fs
-                struct stat * s_passthru = malloc(sizeof(*s_passthru));
-                s_passthru->st_mode = 0;
-                if(passthru->getattr(fpath, s_passthru) == 0) {
-
-                    // Try reading the file at the same path from the real fs
-                    struct stat * s_real = malloc(sizeof(*s_real));
-                    s_real->st_mode = 0;
-                    
-                    // Create a JSON object containing the params, so we can pass it back to the test suite
-                    cJSON * params = cJSON_CreateObject();
-                    cJSON_AddStringToObject(params, "path", fpath);
-                    cJSON_AddItemToObject(params, "stat", stat_to_json(s_real));
-
-                    if(real->getattr(fpath, s_real) == 0) {
-
-                        // Make sure file properties match up
-                        if(S_ISBLK(s_passthru->st_mode) && !S_ISBLK(s_real->st_mode)) {
-                            ts_test_fail("getattr", params, "'%s' should be a block special file", fpath);
-                            equivalent = false;
-                        } else if(S_ISCHR(s_passthru->st_mode) && !S_ISCHR(s_real->st_mode)) {
-                            ts_test_fail("getattr", params, "'%s' should be a character special file", fpath);
-                            equivalent = false;
-                        } else if(S_ISDIR(s_passthru->st_mode) && !S_ISDIR(s_real->st_mode)) {
-                            ts_test_fail("getattr", params, "'%s' should be a directory", fpath);
-                            equivalent = false;
-                        } else if(S_ISFIFO(s_passthru->st_mode) && !S_ISFIFO(s_real->st_mode)) {
-                            ts_test_fail("getattr", params, "'%s' should be a pipe or FIFO special file", fpath);
-                            equivalent = false;
-                        } else if(S_ISREG(s_passthru->st_mode) && !S_ISREG(s_real->st_mode)) {
-                            ts_test_fail("getattr", params, "'%s' should be a regular file", fpath);
-                            equivalent = false;
-                        } else if(S_ISLNK(s_passthru->st_mode) && !S_ISLNK(s_real->st_mode)) {
-                            ts_test_fail("getattr", params, "'%s' should be a symbolic link", fpath);
-                            equivalent = false;
-                        } else if(S_ISSOCK(s_passthru->st_mode) && !S_ISSOCK(s_real->st_mode)) {
-                            ts_test_fail("getattr", params, "'%s' should be a socket", fpath);
-                            equivalent = false;
-                        /*} else if(s_passthru->st_nlink != s_real->st_nlink) {
-                            ts_test_fail("getattr", params, "'%s' has %d hard links but should have %d", fpath, s_real->st_nlink, s_passthru->st_nlink);
-                            equivalent = false;*/
-                        /*} else if(s_passthru->st_size != s_real->st_size) {
-                            ts_test_fail("getattr", params, "'%s' has size %d but should be %d", fpath, s_real->st_size, s_passthru->st_size);
-                            equivalent = false;*/
-                        } else if(!timesRoughlyEqual(s_passthru->st_atime, s_real->st_atime)) {
-                            ts_test_fail("getattr", params, "'%s' has last access time of %lld but should be %lld", fpath, (long long) s_real->st_atime, (long long) s_passthru->st_atime);
-                            equivalent = false;
-                        } else if(!timesRoughlyEqual(s_passthru->st_mtime, s_real->st_mtime)) {
-                            ts_test_fail("getattr", params, "'%s' has last modification time of %lld but should be %lld", fpath, (long long) s_real->st_mtime, (long long) s_passthru->st_mtime);
-                            equivalent = false;
-                        } else if(!timesRoughlyEqual(s_passthru->st_ctime, s_real->st_ctime)) {
-                            ts_test_fail("getattr", params, "'%s' has last status change time of %lld but should be %lld", fpath, (long long) s_real->st_ctime, (long long) s_passthru->st_ctime);
-                            equivalent = false;
-                        }
-
-                        // If there are no errors so far and the file is actually a directory then recurse into it
-                        if(equivalent && S_ISDIR(s_passthru->st_mode) != 0) {
-                            equivalent = assert_equivalent_path(passthru, real, fpath) == false ? false : equivalent;
-                        }
-                    } else {
-                        ts_test_fail("getattr", params, "'%s' should exist but getattr failed", fpath);
-                        equivalent = false;
-                    }
-                    free(s_real);
-                    cJSON_Delete(params);
-                } else {
-                    fprintf(stderr, "Getattr failed on '%s'\n", fpath);
-                    equivalent = false;
-                }
-                free(s_passthru);
-            }
-        } else {
-            fprintf(stderr, "  Directory '%s' is empty\n", path);
-            equivalent = false;
-        }
-        free(fdata->files);
-        free(fdata);
-    } else {
-        fprintf(stderr, "  Error calling opendir on '%s'\n", path);
-        equivalent = false;
+    char dir[PATH_MAX];
+    strncpy(dir, path, sizeof(dir) - 1);
+    dir[sizeof(dir) - 1] = '\0';
+    while(true) {
+        g_hash_table_remove(digests_passthru.dirs, dir);
+        g_hash_table_remove(digests_real.dirs, dir);
+        if(strcmp(dir, "/") == 0) break;
+        char * slash = strrchr(dir, '/');
+        if(slash == dir) slash[1] = '\0';
+        else *slash = '\0';
     }
-    free(fi);
-    return equivalent;
 }
 
-// Convenience method for the above
-bool assert_equivalent(const struct fuse_operations * passthru, const struct fuse_operations * real);
-bool assert_equivalent(const struct fuse_operations * passthru, const struct fuse_operations * real) {
-    return assert_equivalent_path(passthru, real, "/");
+// Forget what a replayed call could have changed
+void ts_digests_touch_call(const struct ts_plan_group * group, const struct ts_plan_call * call);
+void ts_digests_touch_call(const struct ts_plan_group * group, const struct ts_plan_call * call) {
+    unsigned effects = ts_op_effects(call->op);
+    if(effects & (TS_EFFECT_SUBTREE | TS_EFFECT_ALL)) {
+        // Moving a directory changes the path of everything in it
+        ts_digests_clear(&digests_passthru);
+        ts_digests_clear(&digests_real);
+        return;
+    }
+    ts_digests_touch(plan_string(group, call->path), effects != 0);
+    ts_digests_touch(plan_string(group, call->path2), effects != 0);
 }
 
-// FUSE normally provides this method in a call to readdir, so must be implemented here instead 
-int readdir_filler(void * buf, const char * name, const struct stat * stbuf, off_t off);
-int readdir_filler(void * buf, const char * name, const struct stat * stbuf, off_t off) {
-    (void) buf;
-    (void) name;
-    (void) stbuf;
+// Digest the contents of a regular file, reading it through the filesystem's own calls
+// Returns 0 on success, otherwise what the failing call returned (-ENOSYS if the filesystem can't read)
+int file_digest(const struct fuse_operations * op, const char * path, const struct stat * st, uint64_t * digest);
+int file_digest(const struct fuse_operations * op, const char * path, const struct stat * st, uint64_t * digest) {
+    struct ts_digests * digests = ts_digests_for(op);
+    struct ts_digest * cached = g_hash_table_lookup(digests->files, path);
+    if(cached != NULL && cached->ino == st->st_ino && cached->size == st->st_size && cached->mtime == st->st_mtime &&
+            cached->mtime_nsec == ST_MTIM_NSEC(st) && cached->ctime == st->st_ctime) {
+        *digest = cached->hash;
+        return 0;
+    }
+    if(op->read == NULL) return -ENOSYS;
+
+    static char * buf = NULL;
+    if(buf == NULL) buf = malloc(TS_DIGEST_CHUNK);
+
+    struct fuse_file_info fi;
+    empty_fi(&fi);
+    fi.flags = O_RDONLY;
+    int retval = op->open != NULL ? op->open(path, &fi) : 0;
+    if(retval < 0) return retval;
+
+    struct ts_hash h;
+    ts_hash_init(&h);
+    off_t offset = 0;
+    while((retval = op->read(path, buf, TS_DIGEST_CHUNK, offset, &fi)) > 0) {
+        ts_hash_update(&h, buf, retval);
+        offset += retval;
+    }
+    if(op->release != NULL) op->release(path, &fi);
+    if(retval < 0) return retval;
+
+    *digest = ts_hash_final(&h);
+    cached = malloc(sizeof(*cached));
+    cached->hash = *digest;
+    cached->ino = st->st_ino;
+    cached->size = st->st_size;
+    cached->mtime = st->st_mtime;
+    cached->mtime_nsec = ST_MTIM_NSEC(st);
+    cached->ctime = st->st_ctime;
+    g_hash_table_replace(digests->files, strdup(path), cached);
+    return 0;
+}
+
+
+// A directory as listed by readdir, sorted by name
+struct listing_entry {
+    char * name;
+    struct stat st;
+    bool has_stat;              // The filler was given a complete stat for the entry
+};
+
+struct listing {
+    struct listing_entry * entries;
+    size_t num_entries;
+    size_t capacity;
+};
+
+int listing_filler(void * buf, const char * name, const struct stat * stbuf, off_t off);
+int listing_filler(void * buf, const char * name, const struct stat * stbuf, off_t off) {
     (void) off;
+    struct listing * listing = (struct listing *) buf;
+
+    // Skip pointers to the current and parent directories
+    if(strcmp(name, ".") == 0 || strcmp(name, "..") == 0) return 0;
+
+    if(listing->num_entries == listing->capacity) {
+        listing->capacity = listing->capacity == 0 ? 16 : listing->capacity * 2;
+        listing->entries = realloc(listing->entries, listing->capacity * sizeof(*listing->entries));
+    }
+    struct listing_entry * entry = &listing->entries[listing->num_entries++];
+    entry->name = strdup(name);
+
+    // Many filesystems only fill in the inode and type here, which isn't enough to compare against,
+    // so a stat only counts if it looks like it came from getattr
+    entry->has_stat = stbuf != NULL && stbuf->st_nlink > 0;
+    if(entry->has_stat) entry->st = *stbuf;
     return 0;
 }
 
-// Call a function in the FUSE operations struct, identified by its name as a string
-// Pass the parameters as a JSON object and pass a reference to the map of filenames to filehandles
-int make_call(const struct fuse_operations * op, const char * func_name, cJSON * params, struct fuse_file_info * fi, GHashTable * fhs, bool * func_not_defined);
-int make_call(const struct fuse_operations * op, const char * func_name, cJSON * params, struct fuse_file_info * fi, GHashTable * fhs, bool * func_not_defined) {
-    if(op != NULL) {
-        //printf("   %s call\n", func_name);
-
-        int retval = -1;
-        if(strcmp(func_name, "getattr") == 0)
-        {
-            if(op->getattr != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                struct stat * s = json_to_stat(cJSON_GetObjectItem(params, "stat"));
-                retval = op->getattr(path, s);
-                free(s);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "readlink") == 0)
-        {
-            if(op->readlink != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                size_t size = cJSON_GetObjectItem(params, "size")->valueint;
-                char link[size];
-                retval = op->readlink(path, link, size);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "getdir") == 0)
-        {
-            if(op->getdir != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                retval = op->getdir(path, NULL, NULL);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "mknod") == 0)
-        {
-            if(op->mknod != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                mode_t mode = cJSON_GetObjectItem(params, "mode")->valueint;
-                dev_t dev = cJSON_GetObjectItem(params, "dev")->valueint;
-                retval = op->mknod(path, mode, dev);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "mkdir") == 0)
-        {
-            if(op->mkdir != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                mode_t mode = cJSON_GetObjectItem(params, "mode")->valueint;
-                retval = op->mkdir(path, mode);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "unlink") == 0)
-        {
-            if(op->unlink != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                retval = op->unlink(path);
-                destroy_fh(fhs, path);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "rmdir") == 0)
-        {
-            if(op->rmdir != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                retval = op->rmdir(path);
-                destroy_fh(fhs, path);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "symlink") == 0)
-        {
-            if(op->symlink != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                const char * link = cJSON_GetObjectItem(params, "link")->valuestring;
-                retval = op->symlink(path, link);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "rename") == 0)
-        {
-            if(op->rename != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                const char * newpath = cJSON_GetObjectItem(params, "newpath")->valuestring;
-                retval = op->rename(path, newpath);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "link") == 0)
-        {
-            if(op->link != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                const char * newpath = cJSON_GetObjectItem(params, "newpath")->valuestring;
-                retval = op->link(path, newpath);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "chmod") == 0)
-        {
-            if(op->chmod != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                mode_t mode = cJSON_GetObjectItem(params, "mode")->valueint;
-                retval = op->chmod(path, mode);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "chown") == 0)
-        {
-            if(op->chown != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                uid_t uid = cJSON_GetObjectItem(params, "uid")->valueint;
-                gid_t gid = cJSON_GetObjectItem(params, "gid")->valueint;
-                retval = op->chown(path, uid, gid);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "truncate") == 0)
-        {
-            if(op->truncate != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                off_t newsize = cJSON_GetObjectItem(params, "newsize")->valueint;
-                retval = op->truncate(path, newsize);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "utime") == 0)
-        {
-            if(op->utime != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                struct utimbuf * ubuf = json_to_utimbuf(cJSON_GetObjectItem(params, "ubuf"));
-                retval = op->utime(path, ubuf);
-                free(ubuf);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "open") == 0)
-        {
-            if(op->open != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                update_fi(NULL, NULL, fi, cJSON_GetObjectItem(params, "fi"));
-                retval = op->open(path, fi);
-                store_fh(fhs, path, fi->fh);
-                increment_open(fhs, path);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "read") == 0)
-        {
-            if(op->read != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                size_t size = cJSON_GetObjectItem(params, "size")->valueint;
-                void * buf = malloc(size);
-                off_t offset = cJSON_GetObjectItem(params, "offset")->valueint;
-                update_fi(fhs, path, fi, cJSON_GetObjectItem(params, "fi"));
-                retval = op->read(path, buf, size, offset, fi);
-                free(buf);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "write") == 0)
-        {
-            if(op->write != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                const char * buf = cJSON_GetObjectItem(params, "buf")->valuestring;
-                size_t size = cJSON_GetObjectItem(params, "size")->valueint;
-                off_t offset = cJSON_GetObjectItem(params, "offset")->valueint;
-                update_fi(fhs, path, fi, cJSON_GetObjectItem(params, "fi"));
-                retval = op->write(path, buf, size, offset, fi);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "statfs") == 0)
-        {
-            if(op->statfs != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                struct statvfs * s = json_to_statvfs(cJSON_GetObjectItem(params, "statvfs"));
-                retval = op->statfs(path, s);
-                free(s);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "flush") == 0)
-        {
-            if(op->flush != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                update_fi(fhs, path, fi, cJSON_GetObjectItem(params, "fi"));
-                retval = op->flush(path, fi);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "release") == 0)
-        {
-            if(op->release != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                update_fi(fhs, path, fi, cJSON_GetObjectItem(params, "fi"));
-                retval = op->release(path, fi);
-                //destroy_fh(fhs, path);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "fsync") == 0)
-        {
-            if(op->fsync != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                int datasync = cJSON_GetObjectItem(params, "datasync")->valueint;
-                update_fi(fhs, path, fi, cJSON_GetObjectItem(params, "fi"));
-                retval = op->fsync(path, datasync, fi);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "setxattr") == 0)
-        {
-            if(op->setxattr != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                const char * name = cJSON_GetObjectItem(params, "name")->valuestring;
-                const char * value = cJSON_GetObjectItem(params, "value")->valuestring;
-                size_t size = cJSON_GetObjectItem(params, "size")->valueint;
-                int flags = cJSON_GetObjectItem(params, "flags")->valueint;
-
-                #ifdef __APPLE__
-                    // This function takes a position parameter on Mac but not Linux
-                    // We also wont have position in the test data if it was generated on Linux
-                    cJSON * position_obj = cJSON_GetObjectItem(params, "position");
-                    uint32_t position = 0;
-                    if(position_obj != NULL) {
-                        position = position_obj->valueint;
-                    }
-                    retval = op->setxattr(path, name, value, size, flags, position);
-                #else
-                    retval = op->setxattr(path, name, value, size, flags);
-                #endif
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "getxattr") == 0)
-        {
-            if(op->getxattr != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                const char * name = cJSON_GetObjectItem(params, "name")->valuestring;
-                size_t size = cJSON_GetObjectItem(params, "size")->valueint;
-                char value[size];
-
-                #ifdef __APPLE__
-                    // This function takes a position parameter on Mac but not Linux
-                    // We also wont have position in the test data if it was generated on Linux
-                    cJSON * position_obj = cJSON_GetObjectItem(params, "position");
-                    uint32_t position = 0;
-                    if(position_obj != NULL) {
-                        position = position_obj->valueint;
-                    }
-                    retval = op->getxattr(path, name, value, size, position);
-                #else
-                    retval = op->getxattr(path, name, value, size);
-                #endif
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "listxattr") == 0)
-        {
-            if(op->listxattr != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                size_t size = cJSON_GetObjectItem(params, "size")->valueint;
-                char list[size];
-                retval = op->listxattr(path, list, size);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "removexattr") == 0)
-        {
-            if(op->removexattr != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                const char * name = cJSON_GetObjectItem(params, "name")->valuestring;
-                retval = op->removexattr(path, name);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "opendir") == 0)
-        {
-            if(op->opendir != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                update_fi(NULL, NULL, fi, cJSON_GetObjectItem(params, "fi"));
-                retval = op->opendir(path, fi);
-                store_fh(fhs, path, fi->fh);
-                increment_open(fhs, path);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "readdir") == 0)
-        {
-            if(op->readdir != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                off_t offset = cJSON_GetObjectItem(params, "offset")->valueint;
-                void * buf = NULL; // this buffer is for our filler function, which is empty
-                fuse_fill_dir_t filler = readdir_filler;
-                update_fi(fhs, path, fi, cJSON_GetObjectItem(params, "fi"));
-                retval = op->readdir(path, buf, filler, offset, fi);
-                //free(buf);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "releasedir") == 0)
-        {
-            if(op->releasedir != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                update_fi(fhs, path, fi, cJSON_GetObjectItem(params, "fi"));
-                //retval = op->releasedir(path, fi);
-                //destroy_fh(fhs, path);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "fsyncdir") == 0)
-        {
-            if(op->fsyncdir != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                int datasync = cJSON_GetObjectItem(params, "datasync")->valueint;
-                update_fi(fhs, path, fi, cJSON_GetObjectItem(params, "fi"));
-                retval = op->fsyncdir(path, datasync, fi);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "init") == 0)
-        {
-            if(op->init != NULL) {
-                struct fuse_conn_info * conn = json_to_fuse_conn_info(cJSON_GetObjectItem(params, "conn"));
-                op->init(conn);
-                retval = 0;
-                free(conn);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "destroy") == 0)
-        {
-            if(op->destroy != NULL) {
-                void * userdata = NULL;
-                op->destroy(userdata);
-                retval = 0;
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "access") == 0)
-        {
-            if(op->access != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                int mask = cJSON_GetObjectItem(params, "mask")->valueint;
-                retval = op->access(path, mask);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "create") == 0)
-        {
-            if(op->create != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                mode_t mode = cJSON_GetObjectItem(params, "mode")->valueint;
-                update_fi(NULL, NULL, fi, cJSON_GetObjectItem(params, "fi"));
-                retval = op->create(path, mode, fi);
-                store_fh(fhs, path, fi->fh);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "ftruncate") == 0)
-        {
-            if(op->ftruncate != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                off_t offset = cJSON_GetObjectItem(params, "offset")->valueint;
-                update_fi(fhs, path, fi, cJSON_GetObjectItem(params, "fi"));
-                retval = op->ftruncate(path, offset, fi);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "fgetattr") == 0)
-        {
-            if(op->fgetattr != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                struct stat * s = json_to_stat(cJSON_GetObjectItem(params, "stat"));
-                update_fi(fhs, path, fi, cJSON_GetObjectItem(params, "fi"));
-                retval = op->fgetattr(path, s, fi);
-                free(s);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "lock") == 0)
-        {
-            if(op->lock != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                update_fi(fhs, path, fi, cJSON_GetObjectItem(params, "fi"));
-                int cmd = cJSON_GetObjectItem(params, "cmd")->valueint;
-                struct flock * flock = json_to_flock(cJSON_GetObjectItem(params, "flock"));
-                retval = op->lock(path, fi, cmd, flock);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "utimens") == 0)
-        {
-            if(op->utimens != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                struct timespec * tv = json_to_timespec_array(cJSON_GetObjectItem(params, "tv"));
-                retval = op->utimens(path, tv);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "bmap") == 0)
-        {
-            if(op->bmap != NULL) {
-                // This makes sense only for block device backed filesystems mounted with the 'blkdev' option
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                size_t blocksize = cJSON_GetObjectItem(params, "blocksize")->valueint;
-                retval = op->bmap(path, blocksize, NULL);
-            } else {
-                *func_not_defined = true;
-            }
-        }
+int compare_listing_entries(const void * a, const void * b);
+int compare_listing_entries(const void * a, const void * b) {
+    return strcmp(((const struct listing_entry *) a)->name, ((const struct listing_entry *) b)->name);
+}
 
-        #ifdef __APPLE__ // Apple osxfuse-only functions
+// Read a directory's entries, apart from '.' and '..', in order of name
+// Returns 0 on success, otherwise what opendir or readdir returned
+int read_listing(const struct fuse_operations * op, const char * path, struct listing * listing);
+int read_listing(const struct fuse_operations * op, const char * path, struct listing * listing) {
+    listing->entries = NULL;
+    listing->num_entries = 0;
+    listing->capacity = 0;
+
+    struct fuse_file_info fi;
+    empty_fi(&fi);
+    int retval = op->opendir(path, &fi);
+    if(retval != 0) return retval;
+    retval = op->readdir(path, (void *) listing, listing_filler, 0, &fi);
+    op->releasedir(path, &fi);
+
+    if(listing->num_entries > 1) {
+        qsort(listing->entries, listing->num_entries, sizeof(*listing->entries), compare_listing_entries);
+    }
+    return retval;
+}
 
-        else if(strcmp(func_name, "setvolname") == 0)
-        {
-            if(op->setvolname != NULL) {
-                const char * volname = cJSON_GetObjectItem(params, "volname")->valuestring;    
-                retval = op->setvolname(volname);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "exchange") == 0)
-        {
-            if(op->exchange != NULL) {
-                const char * path1 = cJSON_GetObjectItem(params, "path1")->valuestring;
-                const char * path2 = cJSON_GetObjectItem(params, "path2")->valuestring;
-                int options = cJSON_GetObjectItem(params, "options")->valueint; 
-                retval = op->exchange(path1, path2, options);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "getxtimes") == 0)
-        {
-            if(op->getxtimes != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                struct timespec bkuptime = json_to_timespec(cJSON_GetObjectItem(params, "bkuptime"));
-                struct timespec crtime = json_to_timespec(cJSON_GetObjectItem(params, "crtime"));    
-                retval = op->getxtimes(path, &bkuptime, &crtime);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "setbkuptime") == 0)
-        {
-            if(op->setbkuptime != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                struct timespec tv = json_to_timespec(cJSON_GetObjectItem(params, "tv"));    
-                retval = op->setbkuptime(path, &tv);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "setchgtime") == 0)
-        {
-            if(op->setchgtime != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                struct timespec tv = json_to_timespec(cJSON_GetObjectItem(params, "tv"));    
-                retval = op->setchgtime(path, &tv);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "setcrtime") == 0)
-        {
-            if(op->setcrtime != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                struct timespec tv = json_to_timespec(cJSON_GetObjectItem(params, "tv"));    
-                retval = op->setcrtime(path, &tv);
-            } else {
-                *func_not_defined = true;
-            }
-        }
-        else if(strcmp(func_name, "chflags") == 0)
-        {
-            if(op->chflags != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                int flags = cJSON_GetObjectItem(params, "flags")->valueint;
-                retval = op->chflags(path, flags);
-            } else {
-                *func_not_defined = true;
-            }
-        }
+void free_listing(struct listing * listing);
+void free_listing(struct listing * listing) {
+    size_t i;
+    for(i = 0; i < listing->num_entries; i++) {
+        free(listing->entries[i].name);
+    }
+    free(listing->entries);
+}
 
-        else if(strcmp(func_name, "setattr_x") == 0)
-        {
-            if(op->setattr_x != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                struct setattr_x * attr = json_to_setattr_x(cJSON_GetObjectItem(params, "attr"));
-                retval = op->setattr_x(path, attr);
-            } else {
-                *func_not_defined = true;
-            }
-        }
+/* Resetting a filesystem between groups
+ *
+ * The passthru fs is a directory we own, so it's reset by renaming its root out of the way and making a fresh one,
+ * and the old tree is deleted in the background while the next group runs. The filesystem under test can only be
+ * reset through its own calls, which happens in post-order across several threads if it was mounted multithreaded
+ * (it then has to cope with concurrent calls anyway), or on this thread if not.
+ */
+
+#define TS_RESET_THREADS 8
+
+// A directory being emptied, which is removed once all the directories in it have been
+struct reset_dir {
+    char * path;
+    struct reset_dir * parent;
+    struct reset_dir * next;    // In the queue of directories waiting to be listed
+    int pending;                // Subdirectories still to be removed, plus one until it's been listed
+};
 
-        else if(strcmp(func_name, "fsetattr_x") == 0)
-        {
-            if(op->fsetattr_x != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                struct setattr_x * attr = json_to_setattr_x(cJSON_GetObjectItem(params, "attr"));
-                update_fi(fhs, path, fi, cJSON_GetObjectItem(params, "fi"));    
-                retval = op->fsetattr_x(path, attr, fi);
-            } else {
-                *func_not_defined = true;
-            }
-        }
+struct reset_work {
+    const struct fuse_operations * op;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    struct reset_dir * queue;
+    int outstanding;            // Directories not yet removed
+};
 
-        #else // Linux libfuse-only functions
-
-        else if(strcmp(func_name, "ioctl") == 0)
-        {
-            if(op->ioctl != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                int cmd = cJSON_GetObjectItem(params, "cmd")->valueint;
-                void * arg = NULL;
-                int flags = cJSON_GetObjectItem(params, "flags")->valueint;
-                void * data = NULL;
-                update_fi(fhs, path, fi, cJSON_GetObjectItem(params, "fi"));
-                retval = op->ioctl(path, cmd, arg, fi, flags, data);
-            } else {
-                *func_not_defined = true;
-            }
+static bool reset_multithreaded = false;
+static pid_t passthru_trash_pid = 0;        // Process deleting an old passthru root, if there is one
+
+// Take a directory off the pending count of its parent, removing any that are now empty, all the way up
+void reset_dir_done(struct reset_work * work, struct reset_dir * dir);
+void reset_dir_done(struct reset_work * work, struct reset_dir * dir) {
+    pthread_mutex_lock(&work->lock);
+    while(dir != NULL && --dir->pending == 0) {
+        pthread_mutex_unlock(&work->lock);
+
+        // Delete empty directory, but not the mountpoint!
+        if(dir->parent != NULL && work->op->rmdir(dir->path) < 0) {
+            ts_test_fail("rmdir", NULL, "Call failed on %s. Error was: %s", dir->path, strerror(errno));
         }
-        else if(strcmp(func_name, "poll") == 0)
-        {
-            if(op->poll != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                void * ph = NULL;
-                unsigned reventsp = cJSON_GetObjectItem(params, "reventsp")->valueint;
-                update_fi(fhs, path, fi, cJSON_GetObjectItem(params, "fi"));
-                retval = op->poll(path, fi, ph, &reventsp);
-            } else {
-                *func_not_defined = true;
+
+        pthread_mutex_lock(&work->lock);
+        struct reset_dir * parent = dir->parent;
+        free(dir->path);
+        free(dir);
+        dir = parent;
+        work->outstanding--;
+    }
+    if(work->outstanding == 0) pthread_cond_broadcast(&work->changed);
+    pthread_mutex_unlock(&work->lock);
+}
+
+// Unlink everything in a directory that isn't a directory, and queue up the ones that are
+void reset_dir_list(struct reset_work * work, struct reset_dir * dir);
+void reset_dir_list(struct reset_work * work, struct reset_dir * dir) {
+    const struct fuse_operations * op = work->op;
+    struct listing listing;
+    int retval = read_listing(op, dir->path, &listing);
+    if(retval != 0) {
+        ts_test_fail("readdir", NULL, "Call failed on %s. Error was: %d", dir->path, retval);
+    }
+
+    size_t i;
+    for(i = 0; i < listing.num_entries; i++) {
+        struct listing_entry * entry = &listing.entries[i];
+
+        // Construct absolute path (because we just have a filename)
+        size_t path_len = strlen(dir->path) + strlen(entry->name) + 2;
+        char * fpath = malloc(path_len);
+        snprintf(fpath, path_len, "%s%s%s", dir->path, dir->parent == NULL ? "" : "/", entry->name);
+
+        // Delete the file (if it's a file) or queue the subdirectory (if it's a directory)
+        struct stat s;
+        if(entry->has_stat) {
+            s = entry->st;
+        } else if(op->getattr(fpath, &s) != 0) {
+            ts_test_fail("getattr", NULL, "Call failed on path %s. Error was: %s", fpath, strerror(errno));
+            free(fpath);
+            continue;
+        }
+
+        if(S_ISDIR(s.st_mode)) {
+            struct reset_dir * child = malloc(sizeof(*child));
+            child->path = fpath;
+            child->parent = dir;
+            child->pending = 1;
+            pthread_mutex_lock(&work->lock);
+            dir->pending++;
+            work->outstanding++;
+            child->next = work->queue;
+            work->queue = child;
+            pthread_cond_signal(&work->changed);
+            pthread_mutex_unlock(&work->lock);
+        } else {
+            if(op->unlink(fpath) < 0) {
+                ts_test_fail("unlink", NULL, "Call failed on path %s. Error was: %s", fpath, strerror(errno));
             }
+            free(fpath);
         }
-        else if(strcmp(func_name, "write_buf") == 0)
-        {
-            if(op->write_buf != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                struct fuse_bufvec * buf = json_to_fuse_bufvec(path, fhs, cJSON_GetObjectItem(params, "buf"));
-                int off = cJSON_GetObjectItem(params, "off")->valueint;
-                update_fi(fhs, path, fi, cJSON_GetObjectItem(params, "fi"));    
-                retval = op->write_buf(path, buf, off, fi);
+    }
+    free_listing(&listing);
+    reset_dir_done(work, dir);
+}
+
+// Keep listing directories from the queue until every directory has been removed
+void * reset_worker(void * arg);
+void * reset_worker(void * arg) {
+    struct reset_work * work = arg;
+    pthread_mutex_lock(&work->lock);
+    while(true) {
+        while(work->queue == NULL && work->outstanding > 0) {
+            pthread_cond_wait(&work->changed, &work->lock);
+        }
+        if(work->queue == NULL) break;
+        struct reset_dir * dir = work->queue;
+        work->queue = dir->next;
+        pthread_mutex_unlock(&work->lock);
+        reset_dir_list(work, dir);
+        pthread_mutex_lock(&work->lock);
+    }
+    pthread_mutex_unlock(&work->lock);
+    return NULL;
+}
+
+// Reset an entire FUSE filesystem by deleting every file and directory through its own calls
+// This requires opendir, readdir, releasedir, unlink and rmdir to be defined and implemented correctly
+void reset_filesystem_calls(const struct fuse_operations * op, int num_threads);
+void reset_filesystem_calls(const struct fuse_operations * op, int num_threads) {
+    struct reset_work work;
+    work.op = op;
+    pthread_mutex_init(&work.lock, NULL);
+    pthread_cond_init(&work.changed, NULL);
+
+    struct reset_dir * root = malloc(sizeof(*root));
+    root->path = strdup("/");
+    root->parent = NULL;
+    root->next = NULL;
+    root->pending = 1;
+    work.queue = root;
+    work.outstanding = 1;
+
+    // This thread works through the queue too, so it's all that runs if only one thread is wanted
+    pthread_t threads[TS_RESET_THREADS];
+    int started = 0;
+    while(started < num_threads - 1 && started < TS_RESET_THREADS) {
+        if(pthread_create(&threads[started], NULL, reset_worker, &work) != 0) break;
+        started++;
+    }
+    reset_worker(&work);
+    while(started > 0) {
+        pthread_join(threads[--started], NULL);
+    }
+
+    pthread_cond_destroy(&work.changed);
+    pthread_mutex_destroy(&work.lock);
+}
+
+// Delete a directory tree directly, without going through any filesystem's calls
+void remove_tree(const char * path);
+void remove_tree(const char * path) {
+    DIR * dir = opendir(path);
+    if(dir != NULL) {
+        struct dirent * de;
+        while((de = readdir(dir)) != NULL) {
+            if(strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+            char fpath[PATH_MAX];
+            snprintf(fpath, sizeof(fpath), "%s/%s", path, de->d_name);
+            struct stat s;
+            if(lstat(fpath, &s) == 0 && S_ISDIR(s.st_mode)) {
+                remove_tree(fpath);
             } else {
-                *func_not_defined = true;
+                unlink(fpath);
             }
         }
-        else if(strcmp(func_name, "read_buf") == 0)
-        {
-            if(op->read_buf != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                int size = cJSON_GetObjectItem(params, "size")->valueint;
-                void * bufp = malloc(size);
-                int off = cJSON_GetObjectItem(params, "off")->valueint;
-                update_fi(fhs, path, fi, cJSON_GetObjectItem(params, "fi"));
-                retval = op->read_buf(path, bufp, size, off, fi);
-                free(bufp);
-            } else {
-                *func_not_defined = true;
-            }
+        closedir(dir);
+    }
+    rmdir(path);
+}
+
+
+// Wait for the last passthru root to finish being deleted
+void reset_passthru_wait(void);
+void reset_passthru_wait(void) {
+    if(passthru_trash_pid > 0) {
+        while(waitpid(passthru_trash_pid, NULL, 0) < 0 && errno == EINTR);
+        passthru_trash_pid = 0;
+    }
+}
+
+// Swap a passthru root for an empty directory, and delete the old one in the background
+// That's done by a process rather than a thread, so the test suite never has a thread running when it forks a group
+// Returns false if the root couldn't be swapped, in which case it's left as it was
+bool reset_passthru_root(const char * root);
+bool reset_passthru_root(const char * root) {
+    reset_passthru_wait();
+
+    // Renaming a directory over an empty one replaces it, so the old root can be moved to a unique name this way
+    size_t trash_len = strlen(root) + sizeof(".trash-XXXXXX");
+    char * trash = malloc(trash_len);
+    snprintf(trash, trash_len, "%s.trash-XXXXXX", root);
+    if(mkdtemp(trash) == NULL) {
+        free(trash);
+        return false;
+    }
+    if(rename(root, trash) != 0) {
+        rmdir(trash);
+        free(trash);
+        return false;
+    }
+    if(mkdir(root, 0777) != 0) {
+        // Put the old root back rather than leave the passthru fs without one
+        rename(trash, root);
+        free(trash);
+        return false;
+    }
+
+    passthru_trash_pid = fork();
+    if(passthru_trash_pid == 0) {
+        remove_tree(trash);
+        _exit(0);
+    }
+    if(passthru_trash_pid < 0) {
+        passthru_trash_pid = 0;
+        remove_tree(trash);
+    }
+    free(trash);
+    return true;
+}
+
+void reset_filesystem(const struct fuse_operations * op);
+void reset_filesystem(const struct fuse_operations * op) {
+    if(op != passthru_ops || !reset_passthru_root(root_path)) {
+        reset_filesystem_calls(op, reset_multithreaded ? TS_RESET_THREADS : 1);
+    }
+    ts_digests_clear(ts_digests_for(op));
+}
+
+bool timesRoughlyEqual(time_t t1, time_t t2);
+bool timesRoughlyEqual(time_t t1, time_t t2) {
+    time_t window = 5;
+    if(t2 >= t1 - window && t2 <= t1 + window) return true;
+    else return false;
+}
+
+bool assert_equivalent_tree(const struct fuse_operations * passthru, const struct fuse_operations * real, const char * path, struct ts_summary * summary);
+
+// Check that a path which exists on the passthru fs matches the same path on the real fs, and optionally
+// everything beneath it if it's a directory. The real fs is only asked for the path's attributes if s_listed
+// is NULL. If summary isn't NULL it's filled in with the digests of the path on both filesystems, for the
+// summary of the directory containing it.
+bool assert_equivalent_entry(const struct fuse_operations * passthru, const struct fuse_operations * real, const char * fpath, const struct stat * s_passthru, const struct stat * s_listed, bool recurse, struct ts_summary * summary);
+bool assert_equivalent_entry(const struct fuse_operations * passthru, const struct fuse_operations * real, const char * fpath, const struct stat * s_passthru, const struct stat * s_listed, bool recurse, struct ts_summary * summary) {
+    bool equivalent = true;
+    struct ts_summary entry = { s_passthru->st_mode & S_IFMT, s_passthru->st_mode & S_IFMT, true };
+
+    // Try reading the file at the same path from the real fs, unless its listing already gave us that
+    struct stat s_real;
+    memset(&s_real, 0, sizeof(s_real));
+    if(s_listed != NULL) {
+        s_real = *s_listed;
+    } else if(real->getattr(fpath, &s_real) != 0) {
+        cJSON * params = cJSON_CreateObject();
+        cJSON_AddStringToObject(params, "path", fpath);
+        ts_test_fail("getattr", params, "'%s' should exist but getattr failed", fpath);
+        return false;
+    }
+    entry.real = s_real.st_mode & S_IFMT;
+
+    // Create a JSON object containing the params, so we can pass it back to the test suite
+    // It belongs to the test suite once a failure has been reported with it
+    cJSON * params = cJSON_CreateObject();
+    cJSON_AddStringToObject(params, "path", fpath);
+    cJSON_AddItemToObject(params, "stat", stat_to_json(&s_real));
+    bool reported = true;
+
+    // Make sure file properties match up
+    if(S_ISBLK(s_passthru->st_mode) && !S_ISBLK(s_real.st_mode)) {
+        ts_test_fail("getattr", params, "'%s' should be a block special file", fpath);
+    } else if(S_ISCHR(s_passthru->st_mode) && !S_ISCHR(s_real.st_mode)) {
+        ts_test_fail("getattr", params, "'%s' should be a character special file", fpath);
+    } else if(S_ISDIR(s_passthru->st_mode) && !S_ISDIR(s_real.st_mode)) {
+        ts_test_fail("getattr", params, "'%s' should be a directory", fpath);
+    } else if(S_ISFIFO(s_passthru->st_mode) && !S_ISFIFO(s_real.st_mode)) {
+        ts_test_fail("getattr", params, "'%s' should be a pipe or FIFO special file", fpath);
+    } else if(S_ISREG(s_passthru->st_mode) && !S_ISREG(s_real.st_mode)) {
+        ts_test_fail("getattr", params, "'%s' should be a regular file", fpath);
+    } else if(S_ISLNK(s_passthru->st_mode) && !S_ISLNK(s_real.st_mode)) {
+        ts_test_fail("getattr", params, "'%s' should be a symbolic link", fpath);
+    } else if(S_ISSOCK(s_passthru->st_mode) && !S_ISSOCK(s_real.st_mode)) {
+        ts_test_fail("getattr", params, "'%s' should be a socket", fpath);
+    } else if(!S_ISDIR(s_passthru->st_mode) && s_passthru->st_nlink != s_real.st_nlink) {
+        // Directories are left out, as filesystems don't agree on how to count their links
+        ts_test_fail("getattr", params, "'%s' has %lld hard links but should have %lld", fpath, (long long) s_real.st_nlink, (long long) s_passthru->st_nlink);
+    } else if((S_ISREG(s_passthru->st_mode) || S_ISLNK(s_passthru->st_mode)) && s_passthru->st_size != s_real.st_size) {
+        ts_test_fail("getattr", params, "'%s' has size %lld but should be %lld", fpath, (long long) s_real.st_size, (long long) s_passthru->st_size);
+    } else if(!timesRoughlyEqual(s_passthru->st_atime, s_real.st_atime)) {
+        ts_test_fail("getattr", params, "'%s' has last access time of %lld but should be %lld", fpath, (long long) s_real.st_atime, (long long) s_passthru->st_atime);
+    } else if(!timesRoughlyEqual(s_passthru->st_mtime, s_real.st_mtime)) {
+        ts_test_fail("getattr", params, "'%s' has last modification time of %lld but should be %lld", fpath, (long long) s_real.st_mtime, (long long) s_passthru->st_mtime);
+    } else if(!timesRoughlyEqual(s_passthru->st_ctime, s_real.st_ctime)) {
+        ts_test_fail("getattr", params, "'%s' has last status change time of %lld but should be %lld", fpath, (long long) s_real.st_ctime, (long long) s_passthru->st_ctime);
+    } else {
+        reported = false;
+    }
+    equivalent = !reported;
+
+    // Compare what regular files contain, if the passthru fs can be read (if it can't, there's nothing to compare against)
+    uint64_t digest_passthru, digest_real;
+    if(equivalent && S_ISREG(s_passthru->st_mode) && file_digest(passthru, fpath, s_passthru, &digest_passthru) == 0) {
+        int retval = file_digest(real, fpath, &s_real, &digest_real);
+        if(retval == 0 && digest_passthru != digest_real) {
+            ts_test_fail("read", params, "'%s' doesn't contain what it should", fpath);
+            reported = true;
+        } else if(retval < 0 && retval != -ENOSYS) {
+            ts_test_fail("read", params, "'%s' couldn't be read (error %d)", fpath, retval);
+            reported = true;
+        } else if(retval == 0) {
+            entry.passthru = ts_hash_combine(entry.passthru, digest_passthru);
+            entry.real = ts_hash_combine(entry.real, digest_real);
+        } else {
+            // Without its contents the file can't be part of a summary
+            entry.cacheable = false;
         }
-        else if(strcmp(func_name, "flock") == 0)
-        {
-            if(op->flock != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                int op_int = cJSON_GetObjectItem(params, "op")->valueint;
-                update_fi(fhs, path, fi, cJSON_GetObjectItem(params, "fi"));
-                retval = op->flock(path, fi, op_int);
+        // Another path could change these contents
+        if(s_passthru->st_nlink > 1) entry.cacheable = false;
+        equivalent = !reported;
+    }
+
+    // And where symbolic links point
+    if(equivalent && S_ISLNK(s_passthru->st_mode) && passthru->readlink != NULL && real->readlink != NULL) {
+        char target_passthru[PATH_MAX], target_real[PATH_MAX];
+        if(passthru->readlink(fpath, target_passthru, sizeof(target_passthru)) == 0 && real->readlink(fpath, target_real, sizeof(target_real)) == 0) {
+            if(strcmp(target_passthru, target_real) != 0) {
+                ts_test_fail("readlink", params, "'%s' links to '%s' but should link to '%s'", fpath, target_real, target_passthru);
+                reported = true;
+                equivalent = false;
             } else {
-                *func_not_defined = true;
+                entry.passthru = ts_hash_combine(entry.passthru, ts_hash_bytes(target_passthru, strlen(target_passthru)));
+                entry.real = ts_hash_combine(entry.real, ts_hash_bytes(target_real, strlen(target_real)));
             }
         }
-        else if(strcmp(func_name, "fallocate") == 0)
-        {
-            if(op->fallocate != NULL) {
-                const char * path = cJSON_GetObjectItem(params, "path")->valuestring;
-                int mode = cJSON_GetObjectItem(params, "mode")->valueint;
-                int offset = cJSON_GetObjectItem(params, "offset")->valueint;
-                int len = cJSON_GetObjectItem(params, "len")->valueint;
-                update_fi(fhs, path, fi, cJSON_GetObjectItem(params, "fi"));    
-                retval = op->fallocate(path, mode, offset, len, fi);
-            } else {
-                *func_not_defined = true;
-            }
+    }
+    if(!reported) cJSON_Delete(params);
+
+    // If there are no errors so far and the file is actually a directory then recurse into it
+    if(recurse && equivalent && S_ISDIR(s_passthru->st_mode) != 0) {
+        struct ts_summary child;
+        equivalent = assert_equivalent_tree(passthru, real, fpath, &child);
+        entry.passthru = ts_hash_combine(entry.passthru, child.passthru);
+        entry.real = ts_hash_combine(entry.real, child.real);
+        entry.cacheable = child.cacheable;
+    }
+
+    if(summary != NULL) *summary = entry;
+    return equivalent;
+}
+
+// Check whether the states both filesystems are equivalent beneath a directory, filling in its summary
+// Both directories are listed, and the sorted listings merged, so entries missing from either side are found
+bool assert_equivalent_tree(const struct fuse_operations * passthru, const struct fuse_operations * real, const char * path, struct ts_summary * summary);
+bool assert_equivalent_tree(const struct fuse_operations * passthru, const struct fuse_operations * real, const char * path, struct ts_summary * summary) {
+
+    // A subtree that was equivalent when it was last walked, and that no call has touched since, is taken to still be
+    uint64_t * cached_passthru = g_hash_table_lookup(digests_passthru.dirs, path);
+    uint64_t * cached_real = g_hash_table_lookup(digests_real.dirs, path);
+    if(cached_passthru != NULL && cached_real != NULL && *cached_passthru == *cached_real) {
+        summary->passthru = *cached_passthru;
+        summary->real = *cached_real;
+        summary->cacheable = true;
+        return true;
+    }
+
+    bool equivalent = true;
+    summary->passthru = 0;
+    summary->real = 0;
+    summary->cacheable = true;
+
+    struct listing listing_passthru, listing_real;
+    if(read_listing(passthru, path, &listing_passthru) != 0) {
+        fprintf(stderr, "  Error listing '%s'\n", path);
+        free_listing(&listing_passthru);
+        return false;
+    }
+    int retval = read_listing(real, path, &listing_real);
+    if(retval != 0) {
+        cJSON * params = cJSON_CreateObject();
+        cJSON_AddStringToObject(params, "path", path);
+        ts_test_fail("readdir", params, "'%s' couldn't be listed (error %d)", path, retval);
+        free_listing(&listing_passthru);
+        free_listing(&listing_real);
+        return false;
+    }
+
+    size_t i = 0, j = 0;
+    while(i < listing_passthru.num_entries || j < listing_real.num_entries) {
+        struct listing_entry * entry_passthru = i < listing_passthru.num_entries ? &listing_passthru.entries[i] : NULL;
+        struct listing_entry * entry_real = j < listing_real.num_entries ? &listing_real.entries[j] : NULL;
+        int order = entry_passthru == NULL ? 1 : entry_real == NULL ? -1 : strcmp(entry_passthru->name, entry_real->name);
+        const char * fname = order <= 0 ? entry_passthru->name : entry_real->name;
+
+        // Construct absolute path (because we just have a filename)
+        size_t path_len = strlen(path) + strlen(fname) + 1;
+        char fpath[path_len + 1];
+        strcpy(fpath, path);
+        if(fpath[strlen(path)-1] != '/') {
+            // Add a directory separator if we need one
+            strcat(fpath, "/");
+        }
+        strcat(fpath, fname);
+
+        if(order < 0) {
+            cJSON * params = cJSON_CreateObject();
+            cJSON_AddStringToObject(params, "path", fpath);
+            ts_test_fail("readdir", params, "'%s' should exist but isn't listed in '%s'", fpath, path);
+            equivalent = false;
+            i++;
+            continue;
+        } else if(order > 0) {
+            cJSON * params = cJSON_CreateObject();
+            cJSON_AddStringToObject(params, "path", fpath);
+            ts_test_fail("readdir", params, "'%s' shouldn't exist but is listed in '%s'", fpath, path);
+            equivalent = false;
+            j++;
+            continue;
+        }
+        i++;
+        j++;
+
+        // Stat the file on the passthru fs, unless the listing already did
+        struct stat s_passthru;
+        if(entry_passthru->has_stat) {
+            s_passthru = entry_passthru->st;
+        } else if(passthru->getattr(fpath, &s_passthru) != 0) {
+            fprintf(stderr, "Getattr failed on '%s'\n", fpath);
+            equivalent = false;
+            continue;
         }
 
-        #endif
+        struct ts_summary entry;
+        equivalent = assert_equivalent_entry(passthru, real, fpath, &s_passthru, entry_real->has_stat ? &entry_real->st : NULL, true, &entry) == false ? false : equivalent;
+
+        // Entries are summed, so the summary doesn't depend on the order they're listed in
+        uint64_t name = ts_hash_bytes(fname, strlen(fname));
+        summary->passthru += ts_hash_combine(name, entry.passthru);
+        summary->real += ts_hash_combine(name, entry.real);
+        if(!entry.cacheable) summary->cacheable = false;
+    }
+    free_listing(&listing_passthru);
+    free_listing(&listing_real);
+
+    if(equivalent && summary->cacheable) {
+        uint64_t * stored_passthru = malloc(sizeof(*stored_passthru));
+        uint64_t * stored_real = malloc(sizeof(*stored_real));
+        *stored_passthru = summary->passthru;
+        *stored_real = summary->real;
+        g_hash_table_replace(digests_passthru.dirs, strdup(path), stored_passthru);
+        g_hash_table_replace(digests_real.dirs, strdup(path), stored_real);
+    }
+    return equivalent;
+}
+
+// Check whether the states both filesystems are equivalent
+bool assert_equivalent_path(const struct fuse_operations * passthru, const struct fuse_operations * real, const char * path);
+bool assert_equivalent_path(const struct fuse_operations * passthru, const struct fuse_operations * real, const char * path) {
+    struct ts_summary summary;
+    return assert_equivalent_tree(passthru, real, path, &summary);
+}
+
+// Convenience method for the above
+bool assert_equivalent(const struct fuse_operations * passthru, const struct fuse_operations * real);
+bool assert_equivalent(const struct fuse_operations * passthru, const struct fuse_operations * real) {
+    return assert_equivalent_path(passthru, real, "/");
+}
 
-        else
-        {
-            report_testsuite_error("Cannot make call '%s' as it is not handled by the test suite", func_name);
+// Check a single path that a call may have changed. Unlike the tree walk, the path may not exist on the
+// passthru fs (it was just removed, or the call failed), in which case it mustn't exist on the real fs either
+bool assert_equivalent_changed(const struct fuse_operations * passthru, const struct fuse_operations * real, const char * path, bool recurse);
+bool assert_equivalent_changed(const struct fuse_operations * passthru, const struct fuse_operations * real, const char * path, bool recurse) {
+    // The roots are different directories, so like the tree walk only compare what's inside them
+    if(strcmp(path, "/") == 0) return recurse ? assert_equivalent_path(passthru, real, path) : true;
+
+    struct stat s_passthru;
+    s_passthru.st_mode = 0;
+    if(passthru->getattr(path, &s_passthru) == 0) {
+        return assert_equivalent_entry(passthru, real, path, &s_passthru, NULL, recurse, NULL);
+    }
+
+    struct stat s_real;
+    if(real->getattr(path, &s_real) == 0) {
+        cJSON * params = cJSON_CreateObject();
+        cJSON_AddStringToObject(params, "path", path);
+        cJSON_AddItemToObject(params, "stat", stat_to_json(&s_real));
+        ts_test_fail("getattr", params, "'%s' should not exist but getattr succeeded", path);
+        return false;
+    }
+    return true;
+}
+
+// Check only the paths the call could have changed, as given by ts_op_effects
+bool assert_equivalent_call(const struct fuse_operations * passthru, const struct fuse_operations * real, const struct ts_plan_group * group, const struct ts_plan_call * call);
+bool assert_equivalent_call(const struct fuse_operations * passthru, const struct fuse_operations * real, const struct ts_plan_group * group, const struct ts_plan_call * call) {
+    unsigned effects = ts_op_effects(call->op);
+    if(effects == 0) return true;
+    if(effects & TS_EFFECT_ALL) return assert_equivalent(passthru, real);
+
+    // The changed paths, then their parents, without duplicates
+    const char * changed[4];
+    char parents[2][PATH_MAX];
+    int num_changed = 0;
+    const char * path = plan_string(group, call->path);
+    const char * path2 = plan_string(group, call->path2);
+    if((effects & TS_EFFECT_PATH) && path != NULL) changed[num_changed++] = path;
+    if((effects & TS_EFFECT_PATH2) && path2 != NULL) changed[num_changed++] = path2;
+
+    int num_paths = num_changed;
+    if(effects & TS_EFFECT_PARENTS) {
+        int i;
+        for(i = 0; i < num_changed; i++) {
+            const char * slash = strrchr(changed[i], '/');
+            if(slash == NULL || slash[1] == '\0') continue;
+            size_t len = slash == changed[i] ? 1 : (size_t) (slash - changed[i]);
+            if(len >= PATH_MAX) continue;
+            memcpy(parents[i], changed[i], len);
+            parents[i][len] = '\0';
+            changed[num_paths++] = parents[i];
         }
-        return retval;
-    } else {
-        report_testsuite_error("Cannot make call '%s' as fuse_operations is null\n", func_name);
+    }
+
+    bool equivalent = true;
+    int i, j;
+    for(i = 0; i < num_paths; i++) {
+        for(j = 0; j < i; j++) {
+            if(strcmp(changed[i], changed[j]) == 0) break;
+        }
+        if(j < i) continue;
+        bool recurse = (effects & TS_EFFECT_SUBTREE) && i < num_changed;
+        if(!assert_equivalent_changed(passthru, real, changed[i], recurse)) equivalent = false;
+    }
+    return equivalent;
+}
+
+// FUSE normally provides this method in a call to readdir, so must be implemented here instead 
+int readdir_filler(void * buf, const char * name, const struct stat * stbuf, off_t off);
+int readdir_filler(void * buf, const char * name, const struct stat * stbuf, off_t off) {
+    (void) buf;
+    (void) name;
+    (void) stbuf;
+    (void) off;
+    return 0;
+}
+
+// Buffer for calls to read into, kept between calls and only ever grown
+void * replay_buffer(size_t size);
+void * replay_buffer(size_t size) {
+    static void * buf = NULL;
+    static size_t capacity = 0;
+    if(size > capacity || buf == NULL) {
+        capacity = size > 4096 ? size : 4096;
+        buf = realloc(buf, capacity);
+    }
+    return buf;
+}
+
+// Parameters of a call as reported to fdt, or NULL if it had none
+cJSON * plan_params(const struct ts_plan_group * group, const struct ts_plan_call * call);
+cJSON * plan_params(const struct ts_plan_group * group, const struct ts_plan_call * call) {
+    return call->params != 0 ? cJSON_Parse(plan_string(group, call->params)) : NULL;
+}
+
+#define TS_REQUIRE_OP(func) if(op->func == NULL) { *func_not_defined = true; break; }
+
+// Make a compiled call against a set of FUSE operations, with filehandles resolved through the slots of that filesystem
+// Struct arguments are copied out of the plan for each call, as filesystems are free to write to them
+int replay_call(const struct fuse_operations * op, const struct ts_plan_group * group, const struct ts_plan_call * call, struct fuse_file_info * fi, struct fh_slot * fhs, bool * func_not_defined);
+int replay_call(const struct fuse_operations * op, const struct ts_plan_group * group, const struct ts_plan_call * call, struct fuse_file_info * fi, struct fh_slot * fhs, bool * func_not_defined) {
+    if(op == NULL) {
+        report_testsuite_error("Cannot make call '%s' as fuse_operations is null\n", plan_string(group, call->func));
         return -1;
     }
+
+    const char * path = plan_string(group, call->path);
+    const char * path2 = plan_string(group, call->path2);
+    const int64_t * args = call->args;
+    int retval = -1;
+    switch(call->op) {
+    case TS_OP_GETATTR: {
+        TS_REQUIRE_OP(getattr);
+        struct stat s = *(const struct stat *) plan_data(group, call->data);
+        retval = op->getattr(path, &s);
+        break;
+    }
+    case TS_OP_READLINK:
+        TS_REQUIRE_OP(readlink);
+        retval = op->readlink(path, replay_buffer(args[0]), args[0]);
+        break;
+    case TS_OP_GETDIR:
+        TS_REQUIRE_OP(getdir);
+        retval = op->getdir(path, NULL, NULL);
+        break;
+    case TS_OP_MKNOD:
+        TS_REQUIRE_OP(mknod);
+        retval = op->mknod(path, args[0], args[1]);
+        break;
+    case TS_OP_MKDIR:
+        TS_REQUIRE_OP(mkdir);
+        retval = op->mkdir(path, args[0]);
+        break;
+    case TS_OP_UNLINK:
+        TS_REQUIRE_OP(unlink);
+        retval = op->unlink(path);
+        destroy_fh(fhs, call->slot);
+        break;
+    case TS_OP_RMDIR:
+        TS_REQUIRE_OP(rmdir);
+        retval = op->rmdir(path);
+        destroy_fh(fhs, call->slot);
+        break;
+    case TS_OP_SYMLINK:
+        TS_REQUIRE_OP(symlink);
+        retval = op->symlink(path, path2);
+        break;
+    case TS_OP_RENAME:
+        TS_REQUIRE_OP(rename);
+        retval = op->rename(path, path2);
+        break;
+    case TS_OP_LINK:
+        TS_REQUIRE_OP(link);
+        retval = op->link(path, path2);
+        break;
+    case TS_OP_CHMOD:
+        TS_REQUIRE_OP(chmod);
+        retval = op->chmod(path, args[0]);
+        break;
+    case TS_OP_CHOWN:
+        TS_REQUIRE_OP(chown);
+        retval = op->chown(path, args[0], args[1]);
+        break;
+    case TS_OP_TRUNCATE:
+        TS_REQUIRE_OP(truncate);
+        retval = op->truncate(path, args[0]);
+        break;
+    case TS_OP_UTIME: {
+        TS_REQUIRE_OP(utime);
+        struct utimbuf ubuf = *(const struct utimbuf *) plan_data(group, call->data);
+        retval = op->utime(path, &ubuf);
+        break;
+    }
+    case TS_OP_OPEN:
+        TS_REQUIRE_OP(open);
+        update_fi(NULL, -1, fi, &call->fi);
+        retval = op->open(path, fi);
+        store_fh(fhs, call->slot, fi->fh);
+        increment_open(fhs, call->slot);
+        break;
+    case TS_OP_READ:
+        TS_REQUIRE_OP(read);
+        update_fi(fhs, call->slot, fi, &call->fi);
+        retval = op->read(path, replay_buffer(args[0]), args[0], args[1], fi);
+        break;
+    case TS_OP_WRITE:
+        TS_REQUIRE_OP(write);
+        update_fi(fhs, call->slot, fi, &call->fi);
+        retval = op->write(path, plan_string(group, call->str), args[0], args[1], fi);
+        break;
+    case TS_OP_STATFS: {
+        TS_REQUIRE_OP(statfs);
+        struct statvfs s = *(const struct statvfs *) plan_data(group, call->data);
+        retval = op->statfs(path, &s);
+        break;
+    }
+    case TS_OP_FLUSH:
+        TS_REQUIRE_OP(flush);
+        update_fi(fhs, call->slot, fi, &call->fi);
+        retval = op->flush(path, fi);
+        break;
+    case TS_OP_RELEASE:
+        TS_REQUIRE_OP(release);
+        update_fi(fhs, call->slot, fi, &call->fi);
+        retval = op->release(path, fi);
+        break;
+    case TS_OP_FSYNC:
+        TS_REQUIRE_OP(fsync);
+        update_fi(fhs, call->slot, fi, &call->fi);
+        retval = op->fsync(path, args[0], fi);
+        break;
+    case TS_OP_SETXATTR:
+        TS_REQUIRE_OP(setxattr);
+        #ifdef __APPLE__
+            // This function takes a position parameter on Mac but not Linux, which is 0 if the test data came from Linux
+            retval = op->setxattr(path, plan_string(group, call->str), plan_string(group, call->str2), args[0], args[1], args[2]);
+        #else
+            retval = op->setxattr(path, plan_string(group, call->str), plan_string(group, call->str2), args[0], args[1]);
+        #endif
+        break;
+    case TS_OP_GETXATTR:
+        TS_REQUIRE_OP(getxattr);
+        #ifdef __APPLE__
+            retval = op->getxattr(path, plan_string(group, call->str), replay_buffer(args[0]), args[0], args[2]);
+        #else
+            retval = op->getxattr(path, plan_string(group, call->str), replay_buffer(args[0]), args[0]);
+        #endif
+        break;
+    case TS_OP_LISTXATTR:
+        TS_REQUIRE_OP(listxattr);
+        retval = op->listxattr(path, replay_buffer(args[0]), args[0]);
+        break;
+    case TS_OP_REMOVEXATTR:
+        TS_REQUIRE_OP(removexattr);
+        retval = op->removexattr(path, plan_string(group, call->str));
+        break;
+    case TS_OP_OPENDIR:
+        TS_REQUIRE_OP(opendir);
+        update_fi(NULL, -1, fi, &call->fi);
+        retval = op->opendir(path, fi);
+        store_fh(fhs, call->slot, fi->fh);
+        increment_open(fhs, call->slot);
+        break;
+    case TS_OP_READDIR:
+        TS_REQUIRE_OP(readdir);
+        update_fi(fhs, call->slot, fi, &call->fi);
+        retval = op->readdir(path, NULL, readdir_filler, args[0], fi);
+        break;
+    case TS_OP_RELEASEDIR:
+        // Not made, as the directory's filehandle is still needed by later calls in the test data
+        TS_REQUIRE_OP(releasedir);
+        update_fi(fhs, call->slot, fi, &call->fi);
+        break;
+    case TS_OP_FSYNCDIR:
+        TS_REQUIRE_OP(fsyncdir);
+        update_fi(fhs, call->slot, fi, &call->fi);
+        retval = op->fsyncdir(path, args[0], fi);
+        break;
+    case TS_OP_INIT: {
+        TS_REQUIRE_OP(init);
+        struct fuse_conn_info conn = *(const struct fuse_conn_info *) plan_data(group, call->data);
+        op->init(&conn);
+        retval = 0;
+        break;
+    }
+    case TS_OP_DESTROY:
+        TS_REQUIRE_OP(destroy);
+        op->destroy(NULL);
+        retval = 0;
+        break;
+    case TS_OP_ACCESS:
+        TS_REQUIRE_OP(access);
+        retval = op->access(path, args[0]);
+        break;
+    case TS_OP_CREATE:
+        TS_REQUIRE_OP(create);
+        update_fi(NULL, -1, fi, &call->fi);
+        retval = op->create(path, args[0], fi);
+        store_fh(fhs, call->slot, fi->fh);
+        break;
+    case TS_OP_FTRUNCATE:
+        TS_REQUIRE_OP(ftruncate);
+        update_fi(fhs, call->slot, fi, &call->fi);
+        retval = op->ftruncate(path, args[0], fi);
+        break;
+    case TS_OP_FGETATTR: {
+        TS_REQUIRE_OP(fgetattr);
+        struct stat s = *(const struct stat *) plan_data(group, call->data);
+        update_fi(fhs, call->slot, fi, &call->fi);
+        retval = op->fgetattr(path, &s, fi);
+        break;
+    }
+    case TS_OP_LOCK: {
+        TS_REQUIRE_OP(lock);
+        struct flock flock = *(const struct flock *) plan_data(group, call->data);
+        update_fi(fhs, call->slot, fi, &call->fi);
+        retval = op->lock(path, fi, args[0], &flock);
+        break;
+    }
+    case TS_OP_UTIMENS: {
+        TS_REQUIRE_OP(utimens);
+        struct timespec tv[2];
+        memcpy(tv, plan_data(group, call->data), sizeof(tv));
+        retval = op->utimens(path, tv);
+        break;
+    }
+    case TS_OP_BMAP:
+        // This makes sense only for block device backed filesystems mounted with the 'blkdev' option
+        TS_REQUIRE_OP(bmap);
+        retval = op->bmap(path, args[0], NULL);
+        break;
+
+    #ifdef __APPLE__ // Apple osxfuse-only functions
+
+    case TS_OP_SETVOLNAME:
+        TS_REQUIRE_OP(setvolname);
+        retval = op->setvolname(plan_string(group, call->str));
+        break;
+    case TS_OP_EXCHANGE:
+        TS_REQUIRE_OP(exchange);
+        retval = op->exchange(path, path2, args[0]);
+        break;
+    case TS_OP_GETXTIMES: {
+        TS_REQUIRE_OP(getxtimes);
+        struct timespec tv[2];
+        memcpy(tv, plan_data(group, call->data), sizeof(tv));
+        retval = op->getxtimes(path, &tv[0], &tv[1]);
+        break;
+    }
+    case TS_OP_SETBKUPTIME: {
+        TS_REQUIRE_OP(setbkuptime);
+        struct timespec tv = *(const struct timespec *) plan_data(group, call->data);
+        retval = op->setbkuptime(path, &tv);
+        break;
+    }
+    case TS_OP_SETCHGTIME: {
+        TS_REQUIRE_OP(setchgtime);
+        struct timespec tv = *(const struct timespec *) plan_data(group, call->data);
+        retval = op->setchgtime(path, &tv);
+        break;
+    }
+    case TS_OP_SETCRTIME: {
+        TS_REQUIRE_OP(setcrtime);
+        struct timespec tv = *(const struct timespec *) plan_data(group, call->data);
+        retval = op->setcrtime(path, &tv);
+        break;
+    }
+    case TS_OP_CHFLAGS:
+        TS_REQUIRE_OP(chflags);
+        retval = op->chflags(path, args[0]);
+        break;
+    case TS_OP_SETATTR_X: {
+        TS_REQUIRE_OP(setattr_x);
+        struct setattr_x attr = *(const struct setattr_x *) plan_data(group, call->data);
+        retval = op->setattr_x(path, &attr);
+        break;
+    }
+    case TS_OP_FSETATTR_X: {
+        TS_REQUIRE_OP(fsetattr_x);
+        struct setattr_x attr = *(const struct setattr_x *) plan_data(group, call->data);
+        update_fi(fhs, call->slot, fi, &call->fi);
+        retval = op->fsetattr_x(path, &attr, fi);
+        break;
+    }
+
+    #else // Linux libfuse-only functions
+
+    case TS_OP_IOCTL:
+        TS_REQUIRE_OP(ioctl);
+        update_fi(fhs, call->slot, fi, &call->fi);
+        retval = op->ioctl(path, args[0], NULL, fi, args[1], NULL);
+        break;
+    case TS_OP_POLL: {
+        TS_REQUIRE_OP(poll);
+        unsigned reventsp = args[0];
+        update_fi(fhs, call->slot, fi, &call->fi);
+        retval = op->poll(path, fi, NULL, &reventsp);
+        break;
+    }
+    case TS_OP_WRITE_BUF: {
+        TS_REQUIRE_OP(write_buf);
+        // Buffers were compiled as their size, flags and position, and are given memory and the path's filehandle here
+        const int64_t * bufs_data = plan_data(group, call->data);
+        size_t num_bufs = bufs_data[0];
+        struct fuse_bufvec * buf = calloc(1, sizeof(*buf) + num_bufs * sizeof(struct fuse_buf));
+        static const enum fuse_buf_flags buf_flags[] = {0, FUSE_BUF_IS_FD, FUSE_BUF_FD_SEEK, FUSE_BUF_FD_RETRY};
+        buf->count = args[1];
+        buf->idx = args[2];
+        buf->off = args[3];
+        size_t i;
+        for(i = 0; i < num_bufs; i++) {
+            buf->buf[i].size = bufs_data[3 * i + 1];
+            buf->buf[i].flags = buf_flags[bufs_data[3 * i + 2]];
+            buf->buf[i].mem = malloc(buf->buf[i].size);
+            buf->buf[i].fd = path_to_fh(fhs, call->slot);
+            buf->buf[i].pos = bufs_data[3 * i + 3];
+        }
+        update_fi(fhs, call->slot, fi, &call->fi);
+        retval = op->write_buf(path, buf, args[0], fi);
+        for(i = 0; i < num_bufs; i++) {
+            free(buf->buf[i].mem);
+        }
+        free(buf);
+        break;
+    }
+    case TS_OP_READ_BUF:
+        TS_REQUIRE_OP(read_buf);
+        update_fi(fhs, call->slot, fi, &call->fi);
+        retval = op->read_buf(path, replay_buffer(args[0]), args[0], args[1], fi);
+        break;
+    case TS_OP_FLOCK:
+        TS_REQUIRE_OP(flock);
+        update_fi(fhs, call->slot, fi, &call->fi);
+        retval = op->flock(path, fi, args[0]);
+        break;
+    case TS_OP_FALLOCATE:
+        TS_REQUIRE_OP(fallocate);
+        update_fi(fhs, call->slot, fi, &call->fi);
+        retval = op->fallocate(path, args[0], args[1], args[2], fi);
+        break;
+
+    #endif
+
+    default:
+        report_testsuite_error("Cannot make call '%s' as it is not handled by the test suite", plan_string(group, call->func));
+        break;
+    }
+    return retval;
 }
 
-// Returns true if all tests passed, or false if a single test failed
-bool run_test_sequence(cJSON * calls);
-bool run_test_sequence(cJSON * calls) {
-    int num_calls = cJSON_GetArraySize(calls);
-    int i;
-    for(i = 0; i < num_calls; i++) {
-        cJSON * call = cJSON_GetArrayItem(calls, i);
-        const char * func_name = cJSON_GetObjectItem(call, "name")->valuestring;
-        cJSON * params = cJSON_GetObjectItem(call, "params");
-
-        // Call passthru filesystem and record any error string
-        bool passthru_func_not_defined = false;
-        int passthru_retval = make_call(passthru_ops, func_name, params, fi_passthru, fhs_passthru, &passthru_func_not_defined);
-        
-        // If the passthru function is not defined then there's either an error in our passthru fs or the test data is bad (or more up-to-date)
-        if(passthru_func_not_defined) {
-            ts_test_fail(func_name, NULL, "Cannot make call '%s' as it is not handled by the internal passthru filesystem", func_name);
-            return false;
-        }
+#undef TS_REQUIRE_OP
 
-        // Get the error string if there was an error
-        char * passthru_error = NULL;
-        if(passthru_retval < 0) {
-            passthru_error = strerror(errno);
-        }
+// What the group being run is doing, kept in memory shared with the parent when it runs in a child process,
+// so that if the filesystem crashes the parent can say where
+enum ts_child_phase { TS_PHASE_GROUP, TS_PHASE_CALL, TS_PHASE_CHECK, TS_PHASE_RESET, TS_PHASE_DONE };
 
-        // Call the filesystem under test
-        bool real_func_not_defined = false;
-        int real_retval = make_call(real_ops, func_name, params, fi_real, fhs_real, &real_func_not_defined);
+struct ts_child_state {
+    volatile int32_t phase;
+    volatile int32_t in_sequence;   // Whether a sequence has started and not yet ended
+    volatile int32_t real;          // Whether the call is being made on the filesystem under test
+    volatile uint32_t sequence;     // Index of the sequence being run
+    volatile uint32_t call;         // Index of the call within it
+};
 
-        // If the function is not defined they just need to implement it
-        if(real_func_not_defined) {
-            ts_test_fail(func_name, NULL, "Function not defined");
-            return false;
-        }
+static struct ts_child_state child_state_local;
+static struct ts_child_state * child_state = &child_state_local;
 
-        // Get the error string if there was an error (note: this relies on the users filesystem setting errno)
-        char * real_error = NULL;
-        if(real_retval < 0) {
-            real_error = strerror(errno);
-        }
-        
-        // Check that both functions either passed or failed
-        // For example, getattr may fail by returning -1 on one filesystem but another will return -6
-        // They both indicate failure and this is all that the FUSE/POSIX spec requires.
-        if((passthru_retval < 0 && real_retval >= 0) || (passthru_retval >= 0 && real_retval < 0)) {
-            // Report the error and skip checking for filesystem equivalence
+// Returns true if all tests passed, or false if a single test failed
+bool run_test_sequence(const struct ts_plan_group * group, const struct ts_plan_sequence * sequence);
+bool run_test_sequence(const struct ts_plan_group * group, const struct ts_plan_sequence * sequence) {
+    const struct ts_plan_call * calls = plan_data(group, sequence->calls);
+    uint32_t i;
+    for(i = 0; i < sequence->num_calls; i++) {
+        const struct ts_plan_call * call = &calls[i];
+        const char * func_name = plan_string(group, call->func);
+
+        // Identical back-to-back calls may have been compacted into one, so replay each of them
+        uint32_t r;
+        for(r = 0; r < call->repeat; r++) {
+            child_state->call = i;
+            child_state->phase = TS_PHASE_CALL;
+
+            // Call passthru filesystem and record any error string
+            child_state->real = 0;
+            bool passthru_func_not_defined = false;
+            int passthru_retval = replay_call(passthru_ops, group, call, fi_passthru, fhs_passthru, &passthru_func_not_defined);
+
+            // If the passthru function is not defined then there's either an error in our passthru fs or the test data is bad (or more up-to-date)
+            if(passthru_func_not_defined) {
+                ts_test_fail(func_name, NULL, "Cannot make call '%s' as it is not handled by the internal passthru filesystem", func_name);
+                return false;
+            }
+
+            // Get the error string if there was an error
+            char * passthru_error = NULL;
             if(passthru_retval < 0) {
-                ts_test_fail(func_name, params, "Expected call to fail with return value -1 but it returned %d which indicates success. It should have failed with this error: %s", real_retval, passthru_error);
-            } else {
-                ts_test_fail(func_name, params, "Expected call to pass with return value 0 but it returned %d which indicates failure. The filesystem reported this error: %s", real_retval, real_error);
+                passthru_error = strerror(errno);
             }
-            return false;
-        } else {
-            // Function returned the correct value so check whether the states both filesystems are equivalent
-            bool equivalent = assert_equivalent(passthru_ops, real_ops);
-            if(equivalent) {
-                // If we got to this point and the filesystems are equivalent then the test passes
-                ts_test_pass(func_name);
-            } else {
-                // don't need to report this one, as the assert method reports the specific errors
+
+            // Call the filesystem under test
+            child_state->real = 1;
+            bool real_func_not_defined = false;
+            int real_retval = replay_call(real_ops, group, call, fi_real, fhs_real, &real_func_not_defined);
+
+            // If the function is not defined they just need to implement it
+            if(real_func_not_defined) {
+                ts_test_fail(func_name, NULL, "Function not defined");
                 return false;
             }
+
+            // Get the error string if there was an error (note: this relies on the users filesystem setting errno)
+            char * real_error = NULL;
+            if(real_retval < 0) {
+                real_error = strerror(errno);
+            }
+
+            // Whatever the call could have changed has to be looked at again
+            ts_digests_touch_call(group, call);
+            child_state->phase = TS_PHASE_CHECK;
+
+            // Check that both functions either passed or failed
+            // For example, getattr may fail by returning -1 on one filesystem but another will return -6
+            // They both indicate failure and this is all that the FUSE/POSIX spec requires.
+            if((passthru_retval < 0 && real_retval >= 0) || (passthru_retval >= 0 && real_retval < 0)) {
+                // Report the error and skip checking for filesystem equivalence
+                if(passthru_retval < 0) {
+                    ts_test_fail(func_name, plan_params(group, call), "Expected call to fail with return value -1 but it returned %d which indicates success. It should have failed with this error: %s", real_retval, passthru_error);
+                } else {
+                    ts_test_fail(func_name, plan_params(group, call), "Expected call to pass with return value 0 but it returned %d which indicates failure. The filesystem reported this error: %s", real_retval, real_error);
+                }
+                return false;
+            } else {
+                // Function returned the correct value so check whether the states both filesystems are equivalent,
+                // looking only at what this call could have changed
+                bool equivalent = assert_equivalent_call(passthru_ops, real_ops, group, call);
+                if(equivalent) {
+                    // If we got to this point and the filesystems are equivalent then the test passes
+                    ts_test_pass(func_name);
+                } else {
+                    // don't need to report this one, as the assert method reports the specific errors
+                    return false;
+                }
+            }
         }
     }
-    return true;
+
+    // Compare the whole tree once the sequence is done, for anything the per-call checks couldn't see. A cached
+    // summary only covers what calls were known to touch, so none are trusted here
+    child_state->phase = TS_PHASE_CHECK;
+    ts_digests_clear_dirs();
+    return assert_equivalent(passthru_ops, real_ops);
 }
 
 // Test that basic operations work. This is more of a sanity check before ploughing through with the main tests.
@@ -1478,33 +2665,387 @@ bool test_basic_ops(const struct fuse_operations * op) {
     }
 }
 
-void testsuite_init(const struct fuse_operations * op, size_t op_size, char * mountpoint);
-void testsuite_init(const struct fuse_operations * op, size_t op_size, char * mpoint) {
+// Run a group of sequences, then reset the filesystem under test ready for the next
+// The passthru fs is reset by whoever runs the group, as its root may belong to the parent process
+void run_group(const struct ts_plan_group * group);
+void run_group(const struct ts_plan_group * group) {
+    child_state->phase = TS_PHASE_GROUP;
+    child_state->in_sequence = 0;
+    testsuite_grp_start(group->num_sequences);
+
+    // Setup new filehandle tables for this group, with a slot for each path it uses
+    // The real FUSE library would be responsible for keeping track of filehandles and passing them to functions
+    fhs_passthru = calloc(group->num_slots + 1, sizeof(*fhs_passthru));
+    fhs_real = calloc(group->num_slots + 1, sizeof(*fhs_real));
+
+    // Run sequences within this group, stopping if any test fails
+    bool group_passed = true;
+    const struct ts_plan_sequence * sequences = plan_data(group, group->sequences);
+    uint32_t j;
+    for(j = 0; j < group->num_sequences; j++) {
+        testsuite_seq_start(group, &sequences[j]);
+        child_state->sequence = j;
+        child_state->in_sequence = 1;
+        bool all_passed = run_test_sequence(group, &sequences[j]);
+        child_state->phase = TS_PHASE_GROUP;
+        child_state->in_sequence = 0;
+        if(all_passed) {
+            // Sequence passed
+            testsuite_seq_end(true);
+        } else {
+            // Sequence failed at some point, and group therefore fails too
+            testsuite_seq_end(false);
+            group_passed = false;
+            break;
+        }
+    }
+
+    // Reset the real filesystem
+    child_state->phase = TS_PHASE_RESET;
+    reset_filesystem(real_ops);
+
+    testsuite_grp_end(group_passed);
+    child_state->phase = TS_PHASE_DONE;
+
+    // Destroy filehandle tables
+    free(fhs_passthru);
+    free(fhs_real);
+}
+
+/* Each group runs in a child forked from the filesystem process
+ *
+ * Children start from the filesystem as it was once initialised, so a crash in the filesystem only loses the
+ * group it happened in, and is reported with the call it happened during. Each child reports events down a
+ * pipe of its own, and the parent passes them on in the order of the groups, holding back those of later groups
+ * while an earlier one is still running.
+ *
+ * Up to $FDT_TS_JOBS children run at once, each with its own passthru root. That only suits filesystems that
+ * keep their state in memory, which every child then has a copy-on-write copy of, so by default there's one.
+ */
+
+#define TS_MAX_JOBS 64
+
+struct ts_job {
+    pid_t pid;
+    int fd;                         // Read end of the child's pipe, or -1 once the child has finished
+    int slot;                       // Passthru root and shared state, each in use by one child at a time
+    int status;                     // As returned by waitpid
+    GByteArray * output;            // Events held back until the groups before this one are done
+    GByteArray * blob;              // The group, if it isn't in a mapped plan, kept in case it has to be reported on
+    const struct ts_plan_group * group;
+};
+
+static struct ts_job jobs[TS_MAX_JOBS];         // Running and finished groups, in order, from jobs_head
+static int jobs_head = 0;
+static int jobs_count = 0;
+static int jobs_max = 1;
+static bool job_slot_busy[TS_MAX_JOBS];
+static char * job_roots[TS_MAX_JOBS];
+static struct ts_child_state * job_states;      // One per slot, shared with the children
+
+void jobs_init(void);
+void jobs_init(void) {
+    const char * jobs_env = getenv(FDT_TS_JOBS_ENV);
+    jobs_max = jobs_env != NULL ? atoi(jobs_env) : 1;
+    if(jobs_max < 1) jobs_max = 1;
+    if(jobs_max > TS_MAX_JOBS) jobs_max = TS_MAX_JOBS;
+
+    job_states = mmap(NULL, TS_MAX_JOBS * sizeof(*job_states), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(job_states == MAP_FAILED) job_states = NULL;
+}
+
+void jobs_destroy(void);
+void jobs_destroy(void) {
+    int slot;
+    for(slot = 0; slot < TS_MAX_JOBS; slot++) {
+        // The first slot uses the passthru root itself, which is left in place as it always has been
+        if(slot > 0 && job_roots[slot] != NULL) {
+            remove_tree(job_roots[slot]);
+        }
+        free(job_roots[slot]);
+        job_roots[slot] = NULL;
+    }
+    if(job_states != NULL) {
+        munmap(job_states, TS_MAX_JOBS * sizeof(*job_states));
+        job_states = NULL;
+    }
+}
+
+// Pass events on to the test suite
+void forward_events(const void * data, size_t len);
+void forward_events(const void * data, size_t len) {
+    fwrite(data, 1, len, testsuite_fifo);
+    fflush(testsuite_fifo);
+}
+
+// Report what a child was doing when it died, and close off the sequence and group it was in
+void report_job_crash(const struct ts_job * job, const struct ts_child_state * state);
+void report_job_crash(const struct ts_job * job, const struct ts_child_state * state) {
+    const struct ts_plan_group * group = job->group;
+    char how[128];
+    if(WIFSIGNALED(job->status)) {
+        snprintf(how, sizeof(how), "crashed with signal %d (%s)", WTERMSIG(job->status), strsignal(WTERMSIG(job->status)));
+    } else {
+        snprintf(how, sizeof(how), "exited with status %d", WEXITSTATUS(job->status));
+    }
+    const char * which = state->real ? "The filesystem" : "The internal passthru filesystem";
+
+    if(state->in_sequence && state->sequence < group->num_sequences) {
+        const struct ts_plan_sequence * sequence = &((const struct ts_plan_sequence *) plan_data(group, group->sequences))[state->sequence];
+        if(state->call < sequence->num_calls) {
+            const struct ts_plan_call * call = &((const struct ts_plan_call *) plan_data(group, sequence->calls))[state->call];
+            const char * func_name = plan_string(group, call->func);
+            if(state->phase == TS_PHASE_CALL) {
+                ts_test_fail(func_name, plan_params(group, call), "%s %s during this call", which, how);
+            } else {
+                ts_test_fail(func_name, plan_params(group, call), "The filesystem %s while being compared with the passthru filesystem after this call", how);
+            }
+        } else {
+            ts_test_fail("__SEQUENCE", NULL, "The filesystem %s", how);
+        }
+        testsuite_seq_end(false);
+    } else if(state->phase == TS_PHASE_RESET) {
+        ts_test_fail("__RESET", NULL, "The filesystem %s while being reset after the group", how);
+    } else {
+        ts_test_fail("__GROUP", NULL, "The filesystem %s", how);
+    }
+    testsuite_grp_end(false);
+}
+
+// The filesystem under test is reset in a child of its own after a crash, in case that crashes too
+void reset_after_crash(void);
+void reset_after_crash(void) {
+    fflush(stdout);
+    fflush(testsuite_fifo);
+    pid_t pid = fork();
+    if(pid == 0) {
+        reset_filesystem(real_ops);
+        fflush(testsuite_fifo);
+        _exit(0);
+    }
+    int status = 0;
+    while(pid > 0 && waitpid(pid, &status, 0) < 0 && errno == EINTR);
+    if(pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        report_testsuite_error("The filesystem couldn't be reset after it crashed, so later groups may fail");
+    }
+}
+
+// Pass on what running children have reported, and wait for those whose pipes have closed
+void pump_jobs(void);
+void pump_jobs(void) {
+    struct pollfd fds[TS_MAX_JOBS];
+    struct ts_job * polled[TS_MAX_JOBS];
+    int num_polled = 0;
+    int k;
+    for(k = 0; k < jobs_count; k++) {
+        struct ts_job * job = &jobs[(jobs_head + k) % TS_MAX_JOBS];
+        if(job->fd < 0) continue;
+        fds[num_polled].fd = job->fd;
+        fds[num_polled].events = POLLIN;
+        fds[num_polled].revents = 0;
+        polled[num_polled++] = job;
+    }
+    if(num_polled == 0 || poll(fds, num_polled, -1) < 0) return;
+
+    static char buf[65536];
+    for(k = 0; k < num_polled; k++) {
+        if(fds[k].revents == 0) continue;
+        struct ts_job * job = polled[k];
+        ssize_t len = read(job->fd, buf, sizeof(buf));
+        if(len > 0) {
+            // Only the earliest group still going is passed on straight away
+            if(job == &jobs[jobs_head]) forward_events(buf, len);
+            else g_byte_array_append(job->output, (const guint8 *) buf, len);
+        } else if(len == 0 || errno != EINTR) {
+            close(job->fd);
+            job->fd = -1;
+            while(waitpid(job->pid, &job->status, 0) < 0 && errno == EINTR);
+        }
+    }
+}
+
+// Finish off groups from the front of the queue whose children are done, in order
+void retire_jobs(void);
+void retire_jobs(void) {
+    while(jobs_count > 0 && jobs[jobs_head].fd < 0) {
+        struct ts_job * job = &jobs[jobs_head];
+        struct ts_child_state * state = &job_states[job->slot];
+        if(!WIFEXITED(job->status) || WEXITSTATUS(job->status) != 0 || state->phase != TS_PHASE_DONE) {
+            report_job_crash(job, state);
+            reset_after_crash();
+        }
+
+        // The passthru root is ours, so it's swapped for an empty one here rather than in the child
+        if(!reset_passthru_root(job_roots[job->slot])) {
+            const char * saved_root = root_path;
+            root_path = job_roots[job->slot];
+            reset_filesystem_calls(passthru_ops, 1);
+            root_path = saved_root;
+        }
+
+        job_slot_busy[job->slot] = false;
+        g_byte_array_free(job->output, TRUE);
+        if(job->blob != NULL) g_byte_array_free(job->blob, TRUE);
+        jobs_head = (jobs_head + 1) % TS_MAX_JOBS;
+        jobs_count--;
+
+        // The next group is now the earliest, so whatever it's been holding back can go
+        if(jobs_count > 0 && jobs[jobs_head].output->len > 0) {
+            forward_events(jobs[jobs_head].output->data, jobs[jobs_head].output->len);
+            g_byte_array_set_size(jobs[jobs_head].output, 0);
+        }
+    }
+}
+
+// Wait for every group that's been started to finish
+void finish_jobs(void);
+void finish_jobs(void) {
+    while(jobs_count > 0) {
+        pump_jobs();
+        retire_jobs();
+    }
+}
+
+// Start running a group in a child, once there's room for another. The job takes the blob, if there is one
+// If a child can't be started, the group is run here instead, once those before it have finished
+void start_job(const struct ts_plan_group * group, GByteArray * blob);
+void start_job(const struct ts_plan_group * group, GByteArray * blob) {
+    while(jobs_count >= jobs_max) {
+        pump_jobs();
+        retire_jobs();
+    }
+
+    int slot;
+    for(slot = 0; slot < TS_MAX_JOBS && job_slot_busy[slot]; slot++);
+    if(job_roots[slot] == NULL) {
+        if(slot == 0) {
+            job_roots[slot] = strdup(root_path);
+        } else {
+            size_t root_len = strlen(root_path) + 16;
+            job_roots[slot] = malloc(root_len);
+            snprintf(job_roots[slot], root_len, "%s-%d", root_path, slot);
+        }
+        mkdir(job_roots[slot], 0777);
+    }
+
+    int fds[2];
+    pid_t pid = -1;
+    if(job_states != NULL && pipe(fds) == 0) {
+        // Anything still buffered would otherwise be written again by the child
+        fflush(stdout);
+        fflush(stderr);
+        fflush(testsuite_fifo);
+        pid = fork();
+        if(pid == 0) {
+            close(fds[0]);
+            fclose(testsuite_fifo);
+            testsuite_fifo = fdopen(fds[1], "w");
+            child_state = &job_states[slot];
+            memset((void *) child_state, 0, sizeof(*child_state));
+            root_path = job_roots[slot];
+            run_group(group);
+            fflush(testsuite_fifo);
+            _exit(0);
+        }
+        close(fds[1]);
+        if(pid < 0) close(fds[0]);
+    }
+
+    if(pid < 0) {
+        finish_jobs();
+        run_group(group);
+        reset_filesystem(passthru_ops);
+        if(blob != NULL) g_byte_array_free(blob, TRUE);
+        return;
+    }
+
+    struct ts_job * job = &jobs[(jobs_head + jobs_count) % TS_MAX_JOBS];
+    job->pid = pid;
+    job->fd = fds[0];
+    job->slot = slot;
+    job->status = 0;
+    job->output = g_byte_array_new();
+    job->blob = blob;
+    job->group = group;
+    job_slot_busy[slot] = true;
+    jobs_count++;
+}
+
+// Run every group of the test data. If there's a cached plan for it the groups are run from that, otherwise each
+// group is compiled and run as soon as it's been read, and the plan is cached once they all have been.
+// Returns false if the test data turned out not to be valid
+bool run_test_data(const struct test_data * data);
+bool run_test_data(const struct test_data * data) {
+    jobs_init();
+    bool valid = true;
+    if(data->plan != NULL) {
+        const struct ts_plan_group * group = plan_first_group(data->plan);
+        uint32_t i;
+        for(i = 0; i < data->plan->header->num_groups; i++, group = plan_next_group(group)) {
+            start_job(group, NULL);
+        }
+    } else {
+        struct plan_writer writer;
+        plan_writer_open(&writer, data->hash);
+        size_t pos = 0;
+        const char * text;
+        size_t text_len;
+        int found;
+        while((found = next_group_text(data, &pos, &text, &text_len)) == 1) {
+            cJSON * group_obj = parse_group_text(text, text_len);
+            if(group_obj == NULL) {
+                found = -1;
+                break;
+            }
+            GByteArray * group = compile_group(group_obj);
+            cJSON_Delete(group_obj);
+            plan_writer_add(&writer, group);
+            start_job((const struct ts_plan_group *) group->data, group);
+        }
+        plan_writer_close(&writer, found == 0);
+        valid = found == 0;
+    }
+    finish_jobs();
+    jobs_destroy();
+    return valid;
+}
+
+void testsuite_init(const struct fuse_operations * op, size_t op_size, char * mountpoint, bool multithreaded);
+void testsuite_init(const struct fuse_operations * op, size_t op_size, char * mpoint, bool multithreaded) {
     (void) op_size;
     printf("[libfuse] Called testsuite_init\n");
     real_ops = op;
     passthru_ops = &passthru_ops_s;
     mountpoint = mpoint;
+    reset_multithreaded = multithreaded;
     testsuite_fifo_init();
 
     // Load tests using the filename passed in the environment variable
     char * tests_file = getenv("TEST_DATA_FILE");
+    struct test_data data;
+    bool loaded = false;
+    errno = 0;
     if(tests_file != NULL && strlen(tests_file) > 0) {
-        groups = readJSONFile(tests_file);
-    } else {
-        groups = NULL;
+        loaded = open_test_data(tests_file, &data);
     }
 
-    if(groups != NULL) {
+    if(loaded) {
 
         // Create the root directory for the passthru filesystem, if it does not already exist
-        root_path = "/tmp/fdt-ts-root";
+        // Each session gets its own, so test suites can run against several filesystems at once
+        if(getenv(FDT_SESSION_ENV) != NULL) {
+            fdt_channel_name(getenv(FDT_SESSION_ENV), FDT_CHANNEL_TS_ROOT, testsuite_root_path, sizeof(testsuite_root_path));
+            root_path = testsuite_root_path;
+        } else {
+            root_path = "/tmp/fdt-ts-root";
+        }
         struct stat s;
         int retval = stat(root_path, &s);
         if(retval != 0) {
             retval = mkdir(root_path, 0777);
             if(retval != 0) {
                 report_testsuite_error("Unable to create root directory for passthru filesystem at '%s': %s", root_path, strerror(errno));
+                close_test_data(&data);
                 goto end;
             }
         }
@@ -1514,58 +3055,24 @@ void testsuite_init(const struct fuse_operations * op, size_t op_size, char * mp
         empty_fi(fi_passthru);
         fi_real = malloc(sizeof(*fi_real));
         empty_fi(fi_real);
+        ts_digests_init();
 
         // Make sure basic operations work before running the main tests
         // This includes deletion, for example, as chaos would ensue without this
         bool basics_ok = test_basic_ops(real_ops);
         if(basics_ok) {
-
-            // Run each group of sequences
-            int i;
-            for(i = 0; i < cJSON_GetArraySize(groups); i++) {
-                cJSON * group = cJSON_GetArrayItem(groups, i);
-                testsuite_grp_start(group);
-
-                // Setup new filehandle tables for this group
-                // These map from filename to filehandle, as the real FUSE library would be responsible for keeping track of them and passing them to functions
-                fhs_passthru = g_hash_table_new(g_str_hash, g_str_equal);
-                fhs_real = g_hash_table_new(g_str_hash, g_str_equal);
-
-                // Run sequences within this group, stopping if any test fails
-                bool group_passed = true;
-                int j;
-                for(j = 0; j < cJSON_GetArraySize(group); j++) {
-                    cJSON * sequence = cJSON_GetArrayItem(group, j);
-                    testsuite_seq_start(sequence);
-                    cJSON * calls = cJSON_GetObjectItem(sequence, "calls");
-                    bool all_passed = run_test_sequence(calls);
-                    if(all_passed) {
-                        // Sequence passed
-                        testsuite_seq_end(true);
-                    } else {
-                        // Sequence failed at some point, and group therefore fails too
-                        testsuite_seq_end(false);
-                        group_passed = false;
-                        break;
-                    }
-                }
-
-                // Reset the passthru and real filesystems
-                reset_filesystem(passthru_ops);
-                reset_filesystem(real_ops);
-
-                testsuite_grp_end(group_passed);
-
-                // Destroy filehandle tables
-                g_hash_table_destroy(fhs_passthru);
-                g_hash_table_destroy(fhs_real);
-
+            // Run each group of sequences, as it's read
+            if(!run_test_data(&data)) {
+                report_testsuite_error("Error parsing JSON test data");
             }
         } else {
             report_testsuite_error("Not running main test suite as a number of basic operations are not defined");
         }
+        reset_passthru_wait();
         free(fi_passthru);
         free(fi_real);
+        ts_digests_free();
+        close_test_data(&data);
     } else {
         if(errno == 0) {
             report_testsuite_error("Error parsing JSON test data");
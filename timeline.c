@@ -0,0 +1,527 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <gtk/gtk.h>
+#include <glib.h>
+
+#include "cJSON.h"
+#include "trace.h"
+#include "timeline.h"
+
+// Layout of the timeline, in pixels
+#define TIMELINE_RULER_HEIGHT 20
+#define TIMELINE_GUTTER_WIDTH 80
+#define TIMELINE_LANE_HEIGHT 16
+#define TIMELINE_LANE_GAP 3
+
+// Calls are drawn individually rather than as pixel columns when there are few enough of them to see
+#define TIMELINE_SPANS_PER_PIXEL 0.25
+
+static const double opcode_colours[][3] = {
+    {0.30, 0.55, 0.85}, {0.95, 0.60, 0.20}, {0.40, 0.70, 0.35}, {0.60, 0.45, 0.80},
+    {0.85, 0.75, 0.25}, {0.30, 0.70, 0.70}, {0.85, 0.45, 0.65}, {0.55, 0.55, 0.55}
+};
+static const double error_colour[3] = {0.85, 0.15, 0.15};
+
+/* GUI widgets and view state */
+static struct timeline * timeline = NULL;
+static GtkWidget * timeline_area;
+static GtkWidget * timeline_status;
+static int64_t view_start = 0;                  // Relative to the timeline's origin
+static int64_t view_span = 10 * G_USEC_PER_SEC;
+static bool follow = TRUE;                      // Keep the latest calls in view
+static bool dragging = FALSE;
+static double drag_x;
+static int64_t drag_view_start;
+
+static struct timeline_lane * laneNew(int tid) {
+    struct timeline_lane * lane = calloc(1, sizeof(*lane));
+    lane->tid = tid;
+    lane->spans = g_array_new(FALSE, FALSE, sizeof(struct timeline_span));
+    lane->busy = g_array_new(FALSE, TRUE, sizeof(int64_t));
+    lane->errors = g_array_new(FALSE, TRUE, sizeof(uint32_t));
+    lane->lod = g_ptr_array_new();
+    g_array_set_size(lane->busy, 1);
+    g_array_set_size(lane->errors, 1);
+    return lane;
+}
+
+static void laneReset(struct timeline_lane * lane) {
+    g_array_set_size(lane->spans, 0);
+    g_array_set_size(lane->busy, 1);
+    g_array_set_size(lane->errors, 1);
+    for(guint i = 0; i < lane->lod->len; i++) {
+        g_array_free(g_ptr_array_index(lane->lod, i), TRUE);
+    }
+    g_ptr_array_set_size(lane->lod, 0);
+}
+
+static void laneFree(struct timeline_lane * lane) {
+    laneReset(lane);
+    g_array_free(lane->spans, TRUE);
+    g_array_free(lane->busy, TRUE);
+    g_array_free(lane->errors, TRUE);
+    g_ptr_array_free(lane->lod, TRUE);
+    free(lane);
+}
+
+static inline struct timeline_span * laneSpan(struct timeline_lane * lane, size_t i) {
+    return &g_array_index(lane->spans, struct timeline_span, i);
+}
+
+static inline int64_t spanLength(struct timeline_lane * lane, uint32_t i) {
+    return laneSpan(lane, i)->end - laneSpan(lane, i)->start;
+}
+
+// Entry of a level of detail, where level 0 is the spans themselves
+static inline uint32_t lodItem(struct timeline_lane * lane, guint level, size_t pos) {
+    if(level == 0) return pos;
+    return g_array_index((GArray *) g_ptr_array_index(lane->lod, level - 1), uint32_t, pos);
+}
+
+static inline size_t lodLength(struct timeline_lane * lane, guint level) {
+    if(level == 0) return lane->spans->len;
+    return ((GArray *) g_ptr_array_index(lane->lod, level - 1))->len;
+}
+
+// Account for span i, which has just been appended, in every level of detail
+static void lodAppend(struct timeline_lane * lane, uint32_t i) {
+    for(guint level = 1; ; level++) {
+        if(level > lane->lod->len) {
+            // A level is only added once the one below it has two entries to summarise
+            if(lodLength(lane, level - 1) < 2) return;
+            uint32_t a = lodItem(lane, level - 1, 0);
+            uint32_t b = lodItem(lane, level - 1, 1);
+            uint32_t best = spanLength(lane, b) > spanLength(lane, a) ? b : a;
+            GArray * nodes = g_array_new(FALSE, FALSE, sizeof(uint32_t));
+            g_array_append_val(nodes, best);
+            g_ptr_array_add(lane->lod, nodes);
+            continue;
+        }
+
+        GArray * nodes = g_ptr_array_index(lane->lod, level - 1);
+        size_t node = i >> (TIMELINE_LOD_SHIFT * level);
+        if(node == nodes->len) {
+            g_array_append_val(nodes, i);
+        } else {
+            uint32_t * best = &g_array_index(nodes, uint32_t, node);
+            // Nothing above can change if this level didn't
+            if(spanLength(lane, i) <= spanLength(lane, *best)) return;
+            *best = i;
+        }
+    }
+}
+
+static void laneAppend(struct timeline_lane * lane, struct timeline_span * span) {
+    // Clocks can step backwards slightly between threads, but calls on one thread can't overlap
+    if(lane->spans->len > 0) {
+        int64_t prev_end = laneSpan(lane, lane->spans->len - 1)->end;
+        if(span->start < prev_end) span->start = prev_end;
+        if(span->end < span->start) span->end = span->start;
+    }
+
+    uint32_t i = lane->spans->len;
+    g_array_append_val(lane->spans, *span);
+    int64_t busy = g_array_index(lane->busy, int64_t, i) + (span->end - span->start);
+    uint32_t errors = g_array_index(lane->errors, uint32_t, i) + (span->retval < 0 ? 1 : 0);
+    g_array_append_val(lane->busy, busy);
+    g_array_append_val(lane->errors, errors);
+    lodAppend(lane, i);
+}
+
+// Longest span with an index in [lo, hi), or -1 if the range is empty
+static int64_t longestInRange(struct timeline_lane * lane, size_t lo, size_t hi) {
+    int64_t best = -1;
+    for(guint level = 0; lo < hi; level++) {
+        while(lo < hi && (lo & (TIMELINE_LOD_FANOUT - 1)) != 0) {
+            uint32_t item = lodItem(lane, level, lo++);
+            if(best < 0 || spanLength(lane, item) > spanLength(lane, best)) best = item;
+        }
+        while(lo < hi && (hi & (TIMELINE_LOD_FANOUT - 1)) != 0) {
+            uint32_t item = lodItem(lane, level, --hi);
+            if(best < 0 || spanLength(lane, item) > spanLength(lane, best)) best = item;
+        }
+        lo >>= TIMELINE_LOD_SHIFT;
+        hi >>= TIMELINE_LOD_SHIFT;
+    }
+    return best;
+}
+
+// First span ending after t
+static size_t firstEndingAfter(struct timeline_lane * lane, int64_t t) {
+    size_t lo = 0, hi = lane->spans->len;
+    while(lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if(laneSpan(lane, mid)->end > t) hi = mid;
+        else lo = mid + 1;
+    }
+    return lo;
+}
+
+// First span starting at or after t
+static size_t firstStartingFrom(struct timeline_lane * lane, int64_t t) {
+    size_t lo = 0, hi = lane->spans->len;
+    while(lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if(laneSpan(lane, mid)->start >= t) hi = mid;
+        else lo = mid + 1;
+    }
+    return lo;
+}
+
+/* Summarise the calls on a lane that overlap [from, to): the time spent in them, how many failed, and the longest
+ * Returns FALSE if no calls overlap it
+ */
+bool timelineColumn(struct timeline_lane * lane, int64_t from, int64_t to, int64_t * busy, uint32_t * errors, const struct timeline_span ** longest) {
+    size_t i = firstEndingAfter(lane, from);
+    size_t j = firstStartingFrom(lane, to);
+    if(i >= j) return FALSE;
+
+    *busy = g_array_index(lane->busy, int64_t, j) - g_array_index(lane->busy, int64_t, i);
+    struct timeline_span * first = laneSpan(lane, i);
+    struct timeline_span * last = laneSpan(lane, j - 1);
+    if(first->start < from) *busy -= from - first->start;
+    if(last->end > to) *busy -= last->end - to;
+    *errors = g_array_index(lane->errors, uint32_t, j) - g_array_index(lane->errors, uint32_t, i);
+    *longest = laneSpan(lane, longestInRange(lane, i, j));
+    return TRUE;
+}
+
+struct timeline * timelineNew() {
+    struct timeline * tl = calloc(1, sizeof(*tl));
+    tl->lanes = g_ptr_array_new();
+    tl->lane_index = g_hash_table_new(g_direct_hash, g_direct_equal);
+    return tl;
+}
+
+void timelineClear(struct timeline * tl) {
+    for(guint i = 0; i < tl->lanes->len; i++) {
+        laneFree(g_ptr_array_index(tl->lanes, i));
+    }
+    g_ptr_array_set_size(tl->lanes, 0);
+    g_hash_table_remove_all(tl->lane_index);
+    tl->has_origin = FALSE;
+    tl->origin = tl->first = tl->latest = 0;
+    tl->num_spans = 0;
+}
+
+void timelineFree(struct timeline * tl) {
+    if(tl == NULL) return;
+    timelineClear(tl);
+    g_ptr_array_free(tl->lanes, TRUE);
+    g_hash_table_destroy(tl->lane_index);
+    free(tl);
+}
+
+// Drop the older half of the calls, rebuilding each lane from what's left
+static void timelineTrim(struct timeline * tl) {
+    int64_t cut = tl->first + (tl->latest - tl->first) / 2;
+    GArray * kept = g_array_new(FALSE, FALSE, sizeof(struct timeline_span));
+    tl->num_spans = 0;
+    for(guint l = 0; l < tl->lanes->len; l++) {
+        struct timeline_lane * lane = g_ptr_array_index(tl->lanes, l);
+        size_t from = firstEndingAfter(lane, cut);
+        g_array_set_size(kept, 0);
+        g_array_append_vals(kept, laneSpan(lane, from), lane->spans->len - from);
+        laneReset(lane);
+        for(guint i = 0; i < kept->len; i++) {
+            laneAppend(lane, &g_array_index(kept, struct timeline_span, i));
+        }
+        tl->num_spans += lane->spans->len;
+    }
+    g_array_free(kept, TRUE);
+    tl->first = cut;
+}
+
+// Add a debugger event to the timeline. Must be called from the GUI thread, which draws the timeline
+void timelineHandleEvent(struct timeline * tl, cJSON * event) {
+    cJSON * tid_obj = cJSON_GetObjectItem(event, "tid");
+    cJSON * timestamp_obj = cJSON_GetObjectItem(event, "timestamp");
+    if(tid_obj == NULL || timestamp_obj == NULL) {
+        // Older libfuse wrappers don't say when or where calls ran
+        return;
+    }
+    int tid = (int) tid_obj->valuedouble;
+    int64_t timestamp = (int64_t) timestamp_obj->valuedouble;
+    if(!tl->has_origin) {
+        tl->has_origin = TRUE;
+        tl->origin = timestamp;
+    }
+    timestamp -= tl->origin;
+    if(timestamp > tl->latest) tl->latest = timestamp;
+
+    struct timeline_lane * lane = g_hash_table_lookup(tl->lane_index, GINT_TO_POINTER(tid));
+    if(lane == NULL) {
+        lane = laneNew(tid);
+        g_ptr_array_add(tl->lanes, lane);
+        g_hash_table_insert(tl->lane_index, GINT_TO_POINTER(tid), lane);
+    }
+
+    const char * type = cJSON_GetObjectItem(event, "type")->valuestring;
+    const char * name = cJSON_GetObjectItem(event, "name")->valuestring;
+    if(strcmp(type, "invoke") == 0) {
+        lane->inflight = TRUE;
+        lane->inflight_start = timestamp;
+        lane->inflight_opcode = traceOpcode(name);
+    } else if(strcmp(type, "return") == 0) {
+        struct timeline_span span;
+        span.end = timestamp;
+        cJSON * elapsed_obj = cJSON_GetObjectItem(event, "elapsed");
+        if(elapsed_obj != NULL) {
+            span.start = timestamp - (int64_t) (elapsed_obj->valuedouble / 1000);
+        } else {
+            span.start = lane->inflight ? lane->inflight_start : timestamp;
+        }
+        cJSON * returnval_obj = cJSON_GetObjectItem(event, "returnval");
+        span.retval = returnval_obj != NULL && returnval_obj->type == cJSON_Number ? returnval_obj->valueint : 0;
+        span.opcode = traceOpcode(name);
+        lane->inflight = FALSE;
+
+        laneAppend(lane, &span);
+        if(tl->num_spans++ == 0) tl->first = span.start;
+        if(tl->num_spans > TIMELINE_MAX_SPANS) {
+            timelineTrim(tl);
+        }
+    }
+}
+
+/* Drawing */
+
+static void setOpcodeColour(cairo_t * cr, int opcode, bool error, double alpha) {
+    const double * rgb = error ? error_colour : opcode_colours[opcode % G_N_ELEMENTS(opcode_colours)];
+    cairo_set_source_rgba(cr, rgb[0], rgb[1], rgb[2], alpha);
+}
+
+// Tick spacing of 1, 2 or 5 times a power of ten, leaving at least min_px between ticks
+static int64_t tickStep(double us_per_px, double min_px) {
+    double target = us_per_px * min_px;
+    int64_t step = 1;
+    while(TRUE) {
+        if(step >= target) return step;
+        if(step * 2 >= target) return step * 2;
+        if(step * 5 >= target) return step * 5;
+        step *= 10;
+    }
+}
+
+static void drawRuler(cairo_t * cr, int width, double us_per_px) {
+    int64_t step = tickStep(us_per_px, 90);
+    const char * format = step >= G_USEC_PER_SEC ? "%.0fs" : step >= 1000 ? "%.3fs" : "%.6fs";
+    cairo_set_source_rgb(cr, 0.3, 0.3, 0.3);
+    cairo_set_line_width(cr, 1);
+    char label[32];
+    for(int64_t t = (view_start / step) * step; t < view_start + view_span; t += step) {
+        double x = TIMELINE_GUTTER_WIDTH + (t - view_start) / us_per_px;
+        if(x < TIMELINE_GUTTER_WIDTH) continue;
+        cairo_move_to(cr, floor(x) + 0.5, TIMELINE_RULER_HEIGHT - 6);
+        cairo_line_to(cr, floor(x) + 0.5, TIMELINE_RULER_HEIGHT);
+        cairo_stroke(cr);
+        snprintf(label, sizeof(label), format, (double) t / G_USEC_PER_SEC);
+        cairo_move_to(cr, x + 2, TIMELINE_RULER_HEIGHT - 8);
+        cairo_show_text(cr, label);
+    }
+}
+
+static void drawLane(cairo_t * cr, struct timeline_lane * lane, double y, int width, double us_per_px) {
+    int columns = width - TIMELINE_GUTTER_WIDTH;
+    int64_t view_end = view_start + view_span;
+
+    size_t first = firstEndingAfter(lane, view_start);
+    size_t last = firstStartingFrom(lane, view_end);
+    if(last > first && last - first <= columns * TIMELINE_SPANS_PER_PIXEL) {
+        // Few enough calls to draw each of them
+        for(size_t i = first; i < last; i++) {
+            struct timeline_span * span = laneSpan(lane, i);
+            double x0 = TIMELINE_GUTTER_WIDTH + MAX(span->start - view_start, 0) / us_per_px;
+            double x1 = TIMELINE_GUTTER_WIDTH + MIN(span->end - view_start, view_span) / us_per_px;
+            setOpcodeColour(cr, span->opcode, span->retval < 0, 0.9);
+            cairo_rectangle(cr, x0, y, MAX(x1 - x0, 1), TIMELINE_LANE_HEIGHT);
+            cairo_fill_preserve(cr);
+            cairo_set_source_rgba(cr, 0, 0, 0, 0.4);
+            cairo_set_line_width(cr, 1);
+            cairo_stroke(cr);
+        }
+    } else if(last > first) {
+        // Otherwise each pixel column shows the longest call in it, and how busy the thread was
+        for(int c = 0; c < columns; c++) {
+            int64_t from = view_start + (int64_t) (c * us_per_px);
+            int64_t to = view_start + (int64_t) ((c + 1) * us_per_px);
+            int64_t busy;
+            uint32_t errors;
+            const struct timeline_span * longest;
+            if(to <= from || !timelineColumn(lane, from, to, &busy, &errors, &longest)) continue;
+
+            double density = MIN((double) busy / (to - from), 1.0);
+            setOpcodeColour(cr, longest->opcode, longest->retval < 0, 0.25 + 0.75 * density);
+            cairo_rectangle(cr, TIMELINE_GUTTER_WIDTH + c, y, 1, TIMELINE_LANE_HEIGHT);
+            cairo_fill(cr);
+            if(errors > 0) {
+                setOpcodeColour(cr, 0, TRUE, 1);
+                cairo_rectangle(cr, TIMELINE_GUTTER_WIDTH + c, y, 1, 3);
+                cairo_fill(cr);
+            }
+        }
+    }
+
+    // A call still running is drawn up to the latest event, which is what everything else is queued behind
+    if(lane->inflight && lane->inflight_start < view_end) {
+        double x0 = TIMELINE_GUTTER_WIDTH + MAX(lane->inflight_start - view_start, 0) / us_per_px;
+        double x1 = TIMELINE_GUTTER_WIDTH + MIN(timeline->latest - view_start, view_span) / us_per_px;
+        if(x1 > x0) {
+            setOpcodeColour(cr, lane->inflight_opcode, FALSE, 0.45);
+            cairo_rectangle(cr, x0, y + TIMELINE_LANE_HEIGHT / 4, x1 - x0, TIMELINE_LANE_HEIGHT / 2);
+            cairo_fill(cr);
+        }
+    }
+
+    char label[32];
+    snprintf(label, sizeof(label), "tid %d", lane->tid);
+    cairo_set_source_rgb(cr, 0.2, 0.2, 0.2);
+    cairo_move_to(cr, 4, y + TIMELINE_LANE_HEIGHT - 4);
+    cairo_show_text(cr, label);
+}
+
+static gboolean timeline_expose_handler(GtkWidget * widget, GdkEventExpose * event, gpointer data) {
+    GtkAllocation allocation;
+    gtk_widget_get_allocation(widget, &allocation);
+    int width = allocation.width;
+    if(width <= TIMELINE_GUTTER_WIDTH) return TRUE;
+
+    if(follow) {
+        view_start = MAX(timeline->latest - view_span, 0);
+    }
+    double us_per_px = (double) view_span / (width - TIMELINE_GUTTER_WIDTH);
+
+    cairo_t * cr = gdk_cairo_create(gtk_widget_get_window(widget));
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    cairo_paint(cr);
+    cairo_select_font_face(cr, "Sans", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+    cairo_set_font_size(cr, 10);
+
+    drawRuler(cr, width, us_per_px);
+    for(guint l = 0; l < timeline->lanes->len; l++) {
+        double y = TIMELINE_RULER_HEIGHT + TIMELINE_LANE_GAP + l * (TIMELINE_LANE_HEIGHT + TIMELINE_LANE_GAP);
+        drawLane(cr, g_ptr_array_index(timeline->lanes, l), y, width, us_per_px);
+    }
+    cairo_destroy(cr);
+    return TRUE;
+}
+
+/* Interaction: scroll to zoom around the pointer, drag to pan, and double-click to follow the latest calls again */
+
+static double usPerPixel() {
+    GtkAllocation allocation;
+    gtk_widget_get_allocation(timeline_area, &allocation);
+    return (double) view_span / MAX(allocation.width - TIMELINE_GUTTER_WIDTH, 1);
+}
+
+static gboolean timeline_scroll_handler(GtkWidget * widget, GdkEventScroll * event, gpointer data) {
+    double us_per_px = usPerPixel();
+    double x = MAX(event->x - TIMELINE_GUTTER_WIDTH, 0);
+    int64_t pointer_time = view_start + (int64_t) (x * us_per_px);
+
+    if(event->direction == GDK_SCROLL_UP) {
+        view_span = MAX(view_span * 4 / 5, 10);
+    } else if(event->direction == GDK_SCROLL_DOWN) {
+        view_span = MIN(view_span * 5 / 4, (int64_t) 7 * 24 * 3600 * G_USEC_PER_SEC);
+    } else {
+        return FALSE;
+    }
+
+    // Keep the time under the pointer where it was, unless the latest calls are being followed
+    if(!follow) {
+        view_start = pointer_time - (int64_t) (x * usPerPixel());
+    }
+    gtk_widget_queue_draw(timeline_area);
+    return TRUE;
+}
+
+static gboolean timeline_button_handler(GtkWidget * widget, GdkEventButton * event, gpointer data) {
+    if(event->button != 1) return FALSE;
+    if(event->type == GDK_2BUTTON_PRESS) {
+        follow = TRUE;
+        dragging = FALSE;
+        gtk_widget_queue_draw(timeline_area);
+    } else if(event->type == GDK_BUTTON_PRESS) {
+        follow = FALSE;
+        dragging = TRUE;
+        drag_x = event->x;
+        drag_view_start = view_start;
+    } else if(event->type == GDK_BUTTON_RELEASE) {
+        dragging = FALSE;
+    }
+    return TRUE;
+}
+
+// Describe the call under the pointer
+static void showCallAt(double x, double y) {
+    int l = (int) ((y - TIMELINE_RULER_HEIGHT - TIMELINE_LANE_GAP) / (TIMELINE_LANE_HEIGHT + TIMELINE_LANE_GAP));
+    if(x < TIMELINE_GUTTER_WIDTH || y < TIMELINE_RULER_HEIGHT || l < 0 || l >= (int) timeline->lanes->len) {
+        gtk_label_set_text(GTK_LABEL(timeline_status), "");
+        return;
+    }
+    struct timeline_lane * lane = g_ptr_array_index(timeline->lanes, l);
+    double us_per_px = usPerPixel();
+    int64_t t = view_start + (int64_t) ((x - TIMELINE_GUTTER_WIDTH) * us_per_px);
+
+    int64_t busy;
+    uint32_t errors;
+    const struct timeline_span * longest;
+    char status[256];
+    if(timelineColumn(lane, t, t + (int64_t) us_per_px + 1, &busy, &errors, &longest)) {
+        snprintf(status, sizeof(status), "%s on thread %d at %.6fs took %.3fms and returned %d",
+                 traceOpName(longest->opcode), lane->tid, (double) longest->start / G_USEC_PER_SEC,
+                 (longest->end - longest->start) / 1000.0, longest->retval);
+    } else {
+        snprintf(status, sizeof(status), "Thread %d idle at %.6fs", lane->tid, (double) t / G_USEC_PER_SEC);
+    }
+    gtk_label_set_text(GTK_LABEL(timeline_status), status);
+}
+
+static gboolean timeline_motion_handler(GtkWidget * widget, GdkEventMotion * event, gpointer data) {
+    if(dragging) {
+        view_start = drag_view_start - (int64_t) ((event->x - drag_x) * usPerPixel());
+        gtk_widget_queue_draw(timeline_area);
+    } else {
+        showCallAt(event->x, event->y);
+    }
+    return TRUE;
+}
+
+GtkWidget * createTimelineView(struct timeline * tl) {
+    timeline = tl;
+
+    GtkWidget * view = gtk_vbox_new(FALSE, 5);
+
+    GtkWidget * scrolled_window = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+
+    timeline_area = gtk_drawing_area_new();
+    gtk_widget_add_events(timeline_area, GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK | GDK_POINTER_MOTION_MASK | GDK_SCROLL_MASK);
+    g_signal_connect(timeline_area, "expose-event", G_CALLBACK(timeline_expose_handler), NULL);
+    g_signal_connect(timeline_area, "scroll-event", G_CALLBACK(timeline_scroll_handler), NULL);
+    g_signal_connect(timeline_area, "button-press-event", G_CALLBACK(timeline_button_handler), NULL);
+    g_signal_connect(timeline_area, "button-release-event", G_CALLBACK(timeline_button_handler), NULL);
+    g_signal_connect(timeline_area, "motion-notify-event", G_CALLBACK(timeline_motion_handler), NULL);
+    gtk_scrolled_window_add_with_viewport(GTK_SCROLLED_WINDOW(scrolled_window), timeline_area);
+    gtk_widget_show(timeline_area);
+    gtk_widget_show(scrolled_window);
+    gtk_box_pack_start((GtkBox *) view, scrolled_window, TRUE, TRUE, 0);
+
+    timeline_status = gtk_label_new("Scroll to zoom, drag to pan, and double-click to follow the latest calls");
+    gtk_misc_set_alignment(GTK_MISC(timeline_status), 0, 0.5);
+    gtk_widget_show(timeline_status);
+    gtk_box_pack_start((GtkBox *) view, timeline_status, FALSE, TRUE, 0);
+
+    return view;
+}
+
+// Redraw once new events have been added, growing the drawing area if there are new threads
+void timelineRefresh() {
+    if(timeline == NULL) return;
+    int height = TIMELINE_RULER_HEIGHT + TIMELINE_LANE_GAP + timeline->lanes->len * (TIMELINE_LANE_HEIGHT + TIMELINE_LANE_GAP);
+    gtk_widget_set_size_request(timeline_area, -1, height);
+    gtk_widget_queue_draw(timeline_area);
+}
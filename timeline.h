@@ -0,0 +1,59 @@
+#pragma once
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdbool.h>
+#include <gtk/gtk.h>
+#include <glib.h>
+
+#include "cJSON.h"
+
+// Calls kept before the older half of them is dropped
+#define TIMELINE_MAX_SPANS (2 * 1024 * 1024)
+
+// Each level of detail summarises this many entries of the level below
+#define TIMELINE_LOD_SHIFT 3
+#define TIMELINE_LOD_FANOUT (1 << TIMELINE_LOD_SHIFT)
+
+// A call on one thread from invocation to return, in microseconds since the first call
+struct timeline_span {
+    int64_t start;
+    int64_t end;
+    int32_t retval;
+    uint8_t opcode;
+};
+
+/* Calls made by one thread
+ * A thread handles one call at a time, so its spans are sorted by both start and end. Prefix sums give
+ * the busy time and number of errors between any two spans, and each level of detail holds the longest
+ * of TIMELINE_LOD_FANOUT entries of the level below, so a pixel column is summarised in O(log n)
+ * however many calls fall into it.
+ */
+struct timeline_lane {
+    int tid;
+    GArray * spans;         // struct timeline_span
+    GArray * busy;          // int64_t, where busy[i] is the total length of the spans before i
+    GArray * errors;        // uint32_t, where errors[i] is the number of failed spans before i
+    GPtrArray * lod;        // One GArray of uint32_t span indices per level, starting with the level above the spans
+    bool inflight;
+    int64_t inflight_start;
+    uint8_t inflight_opcode;
+};
+
+struct timeline {
+    GPtrArray * lanes;          // In the order the threads were first seen
+    GHashTable * lane_index;    // tid to lane
+    bool has_origin;
+    int64_t origin;             // Time of the first call, in microseconds since the epoch
+    int64_t first;              // Start of the oldest call kept, relative to origin
+    int64_t latest;             // Relative to origin
+    size_t num_spans;
+};
+
+struct timeline * timelineNew();
+void timelineFree(struct timeline * tl);
+void timelineClear(struct timeline * tl);
+void timelineHandleEvent(struct timeline * tl, cJSON * event);
+bool timelineColumn(struct timeline_lane * lane, int64_t from, int64_t to, int64_t * busy, uint32_t * errors, const struct timeline_span ** longest);
+
+GtkWidget * createTimelineView(struct timeline * tl);
+void timelineRefresh();
@@ -0,0 +1,259 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#include "top.h"
+
+static bool isAlive(pid_t pid) {
+    return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+/* Look for the counters of a running filesystem, returning its pid or 0
+ * Shared memory objects are only listed under /dev/shm on Linux, elsewhere the pid has to be given
+ */
+static pid_t findStatsPid() {
+#if __linux__
+    DIR * dir = opendir("/dev/shm");
+    if(dir == NULL) {
+        perror("Unable to list /dev/shm");
+        return 0;
+    }
+    const char * prefix = FDT_STATS_SHM_PREFIX + 1;
+    pid_t found = 0;
+    int num_found = 0;
+    struct dirent * entry;
+    while((entry = readdir(dir)) != NULL) {
+        if(strncmp(entry->d_name, prefix, strlen(prefix)) != 0) continue;
+        pid_t pid = atoi(entry->d_name + strlen(prefix));
+        if(pid <= 0 || !isAlive(pid)) continue;
+        if(num_found == 0) fprintf(stderr, "Filesystems with live counters:");
+        fprintf(stderr, " %d", pid);
+        found = pid;
+        num_found++;
+    }
+    closedir(dir);
+    if(num_found > 0) fprintf(stderr, "\n");
+
+    if(num_found == 0) {
+        fprintf(stderr, "No running filesystem started through fdt was found\n");
+        return 0;
+    } else if(num_found > 1) {
+        fprintf(stderr, "Please choose one by giving its pid\n");
+        return 0;
+    }
+    return found;
+#else
+    fprintf(stderr, "Please give the pid of the filesystem\n");
+    return 0;
+#endif
+}
+
+/* Map the counters of a filesystem read-only, or return NULL if it has none
+ * Quiet callers poll for counters that may not have been created yet, so failures aren't reported to them
+ */
+const struct fdt_stats * openStats(pid_t pid, bool quiet) {
+    char name[64];
+    snprintf(name, sizeof(name), FDT_STATS_SHM_PREFIX "%d", pid);
+    int fd = shm_open(name, O_RDONLY, 0);
+    if(fd < 0) {
+        if(!quiet) fprintf(stderr, "No counters for pid %d: %s\n", pid, strerror(errno));
+        return NULL;
+    }
+    const struct fdt_stats * stats = mmap(NULL, sizeof(struct fdt_stats), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(stats == MAP_FAILED) {
+        if(!quiet) perror("Unable to map counters");
+        return NULL;
+    }
+    if(__atomic_load_n(&stats->magic, __ATOMIC_ACQUIRE) != FDT_STATS_MAGIC || stats->version != FDT_STATS_VERSION) {
+        if(!quiet) fprintf(stderr, "Counters for pid %d are from a different version of fdt\n", pid);
+        closeStats(stats);
+        return NULL;
+    }
+    return stats;
+}
+
+void closeStats(const struct fdt_stats * stats) {
+    munmap((void *) stats, sizeof(struct fdt_stats));
+}
+
+// Latency at quantile q of a histogram with a bucket per power of two, interpolating within the bucket
+double histogramPercentile(const uint64_t * hist, uint64_t total, double q) {
+    if(total == 0) return 0;
+    uint64_t target = (uint64_t) (q * (total - 1)) + 1;
+    uint64_t seen = 0;
+    for(int b = 0; b < FDT_STATS_LATENCY_BUCKETS; b++) {
+        if(hist[b] == 0) continue;
+        if(seen + hist[b] >= target) {
+            double low = b == 0 ? 0 : (double) (1ULL << (b - 1));
+            double high = b == 0 ? 1 : low * 2;
+            return low + (high - low) * (target - seen) / hist[b];
+        }
+        seen += hist[b];
+    }
+    return 0;
+}
+
+void formatLatency(char * buf, size_t len, double ns) {
+    if(ns < 1000) snprintf(buf, len, "%.0fns", ns);
+    else if(ns < 1000000) snprintf(buf, len, "%.1fus", ns / 1000);
+    else if(ns < 1000000000) snprintf(buf, len, "%.1fms", ns / 1000000);
+    else snprintf(buf, len, "%.2fs", ns / 1000000000);
+}
+
+static void clientName(pid_t pid, char * buf, size_t len) {
+    buf[0] = '\0';
+#if __linux__
+    char proc_path[64];
+    snprintf(proc_path, sizeof(proc_path), "/proc/%d/comm", pid);
+    FILE * comm = fopen(proc_path, "r");
+    if(comm != NULL) {
+        if(fgets(buf, len, comm) != NULL) buf[strcspn(buf, "\n")] = '\0';
+        fclose(comm);
+    }
+#endif
+}
+
+struct top_row {
+    int slot;
+    uint64_t rate;
+};
+
+static int compareRows(const void * a, const void * b) {
+    const struct top_row * ra = a;
+    const struct top_row * rb = b;
+    if(ra->rate == rb->rate) return ra->slot - rb->slot;
+    return ra->rate < rb->rate ? 1 : -1;
+}
+
+/* Calls per interval for a slot, or its count so far if it changed hands during the interval
+ * The counts of a contested slot are worn down, so this only ranks the heaviest clients and paths
+ */
+static uint64_t slotRate(uint32_t key, uint32_t prev_key, uint64_t calls, uint64_t prev_calls) {
+    if(key == 0) return 0;
+    if(key != prev_key || calls < prev_calls) return calls;
+    return calls - prev_calls;
+}
+
+static void printOperations(const struct fdt_stats * now, const struct fdt_stats * prev, double secs) {
+    printf("%-12s %10s %10s %9s %9s %9s\n", "op", "ops/s", "total", "err%", "p50", "p99");
+    uint64_t calls = 0, returns = 0, errors = 0;
+    for(int o = 0; o < FDT_STATS_OPS; o++) {
+        const struct fdt_op_counters * cur = &now->ops[o];
+        const struct fdt_op_counters * old = &prev->ops[o];
+        uint64_t d_returns = cur->returns - old->returns;
+        calls += cur->calls - old->calls;
+        returns += d_returns;
+        errors += cur->errors - old->errors;
+        if(d_returns == 0) continue;
+
+        uint64_t hist[FDT_STATS_LATENCY_BUCKETS];
+        for(int b = 0; b < FDT_STATS_LATENCY_BUCKETS; b++) hist[b] = cur->latency[b] - old->latency[b];
+        char p50[16], p99[16];
+        formatLatency(p50, sizeof(p50), histogramPercentile(hist, d_returns, 0.5));
+        formatLatency(p99, sizeof(p99), histogramPercentile(hist, d_returns, 0.99));
+        printf("%-12s %10.0f %10llu %8.2f%% %9s %9s\n", fdt_stats_op_name(o), d_returns / secs,
+                (unsigned long long) cur->returns, (cur->errors - old->errors) * 100.0 / d_returns, p50, p99);
+    }
+    printf("\nTotal: %.0f calls/s, %.0f returns/s, %.2f%% errors, %lld in flight\n", calls / secs, returns / secs,
+            returns > 0 ? errors * 100.0 / returns : 0.0, (long long) now->in_flight);
+}
+
+static void printClients(const struct fdt_stats * now, const struct fdt_stats * prev, double secs) {
+    struct top_row rows[FDT_STATS_PID_SLOTS];
+    int n = 0;
+    for(int s = 0; s < FDT_STATS_PID_SLOTS; s++) {
+        uint64_t rate = slotRate(now->pids[s].pid, prev->pids[s].pid, now->pids[s].calls, prev->pids[s].calls);
+        if(rate > 0) {
+            rows[n].slot = s;
+            rows[n].rate = rate;
+            n++;
+        }
+    }
+    qsort(rows, n, sizeof(rows[0]), compareRows);
+
+    printf("\n%-8s %-16s %10s\n", "pid", "client", "calls/s");
+    for(int i = 0; i < n && i < TOP_ROWS; i++) {
+        char name[32];
+        clientName(now->pids[rows[i].slot].pid, name, sizeof(name));
+        printf("%-8d %-16s %10.0f\n", now->pids[rows[i].slot].pid, name, rows[i].rate / secs);
+    }
+}
+
+static void printPaths(const struct fdt_stats * now, const struct fdt_stats * prev, double secs) {
+    struct top_row rows[FDT_STATS_PATH_SLOTS];
+    int n = 0;
+    for(int s = 0; s < FDT_STATS_PATH_SLOTS; s++) {
+        if(!now->paths[s].ready) continue;
+        uint64_t rate = slotRate(now->paths[s].hash, prev->paths[s].hash, now->paths[s].calls, prev->paths[s].calls);
+        if(rate > 0) {
+            rows[n].slot = s;
+            rows[n].rate = rate;
+            n++;
+        }
+    }
+    qsort(rows, n, sizeof(rows[0]), compareRows);
+
+    printf("\n%10s  %s\n", "calls/s", "path");
+    for(int i = 0; i < n && i < TOP_ROWS; i++) {
+        printf("%10.0f  %.*s\n", rows[i].rate / secs, FDT_STATS_PATH_LEN, now->paths[rows[i].slot].path);
+    }
+}
+
+static double monotonicSeconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/* Redraw a live view of a filesystem's counters every TOP_INTERVAL seconds until it exits
+ * Everything shown is a difference between two copies of the counters, so the filesystem does no extra work
+ */
+int runTop(pid_t fs_pid) {
+    if(fs_pid == 0) fs_pid = findStatsPid();
+    if(fs_pid == 0) return 1;
+    const struct fdt_stats * stats = openStats(fs_pid, false);
+    if(stats == NULL) return 1;
+
+    struct fdt_stats * prev = malloc(sizeof(struct fdt_stats));
+    struct fdt_stats * now = malloc(sizeof(struct fdt_stats));
+    memcpy(prev, stats, sizeof(struct fdt_stats));
+    double prev_time = monotonicSeconds();
+
+    while(isAlive(fs_pid)) {
+        sleep(TOP_INTERVAL);
+        memcpy(now, stats, sizeof(struct fdt_stats));
+        double now_time = monotonicSeconds();
+        double secs = now_time - prev_time > 0 ? now_time - prev_time : TOP_INTERVAL;
+
+        // Clear the screen and move to the top left
+        printf("\033[H\033[2J");
+        printf("fdt top - filesystem pid %d\n\n", fs_pid);
+        printOperations(now, prev, secs);
+        printClients(now, prev, secs);
+        printPaths(now, prev, secs);
+        fflush(stdout);
+
+        struct fdt_stats * tmp = prev;
+        prev = now;
+        now = tmp;
+        prev_time = now_time;
+    }
+    printf("Filesystem %d has exited\n", fs_pid);
+
+    free(prev);
+    free(now);
+    closeStats(stats);
+    return 0;
+}
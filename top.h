@@ -0,0 +1,20 @@
+#pragma once
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fdt_stats.h"
+
+// How often the dashboard is redrawn, in seconds
+#define TOP_INTERVAL 1
+
+// Rows shown in the client and path tables
+#define TOP_ROWS 8
+
+const struct fdt_stats * openStats(pid_t pid, bool quiet);
+void closeStats(const struct fdt_stats * stats);
+double histogramPercentile(const uint64_t * hist, uint64_t total, double q);
+void formatLatency(char * buf, size_t len, double ns);
+int runTop(pid_t fs_pid);
@@ -0,0 +1,597 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "cJSON.h"
+#include "fdt_stats.h"
+#include "trace.h"
+
+struct trace_writer {
+    char * dir;
+    size_t segment_size;
+    bool path_bloom;
+
+    FILE * file;
+    uint32_t segment_num;
+    uint64_t offset;
+
+    // Summary and index of the segment currently being written
+    struct trace_index_footer footer;
+    struct trace_index_entry * entries;
+    uint32_t entries_capacity;
+    uint32_t block_records;
+    uint8_t * bloom;
+};
+
+struct trace_segment {
+    uint8_t * data;
+    size_t size;
+    size_t end;     // Offset just past the last complete record
+
+    struct trace_index_footer footer;
+    const struct trace_index_entry * entries;
+    struct trace_index_entry * scanned_entries;     // Index built by scanning a segment without a footer
+    const uint8_t * bloom;
+};
+
+struct trace_reader {
+    struct trace_segment * segments;
+    int num_segments;
+};
+
+// Opcodes are shared with the live counters in fdt_stats.h, and fit in the 64-bit opcode masks of the index
+int traceOpcode(const char * name) {
+    return fdt_stats_opcode(name);
+}
+
+const char * traceOpName(int opcode) {
+    return fdt_stats_op_name(opcode);
+}
+
+// FNV-1a
+uint32_t tracePathHash(const char * path) {
+    uint32_t hash = 2166136261u;
+    for(const unsigned char * c = (const unsigned char *) path; *c != '\0'; c++) {
+        hash ^= *c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Bloom filter bit positions are derived from the path hash by double hashing
+static uint32_t bloomBit(uint32_t hash, int i, uint32_t bits) {
+    uint32_t hash2 = (hash >> 17 | hash << 15) * 0x9E3779B1u | 1;
+    return (hash + i * hash2) % bits;
+}
+
+static void resetSegmentSummary(struct trace_index_footer * footer) {
+    memset(footer, 0, sizeof(*footer));
+    footer->min_seqnum = INT64_MAX;
+    footer->max_seqnum = INT64_MIN;
+    footer->min_timestamp = INT64_MAX;
+    footer->max_timestamp = INT64_MIN;
+}
+
+static void updateIndexEntry(struct trace_index_entry * entry, const struct trace_record * rec) {
+    if(rec->seqnum < entry->min_seqnum) entry->min_seqnum = rec->seqnum;
+    if(rec->seqnum > entry->max_seqnum) entry->max_seqnum = rec->seqnum;
+    if(rec->timestamp < entry->min_timestamp) entry->min_timestamp = rec->timestamp;
+    if(rec->timestamp > entry->max_timestamp) entry->max_timestamp = rec->timestamp;
+    entry->opcodes |= 1ULL << rec->opcode;
+}
+
+static void updateSegmentSummary(struct trace_index_footer * footer, const struct trace_record * rec) {
+    if(rec->seqnum < footer->min_seqnum) footer->min_seqnum = rec->seqnum;
+    if(rec->seqnum > footer->max_seqnum) footer->max_seqnum = rec->seqnum;
+    if(rec->timestamp < footer->min_timestamp) footer->min_timestamp = rec->timestamp;
+    if(rec->timestamp > footer->max_timestamp) footer->max_timestamp = rec->timestamp;
+    footer->opcodes |= 1ULL << rec->opcode;
+    footer->num_records++;
+}
+
+static char * segmentFileName(const char * dir, uint32_t segment_num) {
+    char * fname = malloc(strlen(dir) + 32);
+    sprintf(fname, "%s/segment-%08u.fdtt", dir, segment_num);
+    return fname;
+}
+
+static int isSegmentFile(const struct dirent * entry) {
+    unsigned int segment_num;
+    char suffix[8];
+    return sscanf(entry->d_name, "segment-%8u.%5s", &segment_num, suffix) == 2 && strcmp(suffix, "fdtt") == 0;
+}
+
+static bool startSegment(struct trace_writer * writer) {
+    char * fname = segmentFileName(writer->dir, writer->segment_num);
+    writer->file = fopen(fname, "wb");
+    if(writer->file == NULL) {
+        fprintf(stderr, "Unable to create trace segment %s: %s\n", fname, strerror(errno));
+        free(fname);
+        return false;
+    }
+    free(fname);
+
+    struct trace_segment_header header;
+    memcpy(header.magic, TRACE_SEGMENT_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.segment_num = writer->segment_num;
+    fwrite(&header, sizeof(header), 1, writer->file);
+    writer->offset = sizeof(header);
+
+    resetSegmentSummary(&writer->footer);
+    writer->block_records = 0;
+    if(writer->bloom != NULL) {
+        memset(writer->bloom, 0, TRACE_BLOOM_BITS / 8);
+    }
+    return true;
+}
+
+// Write the index, bloom filter and footer, after which the segment is never touched again
+static void finishSegment(struct trace_writer * writer) {
+    if(writer->file == NULL) return;
+
+    writer->footer.index_offset = writer->offset;
+    fwrite(writer->entries, sizeof(struct trace_index_entry), writer->footer.num_entries, writer->file);
+    if(writer->bloom != NULL) {
+        writer->footer.bloom_bits = TRACE_BLOOM_BITS;
+        fwrite(writer->bloom, 1, TRACE_BLOOM_BITS / 8, writer->file);
+    }
+    memcpy(writer->footer.magic, TRACE_INDEX_MAGIC, sizeof(writer->footer.magic));
+    fwrite(&writer->footer, sizeof(writer->footer), 1, writer->file);
+    fclose(writer->file);
+    writer->file = NULL;
+    writer->segment_num++;
+}
+
+struct trace_writer * traceWriterOpen(const char * dir, size_t segment_size, bool path_bloom) {
+    if(mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Unable to create trace directory %s: %s\n", dir, strerror(errno));
+        return NULL;
+    }
+
+    struct trace_writer * writer = calloc(1, sizeof(*writer));
+    writer->dir = malloc(strlen(dir) + 1);
+    strcpy(writer->dir, dir);
+    writer->segment_size = segment_size > 0 ? segment_size : TRACE_DEFAULT_SEGMENT_SIZE;
+    writer->path_bloom = path_bloom;
+    if(path_bloom) {
+        writer->bloom = malloc(TRACE_BLOOM_BITS / 8);
+    }
+
+    // Carry on after any segments already in the directory, so a restarted recorder never overwrites them
+    struct dirent ** namelist;
+    int n = scandir(dir, &namelist, isSegmentFile, alphasort);
+    if(n > 0) {
+        sscanf(namelist[n-1]->d_name, "segment-%8u", &writer->segment_num);
+        writer->segment_num++;
+    }
+    for(int i = 0; i < n; i++) {
+        free(namelist[i]);
+    }
+    if(n >= 0) free(namelist);
+
+    if(!startSegment(writer)) {
+        traceWriterClose(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+static int64_t getEventNumber(cJSON * event, const char * key, int64_t fallback) {
+    cJSON * item = cJSON_GetObjectItem(event, key);
+    if(item == NULL || item->type != cJSON_Number) return fallback;
+    return (int64_t) item->valuedouble;
+}
+
+bool traceWriteEvent(struct trace_writer * writer, cJSON * event, const char * path) {
+    if(writer->file == NULL) return false;
+
+    struct trace_record rec;
+    memset(&rec, 0, sizeof(rec));
+
+    char * type = cJSON_GetObjectItem(event, "type")->valuestring;
+    cJSON * params;
+    if(strcmp(type, "invoke") == 0) {
+        rec.type = TRACE_TYPE_INVOKE;
+        params = cJSON_GetObjectItem(event, "params");
+    } else {
+        rec.type = TRACE_TYPE_RETURN;
+        params = cJSON_GetObjectItem(event, "modified_params");
+    }
+    rec.opcode = traceOpcode(cJSON_GetObjectItem(event, "name")->valuestring);
+    rec.seqnum = getEventNumber(event, "seqnum", 0);
+    rec.timestamp = getEventNumber(event, "timestamp", 0);
+    rec.elapsed = getEventNumber(event, "elapsed", -1);
+    rec.tid = getEventNumber(event, "tid", 0);
+    rec.pid = getEventNumber(event, "pid", 0);
+    cJSON * retval = cJSON_GetObjectItem(event, "returnval");
+    if(retval != NULL && retval->type == cJSON_Number) {
+        rec.has_retval = 1;
+        rec.retval = retval->valueint;
+    }
+
+    char * params_json = params != NULL ? cJSON_PrintUnformatted(params) : NULL;
+    const char * params_str = params_json != NULL ? params_json : "{}";
+    rec.params_len = strlen(params_str) + 1;
+    if(path != NULL) {
+        rec.path_len = strlen(path) + 1;
+        rec.path_hash = tracePathHash(path);
+    }
+    size_t unpadded = sizeof(rec) + rec.path_len + rec.params_len;
+    rec.length = (unpadded + 7) & ~(size_t) 7;
+
+    // Rotate before the segment grows past its limit, but never leave a segment empty
+    if(writer->footer.num_records > 0 && writer->offset + rec.length > writer->segment_size) {
+        finishSegment(writer);
+        if(!startSegment(writer)) {
+            free(params_json);
+            return false;
+        }
+    }
+
+    // Start a new index block every TRACE_INDEX_INTERVAL records
+    if(writer->block_records == 0) {
+        if(writer->footer.num_entries == writer->entries_capacity) {
+            writer->entries_capacity = writer->entries_capacity > 0 ? writer->entries_capacity * 2 : 256;
+            writer->entries = realloc(writer->entries, writer->entries_capacity * sizeof(*writer->entries));
+        }
+        struct trace_index_entry * entry = &writer->entries[writer->footer.num_entries++];
+        entry->min_seqnum = INT64_MAX;
+        entry->max_seqnum = INT64_MIN;
+        entry->min_timestamp = INT64_MAX;
+        entry->max_timestamp = INT64_MIN;
+        entry->offset = writer->offset;
+        entry->opcodes = 0;
+    }
+    updateIndexEntry(&writer->entries[writer->footer.num_entries - 1], &rec);
+    updateSegmentSummary(&writer->footer, &rec);
+    writer->block_records = (writer->block_records + 1) % TRACE_INDEX_INTERVAL;
+
+    if(writer->bloom != NULL && path != NULL) {
+        for(int i = 0; i < TRACE_BLOOM_HASHES; i++) {
+            uint32_t bit = bloomBit(rec.path_hash, i, TRACE_BLOOM_BITS);
+            writer->bloom[bit / 8] |= 1 << (bit % 8);
+        }
+    }
+
+    static const char padding[8] = {0};
+    fwrite(&rec, sizeof(rec), 1, writer->file);
+    if(path != NULL) {
+        fwrite(path, 1, rec.path_len, writer->file);
+    }
+    fwrite(params_str, 1, rec.params_len, writer->file);
+    fwrite(padding, 1, rec.length - unpadded, writer->file);
+    writer->offset += rec.length;
+
+    free(params_json);
+    return true;
+}
+
+void traceWriterClose(struct trace_writer * writer) {
+    if(writer == NULL) return;
+    finishSegment(writer);
+    free(writer->entries);
+    free(writer->bloom);
+    free(writer->dir);
+    free(writer);
+}
+
+// Returns the record at offset, or NULL if it is missing or was only partly written
+static const struct trace_record * recordAt(const uint8_t * data, size_t limit, size_t offset) {
+    if(offset + sizeof(struct trace_record) > limit) return NULL;
+    const struct trace_record * rec = (const struct trace_record *) (data + offset);
+    if(rec->length < sizeof(struct trace_record) || offset + rec->length > limit) return NULL;
+
+    // Anything else that doesn't look like a record means the scan has run into the index of a damaged segment
+    if((rec->type != TRACE_TYPE_INVOKE && rec->type != TRACE_TYPE_RETURN) || rec->opcode > TRACE_OP_UNKNOWN
+            || (uint64_t) rec->path_len + rec->params_len + sizeof(struct trace_record) > rec->length
+            || rec->params_len == 0) {
+        return NULL;
+    }
+    return rec;
+}
+
+// Build the index for a segment that was never finished, e.g. because the recorder is still writing it
+static void scanSegment(struct trace_segment * seg) {
+    resetSegmentSummary(&seg->footer);
+    uint32_t capacity = 0;
+    size_t offset = sizeof(struct trace_segment_header);
+    const struct trace_record * rec;
+    while((rec = recordAt(seg->data, seg->size, offset)) != NULL) {
+        if(seg->footer.num_records % TRACE_INDEX_INTERVAL == 0) {
+            if(seg->footer.num_entries == capacity) {
+                capacity = capacity > 0 ? capacity * 2 : 256;
+                seg->scanned_entries = realloc(seg->scanned_entries, capacity * sizeof(*seg->scanned_entries));
+            }
+            struct trace_index_entry * entry = &seg->scanned_entries[seg->footer.num_entries++];
+            entry->min_seqnum = INT64_MAX;
+            entry->max_seqnum = INT64_MIN;
+            entry->min_timestamp = INT64_MAX;
+            entry->max_timestamp = INT64_MIN;
+            entry->offset = offset;
+            entry->opcodes = 0;
+        }
+        updateIndexEntry(&seg->scanned_entries[seg->footer.num_entries - 1], rec);
+        updateSegmentSummary(&seg->footer, rec);
+        offset += rec->length;
+    }
+    seg->end = offset;
+    seg->footer.index_offset = offset;
+    seg->entries = seg->scanned_entries;
+    seg->bloom = NULL;
+}
+
+static bool openSegment(struct trace_segment * seg, const char * fname) {
+    memset(seg, 0, sizeof(*seg));
+    int fd = open(fname, O_RDONLY);
+    if(fd < 0) {
+        fprintf(stderr, "Unable to open trace segment %s: %s\n", fname, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < sizeof(struct trace_segment_header)) {
+        close(fd);
+        return false;
+    }
+    seg->size = st.st_size;
+    seg->data = mmap(NULL, seg->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(seg->data == MAP_FAILED) {
+        fprintf(stderr, "Unable to map trace segment %s: %s\n", fname, strerror(errno));
+        return false;
+    }
+
+    const struct trace_segment_header * header = (const struct trace_segment_header *) seg->data;
+    if(memcmp(header->magic, TRACE_SEGMENT_MAGIC, sizeof(header->magic)) != 0 || header->version != TRACE_VERSION) {
+        fprintf(stderr, "%s is not a trace segment\n", fname);
+        munmap(seg->data, seg->size);
+        return false;
+    }
+
+    // Use the footer if the segment was finished properly, otherwise fall back to scanning it
+    bool has_footer = false;
+    if(seg->size >= sizeof(struct trace_segment_header) + sizeof(struct trace_index_footer)) {
+        memcpy(&seg->footer, seg->data + seg->size - sizeof(struct trace_index_footer), sizeof(seg->footer));
+        size_t index_end = seg->footer.index_offset + seg->footer.num_entries * sizeof(struct trace_index_entry)
+            + seg->footer.bloom_bits / 8 + sizeof(struct trace_index_footer);
+        has_footer = memcmp(seg->footer.magic, TRACE_INDEX_MAGIC, sizeof(seg->footer.magic)) == 0
+            && index_end == seg->size;
+    }
+    if(has_footer) {
+        seg->end = seg->footer.index_offset;
+        seg->entries = (const struct trace_index_entry *) (seg->data + seg->footer.index_offset);
+        seg->bloom = seg->footer.bloom_bits > 0 ? (const uint8_t *) (seg->entries + seg->footer.num_entries) : NULL;
+    } else {
+        scanSegment(seg);
+    }
+    return true;
+}
+
+struct trace_reader * traceOpen(const char * dir) {
+    struct dirent ** namelist;
+    int n = scandir(dir, &namelist, isSegmentFile, alphasort);
+    if(n < 0) {
+        fprintf(stderr, "Unable to read trace directory %s: %s\n", dir, strerror(errno));
+        return NULL;
+    }
+
+    struct trace_reader * reader = calloc(1, sizeof(*reader));
+    reader->segments = calloc(n > 0 ? n : 1, sizeof(*reader->segments));
+    for(int i = 0; i < n; i++) {
+        char * fname = malloc(strlen(dir) + strlen(namelist[i]->d_name) + 2);
+        sprintf(fname, "%s/%s", dir, namelist[i]->d_name);
+        if(openSegment(&reader->segments[reader->num_segments], fname)) {
+            reader->num_segments++;
+        }
+        free(fname);
+        free(namelist[i]);
+    }
+    free(namelist);
+    return reader;
+}
+
+void traceClose(struct trace_reader * reader) {
+    if(reader == NULL) return;
+    for(int i = 0; i < reader->num_segments; i++) {
+        munmap(reader->segments[i].data, reader->segments[i].size);
+        free(reader->segments[i].scanned_entries);
+    }
+    free(reader->segments);
+    free(reader);
+}
+
+int traceNumSegments(struct trace_reader * reader) {
+    return reader->num_segments;
+}
+
+const struct trace_index_footer * traceSegmentSummary(struct trace_reader * reader, int segment) {
+    return &reader->segments[segment].footer;
+}
+
+void traceSegmentStart(struct trace_reader * reader, int segment, struct trace_cursor * cursor) {
+    cursor->reader = reader;
+    cursor->segment = segment;
+    cursor->offset = sizeof(struct trace_segment_header);
+}
+
+void traceRewind(struct trace_reader * reader, struct trace_cursor * cursor) {
+    traceSegmentStart(reader, 0, cursor);
+}
+
+static void nextSegment(struct trace_cursor * cursor) {
+    cursor->segment++;
+    cursor->offset = sizeof(struct trace_segment_header);
+}
+
+// Returns the next record in the cursor's segment, without moving on to the next segment
+const struct trace_record * traceNextInSegment(struct trace_cursor * cursor) {
+    if(cursor->segment >= cursor->reader->num_segments) return NULL;
+    struct trace_segment * seg = &cursor->reader->segments[cursor->segment];
+    const struct trace_record * rec = recordAt(seg->data, seg->end, cursor->offset);
+    if(rec != NULL) {
+        cursor->offset += rec->length;
+    }
+    return rec;
+}
+
+const struct trace_record * traceNext(struct trace_cursor * cursor) {
+    while(cursor->segment < cursor->reader->num_segments) {
+        const struct trace_record * rec = traceNextInSegment(cursor);
+        if(rec != NULL) return rec;
+        nextSegment(cursor);
+    }
+    return NULL;
+}
+
+/* Records are stored in the order they arrived, so seqnums and timestamps are only roughly sorted.
+ * Both seeks find the first index block which could contain the target, and stop at the first
+ * record in it at or beyond the target.
+ */
+static bool seekTo(struct trace_reader * reader, struct trace_cursor * cursor, int64_t target, bool by_time) {
+    for(int s = 0; s < reader->num_segments; s++) {
+        struct trace_segment * seg = &reader->segments[s];
+        if(seg->footer.num_records == 0) continue;
+        if((by_time ? seg->footer.max_timestamp : seg->footer.max_seqnum) < target) continue;
+
+        for(uint32_t e = 0; e < seg->footer.num_entries; e++) {
+            const struct trace_index_entry * entry = &seg->entries[e];
+            if((by_time ? entry->max_timestamp : entry->max_seqnum) < target) continue;
+
+            cursor->reader = reader;
+            cursor->segment = s;
+            cursor->offset = entry->offset;
+            const struct trace_record * rec;
+            size_t offset = cursor->offset;
+            while((rec = traceNextInSegment(cursor)) != NULL) {
+                if((by_time ? rec->timestamp : rec->seqnum) >= target) {
+                    cursor->offset = offset;
+                    return true;
+                }
+                offset = cursor->offset;
+            }
+        }
+    }
+    cursor->reader = reader;
+    cursor->segment = reader->num_segments;
+    cursor->offset = 0;
+    return false;
+}
+
+bool traceSeekSeqnum(struct trace_reader * reader, struct trace_cursor * cursor, int64_t seqnum) {
+    return seekTo(reader, cursor, seqnum, false);
+}
+
+bool traceSeekTime(struct trace_reader * reader, struct trace_cursor * cursor, int64_t timestamp) {
+    return seekTo(reader, cursor, timestamp, true);
+}
+
+// Index of the block containing offset
+static uint32_t findBlock(struct trace_segment * seg, size_t offset) {
+    uint32_t lo = 0, hi = seg->footer.num_entries;
+    while(hi - lo > 1) {
+        uint32_t mid = (lo + hi) / 2;
+        if(seg->entries[mid].offset <= offset) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Skips whole segments and index blocks which don't contain the opcode
+const struct trace_record * traceNextWithOpcode(struct trace_cursor * cursor, int opcode) {
+    uint64_t bit = 1ULL << opcode;
+    while(cursor->segment < cursor->reader->num_segments) {
+        struct trace_segment * seg = &cursor->reader->segments[cursor->segment];
+        if((seg->footer.opcodes & bit) == 0 || cursor->offset >= seg->end) {
+            nextSegment(cursor);
+            continue;
+        }
+        uint32_t block = findBlock(seg, cursor->offset);
+        if((seg->entries[block].opcodes & bit) == 0) {
+            cursor->offset = block + 1 < seg->footer.num_entries ? seg->entries[block + 1].offset : seg->end;
+            continue;
+        }
+        const struct trace_record * rec = traceNextInSegment(cursor);
+        if(rec == NULL) {
+            nextSegment(cursor);
+        } else if(rec->opcode == opcode) {
+            return rec;
+        }
+    }
+    return NULL;
+}
+
+bool traceSegmentMayContainPath(struct trace_reader * reader, int segment, const char * path) {
+    struct trace_segment * seg = &reader->segments[segment];
+    if(seg->bloom == NULL) return true;
+    uint32_t hash = tracePathHash(path);
+    for(int i = 0; i < TRACE_BLOOM_HASHES; i++) {
+        uint32_t bit = bloomBit(hash, i, seg->footer.bloom_bits);
+        if((seg->bloom[bit / 8] & (1 << (bit % 8))) == 0) return false;
+    }
+    return true;
+}
+
+// Skips whole segments whose bloom filter rules the path out
+const struct trace_record * traceNextWithPath(struct trace_cursor * cursor, const char * path) {
+    uint32_t hash = tracePathHash(path);
+    int checked_segment = -1;
+    while(cursor->segment < cursor->reader->num_segments) {
+        if(checked_segment != cursor->segment) {
+            checked_segment = cursor->segment;
+            if(!traceSegmentMayContainPath(cursor->reader, cursor->segment, path)) {
+                nextSegment(cursor);
+                continue;
+            }
+        }
+        const struct trace_record * rec = traceNextInSegment(cursor);
+        if(rec == NULL) {
+            nextSegment(cursor);
+        } else if(rec->path_len > 0 && rec->path_hash == hash && strcmp(traceRecordPath(rec), path) == 0) {
+            return rec;
+        }
+    }
+    return NULL;
+}
+
+const char * traceRecordPath(const struct trace_record * rec) {
+    if(rec->path_len == 0) return NULL;
+    return (const char *) (rec + 1);
+}
+
+const char * traceRecordParams(const struct trace_record * rec) {
+    return (const char *) (rec + 1) + rec->path_len;
+}
+
+// Rebuild an event in the same form libfuse sends it
+cJSON * traceRecordToJSON(const struct trace_record * rec) {
+    cJSON * event = cJSON_CreateObject();
+    cJSON_AddStringToObject(event, "type", rec->type == TRACE_TYPE_INVOKE ? "invoke" : "return");
+    cJSON_AddStringToObject(event, "name", traceOpName(rec->opcode));
+    cJSON_AddNumberToObject(event, "seqnum", rec->seqnum);
+    cJSON_AddNumberToObject(event, "timestamp", rec->timestamp);
+    cJSON_AddNumberToObject(event, "tid", rec->tid);
+    cJSON_AddNumberToObject(event, "pid", rec->pid);
+    cJSON * params = cJSON_Parse(traceRecordParams(rec));
+    if(params == NULL) params = cJSON_CreateObject();
+    if(rec->type == TRACE_TYPE_INVOKE) {
+        cJSON_AddItemToObject(event, "params", params);
+    } else {
+        cJSON_AddNumberToObject(event, "elapsed", rec->elapsed);
+        if(rec->has_retval) {
+            cJSON_AddNumberToObject(event, "returnval", rec->retval);
+        } else {
+            cJSON_AddNullToObject(event, "returnval");
+        }
+        cJSON_AddItemToObject(event, "modified_params", params);
+    }
+    return event;
+}
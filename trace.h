@@ -0,0 +1,120 @@
+#pragma once
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cJSON.h"
+
+/* On-disk trace store
+ *
+ * A trace is a directory of append-only segment files named segment-00000000.fdtt, segment-00000001.fdtt, ...
+ * Each segment is laid out as:
+ *   [segment header][record][record]...[index entries][bloom filter][index footer]
+ * The index, bloom filter and footer are only written once a segment is full (or the recorder stops),
+ * so a segment without a footer was still being written and is scanned instead.
+ */
+
+#define TRACE_SEGMENT_MAGIC "FDTTRACE"
+#define TRACE_INDEX_MAGIC "FDTINDEX"
+#define TRACE_VERSION 1
+
+// Segments are rotated once they reach this size unless told otherwise
+#define TRACE_DEFAULT_SEGMENT_SIZE (64 * 1024 * 1024)
+
+// Number of records covered by each sparse index entry
+#define TRACE_INDEX_INTERVAL 256
+
+// Size of the per-segment path bloom filter, in bits
+#define TRACE_BLOOM_BITS (64 * 1024 * 8)
+#define TRACE_BLOOM_HASHES 4
+
+#define TRACE_TYPE_INVOKE 1
+#define TRACE_TYPE_RETURN 2
+
+// Opcode used for calls whose name isn't in the table
+#define TRACE_OP_UNKNOWN 63
+
+struct trace_segment_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t segment_num;
+};
+
+/* Fixed-size part of each record, followed by the NUL-terminated path (if any) and the
+ * NUL-terminated params JSON. Records are padded to a multiple of 8 bytes.
+ */
+struct trace_record {
+    uint32_t length;
+    uint8_t type;
+    uint8_t opcode;
+    uint8_t has_retval;
+    uint8_t reserved;
+    int64_t seqnum;
+    int64_t timestamp;      // Microseconds since the epoch
+    int64_t elapsed;        // Nanoseconds spent in the filesystem, or -1 for invocations
+    int32_t tid;
+    int32_t pid;
+    int32_t retval;
+    uint32_t path_hash;
+    uint32_t path_len;      // Including the NUL, or 0 if the call has no path
+    uint32_t params_len;    // Including the NUL
+};
+
+// Sparse index entry covering TRACE_INDEX_INTERVAL records starting at offset
+struct trace_index_entry {
+    int64_t min_seqnum;
+    int64_t max_seqnum;
+    int64_t min_timestamp;
+    int64_t max_timestamp;
+    uint64_t offset;
+    uint64_t opcodes;       // Bit n is set if a record with opcode n is in this block
+};
+
+struct trace_index_footer {
+    uint64_t index_offset;
+    uint64_t num_records;
+    uint32_t num_entries;
+    uint32_t bloom_bits;    // 0 if the segment has no bloom filter
+    int64_t min_seqnum;
+    int64_t max_seqnum;
+    int64_t min_timestamp;
+    int64_t max_timestamp;
+    uint64_t opcodes;
+    char magic[8];
+};
+
+struct trace_writer;
+struct trace_reader;
+
+// Position within a trace, as returned by the seek functions
+struct trace_cursor {
+    struct trace_reader * reader;
+    int segment;
+    size_t offset;
+};
+
+int traceOpcode(const char * name);
+const char * traceOpName(int opcode);
+uint32_t tracePathHash(const char * path);
+
+struct trace_writer * traceWriterOpen(const char * dir, size_t segment_size, bool path_bloom);
+bool traceWriteEvent(struct trace_writer * writer, cJSON * event, const char * path);
+void traceWriterClose(struct trace_writer * writer);
+
+struct trace_reader * traceOpen(const char * dir);
+void traceClose(struct trace_reader * reader);
+int traceNumSegments(struct trace_reader * reader);
+const struct trace_index_footer * traceSegmentSummary(struct trace_reader * reader, int segment);
+void traceRewind(struct trace_reader * reader, struct trace_cursor * cursor);
+void traceSegmentStart(struct trace_reader * reader, int segment, struct trace_cursor * cursor);
+bool traceSeekSeqnum(struct trace_reader * reader, struct trace_cursor * cursor, int64_t seqnum);
+bool traceSeekTime(struct trace_reader * reader, struct trace_cursor * cursor, int64_t timestamp);
+const struct trace_record * traceNext(struct trace_cursor * cursor);
+const struct trace_record * traceNextInSegment(struct trace_cursor * cursor);
+const struct trace_record * traceNextWithOpcode(struct trace_cursor * cursor, int opcode);
+const struct trace_record * traceNextWithPath(struct trace_cursor * cursor, const char * path);
+bool traceSegmentMayContainPath(struct trace_reader * reader, int segment, const char * path);
+const char * traceRecordPath(const struct trace_record * rec);
+const char * traceRecordParams(const struct trace_record * rec);
+cJSON * traceRecordToJSON(const struct trace_record * rec);
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <gtk/gtk.h>
 #include <pthread.h>
 #include <stdbool.h>
@@ -13,14 +14,27 @@
 #include "fdt.h"
 #include "wizard.h"
 
-static const char * wizard_fifo_name = "fuse-wizard.fifo";
+static char wizard_fifo_name[PATH_MAX];
 static FILE * wizard_fifo = NULL;
 
-static pthread_mutex_t tailq_events_lock;
-static GSList * wizard_events;
-static GSList * wizard_events_displayed;
-static GHashTable * rows; // func_name:GtkTreeIter
-
+// Events are queued by the reader thread and taken by the GUI, which only keeps the totals for each function
+static pthread_mutex_t tailq_events_lock = PTHREAD_MUTEX_INITIALIZER;
+static GQueue wizard_events = G_QUEUE_INIT;
+
+struct wizard_function {
+    GtkTreeIter iter;
+    int order;                  // Position in the function table
+    int num_passed;
+    int num_failed;
+    int num_skipped;
+    cJSON * first_failure;
+    bool changed;               // Has events the row doesn't show yet
+};
+static GHashTable * functions = NULL; // func_name:struct wizard_function
+static cJSON * last_event = NULL;
+
+// The earliest function in the table with a failing test, whose first failure is shown
+static struct wizard_function * notification_function = NULL;
 static cJSON * notification_event = NULL;
 static funcstat notification_event_status;
 static bool recv_end_event = FALSE;
@@ -288,8 +302,42 @@ GtkWidget * createFunctionsView() {
     return scrolled_window;
 }
 
+static void freeWizardFunction(gpointer data) {
+    struct wizard_function * function = data;
+    cJSON_Delete(function->first_failure);
+    free(function);
+}
+
+// Forget the results of any previous run, which has to happen on the GUI thread
+void resetWizardResults() {
+    pthread_mutex_lock(&tailq_events_lock);
+    cJSON * event;
+    while((event = g_queue_pop_head(&wizard_events)) != NULL) {
+        cJSON_Delete(event);
+    }
+    pthread_mutex_unlock(&tailq_events_lock);
+
+    if(functions != NULL) {
+        g_hash_table_destroy(functions);
+    }
+    functions = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, freeWizardFunction);
+    cJSON_Delete(last_event);
+    last_event = NULL;
+    notification_function = NULL;
+    notification_event = NULL;
+
+    if(event_table_model != NULL) {
+        gtk_tree_store_clear(GTK_TREE_STORE(event_table_model));
+    }
+}
+
 stopToolFunc startWizard() {
 
+    // Channels belong to the session of the filesystem being started
+    sessionChannel(getCurrentSession(), FDT_CHANNEL_WIZARD, wizard_fifo_name, sizeof(wizard_fifo_name));
+
+    resetWizardResults();
+
     // Create a FIFO so that we can receive events
     recv_end_event = FALSE;
     unlink(wizard_fifo_name);
@@ -310,18 +358,6 @@ void * doStartWizard(void * ptr) {
     // Read JSON chunks from the shared pipe that the libfuse wrapper logs to
     wizard_fifo = fopen(wizard_fifo_name, "r");
 
-    // Local lists of events sent by libfuse wrapper
-    if(wizard_events != NULL) {
-        // Clear any old events from previous runs
-        g_slist_free(wizard_events);
-        g_slist_free(wizard_events_displayed);
-        g_hash_table_destroy(rows);
-        notification_event = NULL;
-    }
-    wizard_events = g_slist_alloc();
-    wizard_events_displayed = g_slist_alloc();
-    rows = g_hash_table_new(g_str_hash, g_str_equal);
-    
     bool fifo_open;
     if(wizard_fifo != NULL) fifo_open = TRUE;
     else fifo_open = FALSE;
@@ -386,45 +422,30 @@ void stopWizard() {
 
 gboolean gui_idle_wizard(void) {
 
+    // Take everything that's queued, so each event is only looked at once
     pthread_mutex_lock(&tailq_events_lock);
+    GQueue pending = wizard_events;
+    g_queue_init(&wizard_events);
+    pthread_mutex_unlock(&tailq_events_lock);
 
-    // Clear table if there are no events currently displayed
-    if(wizard_events_displayed != NULL && wizard_events_displayed->next == NULL) {
-        gtk_tree_store_clear(GTK_TREE_STORE(event_table_model));
-    }
-    
-    // Append any new rows
-    GSList * node = wizard_events;
-    while(node != NULL) {
-        cJSON * event = (cJSON *) node->data;
-        if(event != NULL && !isFunctionDisplayed(event)) {
-            const char * test_name = cJSON_GetObjectItem(event, "func_name")->valuestring;
-            char func_name[strlen(test_name) + 1];
-            testToFunction(func_name, test_name);
-            GtkTreeIter * iter = malloc(sizeof(GtkTreeIter));
-            gdk_threads_enter();
-            gtk_tree_store_append(GTK_TREE_STORE(event_table_model), iter, NULL);
-            gtk_tree_store_set(GTK_TREE_STORE(event_table_model), iter, 0, func_name, 1, "", -1);
-            gdk_threads_leave();
-            g_hash_table_insert(rows, g_strdup(func_name), iter);
-            wizard_events_displayed = g_slist_prepend(wizard_events_displayed, event);
+    // Add each event to the totals for its function, adding a row for any function not seen before
+    GSList * changed = NULL;
+    cJSON * event;
+    while((event = g_queue_pop_head(&pending)) != NULL) {
+        struct wizard_function * function = addWizardEvent(event);
+        if(!function->changed) {
+            function->changed = TRUE;
+            changed = g_slist_prepend(changed, function);
         }
-
-        node = node->next;
     }
 
-    // For each of the displayed nodes, find out of all of the events for that function are ok
-    // and change the status of the row accordingly
-    node = wizard_events_displayed;
-    while(node != NULL) {
-        cJSON * event = (cJSON *) node->data;
-        if(event != NULL) {
-            const char * func_name = cJSON_GetObjectItem(event, "func_name")->valuestring;
-            updateFunctionRow(func_name);
-        }
-        node = node->next;
+    // Only the rows of functions with new events need their status changing
+    for(GSList * node = changed; node != NULL; node = node->next) {
+        struct wizard_function * function = node->data;
+        function->changed = FALSE;
+        updateFunctionRow(function);
     }
-    pthread_mutex_unlock(&tailq_events_lock);
+    g_slist_free(changed);
 
     // If there is information about a function then display it in the box to the right
     if(notification_event != NULL) {
@@ -439,7 +460,7 @@ gboolean gui_idle_wizard(void) {
         setMessageViewMessage(message);
         updateInfoTabs(func_name);
     } else {
-        if(wizard_events_displayed != NULL && wizard_events_displayed->next != NULL) {
+        if(functions != NULL && g_hash_table_size(functions) > 0) {
             // There's no notification event, but we're displaying events - this means there are no errors
             if(isFSMounted()) {
                 // Filesystem is still mounted, so tests are still being run
@@ -453,17 +474,6 @@ gboolean gui_idle_wizard(void) {
                 // If the filesystem is unmounted but we didn't get the __END event this means the filesystem crashed before running every test
                 setMessageViewFunc("Filesystem crashed");
 
-                // Get the last event received
-                cJSON * last_event = NULL;
-                GSList * node = wizard_events;
-                while(node != NULL) {
-                    cJSON * event = (cJSON *) node->data;
-                    if(event != NULL) {
-                        last_event = event;
-                    }
-                    node = node->next;
-                }
-
                 // Construct an error message and display it
                 char error_str[1024];
                 error_str[0] = '\0';
@@ -496,101 +506,91 @@ gboolean gui_idle_wizard(void) {
     return TRUE; // only return false if we never want to be called again
 }
 
-// True if there is an entry in the function table for the function this event is testing
-bool isFunctionDisplayed(cJSON * event) {
-    const char * func_name = cJSON_GetObjectItem(event, "func_name")->valuestring;
-    GSList * node = wizard_events_displayed;
-    while(node != NULL) {
-        cJSON * t_event = (cJSON *) node->data;
-        if(t_event != NULL) {
-            const char * t_func_name = cJSON_GetObjectItem(t_event, "func_name")->valuestring;
-            if(strcmp(func_name, t_func_name) == 0) {
-                return true;
-            }
-        }
-        node = node->next;
-    }
-    return false;
-}
-
-void updateFunctionRow(const char * test_name) {
-    // Strip the test_ prefix and find the row for the function (in the table)
+/* Count an event towards the totals of the function it tests, taking ownership of the event
+ * Returns the function, which is added to the table if this is its first event
+ */
+struct wizard_function * addWizardEvent(cJSON * event) {
+    const char * test_name = cJSON_GetObjectItem(event, "func_name")->valuestring;
     char func_name[strlen(test_name) + 1];
     testToFunction(func_name, test_name);
-    GtkTreeIter * iter = (GtkTreeIter *) g_hash_table_lookup(rows, func_name);
-    if(iter != NULL) {
-        cJSON * failing_event = NULL;
-        funcstat status = getFunctionStatus(test_name, &failing_event);
-        char * status_str;
-        switch(status) {
-            case IMPLEMENTED:
-                status_str = "Done";
-            break;
-            case SKIPPED:
-                status_str = "Skipped";
-            break;
-            case DEFINED:
-                status_str = "Needs fixing";
-                notification_event = failing_event;
-                notification_event_status = status;
-            break;
-            case UNDEFINED:
-                status_str = "Needs defining";
-                notification_event = failing_event;
-                notification_event_status = status;
-            break;
-            default:
-                status_str = "?";
-        }
+
+    struct wizard_function * function = g_hash_table_lookup(functions, func_name);
+    if(function == NULL) {
+        function = calloc(1, sizeof(*function));
+        function->order = g_hash_table_size(functions);
         gdk_threads_enter();
-        gtk_tree_store_set(GTK_TREE_STORE(event_table_model), iter, 1, status_str, -1);
+        gtk_tree_store_append(GTK_TREE_STORE(event_table_model), &function->iter, NULL);
+        gtk_tree_store_set(GTK_TREE_STORE(event_table_model), &function->iter, 0, func_name, 1, "", -1);
         gdk_threads_leave();
+        g_hash_table_insert(functions, g_strdup(func_name), function);
+    }
+
+    const int passed = cJSON_GetObjectItem(event, "passed")->valueint;
+    const char * msg = cJSON_GetObjectItem(event, "message")->valuestring;
+    if(passed) {
+        function->num_passed++;
+        if(strcmp("Skipped", msg) == 0) {
+            function->num_skipped++;
+        }
     } else {
-        fprintf(stderr, "Failed to lookup row with key %s\n", func_name);
+        function->num_failed++;
     }
+
+    // Only the first failure of a function and the most recent event are needed later
+    if(!passed && function->first_failure == NULL) {
+        function->first_failure = cJSON_Duplicate(event, 1);
+        if(notification_function == NULL || function->order < notification_function->order) {
+            notification_function = function;
+            notification_event = function->first_failure;
+        }
+    }
+    cJSON_Delete(last_event);
+    last_event = event;
+    return function;
 }
 
-// Work out the status of a function using all of its reported events
-funcstat getFunctionStatus(const char * test_name, cJSON ** failing_event) {
+void updateFunctionRow(struct wizard_function * function) {
+    funcstat status = getFunctionStatus(function);
+    char * status_str;
+    switch(status) {
+        case IMPLEMENTED:
+            status_str = "Done";
+        break;
+        case SKIPPED:
+            status_str = "Skipped";
+        break;
+        case DEFINED:
+            status_str = "Needs fixing";
+        break;
+        case UNDEFINED:
+            status_str = "Needs defining";
+        break;
+        default:
+            status_str = "?";
+    }
+    if(function == notification_function) {
+        notification_event_status = status;
+    }
+    gdk_threads_enter();
+    gtk_tree_store_set(GTK_TREE_STORE(event_table_model), &function->iter, 1, status_str, -1);
+    gdk_threads_leave();
+}
+
+// Work out the status of a function from the totals of its reported events
+funcstat getFunctionStatus(struct wizard_function * function) {
     /* States:
      *   Implemented - Every event with this func_name must have passed==true
      *   Skipped - Same as Implemented, but some events were skipped
      *   Defined - At least one event with this func_name must have passed==true
      *   Undefined - No events with this func_name have passed==true
      */
-    int num_passed = 0;
-    int num_failed = 0;
-    int num_skipped = 0;
-    GSList * node = wizard_events;
-    while(node != NULL) {
-        cJSON * event = (cJSON *) node->data;
-        if(event != NULL) {
-            const char * t_test_name = cJSON_GetObjectItem(event, "func_name")->valuestring;
-            if(strcmp(test_name, t_test_name) == 0) {
-                const int passed = cJSON_GetObjectItem(event, "passed")->valueint;
-                const char * msg = cJSON_GetObjectItem(event, "message")->valuestring;
-                if(passed) {
-                    num_passed++;
-                    if(strcmp("Skipped", msg) == 0) {
-                        num_skipped++;
-                    }
-                } else {
-                    if(*failing_event == NULL) {
-                        *failing_event = event;
-                    }
-                    num_failed++;
-                }
-            }
-        }
-        node = node->next;
-    }
-    if(num_failed == 0) {
-        if(num_skipped > 0) {
+    if(function->num_failed == 0) {
+        if(function->num_skipped > 0) {
             return SKIPPED;
         } else {
             return IMPLEMENTED;
         }
-    } else if(num_passed > 0) {
+    } else if(function->num_passed > 0) {
         return DEFINED;
     } else {
         return UNDEFINED;
@@ -598,7 +598,9 @@ funcstat getFunctionStatus(const char * test_name, cJSON ** failing_event) {
 }
 
 void handleWizardEvent(cJSON * event) {
-    printf("%s\n", cJSON_Print(event));
+    char * event_json = cJSON_Print(event);
+    printf("%s\n", event_json);
+    free(event_json);
     char * func_name = cJSON_GetObjectItem(event, "func_name")->valuestring;
     if(strcmp(func_name, "__END") == 0) {
         // Special event indicating that the wizard is finished
@@ -610,8 +612,9 @@ void handleWizardEvent(cJSON * event) {
         if(isUsingGui()) {
             // Add event to GUI queue (as we can't make changes from this thread directly)
             pthread_mutex_lock(&tailq_events_lock);
-            wizard_events = g_slist_append(wizard_events, event);
+            g_queue_push_tail(&wizard_events, event);
             pthread_mutex_unlock(&tailq_events_lock);
+            requestGUIUpdate();
         } else {
             // Otherwise, we don't need the event anymore
             cJSON_Delete(event);
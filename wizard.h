@@ -6,6 +6,8 @@
 #include "cJSON.h"
 #include "fdt.h"
 
+struct wizard_function;
+
 GtkWidget * createWizardTab();
 GtkWidget * createMessageView();
 void setMessageViewFunc(const char * str);
@@ -17,12 +19,13 @@ gboolean hyperlink_handler_osx(GtkLabel * label, gchar * uri, gpointer  user_dat
 void setLabelText(GtkLabel * label, const char * str, const int size);
 void skip_btn_handler(GtkWidget * widget, gpointer data);
 GtkWidget * createFunctionsView();
+void resetWizardResults();
 stopToolFunc startWizard();
 void * doStartWizard(void * ptr);
 void stopWizard();
 gboolean gui_idle_wizard(void);
-bool isFunctionDisplayed(cJSON * event);
-void updateFunctionRow(const char * func_name);
-funcstat getFunctionStatus(const char * test_name, cJSON ** failing_event);
+struct wizard_function * addWizardEvent(cJSON * event);
+void updateFunctionRow(struct wizard_function * function);
+funcstat getFunctionStatus(struct wizard_function * function);
 void testToFunction(char * function, const char * test);
 void handleWizardEvent(cJSON * event);
\ No newline at end of file
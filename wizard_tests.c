@@ -24,7 +24,9 @@
 #include <stdbool.h>
 #include <glib.h>
 
-const char * wizard_fifo_name = "fuse-wizard.fifo";
+#include "fdt_session.h"
+
+char wizard_fifo_name[PATH_MAX];
 FILE * wizard_fifo = NULL;
 const char * function_not_defined_err = "Define this function and set it in the fuse_operations struct passed to fuse_main.";
 const char * non_existent_file = "/doesnotexistfile.txt";
@@ -37,6 +39,7 @@ void wizard_fifo_init(void);
 void wizard_fifo_init(void)
 {
     if(wizard_fifo == NULL) {
+    	fdt_channel_name(getenv(FDT_SESSION_ENV), FDT_CHANNEL_WIZARD, wizard_fifo_name, sizeof(wizard_fifo_name));
     	wizard_fifo = fopen(wizard_fifo_name, "w");
     }
 }